@@ -0,0 +1,254 @@
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <vector>
+
+#include "bus.h"
+#include "cpu/block_cache.h"
+#include "cpu/cpu.h"
+#include "cpu/trace_sink.h"
+#include "cpu/translated_rom.h"
+
+// Runs the nestest ROM from $C000 until it ends on a BRK and reports instructions per second.
+// Then runs an arithmetic loop and reports emulated cycles per second.
+// Both are run with the interpreter and with the block cache. nestest is also run again on the same Cpu, so the
+// cached blocks of the ROM are reused like the code of a game that runs every frame.
+// The block cache runs with and without fused instruction pairs, and with the JIT. nestest also runs with the code
+// NES_AOT translated at build time.
+// The interpreter also runs the arithmetic loop in the NES_HARDWARE mode, which has no halt checks.
+// Finally nestest is started from its own reset vector, where it waits for a vblank that never comes in an idle loop.
+// nestest itself runs every instruction about once, the translated idle loop shows what translation does for hot code.
+// Usage: NES_BENCH [runs]
+
+// Generated by NES_AOT from nestest with entry $C000, see bench/CMakeLists.txt.
+extern const TranslatedRom nestest;
+
+class CountingTraceSink : public TraceSink
+{
+public:
+    long instructions = 0;
+
+    void trace(const ExecutionData &) override
+    {
+        instructions++;
+    }
+};
+
+std::vector<unsigned char> readPrg(const char *file)
+{
+    std::ifstream in(file, std::ios::binary);
+    std::vector<unsigned char> rom((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    if (rom.size() < 16 + 0x4000)
+        throw std::invalid_argument(std::string("Could not read ROM: ") + file);
+    return std::vector<unsigned char>(rom.begin() + 16, rom.begin() + 16 + 0x4000);
+}
+
+struct CacheStats
+{
+    unsigned long long hits = 0, misses = 0;
+
+    void add(BlockCache *cache)
+    {
+        if (cache == NULL)
+            return;
+        hits += cache->getHits();
+        misses += cache->getMisses();
+    }
+
+    double hitRate() { return 100.0 * hits / (hits + misses); }
+};
+
+void runNestest(std::vector<unsigned char> &prg, TraceSink *sink, bool blockCache, CacheStats &stats)
+{
+    Bus bus;
+    bus.readData(prg.data(), prg.size());
+    bus.write_16(bus.RESET_VECTOR_ADDR, 0xc000);
+
+    Cpu cpu(&bus);
+    cpu.setTraceSink(sink);
+    cpu.setBlockCache(blockCache);
+    cpu.run();
+    stats.add(cpu.getBlockCache());
+}
+
+// Flag heavy loop without memory writes:
+// loop: LDX #$00
+// inner: TXA; ADC #$35; EOR #$5a; ROL A; CMP #$40; SBC #$11; AND #$7f; DEX; BNE inner
+//        JMP loop
+unsigned char ALU_LOOP[] = {
+    0xa2, 0x00,
+    0x8a, 0x69, 0x35, 0x49, 0x5a, 0x2a, 0xc9, 0x40, 0xe9, 0x11, 0x29, 0x7f, 0xca, 0xd0, 0xf1,
+    0x4c, 0x00, 0x80};
+
+void runAluLoop(unsigned long long cycles, bool blockCache, bool fusion, bool jit, CpuMode mode, CacheStats &stats)
+{
+    Bus bus;
+    bus.readData(ALU_LOOP, sizeof(ALU_LOOP));
+    bus.write_16(bus.RESET_VECTOR_ADDR, 0x8000);
+
+    Cpu cpu(&bus);
+    cpu.setBlockCache(blockCache);
+    if (blockCache)
+        cpu.getBlockCache()->setFusion(fusion);
+    cpu.setJit(jit);
+    cpu.setMode(mode);
+    cpu.reset();
+    cpu.runCycles(cycles);
+    stats.add(cpu.getBlockCache());
+}
+
+double benchNestest(std::vector<unsigned char> &prg, int runs, long instructions, bool blockCache)
+{
+    // Cpu::run prints the registers when it stops
+    std::streambuf *coutBuffer = std::cout.rdbuf(nullptr);
+
+    CacheStats stats;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < runs; i++)
+        runNestest(prg, NULL, blockCache, stats);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    std::cout.rdbuf(coutBuffer);
+    double perSecond = (double) instructions * runs / elapsed.count();
+    std::cout << std::dec << "nestest" << (blockCache ? " (block cache)" : "") << ": " << instructions << " instructions x " << runs << " runs in " << elapsed.count() << " s" << std::endl;
+    std::cout << "  " << perSecond / 1e6 << " M instructions/s" << std::endl;
+    if (blockCache)
+        std::cout << "  block hit rate " << stats.hitRate() << "%" << std::endl;
+    return perSecond;
+}
+
+// The ROM is checked once, like when a game is loaded, the translated code needs no warming up.
+double benchNestestTranslated(std::vector<unsigned char> &prg, int runs, long instructions)
+{
+    Bus bus;
+    bus.readData(prg.data(), prg.size());
+    bus.write_16(bus.RESET_VECTOR_ADDR, 0xc000);
+    Cpu cpu(&bus);
+    cpu.setTranslatedRom(&nestest);
+
+    std::streambuf *coutBuffer = std::cout.rdbuf(nullptr);
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < runs; i++)
+        cpu.run();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout.rdbuf(coutBuffer);
+
+    double perSecond = (double) instructions * runs / elapsed.count();
+    std::cout << std::dec << "nestest (translated ahead of time): " << elapsed.count() << " s" << std::endl;
+    std::cout << "  " << perSecond / 1e6 << " M instructions/s, " << 100.0 * cpu.getTranslatedCycles() / cpu.getCycles() / runs << "% of the cycles translated" << std::endl;
+    return perSecond;
+}
+
+const char *cacheName(bool blockCache, bool fusion, bool jit = false)
+{
+    return jit ? " (jit)" : !blockCache ? "" : fusion ? " (block cache)" : " (block cache, no fusion)";
+}
+
+double benchNestestWarm(std::vector<unsigned char> &prg, int runs, long instructions, bool fusion, bool jit)
+{
+    Bus bus;
+    bus.readData(prg.data(), prg.size());
+    bus.write_16(bus.RESET_VECTOR_ADDR, 0xc000);
+    Cpu cpu(&bus);
+    cpu.setBlockCache(true);
+    cpu.getBlockCache()->setFusion(fusion);
+    cpu.setJit(jit);
+
+    std::streambuf *coutBuffer = std::cout.rdbuf(nullptr);
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < runs; i++)
+        cpu.run();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout.rdbuf(coutBuffer);
+
+    CacheStats stats;
+    stats.add(cpu.getBlockCache());
+    double perSecond = (double) instructions * runs / elapsed.count();
+    std::cout << std::dec << "nestest" << cacheName(true, fusion, jit) << " kept between runs: " << elapsed.count() << " s" << std::endl;
+    std::cout << "  " << perSecond / 1e6 << " M instructions/s" << std::endl;
+    std::cout << "  block hit rate " << stats.hitRate() << "%" << std::endl;
+    return perSecond;
+}
+
+double benchAluLoop(unsigned long long cycles, bool blockCache, bool fusion, bool jit, CpuMode mode = INSTRUCTION_TESTS)
+{
+    CacheStats stats;
+    auto start = std::chrono::steady_clock::now();
+    runAluLoop(cycles, blockCache, fusion, jit, mode, stats);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    double perSecond = cycles / elapsed.count();
+    std::cout << "alu loop" << cacheName(blockCache, fusion, jit) << (mode == NES_HARDWARE ? " (NES hardware mode)" : "") << ": " << cycles << " cycles in " << elapsed.count() << " s" << std::endl;
+    std::cout << "  " << perSecond / 1e6 << " M cycles/s" << std::endl;
+    if (blockCache)
+        std::cout << "  block hit rate " << stats.hitRate() << "%" << std::endl;
+    return perSecond;
+}
+
+double benchVblankWait(std::vector<unsigned char> &prg, unsigned long long cycles, bool blockCache, bool translated = false)
+{
+    Bus bus;
+    bus.readData(prg.data(), prg.size());
+    Cpu cpu(&bus);
+    cpu.setBlockCache(blockCache);
+    cpu.setStableIo(true); // Nothing writes the latched registers that stand in for the Ppu
+    if (translated)
+        cpu.setTranslatedRom(&nestest);
+    cpu.reset();
+
+    auto start = std::chrono::steady_clock::now();
+    cpu.runCycles(cycles);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    double perSecond = cycles / elapsed.count();
+    std::cout << "vblank wait" << (translated ? " (translated ahead of time)" : cacheName(blockCache, true)) << ": " << cycles << " cycles in " << elapsed.count() << " s" << std::endl;
+    std::cout << "  " << perSecond / 1e6 << " M cycles/s";
+    if (blockCache)
+        std::cout << ", " << 100.0 * cpu.getSkippedCycles() / cycles << "% fast-forwarded";
+    std::cout << std::endl;
+    return perSecond;
+}
+
+int main(int argc, char **argv)
+{
+    int runs = argc > 1 ? std::stoi(argv[1]) : 2000;
+    std::vector<unsigned char> prg = readPrg(NES_TEST_ROM);
+
+    std::streambuf *coutBuffer = std::cout.rdbuf(nullptr);
+    CountingTraceSink counter;
+    CacheStats unused;
+    runNestest(prg, &counter, false, unused);
+    std::cout.rdbuf(coutBuffer);
+
+    double interpreted = benchNestest(prg, runs, counter.instructions, false);
+    double cached = benchNestest(prg, runs, counter.instructions, true);
+    std::cout << "  block cache speedup " << cached / interpreted << "x" << std::endl;
+    for (bool fusion : {false, true})
+    {
+        cached = benchNestestWarm(prg, runs, counter.instructions, fusion, false);
+        std::cout << "  block cache speedup " << cached / interpreted << "x" << std::endl;
+    }
+    double compiled = benchNestestWarm(prg, runs, counter.instructions, true, true);
+    std::cout << "  jit speedup " << compiled / interpreted << "x" << std::endl;
+    double translated = benchNestestTranslated(prg, runs, counter.instructions);
+    std::cout << "  translated speedup " << translated / interpreted << "x" << std::endl;
+
+    unsigned long long aluCycles = runs * 20000ULL;
+    interpreted = benchAluLoop(aluCycles, false, false, false);
+    double hardware = benchAluLoop(aluCycles, false, false, false, NES_HARDWARE); // Doesn't check for BRK
+    std::cout << "  speedup over instruction tests mode " << hardware / interpreted << "x" << std::endl;
+    for (bool fusion : {false, true})
+    {
+        cached = benchAluLoop(aluCycles, true, fusion, false);
+        std::cout << "  block cache speedup " << cached / interpreted << "x" << std::endl;
+    }
+    compiled = benchAluLoop(aluCycles, true, true, true);
+    std::cout << "  jit speedup " << compiled / interpreted << "x" << std::endl;
+
+    interpreted = benchVblankWait(prg, aluCycles, false);
+    cached = benchVblankWait(prg, aluCycles, true);
+    std::cout << "  block cache speedup " << cached / interpreted << "x" << std::endl;
+    translated = benchVblankWait(prg, aluCycles, false, true);
+    std::cout << "  translated speedup " << translated / interpreted << "x" << std::endl;
+}
@@ -0,0 +1,55 @@
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "ppu/frame_converter.h"
+#include "ppu/ppu.h"
+
+// Converts frames of random palette indices and emphasis to RGBA8888 and RGB565 with every supported instruction set,
+// and reports frames per second.
+// Usage: NES_FRAME_BENCH [frames]
+
+template <typename Pixel>
+void benchmark(FrameConverter &converter, const char *format, int frames,
+               void (FrameConverter::*convert)(const unsigned char *, const unsigned char *, Pixel *) const)
+{
+    static const char *NAMES[] = {"scalar", "ssse3", "avx2"};
+
+    unsigned int random = 12345;
+    std::vector<unsigned char> frame(Ppu::WIDTH * Ppu::HEIGHT);
+    for (unsigned char &pixel : frame)
+        pixel = (random = random * 1103515245 + 12345) >> 16 & 0x3f;
+    std::vector<unsigned char> emphasis(Ppu::HEIGHT);
+    for (int y = 0; y < Ppu::HEIGHT; y++)
+        emphasis[y] = y / 30;
+    std::vector<Pixel> out(frame.size());
+
+    double scalar = 0;
+    for (FrameConverter::Simd simd : {FrameConverter::SCALAR, FrameConverter::SSSE3, FrameConverter::AVX2})
+    {
+        if (!converter.setSimd(simd))
+            continue;
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < frames; i++)
+            (converter.*convert)(frame.data(), emphasis.data(), out.data());
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        if (simd == FrameConverter::SCALAR)
+            scalar = elapsed.count();
+
+        std::cout << format << ", " << NAMES[simd] << ": " << frames << " frames in " << elapsed.count() << " s"
+                  << std::endl;
+        std::cout << "  " << frames / elapsed.count() << " frames/s";
+        if (simd != FrameConverter::SCALAR)
+            std::cout << ", " << scalar / elapsed.count() << "x scalar";
+        std::cout << std::endl;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int frames = argc > 1 ? std::stoi(argv[1]) : 20000;
+    FrameConverter converter;
+    benchmark<uint32_t>(converter, "rgba8888", frames, &FrameConverter::toRgba);
+    benchmark<uint16_t>(converter, "rgb565", frames, &FrameConverter::toRgb565);
+}
@@ -0,0 +1,84 @@
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "bus.h"
+#include "nes.h"
+#include "cpu/cpu.h"
+#include "cpu/trace_sink.h"
+
+// Runs every ROM on a Nes for a number of cycles and reports the most frequent opcode pairs over the whole corpus.
+// The ROMs are inserted like in the emulator, so any supported mapper works, and the Ppu answers vblank polling.
+// Usage: NES_PAIR_PROFILE [--cycles N] [--start ADDR] [--top N] rom...
+// --start overrides the reset vector and runs the Cpu on its own until BRK, e.g. C000 for the automated nestest.
+
+// Cycles that ran.
+unsigned long long profile(std::shared_ptr<const Rom> rom, int start, unsigned long long cycles, TraceSink *sink)
+{
+    if (start >= 0)
+    {
+        Bus bus;
+        bus.insertDisk(rom);
+        Cpu cpu(&bus);
+        cpu.setEntry(start);
+        cpu.setTraceSink(sink);
+        cpu.reset();
+        return cpu.runCycles(cycles);
+    }
+
+    std::unique_ptr<Nes> nes(new Nes());
+    nes->insertDisk(rom);
+    Cpu &cpu = nes->getCpu();
+    cpu.setTraceSink(sink); // Traces peek at the registers, so the program runs the same as without a sink
+    unsigned long long begin = cpu.getCycles();
+    while (cpu.getCycles() - begin < cycles)
+        nes->runFrame();
+    return cpu.getCycles() - begin;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned long long cycles = 10000000;
+    int start = -1;
+    size_t top = 30;
+    std::vector<std::string> roms;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--cycles" && i + 1 < argc)
+            cycles = std::stoull(argv[++i]);
+        else if (arg == "--start" && i + 1 < argc)
+            start = std::stoi(argv[++i], nullptr, 16);
+        else if (arg == "--top" && i + 1 < argc)
+            top = std::stoul(argv[++i]);
+        else
+            roms.push_back(arg);
+    }
+
+    if (roms.empty())
+    {
+        std::cerr << "Usage: NES_PAIR_PROFILE [--cycles N] [--start ADDR] [--top N] rom..." << std::endl;
+        return 1;
+    }
+
+    PairProfileTraceSink pairs;
+    for (const std::string &file : roms)
+    {
+        try
+        {
+            unsigned long long ran = profile(std::make_shared<const Rom>(file), start, cycles, &pairs);
+            std::cout << file << ": " << ran << " cycles" << std::endl;
+        }
+        catch (const std::invalid_argument &e)
+        {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+    }
+
+    std::cout << pairs.instructions << " instructions" << std::endl;
+    pairs.print(std::cout, top);
+}
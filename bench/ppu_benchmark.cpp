@@ -0,0 +1,124 @@
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "nes.h"
+
+// Renders a busy screen, every tile different and 64 sprites, and reports frames per second: of the Ppu alone, by
+// scanlines and by dots, and of the whole console running a program that copies the sprites with OAM DMA on every
+// vblank, with the Ppu in lockstep, catching up, and catching up while a second thread draws. The static screen is
+// the same without sprites, which the scanline renderer doesn't render again. The busy screen is also drawn by the
+// scanline renderer with the sprites evaluated and composited without SIMD, and on 1 up to as many threads as there
+// are cores, to see how it scales.
+// Usage: NES_PPU_BENCH [frames]
+
+class Scene
+{
+public:
+    Scene() : prg(0x8000, 0xea)
+    {
+        // LDA #$80; STA $2000; LDA #$1E; STA $2001; JMP $800A
+        unsigned char program[] = {0xa9, 0x80, 0x8d, 0x00, 0x20, 0xa9, 0x1e, 0x8d, 0x01, 0x20, 0x4c, 0x0a, 0x80};
+        // NMI: LDA #$02; STA $4014; RTI
+        unsigned char nmi[] = {0xa9, 0x02, 0x8d, 0x14, 0x40, 0x40};
+        std::copy(program, program + sizeof(program), prg.begin());
+        std::copy(nmi, nmi + sizeof(nmi), prg.begin() + 0x20);
+        prg[0x7ffa] = 0x20; prg[0x7ffb] = 0x80;
+        prg[0x7ffc] = 0x00; prg[0x7ffd] = 0x80;
+    }
+
+    // Fills CHR RAM, the nametables, the palette and the sprites in RAM, rendering is enabled by the program. Without
+    // sprites they are all below the screen.
+    void insert(Nes &nes, bool sprites = true)
+    {
+        Bus &bus = nes.getBus();
+        bus.insertDisk(RomImage{0, VERTICAL, prg.data(), (int) prg.size(), NULL, 0});
+        nes.reset();
+
+        unsigned int random = 12345;
+        auto next = [&random]() { random = random * 1103515245 + 12345; return (unsigned char) (random >> 16); };
+
+        bus.write_8(0x2006, 0x00);
+        bus.write_8(0x2006, 0x00);
+        for (int i = 0; i < 0x2000 + 0x800; i++)
+            bus.write_8(0x2007, next()); // Pattern tables and both nametables, attributes included
+        bus.write_8(0x2006, 0x3f);
+        bus.write_8(0x2006, 0x00);
+        for (int i = 0; i < 32; i++)
+            bus.write_8(0x2007, next());
+        for (int i = 0; i < 256; i++)
+            bus.write_8(0x0200 + i, sprites || i % 4 ? next() : 0xff);
+        bus.write_8(0x2005, 0x05); // Fine scroll
+        bus.write_8(0x2005, 0x00);
+    }
+
+private:
+    std::vector<unsigned char> prg;
+};
+
+void benchmarkPpu(int frames, PpuRenderer renderer, bool sprites, int threads, const std::string &name,
+    SpriteCompositor::Simd spriteSimd = SpriteCompositor::AVX2)
+{
+    Nes nes;
+    Scene scene; // Holds the PRG ROM while the Nes runs
+    scene.insert(nes, sprites);
+    Ppu &ppu = nes.getPpu();
+    ppu.setRenderer(renderer);
+    ppu.setThreads(threads);
+    ppu.setSpriteSimd(spriteSimd); // Keeps the widest there is when not supported
+    Bus &bus = nes.getBus();
+    for (int i = 0; i < 256; i++)
+        bus.write_8(0x2004, bus.read(0x0200 + i));
+    bus.write_8(0x2001, 0x1e);
+    do
+        ppu.runScanline(); // To the pre-render line, where the renderer changes
+    while (ppu.getScanline() != 0);
+
+    auto start = std::chrono::steady_clock::now();
+    for (int frame = 0; frame < frames; frame++)
+    {
+        do
+            ppu.runScanline();
+        while (ppu.getScanline() != 0);
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << "ppu, " << name << ": " << frames << " frames in " << elapsed.count() << " s" << std::endl;
+    std::cout << "  " << frames / elapsed.count() << " frames/s" << std::endl;
+}
+
+void benchmarkConsole(int frames, PpuSync sync, bool pipelined, const char *name)
+{
+    Nes nes;
+    nes.setSync(sync);
+    nes.setPipelined(pipelined);
+    Scene scene; // Holds the PRG ROM while the Nes runs
+    scene.insert(nes);
+
+    auto start = std::chrono::steady_clock::now();
+    for (int frame = 0; frame < frames; frame++)
+        nes.runFrame();
+    nes.flush();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << "console, " << name << ": " << frames << " frames in " << elapsed.count() << " s" << std::endl;
+    std::cout << "  " << frames / elapsed.count() << " frames/s" << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+    int frames = argc > 1 ? std::stoi(argv[1]) : 2000;
+    benchmarkPpu(frames, SCANLINES, true, 0, "scanlines");
+    benchmarkPpu(frames, SCANLINES, true, 0, "scanlines, scalar sprites", SpriteCompositor::SCALAR);
+    benchmarkPpu(frames, DOTS, true, 0, "dots");
+    benchmarkPpu(frames, SCANLINES, false, 0, "scanlines, static screen");
+    benchmarkPpu(frames, DOTS, false, 0, "dots, static screen");
+    int cores = std::max(1u, std::thread::hardware_concurrency());
+    for (int threads = 1; threads <= cores; threads++)
+        benchmarkPpu(frames, SCANLINES, true, threads, "scanlines, " + std::to_string(threads) + " threads");
+    benchmarkConsole(frames, LOCKSTEP, false, "lockstep");
+    benchmarkConsole(frames, CATCH_UP, false, "catch-up");
+    benchmarkConsole(frames, CATCH_UP, true, "catch-up, pipelined");
+}
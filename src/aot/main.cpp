@@ -0,0 +1,70 @@
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "static_translator.h"
+#include "../bus.h"
+
+// Translates the PRG ROM of an NROM image to C++, see StaticTranslator and nes_translate_rom() in CMakeLists.txt.
+// Usage: NES_AOT [--entry ADDR]... rom.nes name output.cpp
+// name is the identifier of the generated TranslatedRom, --entry adds a start of discovery, e.g. C000 for the
+// automated nestest.
+int main(int argc, char **argv)
+{
+    std::vector<unsigned short> entries;
+    std::vector<std::string> files;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--entry" && i + 1 < argc)
+            entries.push_back(std::stoi(argv[++i], nullptr, 16));
+        else
+            files.push_back(arg);
+    }
+
+    if (files.size() != 3)
+    {
+        std::cerr << "Usage: NES_AOT [--entry ADDR]... rom.nes name output.cpp" << std::endl;
+        return 1;
+    }
+
+    std::shared_ptr<const Rom> rom;
+    try
+    {
+        rom = std::make_shared<const Rom>(files[0]);
+    }
+    catch (const std::invalid_argument &e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    if (rom->getHeader().mapper != 0)
+    {
+        std::cerr << "Can't translate " << files[0] << ", only NROM images have fixed PRG ROM" << std::endl;
+        return 1;
+    }
+
+    Bus bus;
+    bus.insertDisk(rom);
+
+    StaticTranslator translator(&bus);
+    for (unsigned short entry : entries)
+        translator.addEntry(entry);
+    translator.discover();
+
+    std::ofstream out(files[2]);
+    translator.write(out, files[1]);
+    if (!out)
+    {
+        std::cerr << "Can't write " << files[2] << std::endl;
+        return 1;
+    }
+
+    std::cout << files[0] << ": " << translator.getBlockCount() << " blocks, " << translator.getInstructionCount()
+              << " instructions" << std::endl;
+    return 0;
+}
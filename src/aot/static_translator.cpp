@@ -0,0 +1,372 @@
+#include <cctype>
+#include <iomanip>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+
+#include "static_translator.h"
+#include "../bus.h"
+#include "../cpu/cpu.h"
+#include "../cpu/translated_rom.h"
+
+static std::string hex(unsigned int value, int digits)
+{
+    std::ostringstream formatted;
+    formatted << "0x" << std::setfill('0') << std::setw(digits) << std::hex << value;
+    return formatted.str();
+}
+
+// Official opcodes, which writeInstruction() writes out. PLP and RTI depend on the CpuMode and BRK halts in some
+// modes, so these are interpreted.
+static bool isTranslated(unsigned char opCode)
+{
+    return Cpu::OPCODES[opCode].official && opCode != 0x00 && opCode != 0x28 && opCode != 0x40;
+}
+
+// JSR, JMP, RTS and branches, pc is not the next instruction afterwards.
+static bool endsBlock(unsigned char opCode)
+{
+    return opCode == 0x20 || opCode == 0x4c || opCode == 0x60 || opCode == 0x6c || Cpu::OPCODES[opCode].mode == RELATIVE;
+}
+
+// Reads and writes of address go to RAM or PRG ROM, the rest of the address space can be a device. The generated
+// code doesn't know the cycles of the instruction, the interpreter runs the accesses of devices.
+static bool isMemory(unsigned short address)
+{
+    return address < 0x2000 || address >= 0x8000;
+}
+
+// An absolute operand that a device answers, JMP and JSR don't access their operand.
+static bool accessesIo(unsigned char opCode, unsigned short operand)
+{
+    const OpCode &op = Cpu::OPCODES[opCode];
+    return (op.mode == ABSOLUTE || op.mode == INDIRECT) && opCode != 0x4c && opCode != 0x20 && !isMemory(operand);
+}
+
+static std::string lower(const std::string &name)
+{
+    std::string lowered = name;
+    for (char &c : lowered)
+        c = tolower(c);
+    return lowered;
+}
+
+static unsigned short nextPc(unsigned short address, unsigned char opCode)
+{
+    return address + Cpu::OPCODES[opCode].bytes;
+}
+
+static unsigned short branchTarget(unsigned short address, unsigned char opCode, unsigned short operand)
+{
+    return nextPc(address, opCode) + (signed char) operand;
+}
+
+// Disassembly for the comments in the generated code, e.g. "C72C  LDA $0300,X".
+static std::string describe(unsigned short address, unsigned char opCode, unsigned short operand)
+{
+    const OpCode &op = Cpu::OPCODES[opCode];
+    std::ostringstream text;
+    text << std::uppercase << std::hex << std::setfill('0') << std::setw(4) << address << "  " << op.name;
+
+    std::ostringstream value;
+    value << std::uppercase << std::hex << std::setfill('0') << "$" << std::setw(op.bytes == 3 ? 4 : 2) << operand;
+    switch (op.mode)
+    {
+    case ACCUMULATOR: text << " A"; break;
+    case IMMEDIATE: text << " #" << value.str(); break;
+    case ZERO_PAGE:
+    case ABSOLUTE: text << " " << value.str(); break;
+    case ZERO_PAGE_X:
+    case ABSOLUTE_X: text << " " << value.str() << ",X"; break;
+    case ZERO_PAGE_Y:
+    case ABSOLUTE_Y: text << " " << value.str() << ",Y"; break;
+    case INDIRECT: text << " (" << value.str() << ")"; break;
+    case INDEXED_INDIRECT: text << " (" << value.str() << ",X)"; break;
+    case INDIRECT_INDEXED: text << " (" << value.str() << "),Y"; break;
+    case RELATIVE: text << " $" << std::setw(4) << branchTarget(address, opCode, operand); break;
+    default: break;
+    }
+    return text.str();
+}
+
+void StaticTranslator::discover()
+{
+    std::vector<unsigned short> pending = entries;
+    pending.push_back(bus->read_16(0xfffa)); // NMI
+    pending.push_back(bus->read_16(bus->RESET_VECTOR_ADDR));
+    pending.push_back(bus->read_16(bus->BREAK_VECTOR_ADDR)); // IRQ
+
+    std::set<unsigned short> visited;
+    while (!pending.empty())
+    {
+        unsigned short start = pending.back();
+        pending.pop_back();
+        if (start < 0x8000 || !visited.insert(start).second)
+            continue; // Code in RAM can change, it is always interpreted
+
+        Block block = decode(start, pending);
+        if (!block.instructions.empty())
+            blocks[start] = block;
+    }
+}
+
+// Blocks can overlap, e.g. a branch into the middle of another block starts a block of its own.
+StaticTranslator::Block StaticTranslator::decode(unsigned short start, std::vector<unsigned short> &successors)
+{
+    Block block;
+    block.maxCycles = 0;
+
+    unsigned int address = start;
+    while (block.instructions.size() < (size_t) MAX_INSTRUCTIONS)
+    {
+        unsigned char opCode = bus->read(address);
+        const OpCode &op = Cpu::OPCODES[opCode];
+        if (address + op.bytes > 0xffff)
+            break; // Don't wrap around the address space
+
+        unsigned short operand = op.bytes == 3 ? bus->read_16(address + 1) : op.bytes == 2 ? bus->read(address + 1) : 0;
+        if (!isTranslated(opCode) || accessesIo(opCode, operand))
+        {
+            // Interpreted, translated code continues after it. BRK, RTI and JMP ($nnnn) don't continue there.
+            if (opCode != 0x00 && opCode != 0x40 && opCode != 0x6c)
+                successors.push_back(address + op.bytes);
+            break;
+        }
+
+        Instruction instruction;
+        instruction.address = address;
+        instruction.opCode = opCode;
+        instruction.operand = operand;
+        block.instructions.push_back(instruction);
+        block.maxCycles += op.cycles + op.pageCrossPenalty;
+        address += op.bytes;
+
+        if (op.mode == RELATIVE)
+        {
+            block.maxCycles += 2; // Taken to another page
+            successors.push_back(address);
+            successors.push_back(branchTarget(instruction.address, opCode, instruction.operand));
+        }
+        else if (opCode == 0x4c) // JMP absolute
+        {
+            successors.push_back(instruction.operand);
+        }
+        else if (opCode == 0x20) // JSR, the subroutine returns after it
+        {
+            successors.push_back(instruction.operand);
+            successors.push_back(address);
+        }
+        if (endsBlock(opCode))
+            break;
+    }
+
+    block.next = address;
+    if (block.instructions.size() == (size_t) MAX_INSTRUCTIONS)
+        successors.push_back(address);
+    return block;
+}
+
+size_t StaticTranslator::getInstructionCount()
+{
+    size_t count = 0;
+    for (const auto &entry : blocks)
+        count += entry.second.instructions.size();
+    return count;
+}
+
+void StaticTranslator::write(std::ostream &out, const std::string &name)
+{
+    out << "// Generated by NES_AOT, do not edit.\n";
+    out << "#include \"cpu/translated_rom.h\"\n";
+
+    for (const auto &entry : blocks)
+        writeBlock(out, entry.first, entry.second);
+
+    out << "\nstatic const TranslatedBlock blocks[] = {\n";
+    for (const auto &entry : blocks)
+        out << "    {" << hex(entry.first, 4) << ", " << entry.second.maxCycles << ", block_" << hex(entry.first, 4).substr(2) << "},\n";
+    out << "};\n";
+
+    // Lookup by pc without building a table at runtime, in read-only data without relocations
+    std::vector<unsigned short> index(0x8000);
+    int number = 1;
+    for (const auto &entry : blocks)
+        index[entry.first - 0x8000] = number++;
+    out << "\nstatic const unsigned short index[0x8000] = {";
+    for (size_t i = 0; i < index.size(); i++)
+        out << (i % 32 == 0 ? "\n    " : " ") << index[i] << ",";
+    out << "\n};\n";
+
+    out << "\nextern const TranslatedRom " << name << ";\n";
+    out << "const TranslatedRom " << name << " = {\"" << name << "\", " << hex(TranslatedRom::computeChecksum(bus), 8) << ", "
+        << blocks.size() << ", blocks, index};\n";
+}
+
+// The state is copied into a local so it can live in registers, the calls to the bus can't change it.
+void StaticTranslator::writeBlock(std::ostream &out, unsigned short start, const Block &block)
+{
+    out << "\nstatic bool block_" << hex(start, 4).substr(2) << "(GuestState &state, Bus *bus)\n";
+    out << "{\n";
+    out << "    GuestState s = state;\n";
+
+    bool jumped = false;
+    for (const Instruction &instruction : block.instructions)
+        jumped = writeInstruction(out, instruction);
+    if (!jumped)
+        out << "    s.pc = " << hex(block.next, 4) << ";\n";
+
+    out << "    state = s;\n";
+    out << "    return true;\n";
+    out << "}\n";
+}
+
+// Writes the effective address into a local when it depends on registers or memory, with the page cross penalty.
+// When that address is only known at runtime and a device answers it, the block exits before the instruction.
+// Returns the expression for the address.
+std::string StaticTranslator::writeAddress(std::ostream &out, const Instruction &instruction)
+{
+    const OpCode &op = Cpu::OPCODES[instruction.opCode];
+    std::string operand = hex(instruction.operand, op.bytes == 3 ? 4 : 2);
+    switch (op.mode)
+    {
+    case ZERO_PAGE:
+    case ABSOLUTE:
+        return operand;
+    case ZERO_PAGE_X:
+    case ZERO_PAGE_Y:
+        out << "        unsigned short address = (unsigned char) (" << operand << " + s." << (op.mode == ZERO_PAGE_X ? "x" : "y") << ");\n";
+        return "address";
+    case ABSOLUTE_X:
+    case ABSOLUTE_Y:
+        out << "        unsigned short address = " << operand << " + s." << (op.mode == ABSOLUTE_X ? "x" : "y") << ";\n";
+        writeSideExit(out, instruction);
+        if (op.pageCrossPenalty)
+            out << "        s.cycles += ((" << operand << " ^ address) & 0xff00) != 0;\n";
+        return "address";
+    case INDEXED_INDIRECT:
+        out << "        unsigned short address = bus->read_16_zero_page_wrap((unsigned char) (" << operand << " + s.x));\n";
+        writeSideExit(out, instruction);
+        return "address";
+    case INDIRECT_INDEXED:
+        out << "        unsigned short base = bus->read_16_zero_page_wrap(" << operand << ");\n";
+        out << "        unsigned short address = base + s.y;\n";
+        writeSideExit(out, instruction);
+        if (op.pageCrossPenalty)
+            out << "        s.cycles += ((base ^ address) & 0xff00) != 0;\n";
+        return "address";
+    default:
+        return "";
+    }
+}
+
+// Hands the instruction to the interpreter when address is I/O, with the state from before it, see TranslatedBlock.
+void StaticTranslator::writeSideExit(std::ostream &out, const Instruction &instruction)
+{
+    out << "        if (bus->isIo(address))\n"
+        << "        {\n"
+        << "            s.pc = " << hex(instruction.address, 4) << ";\n"
+        << "            state = s;\n"
+        << "            return false;\n"
+        << "        }\n";
+}
+
+// Same as the handler of the opcode in Cpu, see GuestState for the shared parts. Returns true when it set pc.
+bool StaticTranslator::writeInstruction(std::ostream &out, const Instruction &instruction)
+{
+    const OpCode &op = Cpu::OPCODES[instruction.opCode];
+    std::string name = op.name;
+    unsigned short next = nextPc(instruction.address, instruction.opCode);
+
+    out << "    // " << describe(instruction.address, instruction.opCode, instruction.operand) << "\n";
+    out << "    {\n";
+    std::string address = writeAddress(out, instruction);
+    out << "        s.cycles += " << (int) op.cycles << ";\n";
+    std::string value = op.mode == IMMEDIATE ? hex(instruction.operand, 2) : "bus->read(" + address + ")";
+    // Register named by the last letter, e.g. LDX and CPY
+    std::string reg = "s." + lower(name.substr(2));
+
+    if (name == "LDA" || name == "LDX" || name == "LDY")
+        out << "        " << reg << " = " << value << ";\n"
+            << "        s.updateZeroAndNegativeFlag(" << reg << ");\n";
+    else if (name == "STA" || name == "STX" || name == "STY")
+        out << "        bus->write_8(" << address << ", " << reg << ");\n";
+    else if (name == "ADC" || name == "SBC")
+        out << "        s." << lower(name) << "(" << value << ");\n";
+    else if (name == "AND" || name == "ORA" || name == "EOR")
+        out << "        s.a " << (name == "AND" ? "&" : name == "ORA" ? "|" : "^") << "= " << value << ";\n"
+            << "        s.updateZeroAndNegativeFlag(s.a);\n";
+    else if (name == "CMP" || name == "CPX" || name == "CPY")
+        out << "        s.compare(" << (name == "CMP" ? "s.a" : reg) << ", " << value << ");\n";
+    else if (name == "BIT")
+        out << "        s.bit(" << value << ");\n";
+    else if ((name == "ASL" || name == "LSR" || name == "ROL" || name == "ROR") && op.mode == ACCUMULATOR)
+        out << "        s.a = s." << lower(name) << "(s.a);\n";
+    else if (name == "ASL" || name == "LSR" || name == "ROL" || name == "ROR")
+        out << "        bus->write_8(" << address << ", s." << lower(name) << "(bus->read(" << address << ")));\n";
+    else if (name == "INC" || name == "DEC")
+        out << "        unsigned char value = bus->read(" << address << ") " << (name == "INC" ? "+" : "-") << " 1;\n"
+            << "        bus->write_8(" << address << ", value);\n"
+            << "        s.updateZeroAndNegativeFlag(value);\n";
+    else if (name == "INX" || name == "INY" || name == "DEX" || name == "DEY")
+        out << "        " << reg << (name[0] == 'I' ? "++" : "--") << ";\n"
+            << "        s.updateZeroAndNegativeFlag(" << reg << ");\n";
+    else if (name == "TAX" || name == "TAY" || name == "TXA" || name == "TYA" || name == "TSX")
+        out << "        " << reg << " = s." << (name[1] == 'S' ? "sp" : lower(name.substr(1, 1))) << ";\n"
+            << "        s.updateZeroAndNegativeFlag(" << reg << ");\n";
+    else if (name == "TXS")
+        out << "        s.sp = s.x;\n";
+    else if (name == "CLC" || name == "SEC")
+        out << "        s.carry = " << (name == "SEC") << ";\n";
+    else if (name == "CLV")
+        out << "        s.overflowResult = 0;\n";
+    else if (name == "CLI" || name == "CLD")
+        out << "        s.status &= " << (name == "CLI" ? "0b1111'1011" : "0b1111'0111") << ";\n";
+    else if (name == "SEI" || name == "SED")
+        out << "        s.status |= " << (name == "SEI" ? "0b0000'0100" : "0b0000'1000") << ";\n";
+    else if (name == "PHA")
+        out << "        s.pushStack(bus, s.a);\n";
+    else if (name == "PHP")
+        out << "        s.pushStack(bus, s.getStatus() | 0b0011'0000);\n";
+    else if (name == "PLA")
+        out << "        s.a = s.pullStack(bus);\n"
+            << "        s.updateZeroAndNegativeFlag(s.a);\n";
+    else if (name == "NOP")
+        ;
+    else if (name == "JMP" && op.mode == ABSOLUTE)
+        out << "        s.pc = " << hex(instruction.operand, 4) << ";\n";
+    else if (name == "JMP" && (instruction.operand & 0xff) == 0xff) // Page boundary bug, see Cpu::jmp()
+        out << "        s.pc = bus->read(" << hex(instruction.operand, 4) << ") | bus->read(" << hex(instruction.operand & 0xff00, 4) << ") << 8;\n";
+    else if (name == "JMP")
+        out << "        s.pc = bus->read_16(" << hex(instruction.operand, 4) << ");\n";
+    else if (name == "JSR")
+        out << "        s.pushStack(bus, " << hex((next - 1) >> 8, 2) << ");\n"
+            << "        s.pushStack(bus, " << hex((next - 1) & 0xff, 2) << ");\n"
+            << "        s.pc = " << hex(instruction.operand, 4) << ";\n";
+    else if (name == "RTS")
+        out << "        unsigned short low = s.pullStack(bus);\n"
+            << "        unsigned short high = s.pullStack(bus);\n"
+            << "        s.pc = ((high << 8) | low) + 1;\n";
+    else if (op.mode == RELATIVE)
+    {
+        static const std::map<std::string, std::string> conditions = {
+            {"BCC", "s.carry == 0"}, {"BCS", "s.carry == 1"},
+            {"BNE", "s.zeroResult != 0"}, {"BEQ", "s.zeroResult == 0"},
+            {"BPL", "(s.negativeResult >> 7) == 0"}, {"BMI", "(s.negativeResult >> 7) == 1"},
+            {"BVC", "(s.overflowResult >> 7) == 0"}, {"BVS", "(s.overflowResult >> 7) == 1"}};
+        unsigned short target = branchTarget(instruction.address, instruction.opCode, instruction.operand);
+        out << "        if (" << conditions.at(name) << ")\n"
+            << "        {\n"
+            << "            s.cycles += " << (((next ^ target) & 0xff00) ? 2 : 1) << ";\n"
+            << "            s.pc = " << hex(target, 4) << ";\n"
+            << "        }\n"
+            << "        else\n"
+            << "        {\n"
+            << "            s.pc = " << hex(next, 4) << ";\n"
+            << "        }\n";
+    }
+    else
+        throw std::logic_error(std::string("No translation for ") + op.name);
+
+    out << "    }\n";
+    return endsBlock(instruction.opCode);
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+class Bus;
+
+// Recovers the control flow of a PRG ROM from its entry points and writes every reachable block as a C++ function,
+// generating the TranslatedRom that Cpu::setTranslatedRom() runs.
+// Only code in $8000-$FFFF is translated, which is assumed to be read-only (NROM). Blocks end at branches, jumps,
+// calls and returns, and before BRK, RTI, PLP, unofficial opcodes and absolute accesses outside RAM and PRG ROM, which
+// are left to the interpreter. Indexed and indirect accesses exit to the interpreter when they hit I/O at runtime.
+// The targets of RTS, RTI and indirect jumps are only known at runtime, the Cpu looks them up and interprets pcs
+// that were never discovered.
+class StaticTranslator
+{
+public:
+    // Longer straight line code is split, the Cpu interprets a block that doesn't fit in the remaining budget.
+    static const int MAX_INSTRUCTIONS = 64;
+
+    StaticTranslator(Bus *bus) : bus(bus) { }
+
+    // Extra start of discovery, the reset, NMI and IRQ vectors are always used.
+    void addEntry(unsigned short address) { entries.push_back(address); }
+
+    // Follows branches, jumps and calls from the entries.
+    void discover();
+
+    // Writes the blocks and a TranslatedRom called name, which must be a C++ identifier.
+    void write(std::ostream &out, const std::string &name);
+
+    size_t getBlockCount() { return blocks.size(); }
+    size_t getInstructionCount();
+
+private:
+    struct Instruction
+    {
+        unsigned short address;
+        unsigned char opCode;
+        unsigned short operand;
+    };
+
+    struct Block
+    {
+        std::vector<Instruction> instructions;
+        unsigned short next;      // pc after the block, unless the last instruction jumps
+        unsigned short maxCycles; // With every penalty
+    };
+
+    Bus *bus;
+    std::vector<unsigned short> entries;
+    std::map<unsigned short, Block> blocks;
+
+    Block decode(unsigned short start, std::vector<unsigned short> &successors);
+    void writeBlock(std::ostream &out, unsigned short start, const Block &block);
+    bool writeInstruction(std::ostream &out, const Instruction &instruction);
+    std::string writeAddress(std::ostream &out, const Instruction &instruction);
+    void writeSideExit(std::ostream &out, const Instruction &instruction);
+};
@@ -2,54 +2,183 @@
 #include <iostream>
 
 #include "bus.h"
+#include "cartridge/cartridge.h"
 
-void Bus::insertDisk(Rom *rom)
+Bus::Bus()
 {
-    readData(rom->getPrgData(), rom->size);
+    mapIo(0x00, 256, &openBus);
+    for (int mirror = 0; mirror < RAM_END / RAM_SIZE; mirror++)
+        mapMemory(mirror * RAM_SIZE >> 8, RAM_SIZE >> 8, ram, true);
+    mapIo(0x20, 0x20, &ppuRegisters);
+    testMemory.reset(new unsigned char[0xc000]());
+    mapMemory(0x41, 0xbf, testMemory.get() + 0x100, true);
+}
+
+Bus::~Bus() // Where Cartridge is a complete type
+{
+}
+
+void Bus::insertDisk(std::shared_ptr<const Rom> rom)
+{
+    insertDisk(rom->getImage(), rom);
+}
+
+void Bus::insertDisk(const RomImage &image, std::shared_ptr<const void> owner)
+{
+    cartridge.reset(new Cartridge(this, image, owner));
+    testMemory.reset(); // All its pages belong to the cartridge now
+}
+
+void Bus::insertDisk(const Cartridge &other)
+{
+    cartridge.reset(new Cartridge(this, other));
+    testMemory.reset();
 }
 
 void Bus::readData(unsigned char *data, int length)
 {
     unsigned short start = 0x8000;
     write(start, data, length);
-    write(0xc000, data, length); // TODO depends on ROM
+    write(0xc000, data, length);
+}
+
+void Bus::mapMemory(unsigned char firstPage, int count, unsigned char *data, bool writable)
+{
+    for (int i = 0; i < count; i++)
+        remap(firstPage + i, data + i * 256, writable ? data + i * 256 : NULL);
+}
+
+void Bus::mapMemory(unsigned char firstPage, int count, const unsigned char *data)
+{
+    for (int i = 0; i < count; i++)
+        remap(firstPage + i, data + i * 256, NULL);
 }
 
+void Bus::mapIo(unsigned char firstPage, int count, MemoryMappedIo *device)
+{
+    for (int i = 0; i < count; i++)
+    {
+        remap(firstPage + i, NULL, NULL);
+        ioPages[firstPage + i] = device ? device : &openBus;
+    }
+}
+
+// A bank switch only swaps the pointers, code cached for the page is stale afterwards.
+void Bus::remap(int page, const unsigned char *read, unsigned char *write)
+{
+    bool changed = readPages[page] != read || writePages[page] != write;
+    readPages[page] = read;
+    writePages[page] = write;
+    if (changed && watchedPages[page] && writeWatcher)
+        writeWatcher->remapped(page);
+}
+
+// Copies whole pages at once when nothing has to see the writes.
 void Bus::write(unsigned short address, unsigned char data[], int length)
 {
-    std::copy(data, data+length, memory + address);
+    while (length > 0)
+    {
+        unsigned char page = address >> 8;
+        int count = std::min(length, 256 - (address & 0xff));
+        if (writePages[page] && !watchedPages[page])
+        {
+            std::copy(data, data + count, writePages[page] + (address & 0xff));
+        }
+        else
+        {
+            for (int i = 0; i < count; i++)
+                write_8(address + i, data[i]);
+        }
+        address += count;
+        data += count;
+        length -= count;
+    }
 }
 
-void Bus::write_8(unsigned short address, unsigned char byte)
+void Bus::readPage(unsigned char page, unsigned char *data)
 {
-    memory[address] = byte;
+    if (readPages[page])
+    {
+        std::copy(readPages[page], readPages[page] + 256, data);
+        return;
+    }
+    for (int i = 0; i < 256; i++)
+        data[i] = readIo(page << 8 | i);
 }
 
 // 16-bit values are stored in little-endian
 void Bus::write_16(unsigned short address, unsigned short data)
 {
-    memory[address] = data & 0x00ff;
-    memory[address + 1] = (data & 0xff00) >> 8;
+    write_8(address, data & 0x00ff);
+    write_8(address + 1, (data & 0xff00) >> 8);
 }
 
-unsigned char Bus::read(unsigned short address)
+void Bus::setWriteWatcher(WriteWatcher *watcher)
 {
-    return memory[address];
+    writeWatcher = watcher;
+    std::fill(watchedPages, watchedPages + 256, 0);
 }
 
-// 16-bit values are stored in little-endian
-unsigned short Bus::read_16(unsigned short address)
+void Bus::watch(unsigned char page)
+{
+    if (page < RAM_END >> 8)
+    {
+        for (int mirror = page % (RAM_SIZE >> 8); mirror < RAM_END >> 8; mirror += RAM_SIZE >> 8)
+            watchedPages[mirror]++;
+    }
+    else
+    {
+        watchedPages[page]++;
+    }
+}
+
+void Bus::unwatch(unsigned char page)
 {
-    unsigned short p1 = memory[address]; 
-    unsigned short p2 = memory[address+1];
-    return (p2 << 8) | p1;
+    if (page < RAM_END >> 8)
+    {
+        for (int mirror = page % (RAM_SIZE >> 8); mirror < RAM_END >> 8; mirror += RAM_SIZE >> 8)
+            watchedPages[mirror]--;
+    }
+    else
+    {
+        watchedPages[page]--;
+    }
 }
 
-unsigned short Bus::read_16_zero_page_wrap(unsigned short address)
+unsigned char Bus::readIo(unsigned short address)
 {
-    unsigned short p1 = memory[address % 256];
-    unsigned short p2 = memory[(address+1) % 256];
-    return (p2 << 8) | p1;
+    if (ioListener == NULL)
+        return ioPages[address >> 8]->read(address);
+    ioListener->accessing(address, false);
+    unsigned char value = ioPages[address >> 8]->read(address);
+    ioListener->accessed(address, value, false);
+    return value;
+}
+
+void Bus::writeIo(unsigned short address, unsigned char byte)
+{
+    if (ioListener)
+        ioListener->accessing(address, true);
+    ioPages[address >> 8]->write(address, byte);
+    if (ioListener)
+        ioListener->accessed(address, byte, true);
+}
+
+// A write to RAM changes all its mirrors.
+void Bus::notifyWatcher(unsigned short address)
+{
+    if (writeWatcher == NULL)
+        return;
+
+    if (address < RAM_END)
+    {
+        for (unsigned short mirror = address % RAM_SIZE; mirror < RAM_END; mirror += RAM_SIZE)
+            writeWatcher->written(mirror);
+    }
+    else
+    {
+        writeWatcher->written(address);
+    }
 }
 
 signed int Bus::read_signed(unsigned short address)
@@ -57,4 +186,4 @@ signed int Bus::read_signed(unsigned short address)
     unsigned char value = read(address);
     bool negative = (value >> 7) == 1;
     return negative ? -((unsigned char) (~value + 1)) : value;
-}
\ No newline at end of file
+}
@@ -2,31 +2,180 @@
 
 #include <iomanip>
 #include <iostream>
+#include <memory>
 #include <optional>
 #include <string>
 #include <sstream>
 
 #include "rom.cpp"
 
+// Notified of writes to watched pages, e.g. to drop cached code that was overwritten.
+class WriteWatcher
+{
+public:
+    virtual ~WriteWatcher() {}
+    virtual void written(unsigned short address) = 0;
+    // The memory of a watched page was switched, e.g. to another ROM bank.
+    virtual void remapped(unsigned char page) = 0;
+};
+
+// Notified before every access that goes to a device, e.g. to bring a device that runs behind up to date first, and
+// after it with the value that was read or written.
+class IoListener
+{
+public:
+    virtual ~IoListener() {}
+    virtual void accessing(unsigned short address, bool write) = 0;
+    virtual void accessed(unsigned short address, unsigned char value, bool write) {}
+};
+
+class Cartridge;
+
+// A device on the bus, e.g. the registers of the PPU. Unlike memory, reads can have side effects.
+class MemoryMappedIo
+{
+public:
+    virtual ~MemoryMappedIo() {}
+    virtual unsigned char read(unsigned short address) = 0;
+    virtual void write(unsigned short address, unsigned char value) = 0;
+    // What read() would return, without its side effects, e.g. for traces.
+    virtual unsigned char peek(unsigned short address) = 0;
+};
+
+// Nothing answers: reads are $FF like in the nestest log, writes are ignored.
+class OpenBus : public MemoryMappedIo
+{
+public:
+    unsigned char read(unsigned short address) override { return 0xff; }
+    void write(unsigned short address, unsigned char value) override {}
+    unsigned char peek(unsigned short address) override { return 0xff; }
+};
+
+// Registers that read back the value last written to them, mirrored every count bytes. Stands in for the PPU
+// registers ($2000-$3FFF) until there is a PPU.
+class LatchedRegisters : public MemoryMappedIo
+{
+public:
+    static const int COUNT = 8;
+
+    unsigned char read(unsigned short address) override { return registers[address % COUNT]; }
+    void write(unsigned short address, unsigned char value) override { registers[address % COUNT] = value; }
+    unsigned char peek(unsigned short address) override { return read(address); }
+
+private:
+    unsigned char registers[COUNT] = {};
+};
+
+// The CPU address space as 256 pages of 256 bytes. A page is either host memory, read with one test and one load, or
+// a MemoryMappedIo device that handles its reads and writes:
+//   $0000-$1FFF  2KB RAM, mirrored 4 times
+//   $2000-$3FFF  PPU registers
+//   $4000-$40FF  APU and I/O registers
+//   $4100-$FFFF  the Cartridge, or writable memory for test programs until one is inserted
 class Bus
 {
 public:
 
+    const unsigned short NMI_VECTOR_ADDR = 0xfffa;
     const unsigned short RESET_VECTOR_ADDR = 0xfffc;
     const unsigned short BREAK_VECTOR_ADDR = 0xfffe;
 
-    void insertDisk(Rom *rom);
+    static const int RAM_SIZE = 0x800;
+    static const unsigned short RAM_END = 0x2000; // End of the mirrors
+
+    Bus();
+    ~Bus();
+    Bus(const Bus &) = delete; // The page table points into the Bus
+    Bus &operator=(const Bus &) = delete;
+
+    // Maps the cartridge of the ROM, which is shared with other Buses rather than copied.
+    // Throws std::invalid_argument for unsupported mappers.
+    void insertDisk(std::shared_ptr<const Rom> rom);
+    // Same for an image that isn't loaded from a file, owner holds its data.
+    void insertDisk(const RomImage &image, std::shared_ptr<const void> owner = nullptr);
+    // Same for a copy of the cartridge of another Bus, in the state it is in.
+    void insertDisk(const Cartridge &cartridge);
+    // NULL until a ROM is inserted.
+    Cartridge *getCartridge() { return cartridge.get(); }
+    // Writes a test program to $8000 and mirrors it at $C000, like a 16KB NROM. Only without a cartridge.
     void readData(unsigned char * data, int length);
 
+    // Maps count pages from firstPage to host memory. Writes to read only pages go to the device of the page, e.g. the
+    // registers of a mapper, and are ignored when there is none.
+    void mapMemory(unsigned char firstPage, int count, unsigned char *data, bool writable);
+    void mapMemory(unsigned char firstPage, int count, const unsigned char *data); // Read only
+    // Maps count pages from firstPage to a device, it handles all reads and writes of those pages. Memory mapped on the
+    // pages afterwards takes over the reads, and the writes as well when writable. NULL leaves the pages unconnected.
+    // Remapping a watched page is passed to the watcher.
+    void mapIo(unsigned char firstPage, int count, MemoryMappedIo *device);
 
     void write(unsigned short address, unsigned char data[], int length);
-    void write_8(unsigned short address, unsigned char byte);
+    void write_8(unsigned short address, unsigned char byte)
+    {
+        unsigned char *page = writePages[address >> 8];
+        if (page)
+        {
+            page[address & 0xff] = byte;
+            if (watchedPages[address >> 8])
+                notifyWatcher(address);
+        }
+        else
+        {
+            writeIo(address, byte);
+        }
+    }
+
     void write_16(unsigned short address, unsigned short data);
     
-    unsigned char read(unsigned short address);
-    unsigned short read_16(unsigned short address);
-    unsigned short read_16_zero_page_wrap(unsigned short address);
+    unsigned char read(unsigned short address)
+    {
+        const unsigned char *page = readPages[address >> 8];
+        if (page)
+            return page[address & 0xff];
+        return readIo(address);
+    }
+
+    // The value a read would return, without the side effects of reading a device and without notifying the
+    // IoListener. For traces and debugging, so they don't change what the program sees.
+    unsigned char peek(unsigned short address)
+    {
+        const unsigned char *page = readPages[address >> 8];
+        if (page)
+            return page[address & 0xff];
+        return ioPages[address >> 8]->peek(address);
+    }
+
+    // 16-bit values are stored in little-endian
+    unsigned short read_16(unsigned short address)
+    {
+        unsigned short p1 = read(address);
+        unsigned short p2 = read(address + 1);
+        return (p2 << 8) | p1;
+    }
+
+    // The zero page is always RAM
+    unsigned short read_16_zero_page_wrap(unsigned short address)
+    {
+        unsigned short p1 = ram[address % 256];
+        unsigned short p2 = ram[(address+1) % 256];
+        return (p2 << 8) | p1;
+    }
+
+    // Whether reads of address go to a device, with the pages mapped as they are now.
+    bool isIo(unsigned short address) { return readPages[address >> 8] == NULL; }
+
     signed int read_signed(unsigned short address);
+    // The 256 bytes of a page, e.g. for OAM DMA: one copy when the page is memory, otherwise a read of every byte
+    // from its device, side effects included.
+    void readPage(unsigned char page, unsigned char *data);
+
+    // Writes to a watched page are passed to the watcher, NULL removes the watcher and all watched pages.
+    void setWriteWatcher(WriteWatcher *watcher);
+    // NULL by default.
+    void setIoListener(IoListener *listener) { ioListener = listener; }
+    // Pages are reference counted, every watch needs an unwatch. Watching RAM watches all its mirrors.
+    void watch(unsigned char page);
+    void unwatch(unsigned char page);
 
     void dump(unsigned short from, unsigned short to)
     {
@@ -41,7 +190,29 @@ public:
     }
 
 private:
-    unsigned char memory[0xffff];
+    friend class Jit; // Compiled code reads and writes memory through the page table
+
+    // NULL for pages without memory, ioPages has a device for every page
+    const unsigned char *readPages[256] = {};
+    unsigned char *writePages[256] = {};
+    MemoryMappedIo *ioPages[256] = {};
+
+    unsigned char ram[RAM_SIZE] = {};
+    std::unique_ptr<unsigned char[]> testMemory; // $4000-$FFFF until a cartridge is inserted, see readData()
+
+    OpenBus openBus;
+    LatchedRegisters ppuRegisters;
+    std::unique_ptr<Cartridge> cartridge;
+
+    WriteWatcher *writeWatcher = NULL;
+    unsigned short watchedPages[256] = {};
+    IoListener *ioListener = NULL;
+
+    // Out of line, so the memory accesses inlined in every instruction stay small
+    unsigned char readIo(unsigned short address);
+    void writeIo(unsigned short address, unsigned char byte);
+    void notifyWatcher(unsigned short address);
+    void remap(int page, const unsigned char *read, unsigned char *write);
 
     std::string toHex_16(unsigned short bytes)
     {
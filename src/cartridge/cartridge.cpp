@@ -0,0 +1,118 @@
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+#include "cartridge.h"
+
+Cartridge::Cartridge(Bus *bus, const RomImage &image, std::shared_ptr<const void> owner)
+    : bus(bus), image(image), owner(owner), mapper(createMapper(image.mapper)), mirroring(image.mirroring)
+{
+    if (image.prgSize < 0x4000 || image.prgSize % 0x2000 != 0)
+        throw std::invalid_argument("Invalid PRG ROM size: " + std::to_string(image.prgSize));
+    if (image.chr == NULL)
+    {
+        chrRam.resize(std::max(image.chrRamSize, 0x2000)); // Mappers switch 8KB at least
+        this->image.chr = chrRam.data();
+        this->image.chrSize = chrRam.size();
+    }
+
+    // Smaller PRG RAM is mirrored in whole pages, more is banked but no supported mapper does
+    int prgRamSize = std::min(image.trainer ? 0x2000 : image.prgRamSize, 0x2000);
+    prgRam.resize(prgRamSize ? std::max(prgRamSize, 0x100) : 0);
+    if (image.trainer)
+        std::copy(image.trainer, image.trainer + 512, prgRam.begin() + 0x1000);
+
+    mapPrgRam();
+    std::visit([this](auto &m) { m.reset(*this); }, mapper);
+}
+
+Cartridge::Cartridge(Bus *bus, const Cartridge &other)
+    : bus(bus), image(other.image), owner(other.owner), mapper(other.mapper), mirroring(other.mirroring),
+      prgRam(other.prgRam), chrRam(other.chrRam)
+{
+    if (!chrRam.empty())
+        image.chr = chrRam.data();
+
+    mapPrgRam();
+    for (int slot = 0; slot < 4; slot++)
+    {
+        prgBanks[slot] = other.prgBanks[slot];
+        if (prgBanks[slot])
+            bus->mapMemory(0x80 + slot * 0x20, 0x20, prgBanks[slot]);
+    }
+    for (int slot = 0; slot < 8; slot++)
+        chrBanks[slot] = image.chr + (other.chrBanks[slot] - other.image.chr);
+}
+
+void Cartridge::mapPrgRam()
+{
+    bus->mapIo(0x41, 0x3f, NULL); // Nothing on the cartridge answers at $4100-$7FFF, unless there is PRG RAM
+    for (int page = 0; page < 0x20 && !prgRam.empty(); page++)
+        bus->mapMemory(0x60 + page, 1, prgRam.data() + page * 256 % prgRam.size(), true);
+    bus->mapIo(0x80, 0x80, this); // Until the mapper maps the ROM, writes to it stay here afterwards
+}
+
+Cartridge::Mapper Cartridge::createMapper(int number)
+{
+    switch (number)
+    {
+    case 0:
+        return Nrom();
+    case 1:
+        return Mmc1();
+    case 2:
+        return UxRom();
+    case 3:
+        return CnRom();
+    case 4:
+        return Mmc3();
+    case 7:
+        return AxRom();
+    default:
+        throw std::invalid_argument("Unsupported mapper: " + std::to_string(number));
+    }
+}
+
+void Cartridge::write(unsigned short address, unsigned char value)
+{
+    if (address >= 0x8000)
+        std::visit([&](auto &m) { m.write(*this, address, value); }, mapper);
+}
+
+void Cartridge::mapPrg(int slot, int size, int bank)
+{
+    int banks = image.prgSize / size;
+    bank = (bank % banks + banks) % banks;
+    bus->mapMemory(0x80 + slot * (size >> 8), size >> 8, image.prg + bank * size);
+    for (int i = 0; i < size / 0x2000; i++)
+        prgBanks[slot * (size / 0x2000) + i] = image.prg + bank * size + i * 0x2000;
+}
+
+void Cartridge::mapChr(int slot, int size, int bank)
+{
+    int banks = image.chrSize / size;
+    bank = (bank % banks + banks) % banks;
+    for (int i = 0; i < size / CHR_BANK_SIZE; i++)
+    {
+        int index = slot * (size / CHR_BANK_SIZE) + i;
+        const unsigned char *chrBank = image.chr + bank * size + i * CHR_BANK_SIZE;
+        if (chrBanks[index] != chrBank)
+            chrVersions[index]++;
+        chrBanks[index] = chrBank;
+    }
+}
+
+void Cartridge::writeChr(unsigned short address, unsigned char value)
+{
+    if (chrRam.empty())
+        return;
+    int slot = address / CHR_BANK_SIZE;
+    chrRam[chrBanks[slot] - chrRam.data() + address % CHR_BANK_SIZE] = value;
+    chrVersions[slot]++;
+    // Other slots can show the same bank
+    for (int other = 0; other < 8; other++)
+    {
+        if (other != slot && chrBanks[other] == chrBanks[slot])
+            chrVersions[other]++;
+    }
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <memory>
+#include <variant>
+#include <vector>
+
+#include "mappers.h"
+#include "rom_image.h"
+#include "../bus.h"
+
+// The cartridge on the Bus: PRG ROM at $8000-$FFFF, PRG RAM at $6000-$7FFF and the CHR for the PPU. The PRG ROM is
+// mapped read only, so writes to it come here and go to the registers of the mapper. Bank switches repoint the pages
+// of the Bus and the CHR banks at the ROM data, nothing is copied. Only the RAM and the mapper registers are per
+// Cartridge, any number of them can share one ROM image.
+// The mapper is one of the variant, so there are no virtual calls: ROM reads are plain memory reads on the Bus, and
+// a register write is dispatched with std::visit.
+class Cartridge : public MemoryMappedIo
+{
+public:
+    using Mapper = std::variant<Nrom, Mmc1, UxRom, CnRom, AxRom, Mmc3>;
+
+    static const int CHR_BANK_SIZE = 0x400;
+
+    // Maps the cartridge into the Bus, throws std::invalid_argument for mappers that aren't supported.
+    // The Cartridge keeps a reference to owner, the holder of the image data, when there is one.
+    Cartridge(Bus *bus, const RomImage &image, std::shared_ptr<const void> owner = nullptr);
+    // Maps the ROM of other into another Bus, with a copy of its RAM, its mapper registers and the banks they
+    // selected.
+    Cartridge(Bus *bus, const Cartridge &other);
+    Cartridge(const Cartridge &) = delete; // The Bus points into the Cartridge
+    Cartridge &operator=(const Cartridge &) = delete;
+
+    unsigned char read(unsigned short address) override { return 0xff; } // Unmapped
+    unsigned char peek(unsigned short address) override { return 0xff; }
+    void write(unsigned short address, unsigned char value) override;
+
+    Mapper &getMapper() { return mapper; }
+
+    // Maps PRG ROM bank number bank, of size bytes, at slot number slot from $8000, e.g. slot 1 of 16KB is $C000.
+    // Bank numbers wrap around the size of the ROM, negative numbers count from the end: -1 is the last bank.
+    void mapPrg(int slot, int size, int bank);
+    // Maps CHR bank number bank, of size bytes, at slot number slot of the pattern tables ($0000-$1FFF).
+    void mapChr(int slot, int size, int bank);
+
+    Mirroring getMirroring() { return mirroring; }
+    void setMirroring(Mirroring value) { mirroring = value; }
+
+    // CHR as seen by the PPU, $0000-$1FFF. Writes only change CHR RAM.
+    unsigned char readChr(unsigned short address) { return chrBanks[address / CHR_BANK_SIZE][address % CHR_BANK_SIZE]; }
+    void writeChr(unsigned short address, unsigned char value);
+    // The 1KB bank at slot, of the 8 in the pattern tables.
+    const unsigned char *getChrBank(int slot) { return chrBanks[slot]; }
+    // Changes when the bank at slot is switched or its CHR RAM is written, for caches of decoded CHR.
+    unsigned int getChrVersion(int slot) { return chrVersions[slot]; }
+
+private:
+    Bus *bus;
+    RomImage image;
+    std::shared_ptr<const void> owner;
+    Mapper mapper;
+    Mirroring mirroring;
+
+    std::vector<unsigned char> prgRam;
+    std::vector<unsigned char> chrRam; // Empty with CHR ROM
+    const unsigned char *prgBanks[4] = {}; // Of 8KB from $8000
+    const unsigned char *chrBanks[8] = {};
+    unsigned int chrVersions[8] = {};
+
+    static Mapper createMapper(int number);
+    void mapPrgRam();
+};
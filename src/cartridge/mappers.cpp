@@ -0,0 +1,192 @@
+#include "cartridge.h"
+#include "mappers.h"
+
+void Nrom::reset(Cartridge &cartridge)
+{
+    cartridge.mapPrg(0, 0x4000, 0);
+    cartridge.mapPrg(1, 0x4000, 1); // Wraps around to the first bank for 16KB
+    cartridge.mapChr(0, 0x2000, 0);
+}
+
+void Mmc1::reset(Cartridge &cartridge)
+{
+    apply(cartridge);
+}
+
+// A write with bit 7 set resets the shift register, others shift in bit 0.
+void Mmc1::write(Cartridge &cartridge, unsigned short address, unsigned char value)
+{
+    if (value & 0x80)
+    {
+        shift = 0x10;
+        control |= 0x0c;
+        apply(cartridge);
+        return;
+    }
+
+    bool complete = shift & 1;
+    shift = (shift >> 1) | (value & 1) << 4;
+    if (!complete)
+        return;
+
+    switch (address & 0x6000)
+    {
+    case 0x0000:
+        control = shift;
+        break;
+    case 0x2000:
+        chrBank0 = shift;
+        break;
+    case 0x4000:
+        chrBank1 = shift;
+        break;
+    case 0x6000:
+        prgBank = shift;
+        break;
+    }
+    shift = 0x10;
+    apply(cartridge);
+}
+
+void Mmc1::apply(Cartridge &cartridge)
+{
+    static const Mirroring MIRRORING[4] = {SINGLE_SCREEN_LOWER, SINGLE_SCREEN_UPPER, VERTICAL, HORIZONTAL};
+    cartridge.setMirroring(MIRRORING[control & 3]);
+
+    int bank = prgBank & 0x0f;
+    switch (control >> 2 & 3)
+    {
+    case 0:
+    case 1: // 32KB, the low bit is ignored
+        cartridge.mapPrg(0, 0x8000, bank >> 1);
+        break;
+    case 2: // First bank fixed at $8000
+        cartridge.mapPrg(0, 0x4000, 0);
+        cartridge.mapPrg(1, 0x4000, bank);
+        break;
+    case 3: // Last bank fixed at $C000
+        cartridge.mapPrg(0, 0x4000, bank);
+        cartridge.mapPrg(1, 0x4000, -1);
+        break;
+    }
+
+    if (control & 0x10)
+    {
+        cartridge.mapChr(0, 0x1000, chrBank0);
+        cartridge.mapChr(1, 0x1000, chrBank1);
+    }
+    else
+    {
+        cartridge.mapChr(0, 0x2000, chrBank0 >> 1);
+    }
+}
+
+void UxRom::reset(Cartridge &cartridge)
+{
+    cartridge.mapPrg(0, 0x4000, 0);
+    cartridge.mapPrg(1, 0x4000, -1);
+    cartridge.mapChr(0, 0x2000, 0);
+}
+
+void UxRom::write(Cartridge &cartridge, unsigned short address, unsigned char value)
+{
+    cartridge.mapPrg(0, 0x4000, value);
+}
+
+void CnRom::reset(Cartridge &cartridge)
+{
+    cartridge.mapPrg(0, 0x4000, 0);
+    cartridge.mapPrg(1, 0x4000, 1);
+    cartridge.mapChr(0, 0x2000, 0);
+}
+
+void CnRom::write(Cartridge &cartridge, unsigned short address, unsigned char value)
+{
+    cartridge.mapChr(0, 0x2000, value);
+}
+
+void AxRom::reset(Cartridge &cartridge)
+{
+    write(cartridge, 0x8000, 0);
+    cartridge.mapChr(0, 0x2000, 0);
+}
+
+void AxRom::write(Cartridge &cartridge, unsigned short address, unsigned char value)
+{
+    cartridge.mapPrg(0, 0x8000, value & 0x07);
+    cartridge.setMirroring(value & 0x10 ? SINGLE_SCREEN_UPPER : SINGLE_SCREEN_LOWER);
+}
+
+void Mmc3::reset(Cartridge &cartridge)
+{
+    apply(cartridge);
+}
+
+// The registers are mirrored in pairs, an even and an odd address, every 8KB.
+void Mmc3::write(Cartridge &cartridge, unsigned short address, unsigned char value)
+{
+    bool even = (address & 1) == 0;
+    switch (address & 0xe000)
+    {
+    case 0x8000:
+        if (even)
+            bankSelect = value;
+        else
+            registers[bankSelect & 7] = value;
+        apply(cartridge);
+        break;
+    case 0xa000:
+        if (even && cartridge.getMirroring() != FOUR_SCREEN)
+            cartridge.setMirroring(value & 1 ? HORIZONTAL : VERTICAL);
+        break; // Odd is the PRG RAM protection, which isn't emulated
+    case 0xc000:
+        if (even)
+        {
+            irqLatch = value;
+        }
+        else
+        {
+            irqCounter = 0;
+            irqReload = true;
+        }
+        break;
+    case 0xe000:
+        irqEnabled = !even;
+        if (even)
+            irqPending = false; // Acknowledged
+        break;
+    }
+}
+
+void Mmc3::clockScanline()
+{
+    if (irqCounter == 0 || irqReload)
+    {
+        irqCounter = irqLatch;
+        irqReload = false;
+    }
+    else
+    {
+        irqCounter--;
+    }
+
+    if (irqCounter == 0 && irqEnabled)
+        irqPending = true;
+}
+
+void Mmc3::apply(Cartridge &cartridge)
+{
+    // Bit 6 swaps the switchable bank at $8000 with the fixed second to last bank at $C000
+    bool prgSwap = bankSelect & 0x40;
+    cartridge.mapPrg(prgSwap ? 2 : 0, 0x2000, registers[6]);
+    cartridge.mapPrg(1, 0x2000, registers[7]);
+    cartridge.mapPrg(prgSwap ? 0 : 2, 0x2000, -2);
+    cartridge.mapPrg(3, 0x2000, -1);
+
+    // Bit 7 swaps the 2KB banks at $0000-$0FFF with the 1KB banks at $1000-$1FFF
+    int inverted = bankSelect & 0x80 ? 4 : 0;
+    cartridge.mapChr(inverted / 2, 0x800, registers[0] >> 1);
+    cartridge.mapChr(inverted / 2 + 1, 0x800, registers[1] >> 1);
+    for (int i = 0; i < 4; i++)
+        cartridge.mapChr((4 ^ inverted) + i, 0x400, registers[2 + i]);
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+class Cartridge;
+
+// The mappers only keep their registers, the Cartridge switches the banks they select. Each one has reset(), called
+// when the cartridge is inserted, and write() for the registers at $8000-$FFFF.
+// See https://www.nesdev.org/wiki/Mapper
+
+// Mapper 0: 16KB PRG ROM mirrored at $C000 or 32KB, and 8KB CHR. Nothing to switch.
+struct Nrom
+{
+    void reset(Cartridge &cartridge);
+    void write(Cartridge &cartridge, unsigned short address, unsigned char value) {}
+};
+
+// Mapper 1: registers are written one bit at a time through a shift register, the address of the fifth write
+// selects the register.
+struct Mmc1
+{
+    unsigned char shift = 0x10; // The register is complete when the 1 reaches bit 0
+    unsigned char control = 0x0c; // Last PRG bank fixed at $C000
+    unsigned char chrBank0 = 0;
+    unsigned char chrBank1 = 0;
+    unsigned char prgBank = 0;
+
+    void reset(Cartridge &cartridge);
+    void write(Cartridge &cartridge, unsigned short address, unsigned char value);
+
+private:
+    void apply(Cartridge &cartridge);
+};
+
+// Mapper 2: switchable 16KB PRG ROM at $8000, the last bank is fixed at $C000.
+struct UxRom
+{
+    void reset(Cartridge &cartridge);
+    void write(Cartridge &cartridge, unsigned short address, unsigned char value);
+};
+
+// Mapper 3: fixed PRG ROM like NROM, switchable 8KB CHR.
+struct CnRom
+{
+    void reset(Cartridge &cartridge);
+    void write(Cartridge &cartridge, unsigned short address, unsigned char value);
+};
+
+// Mapper 7: switchable 32KB PRG ROM, and single screen mirroring of either nametable.
+struct AxRom
+{
+    void reset(Cartridge &cartridge);
+    void write(Cartridge &cartridge, unsigned short address, unsigned char value);
+};
+
+// Mapper 4: 8KB PRG and 1-2KB CHR banks selected through 8 bank registers, and a counter that raises an IRQ after a
+// number of scanlines.
+struct Mmc3
+{
+    unsigned char bankSelect = 0;
+    unsigned char registers[8] = {0, 2, 4, 5, 6, 7, 0, 1};
+    unsigned char irqLatch = 0;
+    unsigned char irqCounter = 0;
+    bool irqReload = false;
+    bool irqEnabled = false;
+    bool irqPending = false;
+
+    void reset(Cartridge &cartridge);
+    void write(Cartridge &cartridge, unsigned short address, unsigned char value);
+    // Clocked by the PPU once per rendered scanline.
+    void clockScanline();
+
+private:
+    void apply(Cartridge &cartridge);
+};
@@ -0,0 +1,26 @@
+#pragma once
+
+// How the 2 nametables of the PPU fill its 4 nametable slots.
+enum Mirroring
+{
+    HORIZONTAL,
+    VERTICAL,
+    SINGLE_SCREEN_LOWER,
+    SINGLE_SCREEN_UPPER,
+    FOUR_SCREEN
+};
+
+// The memory of a cartridge as described by its iNES header. The data isn't copied, it is owned by the Rom or by
+// whoever made the image.
+struct RomImage
+{
+    int mapper;
+    Mirroring mirroring;
+    const unsigned char *prg;
+    int prgSize;
+    const unsigned char *chr; // NULL when the cartridge has CHR RAM
+    int chrSize;
+    const unsigned char *trainer = NULL; // 512 bytes for $7000, NULL when there is none
+    int prgRamSize = 0x2000; // Including battery backed RAM
+    int chrRamSize = 0x2000; // Only used without CHR ROM
+};
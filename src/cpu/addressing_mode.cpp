@@ -1,3 +1,5 @@
+#pragma once
+
 enum AddressingMode
 {
     IMPLIED,
@@ -11,5 +13,6 @@ enum AddressingMode
     INDIRECT,
     INDEXED_INDIRECT, // Indirect X
     INDIRECT_INDEXED, // Indirect Y
-    ACCUMULATOR
-};
\ No newline at end of file
+    ACCUMULATOR,
+    RELATIVE // Branches
+};
@@ -0,0 +1,259 @@
+#include <algorithm>
+#include <cstring>
+
+#include "block_cache.h"
+#include "cpu.h"
+
+BlockCache::BlockCache(Bus *bus) : bus(bus)
+{
+    // Never grown, blocks and instructions are referenced by pointer
+    blocks.reserve(MAX_BLOCKS);
+    decoded.reserve(MAX_DECODED);
+    bus->setWriteWatcher(this);
+}
+
+BlockCache::~BlockCache()
+{
+    bus->setWriteWatcher(NULL);
+}
+
+Block *BlockCache::get(unsigned short pc)
+{
+    Block **page = lookup[pc >> 8].get();
+    if (page && page[pc & 0xff])
+    {
+        hits++;
+        return page[pc & 0xff];
+    }
+
+    misses++;
+    return decode(pc);
+}
+
+static bool endsBlock(unsigned char opCode)
+{
+    switch (opCode)
+    {
+    case 0x00: // BRK
+    case 0x20: // JSR
+    case 0x40: // RTI
+    case 0x4c: // JMP absolute
+    case 0x60: // RTS
+    case 0x6c: // JMP indirect
+        return true;
+    default:
+        return Cpu::OPCODES[opCode].mode == RELATIVE;
+    }
+}
+
+// False for instructions that only read memory and change registers or flags, repeating these can't change memory.
+static bool hasSideEffects(const OpCode &op)
+{
+    static const char *const names[] = {
+        "LDA", "LDX", "LDY", "*LAX", "*LAS", "CMP", "CPX", "CPY", "BIT",
+        "ADC", "SBC", "*SBC", "AND", "ORA", "EOR", "*ANC", "*ALR", "*ARR",
+        "TAX", "TAY", "TXA", "TYA", "TSX", "TXS", "INX", "INY", "DEX", "DEY",
+        "CLC", "SEC", "CLI", "SEI", "CLV", "CLD", "SED", "NOP", "*NOP", "JMP"};
+
+    if (op.mode == RELATIVE || op.mode == ACCUMULATOR) // Branches and shifts of A
+        return false;
+    for (const char *name : names)
+        if (strcmp(op.name, name) == 0)
+            return false;
+    return true;
+}
+
+// hasSideEffects() for every opcode, looked up while decoding.
+static bool withoutSideEffects(unsigned char opCode)
+{
+    static const std::vector<bool> pure = [] {
+        std::vector<bool> pure(256);
+        for (int i = 0; i < 256; i++)
+            pure[i] = !hasSideEffects(Cpu::OPCODES[i]);
+        return pure;
+    }();
+    return pure[opCode];
+}
+
+// Whether the instruction can read a page of memory mapped I/O. The target of indirect modes is only known when they
+// run, so these count as I/O. Zero page is RAM.
+static bool readsIo(const DecodedInstruction &instruction, Bus *bus)
+{
+    switch (Cpu::OPCODES[instruction.opCode].mode)
+    {
+    case ABSOLUTE:
+        return instruction.opCode != 0x4c && instruction.opCode != 0x20 && bus->isIo(instruction.operand);
+    case ABSOLUTE_X:
+    case ABSOLUTE_Y:
+        return bus->isIo(instruction.operand) || bus->isIo(instruction.operand + 0xff);
+    case INDIRECT:
+    case INDEXED_INDIRECT:
+    case INDIRECT_INDEXED:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Index in FUSED_PAIRS, or -1.
+static int fusedPair(unsigned char first, unsigned char second)
+{
+    for (int i = 0; i < FUSED_PAIR_COUNT; i++)
+        if (FUSED_PAIRS[i].first == first && FUSED_PAIRS[i].second == second)
+            return i;
+    return -1;
+}
+
+Block *BlockCache::decode(unsigned short pc)
+{
+    // Flushing here is safe, the block returned by the previous get() is no longer running
+    if (blocks.size() == MAX_BLOCKS || decoded.size() + Block::MAX_INSTRUCTIONS > MAX_DECODED)
+        flush();
+
+    size_t first = decoded.size();
+    unsigned int address = pc;
+    bool secondOfPair = false;
+    while (decoded.size() - first < Block::MAX_INSTRUCTIONS)
+    {
+        unsigned char opCode = bus->read(address);
+        const OpCode &op = Cpu::OPCODES[opCode];
+        if (address + op.bytes > 0xffff)
+            break; // Don't wrap around the address space
+
+        DecodedInstruction instruction;
+        instruction.execute = op.execute;
+        instruction.operand = op.bytes == 3 ? bus->read_16(address + 1) : op.bytes == 2 ? bus->read(address + 1) : 0;
+        instruction.nextPc = address + op.bytes;
+        instruction.opCode = opCode;
+        instruction.cycles = op.cycles;
+        instruction.pageCrossPenalty = op.pageCrossPenalty;
+        instruction.handler = opCode;
+
+        // Pairs don't overlap, the previous instruction can't be fused when it is the second of a pair itself
+        bool canFuse = decoded.size() > first && !secondOfPair;
+        int pair = fusion && canFuse ? fusedPair(decoded.back().opCode, opCode) : -1;
+        if (pair >= 0)
+            decoded.back().handler = 256 + pair;
+        secondOfPair = pair >= 0;
+        decoded.push_back(instruction);
+
+        address += op.bytes;
+        if (endsBlock(opCode))
+            break;
+    }
+
+    // An instruction that does not fit before the end of memory is left to the interpreter
+    if (decoded.size() == first)
+        return NULL;
+
+    blocks.push_back(Block());
+    Block *block = &blocks.back();
+    block->start = pc;
+    block->end = address;
+    block->valid = true;
+    block->count = decoded.size() - first;
+    block->instructions = &decoded[first];
+    block->entry = block->instructions[0].handler;
+    block->maxCycles = 0;
+    block->readsIo = false;
+    block->runs = 0;
+    block->code = NULL;
+
+    bool idleCandidate = idleLoops;
+    for (int i = 0; i < block->count; i++)
+    {
+        const DecodedInstruction &instruction = block->instructions[i];
+        block->maxCycles += instruction.cycles + instruction.pageCrossPenalty;
+        block->readsIo = block->readsIo || readsIo(instruction, bus);
+        idleCandidate = idleCandidate && withoutSideEffects(instruction.opCode);
+    }
+
+    const DecodedInstruction &last = block->instructions[block->count - 1];
+    if (Cpu::OPCODES[last.opCode].mode == RELATIVE)
+    {
+        block->maxCycles += 2; // Taken to another page
+        idleCandidate = idleCandidate && (unsigned short) (last.nextPc + (signed char) last.operand) == pc;
+    }
+    else
+    {
+        idleCandidate = idleCandidate && last.opCode == 0x4c && last.operand == pc; // JMP to itself
+    }
+    if (idleCandidate)
+        block->entry = IDLE_LOOP_ENTRY;
+
+    for (unsigned int page = block->start >> 8; page <= (unsigned int) (block->end - 1) >> 8; page++)
+    {
+        pageBlocks[page].push_back(block);
+        bus->watch(page);
+    }
+
+    std::unique_ptr<Block *[]> &page = lookup[pc >> 8];
+    if (!page)
+        page.reset(new Block *[256]());
+    page[pc & 0xff] = block;
+    return block;
+}
+
+void BlockCache::setFusion(bool enabled)
+{
+    fusion = enabled;
+    flush();
+}
+
+void BlockCache::setIdleLoopDetection(bool enabled)
+{
+    idleLoops = enabled;
+    flush();
+}
+
+void BlockCache::written(unsigned short address)
+{
+    std::vector<Block *> &candidates = pageBlocks[address >> 8];
+    for (size_t i = 0; i < candidates.size();)
+    {
+        Block *block = candidates[i];
+        if (address >= block->start && address < block->end)
+            retire(block); // Removes it from candidates
+        else
+            i++;
+    }
+}
+
+void BlockCache::remapped(unsigned char page)
+{
+    std::vector<Block *> &covering = pageBlocks[page];
+    while (!covering.empty())
+        retire(covering.back()); // Removes it from covering
+}
+
+// The memory of a retired block is only reused after the next flush.
+void BlockCache::retire(Block *block)
+{
+    invalidations++;
+    block->valid = false;
+
+    for (unsigned int page = block->start >> 8; page <= (unsigned int) (block->end - 1) >> 8; page++)
+    {
+        std::vector<Block *> &covering = pageBlocks[page];
+        covering.erase(std::find(covering.begin(), covering.end(), block));
+        bus->unwatch(page);
+    }
+
+    lookup[block->start >> 8][block->start & 0xff] = NULL;
+}
+
+void BlockCache::flush()
+{
+    flushes++;
+
+    for (int page = 0; page < 256; page++)
+    {
+        for (size_t i = 0; i < pageBlocks[page].size(); i++)
+            bus->unwatch(page);
+        pageBlocks[page].clear();
+        lookup[page].reset();
+    }
+
+    blocks.clear();
+    decoded.clear();
+}
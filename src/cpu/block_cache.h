@@ -0,0 +1,99 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "../bus.h"
+#include "opcode.h"
+
+class Cpu;
+
+// Machine code for a block, runs its first instructions and returns how many. See Jit.
+typedef int (*CompiledBlock)(Cpu *cpu);
+
+// An instruction with its operand already read from memory.
+struct DecodedInstruction
+{
+    void (Cpu::*execute)();
+    unsigned short operand;
+    unsigned short nextPc;
+    unsigned char opCode;
+    unsigned char cycles; // Base cycles, without page cross and branch penalties
+    bool pageCrossPenalty;
+    unsigned short handler; // opCode, or 256 + index in FUSED_PAIRS when fused with the next instruction
+};
+
+// Straight line code up to and including the first instruction that can change pc (branch, jump, return, BRK).
+struct Block
+{
+    static const int MAX_INSTRUCTIONS = 32;
+
+    unsigned short start;
+    unsigned short end; // One past the last byte
+    bool valid;         // Cleared when the code is overwritten
+    unsigned char count;
+    const DecodedInstruction *instructions;
+    unsigned short entry;     // Handler to start with: the first instruction, or IDLE_LOOP_ENTRY
+    unsigned short maxCycles; // Upper bound of the cycles of the whole block, with every penalty
+    bool readsIo;             // Can read memory mapped I/O, e.g. poll a status register
+    unsigned int runs;        // Times the block was entered while the JIT is enabled
+    CompiledBlock code;       // NULL until the JIT translated the block
+};
+
+// Decoded basic blocks keyed by their start address.
+// Writes to memory covered by a block invalidate it, so self-modifying code keeps working. So does switching the bank
+// of a page it covers.
+// Blocks and their instructions are taken from fixed size buffers, when one is full the whole cache is flushed.
+// Pairs in FUSED_PAIRS are marked for fusion, only the computed goto block runner (NES_THREADED_DISPATCH) fuses them.
+// A block that branches back to its own start without writing memory or using the stack starts with
+// IDLE_LOOP_ENTRY, the Cpu then checks whether it is waiting in an idle loop. Reading a device can have side effects,
+// so blocks that can read I/O are marked, see Cpu::setStableIo().
+class BlockCache : public WriteWatcher
+{
+public:
+    static const int MAX_BLOCKS = 8192;
+    static const int MAX_DECODED = 8 * MAX_BLOCKS;
+    static const unsigned short IDLE_LOOP_ENTRY = 256 + FUSED_PAIR_COUNT;
+
+    BlockCache(Bus *bus);
+    ~BlockCache();
+
+    // Returns the block starting at pc, it is decoded on a miss.
+    // The returned block stays readable until the next call, even when invalidated in between.
+    Block *get(unsigned short pc);
+
+    void written(unsigned short address) override;
+    void remapped(unsigned char page) override;
+
+    // Enabled by default, changing it flushes the cache.
+    void setFusion(bool enabled);
+    // Enabled by default, changing it flushes the cache.
+    void setIdleLoopDetection(bool enabled);
+
+    unsigned long long getHits() { return hits; }
+    unsigned long long getMisses() { return misses; }
+    unsigned long long getInvalidations() { return invalidations; }
+    unsigned long long getFlushes() { return flushes; }
+
+private:
+    Bus *bus;
+    bool fusion = true;
+    bool idleLoops = true;
+
+    std::vector<Block> blocks;
+    std::vector<DecodedInstruction> decoded;
+
+    // Two level table: high byte of the start address, then the low byte. Pages are allocated on first use.
+    std::unique_ptr<Block *[]> lookup[256];
+    // Valid blocks that cover (part of) each page, to find the blocks hit by a write.
+    std::vector<Block *> pageBlocks[256];
+
+    unsigned long long hits = 0;
+    unsigned long long misses = 0;
+    unsigned long long invalidations = 0;
+    unsigned long long flushes = 0;
+
+    Block *decode(unsigned short pc);
+    void retire(Block *block);
+    void flush();
+};
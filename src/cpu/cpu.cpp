@@ -1,796 +1,929 @@
 #include <algorithm>
 #include <bitset>
 #include <iostream>
+#include <limits>
 #include <sstream>
 
+#include "block_cache.h"
 #include "cpu.h"
 #include "execution_data.h"
+#include "jit.h"
+#include "opcode.h"
+#include "trace_sink.h"
+#include "translated_rom.h"
 #include "../bus.h"
 
-#define STOP_ON_BRK
-// #define NES_LOG_TEST
-#define INSTRUCTIONS_TEST
-
+// Name, addressing mode, handler, bytes, base cycles, extra cycle on page cross, official.
+// Cycles: https://www.masswerk.at/6502/6502_instruction_set.html
+constexpr OpCode Cpu::OPCODES[256] = {
+    {"BRK", IMPLIED, &Cpu::brk, 1, 7, false, true},                                    // 0x00
+    {"ORA", INDEXED_INDIRECT, &Cpu::ora<INDEXED_INDIRECT>, 2, 6, false, true},         // 0x01
+    {"*NOP", IMPLIED, &Cpu::nop<IMPLIED>, 1, 2, false, false},                         // 0x02
+    {"*SLO", INDEXED_INDIRECT, &Cpu::slo<INDEXED_INDIRECT>, 2, 8, false, false},       // 0x03
+    {"*NOP", ZERO_PAGE, &Cpu::nop<ZERO_PAGE>, 2, 3, false, false},                     // 0x04
+    {"ORA", ZERO_PAGE, &Cpu::ora<ZERO_PAGE>, 2, 3, false, true},                       // 0x05
+    {"ASL", ZERO_PAGE, &Cpu::modify<&Cpu::asl<ZERO_PAGE>>, 2, 5, false, true},         // 0x06
+    {"*SLO", ZERO_PAGE, &Cpu::slo<ZERO_PAGE>, 2, 5, false, false},                     // 0x07
+    {"PHP", IMPLIED, &Cpu::php, 1, 3, false, true},                                    // 0x08
+    {"ORA", IMMEDIATE, &Cpu::ora<IMMEDIATE>, 2, 2, false, true},                       // 0x09
+    {"ASL", ACCUMULATOR, &Cpu::modify<&Cpu::asl<ACCUMULATOR>>, 1, 2, false, true},     // 0x0a
+    {"*ANC", IMMEDIATE, &Cpu::anc<IMMEDIATE>, 2, 2, false, false},                     // 0x0b
+    {"*NOP", ABSOLUTE, &Cpu::nop<ABSOLUTE>, 3, 4, false, false},                       // 0x0c
+    {"ORA", ABSOLUTE, &Cpu::ora<ABSOLUTE>, 3, 4, false, true},                         // 0x0d
+    {"ASL", ABSOLUTE, &Cpu::modify<&Cpu::asl<ABSOLUTE>>, 3, 6, false, true},           // 0x0e
+    {"*SLO", ABSOLUTE, &Cpu::slo<ABSOLUTE>, 3, 6, false, false},                       // 0x0f
+    {"BPL", RELATIVE, &Cpu::bpl, 2, 2, false, true},                                   // 0x10
+    {"ORA", INDIRECT_INDEXED, &Cpu::ora<INDIRECT_INDEXED>, 2, 5, true, true},          // 0x11
+    {"*NOP", IMPLIED, &Cpu::nop<IMPLIED>, 1, 2, false, false},                         // 0x12
+    {"*SLO", INDIRECT_INDEXED, &Cpu::slo<INDIRECT_INDEXED>, 2, 8, false, false},       // 0x13
+    {"*NOP", ZERO_PAGE_X, &Cpu::nop<ZERO_PAGE_X>, 2, 4, false, false},                 // 0x14
+    {"ORA", ZERO_PAGE_X, &Cpu::ora<ZERO_PAGE_X>, 2, 4, false, true},                   // 0x15
+    {"ASL", ZERO_PAGE_X, &Cpu::modify<&Cpu::asl<ZERO_PAGE_X>>, 2, 6, false, true},     // 0x16
+    {"*SLO", ZERO_PAGE_X, &Cpu::slo<ZERO_PAGE_X>, 2, 6, false, false},                 // 0x17
+    {"CLC", IMPLIED, &Cpu::clc, 1, 2, false, true},                                    // 0x18
+    {"ORA", ABSOLUTE_Y, &Cpu::ora<ABSOLUTE_Y>, 3, 4, true, true},                      // 0x19
+    {"*NOP", IMPLIED, &Cpu::nop<IMPLIED>, 1, 2, false, false},                         // 0x1a
+    {"*SLO", ABSOLUTE_Y, &Cpu::slo<ABSOLUTE_Y>, 3, 7, false, false},                   // 0x1b
+    {"*NOP", ABSOLUTE_X, &Cpu::nop<ABSOLUTE_X>, 3, 4, true, false},                    // 0x1c
+    {"ORA", ABSOLUTE_X, &Cpu::ora<ABSOLUTE_X>, 3, 4, true, true},                      // 0x1d
+    {"ASL", ABSOLUTE_X, &Cpu::modify<&Cpu::asl<ABSOLUTE_X>>, 3, 7, false, true},       // 0x1e
+    {"*SLO", ABSOLUTE_X, &Cpu::slo<ABSOLUTE_X>, 3, 7, false, false},                   // 0x1f
+    {"JSR", ABSOLUTE, &Cpu::jsr, 3, 6, false, true},                                   // 0x20
+    {"AND", INDEXED_INDIRECT, &Cpu::andOp<INDEXED_INDIRECT>, 2, 6, false, true},       // 0x21
+    {"*NOP", IMPLIED, &Cpu::nop<IMPLIED>, 1, 2, false, false},                         // 0x22
+    {"*RLA", INDEXED_INDIRECT, &Cpu::rla<INDEXED_INDIRECT>, 2, 8, false, false},       // 0x23
+    {"BIT", ZERO_PAGE, &Cpu::bit<ZERO_PAGE>, 2, 3, false, true},                       // 0x24
+    {"AND", ZERO_PAGE, &Cpu::andOp<ZERO_PAGE>, 2, 3, false, true},                     // 0x25
+    {"ROL", ZERO_PAGE, &Cpu::modify<&Cpu::rol<ZERO_PAGE>>, 2, 5, false, true},         // 0x26
+    {"*RLA", ZERO_PAGE, &Cpu::rla<ZERO_PAGE>, 2, 5, false, false},                     // 0x27
+    {"PLP", IMPLIED, &Cpu::plp, 1, 4, false, true},                                    // 0x28
+    {"AND", IMMEDIATE, &Cpu::andOp<IMMEDIATE>, 2, 2, false, true},                     // 0x29
+    {"ROL", ACCUMULATOR, &Cpu::modify<&Cpu::rol<ACCUMULATOR>>, 1, 2, false, true},     // 0x2a
+    {"*ANC", IMMEDIATE, &Cpu::anc<IMMEDIATE>, 2, 2, false, false},                     // 0x2b
+    {"BIT", ABSOLUTE, &Cpu::bit<ABSOLUTE>, 3, 4, false, true},                         // 0x2c
+    {"AND", ABSOLUTE, &Cpu::andOp<ABSOLUTE>, 3, 4, false, true},                       // 0x2d
+    {"ROL", ABSOLUTE, &Cpu::modify<&Cpu::rol<ABSOLUTE>>, 3, 6, false, true},           // 0x2e
+    {"*RLA", ABSOLUTE, &Cpu::rla<ABSOLUTE>, 3, 6, false, false},                       // 0x2f
+    {"BMI", RELATIVE, &Cpu::bmi, 2, 2, false, true},                                   // 0x30
+    {"AND", INDIRECT_INDEXED, &Cpu::andOp<INDIRECT_INDEXED>, 2, 5, true, true},        // 0x31
+    {"*NOP", IMPLIED, &Cpu::nop<IMPLIED>, 1, 2, false, false},                         // 0x32
+    {"*RLA", INDIRECT_INDEXED, &Cpu::rla<INDIRECT_INDEXED>, 2, 8, false, false},       // 0x33
+    {"*NOP", ZERO_PAGE_X, &Cpu::nop<ZERO_PAGE_X>, 2, 4, false, false},                 // 0x34
+    {"AND", ZERO_PAGE_X, &Cpu::andOp<ZERO_PAGE_X>, 2, 4, false, true},                 // 0x35
+    {"ROL", ZERO_PAGE_X, &Cpu::modify<&Cpu::rol<ZERO_PAGE_X>>, 2, 6, false, true},     // 0x36
+    {"*RLA", ZERO_PAGE_X, &Cpu::rla<ZERO_PAGE_X>, 2, 6, false, false},                 // 0x37
+    {"SEC", IMPLIED, &Cpu::sec, 1, 2, false, true},                                    // 0x38
+    {"AND", ABSOLUTE_Y, &Cpu::andOp<ABSOLUTE_Y>, 3, 4, true, true},                    // 0x39
+    {"*NOP", IMPLIED, &Cpu::nop<IMPLIED>, 1, 2, false, false},                         // 0x3a
+    {"*RLA", ABSOLUTE_Y, &Cpu::rla<ABSOLUTE_Y>, 3, 7, false, false},                   // 0x3b
+    {"*NOP", ABSOLUTE_X, &Cpu::nop<ABSOLUTE_X>, 3, 4, true, false},                    // 0x3c
+    {"AND", ABSOLUTE_X, &Cpu::andOp<ABSOLUTE_X>, 3, 4, true, true},                    // 0x3d
+    {"ROL", ABSOLUTE_X, &Cpu::modify<&Cpu::rol<ABSOLUTE_X>>, 3, 7, false, true},       // 0x3e
+    {"*RLA", ABSOLUTE_X, &Cpu::rla<ABSOLUTE_X>, 3, 7, false, false},                   // 0x3f
+    {"RTI", IMPLIED, &Cpu::rti, 1, 6, false, true},                                    // 0x40
+    {"EOR", INDEXED_INDIRECT, &Cpu::eor<INDEXED_INDIRECT>, 2, 6, false, true},         // 0x41
+    {"*NOP", IMPLIED, &Cpu::nop<IMPLIED>, 1, 2, false, false},                         // 0x42
+    {"*SRE", INDEXED_INDIRECT, &Cpu::sre<INDEXED_INDIRECT>, 2, 8, false, false},       // 0x43
+    {"*NOP", ZERO_PAGE, &Cpu::nop<ZERO_PAGE>, 2, 3, false, false},                     // 0x44
+    {"EOR", ZERO_PAGE, &Cpu::eor<ZERO_PAGE>, 2, 3, false, true},                       // 0x45
+    {"LSR", ZERO_PAGE, &Cpu::modify<&Cpu::lsr<ZERO_PAGE>>, 2, 5, false, true},         // 0x46
+    {"*SRE", ZERO_PAGE, &Cpu::sre<ZERO_PAGE>, 2, 5, false, false},                     // 0x47
+    {"PHA", IMPLIED, &Cpu::pha, 1, 3, false, true},                                    // 0x48
+    {"EOR", IMMEDIATE, &Cpu::eor<IMMEDIATE>, 2, 2, false, true},                       // 0x49
+    {"LSR", ACCUMULATOR, &Cpu::modify<&Cpu::lsr<ACCUMULATOR>>, 1, 2, false, true},     // 0x4a
+    {"*ALR", IMMEDIATE, &Cpu::alr<IMMEDIATE>, 2, 2, false, false},                     // 0x4b
+    {"JMP", ABSOLUTE, &Cpu::jmp<ABSOLUTE>, 3, 3, false, true},                         // 0x4c
+    {"EOR", ABSOLUTE, &Cpu::eor<ABSOLUTE>, 3, 4, false, true},                         // 0x4d
+    {"LSR", ABSOLUTE, &Cpu::modify<&Cpu::lsr<ABSOLUTE>>, 3, 6, false, true},           // 0x4e
+    {"*SRE", ABSOLUTE, &Cpu::sre<ABSOLUTE>, 3, 6, false, false},                       // 0x4f
+    {"BVC", RELATIVE, &Cpu::bvc, 2, 2, false, true},                                   // 0x50
+    {"EOR", INDIRECT_INDEXED, &Cpu::eor<INDIRECT_INDEXED>, 2, 5, true, true},          // 0x51
+    {"*NOP", IMPLIED, &Cpu::nop<IMPLIED>, 1, 2, false, false},                         // 0x52
+    {"*SRE", INDIRECT_INDEXED, &Cpu::sre<INDIRECT_INDEXED>, 2, 8, false, false},       // 0x53
+    {"*NOP", ZERO_PAGE_X, &Cpu::nop<ZERO_PAGE_X>, 2, 4, false, false},                 // 0x54
+    {"EOR", ZERO_PAGE_X, &Cpu::eor<ZERO_PAGE_X>, 2, 4, false, true},                   // 0x55
+    {"LSR", ZERO_PAGE_X, &Cpu::modify<&Cpu::lsr<ZERO_PAGE_X>>, 2, 6, false, true},     // 0x56
+    {"*SRE", ZERO_PAGE_X, &Cpu::sre<ZERO_PAGE_X>, 2, 6, false, false},                 // 0x57
+    {"CLI", IMPLIED, &Cpu::cli, 1, 2, false, true},                                    // 0x58
+    {"EOR", ABSOLUTE_Y, &Cpu::eor<ABSOLUTE_Y>, 3, 4, true, true},                      // 0x59
+    {"*NOP", IMPLIED, &Cpu::nop<IMPLIED>, 1, 2, false, false},                         // 0x5a
+    {"*SRE", ABSOLUTE_Y, &Cpu::sre<ABSOLUTE_Y>, 3, 7, false, false},                   // 0x5b
+    {"*NOP", ABSOLUTE_X, &Cpu::nop<ABSOLUTE_X>, 3, 4, true, false},                    // 0x5c
+    {"EOR", ABSOLUTE_X, &Cpu::eor<ABSOLUTE_X>, 3, 4, true, true},                      // 0x5d
+    {"LSR", ABSOLUTE_X, &Cpu::modify<&Cpu::lsr<ABSOLUTE_X>>, 3, 7, false, true},       // 0x5e
+    {"*SRE", ABSOLUTE_X, &Cpu::sre<ABSOLUTE_X>, 3, 7, false, false},                   // 0x5f
+    {"RTS", IMPLIED, &Cpu::rts, 1, 6, false, true},                                    // 0x60
+    {"ADC", INDEXED_INDIRECT, &Cpu::adc<INDEXED_INDIRECT>, 2, 6, false, true},         // 0x61
+    {"*NOP", IMPLIED, &Cpu::nop<IMPLIED>, 1, 2, false, false},                         // 0x62
+    {"*RRA", INDEXED_INDIRECT, &Cpu::rra<INDEXED_INDIRECT>, 2, 8, false, false},       // 0x63
+    {"*NOP", ZERO_PAGE, &Cpu::nop<ZERO_PAGE>, 2, 3, false, false},                     // 0x64
+    {"ADC", ZERO_PAGE, &Cpu::adc<ZERO_PAGE>, 2, 3, false, true},                       // 0x65
+    {"ROR", ZERO_PAGE, &Cpu::modify<&Cpu::ror<ZERO_PAGE>>, 2, 5, false, true},         // 0x66
+    {"*RRA", ZERO_PAGE, &Cpu::rra<ZERO_PAGE>, 2, 5, false, false},                     // 0x67
+    {"PLA", IMPLIED, &Cpu::pla, 1, 4, false, true},                                    // 0x68
+    {"ADC", IMMEDIATE, &Cpu::adc<IMMEDIATE>, 2, 2, false, true},                       // 0x69
+    {"ROR", ACCUMULATOR, &Cpu::modify<&Cpu::ror<ACCUMULATOR>>, 1, 2, false, true},     // 0x6a
+    {"*ARR", IMMEDIATE, &Cpu::arr<IMMEDIATE>, 2, 2, false, false},                     // 0x6b
+    {"JMP", INDIRECT, &Cpu::jmp<INDIRECT>, 3, 5, false, true},                         // 0x6c
+    {"ADC", ABSOLUTE, &Cpu::adc<ABSOLUTE>, 3, 4, false, true},                         // 0x6d
+    {"ROR", ABSOLUTE, &Cpu::modify<&Cpu::ror<ABSOLUTE>>, 3, 6, false, true},           // 0x6e
+    {"*RRA", ABSOLUTE, &Cpu::rra<ABSOLUTE>, 3, 6, false, false},                       // 0x6f
+    {"BVS", RELATIVE, &Cpu::bvs, 2, 2, false, true},                                   // 0x70
+    {"ADC", INDIRECT_INDEXED, &Cpu::adc<INDIRECT_INDEXED>, 2, 5, true, true},          // 0x71
+    {"*NOP", IMPLIED, &Cpu::nop<IMPLIED>, 1, 2, false, false},                         // 0x72
+    {"*RRA", INDIRECT_INDEXED, &Cpu::rra<INDIRECT_INDEXED>, 2, 8, false, false},       // 0x73
+    {"*NOP", ZERO_PAGE_X, &Cpu::nop<ZERO_PAGE_X>, 2, 4, false, false},                 // 0x74
+    {"ADC", ZERO_PAGE_X, &Cpu::adc<ZERO_PAGE_X>, 2, 4, false, true},                   // 0x75
+    {"ROR", ZERO_PAGE_X, &Cpu::modify<&Cpu::ror<ZERO_PAGE_X>>, 2, 6, false, true},     // 0x76
+    {"*RRA", ZERO_PAGE_X, &Cpu::rra<ZERO_PAGE_X>, 2, 6, false, false},                 // 0x77
+    {"SEI", IMPLIED, &Cpu::sei, 1, 2, false, true},                                    // 0x78
+    {"ADC", ABSOLUTE_Y, &Cpu::adc<ABSOLUTE_Y>, 3, 4, true, true},                      // 0x79
+    {"*NOP", IMPLIED, &Cpu::nop<IMPLIED>, 1, 2, false, false},                         // 0x7a
+    {"*RRA", ABSOLUTE_Y, &Cpu::rra<ABSOLUTE_Y>, 3, 7, false, false},                   // 0x7b
+    {"*NOP", ABSOLUTE_X, &Cpu::nop<ABSOLUTE_X>, 3, 4, true, false},                    // 0x7c
+    {"ADC", ABSOLUTE_X, &Cpu::adc<ABSOLUTE_X>, 3, 4, true, true},                      // 0x7d
+    {"ROR", ABSOLUTE_X, &Cpu::modify<&Cpu::ror<ABSOLUTE_X>>, 3, 7, false, true},       // 0x7e
+    {"*RRA", ABSOLUTE_X, &Cpu::rra<ABSOLUTE_X>, 3, 7, false, false},                   // 0x7f
+    {"*NOP", IMMEDIATE, &Cpu::nop<IMMEDIATE>, 2, 2, false, false},                     // 0x80
+    {"STA", INDEXED_INDIRECT, &Cpu::sta<INDEXED_INDIRECT>, 2, 6, false, true},         // 0x81
+    {"*NOP", IMMEDIATE, &Cpu::nop<IMMEDIATE>, 2, 2, false, false},                     // 0x82
+    {"*SAX", INDEXED_INDIRECT, &Cpu::sax<INDEXED_INDIRECT>, 2, 6, false, false},       // 0x83
+    {"STY", ZERO_PAGE, &Cpu::sty<ZERO_PAGE>, 2, 3, false, true},                       // 0x84
+    {"STA", ZERO_PAGE, &Cpu::sta<ZERO_PAGE>, 2, 3, false, true},                       // 0x85
+    {"STX", ZERO_PAGE, &Cpu::stx<ZERO_PAGE>, 2, 3, false, true},                       // 0x86
+    {"*SAX", ZERO_PAGE, &Cpu::sax<ZERO_PAGE>, 2, 3, false, false},                     // 0x87
+    {"DEY", IMPLIED, &Cpu::dey, 1, 2, false, true},                                    // 0x88
+    {"*NOP", IMMEDIATE, &Cpu::nop<IMMEDIATE>, 2, 2, false, false},                     // 0x89
+    {"TXA", IMPLIED, &Cpu::txa, 1, 2, false, true},                                    // 0x8a
+    {"*ANE", IMMEDIATE, &Cpu::unstable<0x8b>, 2, 2, false, false},                     // 0x8b
+    {"STY", ABSOLUTE, &Cpu::sty<ABSOLUTE>, 3, 4, false, true},                         // 0x8c
+    {"STA", ABSOLUTE, &Cpu::sta<ABSOLUTE>, 3, 4, false, true},                         // 0x8d
+    {"STX", ABSOLUTE, &Cpu::stx<ABSOLUTE>, 3, 4, false, true},                         // 0x8e
+    {"*SAX", ABSOLUTE, &Cpu::sax<ABSOLUTE>, 3, 4, false, false},                       // 0x8f
+    {"BCC", RELATIVE, &Cpu::bcc, 2, 2, false, true},                                   // 0x90
+    {"STA", INDIRECT_INDEXED, &Cpu::sta<INDIRECT_INDEXED>, 2, 6, false, true},         // 0x91
+    {"*NOP", IMPLIED, &Cpu::nop<IMPLIED>, 1, 2, false, false},                         // 0x92
+    {"*SHA", INDIRECT_INDEXED, &Cpu::unstable<0x93>, 2, 6, false, false},              // 0x93
+    {"STY", ZERO_PAGE_X, &Cpu::sty<ZERO_PAGE_X>, 2, 4, false, true},                   // 0x94
+    {"STA", ZERO_PAGE_X, &Cpu::sta<ZERO_PAGE_X>, 2, 4, false, true},                   // 0x95
+    {"STX", ZERO_PAGE_Y, &Cpu::stx<ZERO_PAGE_Y>, 2, 4, false, true},                   // 0x96
+    {"*SAX", ZERO_PAGE_Y, &Cpu::sax<ZERO_PAGE_Y>, 2, 4, false, false},                 // 0x97
+    {"TYA", IMPLIED, &Cpu::tya, 1, 2, false, true},                                    // 0x98
+    {"STA", ABSOLUTE_Y, &Cpu::sta<ABSOLUTE_Y>, 3, 5, false, true},                     // 0x99
+    {"TXS", IMPLIED, &Cpu::txs, 1, 2, false, true},                                    // 0x9a
+    {"*TAS", ABSOLUTE_Y, &Cpu::unstable<0x9b>, 3, 5, false, false},                    // 0x9b
+    {"*SHY", ABSOLUTE_X, &Cpu::unstable<0x9c>, 3, 5, false, false},                    // 0x9c
+    {"STA", ABSOLUTE_X, &Cpu::sta<ABSOLUTE_X>, 3, 5, false, true},                     // 0x9d
+    {"*SHX", ABSOLUTE_Y, &Cpu::unstable<0x9e>, 3, 5, false, false},                    // 0x9e
+    {"*SHA", ABSOLUTE_Y, &Cpu::unstable<0x9f>, 3, 5, false, false},                    // 0x9f
+    {"LDY", IMMEDIATE, &Cpu::ldy<IMMEDIATE>, 2, 2, false, true},                       // 0xa0
+    {"LDA", INDEXED_INDIRECT, &Cpu::lda<INDEXED_INDIRECT>, 2, 6, false, true},         // 0xa1
+    {"LDX", IMMEDIATE, &Cpu::ldx<IMMEDIATE>, 2, 2, false, true},                       // 0xa2
+    {"*LAX", INDEXED_INDIRECT, &Cpu::lax<INDEXED_INDIRECT>, 2, 6, false, false},       // 0xa3
+    {"LDY", ZERO_PAGE, &Cpu::ldy<ZERO_PAGE>, 2, 3, false, true},                       // 0xa4
+    {"LDA", ZERO_PAGE, &Cpu::lda<ZERO_PAGE>, 2, 3, false, true},                       // 0xa5
+    {"LDX", ZERO_PAGE, &Cpu::ldx<ZERO_PAGE>, 2, 3, false, true},                       // 0xa6
+    {"*LAX", ZERO_PAGE, &Cpu::lax<ZERO_PAGE>, 2, 3, false, false},                     // 0xa7
+    {"TAY", IMPLIED, &Cpu::tay, 1, 2, false, true},                                    // 0xa8
+    {"LDA", IMMEDIATE, &Cpu::lda<IMMEDIATE>, 2, 2, false, true},                       // 0xa9
+    {"TAX", IMPLIED, &Cpu::tax, 1, 2, false, true},                                    // 0xaa
+    {"*LXA", IMMEDIATE, &Cpu::unstable<0xab>, 2, 2, false, false},                     // 0xab
+    {"LDY", ABSOLUTE, &Cpu::ldy<ABSOLUTE>, 3, 4, false, true},                         // 0xac
+    {"LDA", ABSOLUTE, &Cpu::lda<ABSOLUTE>, 3, 4, false, true},                         // 0xad
+    {"LDX", ABSOLUTE, &Cpu::ldx<ABSOLUTE>, 3, 4, false, true},                         // 0xae
+    {"*LAX", ABSOLUTE, &Cpu::lax<ABSOLUTE>, 3, 4, false, false},                       // 0xaf
+    {"BCS", RELATIVE, &Cpu::bcs, 2, 2, false, true},                                   // 0xb0
+    {"LDA", INDIRECT_INDEXED, &Cpu::lda<INDIRECT_INDEXED>, 2, 5, true, true},          // 0xb1
+    {"*NOP", IMPLIED, &Cpu::nop<IMPLIED>, 1, 2, false, false},                         // 0xb2
+    {"*LAX", INDIRECT_INDEXED, &Cpu::lax<INDIRECT_INDEXED>, 2, 5, true, false},        // 0xb3
+    {"LDY", ZERO_PAGE_X, &Cpu::ldy<ZERO_PAGE_X>, 2, 4, false, true},                   // 0xb4
+    {"LDA", ZERO_PAGE_X, &Cpu::lda<ZERO_PAGE_X>, 2, 4, false, true},                   // 0xb5
+    {"LDX", ZERO_PAGE_Y, &Cpu::ldx<ZERO_PAGE_Y>, 2, 4, false, true},                   // 0xb6
+    {"*LAX", ZERO_PAGE_Y, &Cpu::lax<ZERO_PAGE_Y>, 2, 4, false, false},                 // 0xb7
+    {"CLV", IMPLIED, &Cpu::clv, 1, 2, false, true},                                    // 0xb8
+    {"LDA", ABSOLUTE_Y, &Cpu::lda<ABSOLUTE_Y>, 3, 4, true, true},                      // 0xb9
+    {"TSX", IMPLIED, &Cpu::tsx, 1, 2, false, true},                                    // 0xba
+    {"*LAS", ABSOLUTE_Y, &Cpu::las<ABSOLUTE_Y>, 3, 4, true, false},                    // 0xbb
+    {"LDY", ABSOLUTE_X, &Cpu::ldy<ABSOLUTE_X>, 3, 4, true, true},                      // 0xbc
+    {"LDA", ABSOLUTE_X, &Cpu::lda<ABSOLUTE_X>, 3, 4, true, true},                      // 0xbd
+    {"LDX", ABSOLUTE_Y, &Cpu::ldx<ABSOLUTE_Y>, 3, 4, true, true},                      // 0xbe
+    {"*LAX", ABSOLUTE_Y, &Cpu::lax<ABSOLUTE_Y>, 3, 4, true, false},                    // 0xbf
+    {"CPY", IMMEDIATE, &Cpu::cpy<IMMEDIATE>, 2, 2, false, true},                       // 0xc0
+    {"CMP", INDEXED_INDIRECT, &Cpu::cmp<INDEXED_INDIRECT>, 2, 6, false, true},         // 0xc1
+    {"*NOP", IMMEDIATE, &Cpu::nop<IMMEDIATE>, 2, 2, false, false},                     // 0xc2
+    {"*DCP", INDEXED_INDIRECT, &Cpu::dcp<INDEXED_INDIRECT>, 2, 8, false, false},       // 0xc3
+    {"CPY", ZERO_PAGE, &Cpu::cpy<ZERO_PAGE>, 2, 3, false, true},                       // 0xc4
+    {"CMP", ZERO_PAGE, &Cpu::cmp<ZERO_PAGE>, 2, 3, false, true},                       // 0xc5
+    {"DEC", ZERO_PAGE, &Cpu::modify<&Cpu::dec<ZERO_PAGE>>, 2, 5, false, true},         // 0xc6
+    {"*DCP", ZERO_PAGE, &Cpu::dcp<ZERO_PAGE>, 2, 5, false, false},                     // 0xc7
+    {"INY", IMPLIED, &Cpu::iny, 1, 2, false, true},                                    // 0xc8
+    {"CMP", IMMEDIATE, &Cpu::cmp<IMMEDIATE>, 2, 2, false, true},                       // 0xc9
+    {"DEX", IMPLIED, &Cpu::dex, 1, 2, false, true},                                    // 0xca
+    {"*SBX", IMMEDIATE, &Cpu::unknown<0xcb>, 2, 2, false, false},                      // 0xcb
+    {"CPY", ABSOLUTE, &Cpu::cpy<ABSOLUTE>, 3, 4, false, true},                         // 0xcc
+    {"CMP", ABSOLUTE, &Cpu::cmp<ABSOLUTE>, 3, 4, false, true},                         // 0xcd
+    {"DEC", ABSOLUTE, &Cpu::modify<&Cpu::dec<ABSOLUTE>>, 3, 6, false, true},           // 0xce
+    {"*DCP", ABSOLUTE, &Cpu::dcp<ABSOLUTE>, 3, 6, false, false},                       // 0xcf
+    {"BNE", RELATIVE, &Cpu::bne, 2, 2, false, true},                                   // 0xd0
+    {"CMP", INDIRECT_INDEXED, &Cpu::cmp<INDIRECT_INDEXED>, 2, 5, true, true},          // 0xd1
+    {"*NOP", IMPLIED, &Cpu::nop<IMPLIED>, 1, 2, false, false},                         // 0xd2
+    {"*DCP", INDIRECT_INDEXED, &Cpu::dcp<INDIRECT_INDEXED>, 2, 8, false, false},       // 0xd3
+    {"*NOP", ZERO_PAGE_X, &Cpu::nop<ZERO_PAGE_X>, 2, 4, false, false},                 // 0xd4
+    {"CMP", ZERO_PAGE_X, &Cpu::cmp<ZERO_PAGE_X>, 2, 4, false, true},                   // 0xd5
+    {"DEC", ZERO_PAGE_X, &Cpu::modify<&Cpu::dec<ZERO_PAGE_X>>, 2, 6, false, true},     // 0xd6
+    {"*DCP", ZERO_PAGE_X, &Cpu::dcp<ZERO_PAGE_X>, 2, 6, false, false},                 // 0xd7
+    {"CLD", IMPLIED, &Cpu::cld, 1, 2, false, true},                                    // 0xd8
+    {"CMP", ABSOLUTE_Y, &Cpu::cmp<ABSOLUTE_Y>, 3, 4, true, true},                      // 0xd9
+    {"*NOP", IMPLIED, &Cpu::nop<IMPLIED>, 1, 2, false, false},                         // 0xda
+    {"*DCP", ABSOLUTE_Y, &Cpu::dcp<ABSOLUTE_Y>, 3, 7, false, false},                   // 0xdb
+    {"*NOP", ABSOLUTE_X, &Cpu::nop<ABSOLUTE_X>, 3, 4, true, false},                    // 0xdc
+    {"CMP", ABSOLUTE_X, &Cpu::cmp<ABSOLUTE_X>, 3, 4, true, true},                      // 0xdd
+    {"DEC", ABSOLUTE_X, &Cpu::modify<&Cpu::dec<ABSOLUTE_X>>, 3, 7, false, true},       // 0xde
+    {"*DCP", ABSOLUTE_X, &Cpu::dcp<ABSOLUTE_X>, 3, 7, false, false},                   // 0xdf
+    {"CPX", IMMEDIATE, &Cpu::cpx<IMMEDIATE>, 2, 2, false, true},                       // 0xe0
+    {"SBC", INDEXED_INDIRECT, &Cpu::sbc<INDEXED_INDIRECT>, 2, 6, false, true},         // 0xe1
+    {"*NOP", IMMEDIATE, &Cpu::nop<IMMEDIATE>, 2, 2, false, false},                     // 0xe2
+    {"*ISB", INDEXED_INDIRECT, &Cpu::isb<INDEXED_INDIRECT>, 2, 8, false, false},       // 0xe3
+    {"CPX", ZERO_PAGE, &Cpu::cpx<ZERO_PAGE>, 2, 3, false, true},                       // 0xe4
+    {"SBC", ZERO_PAGE, &Cpu::sbc<ZERO_PAGE>, 2, 3, false, true},                       // 0xe5
+    {"INC", ZERO_PAGE, &Cpu::modify<&Cpu::inc<ZERO_PAGE>>, 2, 5, false, true},         // 0xe6
+    {"*ISB", ZERO_PAGE, &Cpu::isb<ZERO_PAGE>, 2, 5, false, false},                     // 0xe7
+    {"INX", IMPLIED, &Cpu::inx, 1, 2, false, true},                                    // 0xe8
+    {"SBC", IMMEDIATE, &Cpu::sbc<IMMEDIATE>, 2, 2, false, true},                       // 0xe9
+    {"NOP", IMPLIED, &Cpu::nop<IMPLIED>, 1, 2, false, true},                           // 0xea
+    {"*SBC", IMMEDIATE, &Cpu::sbc<IMMEDIATE>, 2, 2, false, false},                     // 0xeb
+    {"CPX", ABSOLUTE, &Cpu::cpx<ABSOLUTE>, 3, 4, false, true},                         // 0xec
+    {"SBC", ABSOLUTE, &Cpu::sbc<ABSOLUTE>, 3, 4, false, true},                         // 0xed
+    {"INC", ABSOLUTE, &Cpu::modify<&Cpu::inc<ABSOLUTE>>, 3, 6, false, true},           // 0xee
+    {"*ISB", ABSOLUTE, &Cpu::isb<ABSOLUTE>, 3, 6, false, false},                       // 0xef
+    {"BEQ", RELATIVE, &Cpu::beq, 2, 2, false, true},                                   // 0xf0
+    {"SBC", INDIRECT_INDEXED, &Cpu::sbc<INDIRECT_INDEXED>, 2, 5, true, true},          // 0xf1
+    {"*NOP", IMPLIED, &Cpu::nop<IMPLIED>, 1, 2, false, false},                         // 0xf2
+    {"*ISB", INDIRECT_INDEXED, &Cpu::isb<INDIRECT_INDEXED>, 2, 8, false, false},       // 0xf3
+    {"*NOP", ZERO_PAGE_X, &Cpu::nop<ZERO_PAGE_X>, 2, 4, false, false},                 // 0xf4
+    {"SBC", ZERO_PAGE_X, &Cpu::sbc<ZERO_PAGE_X>, 2, 4, false, true},                   // 0xf5
+    {"INC", ZERO_PAGE_X, &Cpu::modify<&Cpu::inc<ZERO_PAGE_X>>, 2, 6, false, true},     // 0xf6
+    {"*ISB", ZERO_PAGE_X, &Cpu::isb<ZERO_PAGE_X>, 2, 6, false, false},                 // 0xf7
+    {"SED", IMPLIED, &Cpu::sed, 1, 2, false, true},                                    // 0xf8
+    {"SBC", ABSOLUTE_Y, &Cpu::sbc<ABSOLUTE_Y>, 3, 4, true, true},                      // 0xf9
+    {"*NOP", IMPLIED, &Cpu::nop<IMPLIED>, 1, 2, false, false},                         // 0xfa
+    {"*ISB", ABSOLUTE_Y, &Cpu::isb<ABSOLUTE_Y>, 3, 7, false, false},                   // 0xfb
+    {"*NOP", ABSOLUTE_X, &Cpu::nop<ABSOLUTE_X>, 3, 4, true, false},                    // 0xfc
+    {"SBC", ABSOLUTE_X, &Cpu::sbc<ABSOLUTE_X>, 3, 4, true, true},                      // 0xfd
+    {"INC", ABSOLUTE_X, &Cpu::modify<&Cpu::inc<ABSOLUTE_X>>, 3, 7, false, true},       // 0xfe
+    {"*ISB", ABSOLUTE_X, &Cpu::isb<ABSOLUTE_X>, 3, 7, false, false},                   // 0xff
+};
+
+// Reads the operand bytes of the instruction at pc and moves pc to the next instruction.
+inline void Cpu::fetchOperand(unsigned char bytes)
+{
+    if (bytes == 2)
+        operand = bus->read(pc + 1);
+    else if (bytes == 3)
+        operand = bus->read_16(pc + 1);
+    pc += bytes;
+}
 
 // Called when new cartridge inserted
 void Cpu::resetInterrupt()
 {
-    pc = bus->read_16(bus->RESET_VECTOR_ADDR);
+    pc = entry >= 0 ? entry : bus->read_16(bus->RESET_VECTOR_ADDR);
+    cycles = 7; // The reset sequence takes 7 cycles
     resetState();
 }
 
+void Cpu::nmi()
+{
+    interrupt(bus->NMI_VECTOR_ADDR);
+}
+
+bool Cpu::irq()
+{
+    if (status & 0b0000'0100)
+        return false;
+    interrupt(bus->BREAK_VECTOR_ADDR);
+    return true;
+}
+
+// Like BRK, but the pushed status has the break flag cleared.
+void Cpu::interrupt(unsigned short vector)
+{
+    pushStack_16(pc);
+    pushStack((getStatus() & ~0b0001'0000) | 0b0010'0000);
+    status = status | 0b0000'0100;
+    pc = bus->read_16(vector);
+    cycles += 7;
+}
+
 // Reset flags and registers
 // https://wiki.nesdev.org/w/index.php/CPU_power_up_state
 void Cpu::resetState()
 {
-    status = 0x34;
-    #ifdef NES_LOG_TEST
-        status = 0x24; // Log of nestest differs from in the irrelevant bits 5 and 4
-    #endif
-    #ifdef INSTRUCTIONS_TEST
-        status = 0;
-    #endif
+    if (cpuMode == NESTEST_LOG)
+        setStatus(0x24); // Log of nestest differs in the irrelevant bits 5 and 4
+    else if (cpuMode == INSTRUCTION_TESTS)
+        setStatus(0);
+    else
+        setStatus(0x34);
+    loggedInstructions = 0;
     a = 0;
     x = 0;
     y = 0;
     sp = 0xfd;
 }
 
-void Cpu::run()
+void Cpu::reset()
 {
-    int i = 0;
     resetInterrupt();
+}
+
+void Cpu::run()
+{
+    reset();
+
+    TraceSink *sink = traceSink;
+    LogTraceSink logSink(std::cout);
+    if (cpuMode == NESTEST_LOG && traceSink == NULL)
+        traceSink = &logSink;
+
+    runCycles(std::numeric_limits<unsigned long long>::max() - cycles);
+    traceSink = sink;
+
+    if (cpuMode != NESTEST_LOG)
+        print(); // The log is the output
+}
+
+// Calls the instantiation of a run loop for the mode, and for whether there is a trace sink.
+#define CALL_FOR_MODE(function)                                                         \
+    switch (cpuMode)                                                                    \
+    {                                                                                   \
+    case NES_HARDWARE:                                                                  \
+        traceSink ? function<NES_HARDWARE, true>() : function<NES_HARDWARE, false>();   \
+        break;                                                                          \
+    case INSTRUCTION_TESTS:                                                             \
+        traceSink ? function<INSTRUCTION_TESTS, true>() : function<INSTRUCTION_TESTS, false>(); \
+        break;                                                                          \
+    case NESTEST_LOG:                                                                   \
+        traceSink ? function<NESTEST_LOG, true>() : function<NESTEST_LOG, false>();     \
+        break;                                                                          \
+    }
+
+unsigned long long Cpu::runCycles(unsigned long long budget)
+{
+    unsigned long long start = cycles;
+    end = start + budget;
+    CALL_FOR_MODE(runWith)
+    return cycles - start;
+}
+
+// Also called by the run loops for instructions they don't run themselves, so it keeps the end of their budget.
+int Cpu::step()
+{
+    unsigned long long start = cycles;
+    unsigned long long budgetEnd = end;
+    end = start + 1;
+    CALL_FOR_MODE(runLoop)
+    if (end != 0)
+        end = budgetEnd; // Unless the instruction called stop()
+    return cycles - start;
+}
+
+#undef CALL_FOR_MODE
+
+// Runs with the fastest way of running that is enabled.
+template <CpuMode mode, bool tracing>
+void Cpu::runWith()
+{
+    if (translated && !tracing)
+        runTranslated(); // Translated code doesn't record instructions
+    else if (blockCache)
+        runBlocks<mode, tracing>();
+    else
+    #ifdef NES_THREADED_DISPATCH
+        runThreaded<mode, tracing>();
+    #else
+        runLoop<mode, tracing>();
+    #endif
+}
+
+// Checked before every instruction.
+template <CpuMode mode, bool tracing>
+bool Cpu::halts(unsigned char opCode)
+{
+    if constexpr (mode == NESTEST_LOG && tracing)
+    {
+        if (loggedInstructions >= NESTEST_LOG_LENGTH)
+            return true;
+    }
+    return mode != NES_HARDWARE && opCode == 0x00;
+}
+
+// Passes the executed instruction to the trace sink.
+template <CpuMode mode, bool tracing>
+void Cpu::finishTrace()
+{
+    if constexpr (tracing)
+        traceSink->trace(execData);
+    if constexpr (mode == NESTEST_LOG && tracing)
+        loggedInstructions++;
+}
 
-    while (true)
+template <CpuMode mode, bool tracing>
+void Cpu::runLoop()
+{
+    while (cycles < end)
     {
-        execData = new ExecutionData();
         unsigned char opCode = bus->read(pc);
-        execData->pc = pc;
-        
-        #ifdef STOP_ON_BRK
-            if (opCode == 0x00) {
-                delete execData;
-                break;
-            }
-        #endif
-    
-        pc++;
-        execData->setRegisters(a, x, y, sp, status);
+        if (halts<mode, tracing>(opCode))
+            break;
+
+        if constexpr (tracing)
+            startTrace(opCode);
+
         execOpCode(opCode);
 
-        #ifdef NES_LOG_TEST
-            execData->logLine();
-        #endif
-        delete execData;
+        finishTrace<mode, tracing>();
+    }
+}
+
+#ifdef NES_THREADED_DISPATCH
+// Same as runLoop, but every handler is inlined behind its own label and jumps straight to the label of the next opcode
+// (GCC/Clang labels as values). Each opcode gets its own indirect jump, which the host branch predictor can learn per opcode.
+template <CpuMode mode, bool tracing>
+void Cpu::runThreaded()
+{
+    #define OPCODE_LABEL(opCode) &&op_##opCode,
+    static void *const labels[256] = { FOR_EACH_OPCODE(OPCODE_LABEL) };
+    #undef OPCODE_LABEL
+
+    unsigned char opCode;
+
+    #define DISPATCH()                      \
+        if (cycles >= end)                  \
+            return;                         \
+        opCode = bus->read(pc);             \
+        if (halts<mode, tracing>(opCode))   \
+            return;                         \
+        if constexpr (tracing)              \
+            startTrace(opCode);             \
+        goto *labels[opCode];
+
+    #define OPCODE_HANDLER(opCode)                  \
+        op_##opCode:                                \
+            fetchOperand(OPCODES[opCode].bytes);    \
+            (this->*OPCODES[opCode].execute)();     \
+            cycles += OPCODES[opCode].cycles;       \
+            if (OPCODES[opCode].pageCrossPenalty)   \
+                cycles += pageCrossed;              \
+            finishTrace<mode, tracing>();           \
+            DISPATCH()
+
+    DISPATCH()
+    FOR_EACH_OPCODE(OPCODE_HANDLER)
 
-        #ifdef NES_LOG_TEST
-            if (i++ > 8989)
-                exit(0);
-        #endif
+    #undef OPCODE_HANDLER
+    #undef DISPATCH
+}
+#endif
+
+// The Jit is only linked in with NES_JIT, without it jit stays NULL.
+static void deleteJit(Jit *jit)
+{
+    #ifdef NES_JIT
+        delete jit;
+    #endif
+}
+
+void Cpu::setBlockCache(bool enabled)
+{
+    deleteJit(jit);
+    jit = NULL;
+    delete blockCache;
+    blockCache = enabled ? new BlockCache(bus) : NULL;
+}
+
+bool Cpu::setJit(bool enabled)
+{
+    deleteJit(jit);
+    jit = NULL;
+    if (!enabled)
+        return true;
+
+    #ifdef NES_JIT
+        if (blockCache == NULL)
+            blockCache = new BlockCache(bus);
+        jit = new Jit(this, bus, blockCache);
+        if (jit->isAvailable())
+            return true;
+        delete jit;
+        jit = NULL;
+    #endif
+    return false;
+}
+
+Cpu::~Cpu()
+{
+    deleteJit(jit);
+    delete blockCache;
+}
+
+// Same as runLoop, but runs the pre-decoded instructions of a block one after the other.
+// A block is left early when the budget is spent or when it overwrote itself.
+// With NES_THREADED_DISPATCH the handlers are inlined behind labels like in runThreaded, and every handler looks up
+// the next block itself so that the jump into a block is predicted per opcode as well.
+// Fused pairs get a label of their own that runs both handlers, with the budget and block checked in between so
+// cycles stay exact. While tracing, the pair runs as two instructions to get a record for each.
+// Blocks that can be idle loops start with a check that fast-forwards them, see skipIdleLoop().
+// With the JIT enabled the machine code of a block runs first, the handlers continue where it exited, see runCompiled().
+template <CpuMode mode, bool tracing>
+void Cpu::runBlocks()
+{
+    Block *block;
+    const DecodedInstruction *instruction;
+    const DecodedInstruction *last;
+
+    #define START_INSTRUCTION()                             \
+        if (halts<mode, tracing>(instruction->opCode))      \
+            return;                                         \
+        if constexpr (tracing)                              \
+            startTrace(instruction->opCode);                \
+        operand = instruction->operand;                     \
+        pc = instruction->nextPc;
+
+    #define FINISH_INSTRUCTION()                \
+        finishTrace<mode, tracing>();
+
+#ifdef NES_THREADED_DISPATCH
+    #define BLOCK_LABEL(op) &&block_op_##op,
+    #define FUSED_LABEL(first, second) &&fused_##first##_##second,
+    static void *const labels[256 + FUSED_PAIR_COUNT + 1] = {
+        FOR_EACH_OPCODE(BLOCK_LABEL) FOR_EACH_FUSED_PAIR(FUSED_LABEL) &&idle_loop };
+    #undef FUSED_LABEL
+    #undef BLOCK_LABEL
+
+    #define ENTER_BLOCK()                                   \
+        if (cycles >= end)                                  \
+            return;                                         \
+        block = blockCache->get(pc);                        \
+        if (block == NULL)                                  \
+            goto interpret;                                 \
+        instruction = block->instructions;                  \
+        last = instruction + block->count;                  \
+        if (!tracing && jit)                                \
+            goto compiled;                                  \
+        START_INSTRUCTION()                                 \
+        goto *labels[block->entry];
+
+    #define EXECUTE(op)                                     \
+        (this->*OPCODES[op].execute)();                     \
+        cycles += OPCODES[op].cycles;                       \
+        if (OPCODES[op].pageCrossPenalty)                   \
+            cycles += pageCrossed;                          \
+        FINISH_INSTRUCTION()
+
+    #define NEXT_INSTRUCTION()                              \
+        if (++instruction == last || !block->valid)         \
+        {                                                   \
+            ENTER_BLOCK()                                   \
+        }                                                   \
+        if (cycles >= end)                                  \
+            return;                                         \
+        START_INSTRUCTION()                                 \
+        goto *labels[instruction->handler];
+
+    #define BLOCK_HANDLER(op)                               \
+        block_op_##op:                                      \
+            EXECUTE(op)                                     \
+            NEXT_INSTRUCTION()
+
+    #define FUSED_HANDLER(first, second)                    \
+        fused_##first##_##second:                           \
+            if constexpr (tracing)                          \
+                goto *labels[first];                        \
+            EXECUTE(first)                                  \
+            if (!block->valid || cycles >= end)             \
+            {                                               \
+                ENTER_BLOCK()                               \
+            }                                               \
+            instruction++;                                  \
+            operand = instruction->operand;                 \
+            pc = instruction->nextPc;                       \
+            EXECUTE(second)                                 \
+            NEXT_INSTRUCTION()
+
+    ENTER_BLOCK()
+
+interpret:
+    if (step() == 0)
+        return; // Stopped on BRK
+    ENTER_BLOCK()
+
+compiled:
+    instruction += runCompiled(block);
+    if (instruction == last)
+    {
+        ENTER_BLOCK()
+    }
+    START_INSTRUCTION()
+    goto *labels[instruction == block->instructions ? block->entry : instruction->handler];
+
+idle_loop:
+    if constexpr (!tracing)
+    {
+        if (skipIdleLoop(block))
+        {
+            ENTER_BLOCK()
+        }
+        operand = instruction->operand;
+        pc = instruction->nextPc;
     }
+    goto *labels[instruction->handler];
+
+    FOR_EACH_OPCODE(BLOCK_HANDLER)
+    FOR_EACH_FUSED_PAIR(FUSED_HANDLER)
+
+    #undef FUSED_HANDLER
+    #undef BLOCK_HANDLER
+    #undef NEXT_INSTRUCTION
+    #undef EXECUTE
+    #undef ENTER_BLOCK
+#else
+    while (cycles < end)
+    {
+        block = blockCache->get(pc);
+        if (block == NULL)
+        {
+            if (step() == 0)
+                return; // Stopped on BRK
+            continue;
+        }
 
-    print();
+        if (block->entry == BlockCache::IDLE_LOOP_ENTRY && !tracing && skipIdleLoop(block))
+            continue;
+
+        instruction = block->instructions;
+        last = instruction + block->count;
+        if (!tracing && jit)
+        {
+            instruction += runCompiled(block);
+            if (instruction == last)
+                continue;
+        }
+        do
+        {
+            START_INSTRUCTION()
+            (this->*instruction->execute)();
+            cycles += instruction->cycles;
+            if (instruction->pageCrossPenalty)
+                cycles += pageCrossed;
+            FINISH_INSTRUCTION()
+        }
+        while (++instruction != last && block->valid && cycles < end);
+    }
+#endif
+
+    #undef FINISH_INSTRUCTION
+    #undef START_INSTRUCTION
 }
 
-void Cpu::execOpCode(unsigned char opCode)
+// Runs the machine code of the block when the whole block fits in the budget, compiled code can't stop halfway.
+// Blocks are compiled once they ran Jit::THRESHOLD times. Not while tracing, which needs a record per instruction. Returns the number of instructions that ran.
+int Cpu::runCompiled(Block *block)
 {
-    execData->opCode = opCode;
+#ifdef NES_JIT
+    if (block->entry == BlockCache::IDLE_LOOP_ENTRY)
+        return 0; // Checked by skipIdleLoop() first
 
-    switch (opCode)
+    if (block->code == NULL)
     {
-    case 0x00:
-        execData->opCodeName = "BRK";
-        return brk();
-    case 0x01:
-        execData->opCodeName = "ORA";
-        return ora(INDEXED_INDIRECT);
-    case 0x05:
-        execData->opCodeName = "ORA";
-        return ora(ZERO_PAGE);
-    case 0x06:
-        execData->opCodeName = "ASL";
-        asl(ZERO_PAGE);
-        return;
-    case 0x08:
-        execData->opCodeName = "PHP";
-        return php();
-    case 0x09:
-        execData->opCodeName = "ORA";
-        return ora(IMMEDIATE);
-    case 0x0a:
-        execData->opCodeName = "ASL";
-        asl(ACCUMULATOR);
-        return;
-    case 0x0d:
-        execData->opCodeName = "ORA";
-        return ora(ABSOLUTE);
-    case 0x0e:
-        execData->opCodeName = "ASL";
-        asl(ABSOLUTE);
-        return;
-    case 0x10:
-        execData->opCodeName = "BPL";
-        return bpl();
-    case 0x11:
-        execData->opCodeName = "ORA";
-        return ora(INDIRECT_INDEXED);
-    case 0x15:
-        execData->opCodeName = "ORA";
-        return ora(ZERO_PAGE_X);
-    case 0x16:
-        execData->opCodeName = "ASL";
-        asl(ZERO_PAGE_X);
-        return;
-    case 0x18:
-        execData->opCodeName = "CLC";
-        return clc();
-    case 0x19:
-        execData->opCodeName = "ORA";
-        return ora(ABSOLUTE_Y);
-    case 0x1d:
-        execData->opCodeName = "ORA";
-        return ora(ABSOLUTE_X);
-    case 0x1e:
-        execData->opCodeName = "ASL";
-        asl(ABSOLUTE_X);
-        return;
-    case 0x20:
-        execData->opCodeName = "JSR";
-        return jsr();
-    case 0x21:
-        execData->opCodeName = "AND";
-        return andOp(INDEXED_INDIRECT);
-    case 0x24:
-        execData->opCodeName = "BIT";
-        return bit(ZERO_PAGE);
-    case 0x25:
-        execData->opCodeName = "AND";
-        return andOp(ZERO_PAGE);
-    case 0x26:
-        execData->opCodeName = "ROL";
-        rol(ZERO_PAGE);
-        return;
-    case 0x28:
-        execData->opCodeName = "PLP";
-        return plp();
-    case 0x29:
-        execData->opCodeName = "AND";
-        return andOp(IMMEDIATE);
-    case 0x2a:
-        execData->opCodeName = "ROL";
-        rol(ACCUMULATOR);
-        return;
-    case 0x2c:
-        execData->opCodeName = "BIT";
-        return bit(ABSOLUTE);
-    case 0x2d:
-        execData->opCodeName = "AND";
-        return andOp(ABSOLUTE);
-    case 0x2e:
-        execData->opCodeName = "ROL";
-        rol(ABSOLUTE);
-        return;
-    case 0x30:
-        execData->opCodeName = "BMI";
-        return bmi();
-    case 0x31:
-        execData->opCodeName = "AND";
-        return andOp(INDIRECT_INDEXED);
-    case 0x35:
-        execData->opCodeName = "AND";
-        return andOp(ZERO_PAGE_X);
-    case 0x36:
-        execData->opCodeName = "ROL";
-        rol(ZERO_PAGE_X);
-        return;
-    case 0x38:
-        execData->opCodeName = "SEC";
-        return sec();
-    case 0x39:
-        execData->opCodeName = "AND";
-        return andOp(ABSOLUTE_Y);
-    case 0x3d:
-        execData->opCodeName = "AND";
-        return andOp(ABSOLUTE_X);
-    case 0x3e:
-        execData->opCodeName = "ROL";
-        rol(ABSOLUTE_X);
-        return;
-    case 0x40:
-        execData->opCodeName = "RTI";
-        return rti();
-    case 0x41:
-        execData->opCodeName = "EOR";
-        return eor(INDEXED_INDIRECT);
-    case 0x45:
-        execData->opCodeName = "EOR";
-        return eor(ZERO_PAGE);
-    case 0x46:
-        execData->opCodeName = "LSR";
-        lsr(ZERO_PAGE);
-        return;
-    case 0x48:
-        execData->opCodeName = "PHA";
-        return pha();
-    case 0x49:
-        execData->opCodeName = "EOR";
-        return eor(IMMEDIATE);
-    case 0x4a:
-        execData->opCodeName = "LSR";
-        lsr(ACCUMULATOR);
-        return;
-    case 0x4c:
-        execData->opCodeName = "JMP";
-        return jmp(ABSOLUTE);
-    case 0x4d:
-        execData->opCodeName = "EOR";
-        return eor(ABSOLUTE);
-    case 0x4e:
-        execData->opCodeName = "LSR";
-        lsr(ABSOLUTE);
-        return;
-    case 0x50:
-        execData->opCodeName = "BVC";
-        return bvc();
-    case 0x51:
-        execData->opCodeName = "EOR";
-        return eor(INDIRECT_INDEXED);
-    case 0x55:
-        execData->opCodeName = "EOR";
-        return eor(ZERO_PAGE_X);
-    case 0x56:
-        execData->opCodeName = "LSR";
-        lsr(ZERO_PAGE_X);
-        return;
-    case 0x58:
-        execData->opCodeName = "CLI";
-        return cli();
-    case 0x59:
-        execData->opCodeName = "EOR";
-        return eor(ABSOLUTE_Y);
-    case 0x5d:
-        execData->opCodeName = "EOR";
-        return eor(ABSOLUTE_X);
-    case 0x5e:
-        execData->opCodeName = "LSR";
-        lsr(ABSOLUTE_X);
-        return;
-    case 0x60:
-        execData->opCodeName = "RTS";
-        return rts();
-    case 0x61:
-        execData->opCodeName = "ADC";
-        return adc(INDEXED_INDIRECT);
-    case 0x65:
-        execData->opCodeName = "ADC";
-        return adc(ZERO_PAGE);
-    case 0x66:
-        execData->opCodeName = "ROR";
-        ror(ZERO_PAGE);
-        return;
-    case 0x68:
-        execData->opCodeName = "PLA";
-        return pla();
-    case 0x69:
-        execData->opCodeName = "ADC";
-        return adc(IMMEDIATE);
-    case 0x6a:
-        execData->opCodeName = "ROR";
-        ror(ACCUMULATOR);
-        return;
-    case 0x6c:
-        execData->opCodeName = "JMP";
-        return jmp(INDIRECT);
-    case 0x6d:
-        execData->opCodeName = "ADC";
-        return adc(ABSOLUTE);
-    case 0x6e:
-        execData->opCodeName = "ROR";
-        ror(ABSOLUTE);
-        return;
-    case 0x70:
-        execData->opCodeName = "BVS";
-        return bvs();
-    case 0x71:
-        execData->opCodeName = "ADC";
-        return adc(INDIRECT_INDEXED);
-    case 0x75:
-        execData->opCodeName = "ADC";
-        return adc(ZERO_PAGE_X);
-    case 0x76:
-        execData->opCodeName = "ROR";
-        ror(ZERO_PAGE_X);
-        return;
-    case 0x78:
-        execData->opCodeName = "SEI";
-        return sei();
-    case 0x79:
-        execData->opCodeName = "ADC";
-        return adc(ABSOLUTE_Y);
-    case 0x7d:
-        execData->opCodeName = "ADC";
-        return adc(ABSOLUTE_X);
-    case 0x7e:
-        execData->opCodeName = "ROR";
-        ror(ABSOLUTE_X);
-        return;
-    case 0x81:
-        execData->opCodeName = "STA";
-        return sta(INDEXED_INDIRECT);
-    case 0x84:
-        execData->opCodeName = "STY";
-        return sty(ZERO_PAGE);
-    case 0x85:
-        execData->opCodeName = "STA";
-        return sta(ZERO_PAGE);
-    case 0x86:
-        execData->opCodeName = "STX";
-        return stx(ZERO_PAGE);
-    case 0x88:
-        execData->opCodeName = "DEY";
-        return dey();
-    case 0x8a:
-        execData->opCodeName = "TXA";
-        return txa();
-    case 0x8c:
-        execData->opCodeName = "STY";
-        return sty(ABSOLUTE);
-    case 0x8d:
-        execData->opCodeName = "STA";
-        return sta(ABSOLUTE);
-    case 0x8e:
-        execData->opCodeName = "STX";
-        return stx(ABSOLUTE);
-    case 0x90:
-        execData->opCodeName = "BCC";
-        return bcc();
-    case 0x91:
-        execData->opCodeName = "STA";
-        return sta(INDIRECT_INDEXED);
-    case 0x94:
-        execData->opCodeName = "STY";
-        return sty(ZERO_PAGE_X);
-    case 0x95:
-        execData->opCodeName = "STA";
-        return sta(ZERO_PAGE_X);
-    case 0x96:
-        execData->opCodeName = "STX";
-        return stx(ZERO_PAGE_Y);
-    case 0x98:
-        execData->opCodeName = "TYA";
-        return tya();
-    case 0x99:
-        execData->opCodeName = "STA";
-        return sta(ABSOLUTE_Y);
-    case 0x9a:
-        execData->opCodeName = "TXS";
-        return txs();
-    case 0x9d:
-        execData->opCodeName = "STA";
-        return sta(ABSOLUTE_X);
-    case 0xa0:
-        execData->opCodeName = "LDY";
-        return ldy(IMMEDIATE);
-    case 0xa1:
-        execData->opCodeName = "LDA";
-        return lda(INDEXED_INDIRECT);
-    case 0xa2:
-        execData->opCodeName = "LDX";
-        return ldx(IMMEDIATE);
-    case 0xa4:
-        execData->opCodeName = "LDY";
-        return ldy(ZERO_PAGE);
-    case 0xa5:
-        execData->opCodeName = "LDA";
-        return lda(ZERO_PAGE);
-    case 0xa6:
-        execData->opCodeName = "LDX";
-        return ldx(ZERO_PAGE);
-    case 0xa8:
-        execData->opCodeName = "TAY";
-        return tay();
-    case 0xa9:
-        execData->opCodeName = "LDA";
-        return lda(IMMEDIATE);
-    case 0xaa:
-        execData->opCodeName = "TAX";
-        return tax();
-    case 0xac:
-        execData->opCodeName = "LDY";
-        return ldy(ABSOLUTE);
-    case 0xad:
-        execData->opCodeName = "LDA";
-        return lda(ABSOLUTE);
-    case 0xae:
-        execData->opCodeName = "LDX";
-        return ldx(ABSOLUTE);
-    case 0xb0:
-        execData->opCodeName = "BCS";
-        return bcs();
-    case 0xb1:
-        execData->opCodeName = "LDA";
-        return lda(INDIRECT_INDEXED);
-    case 0xb4:
-        execData->opCodeName = "LDY";
-        return ldy(ZERO_PAGE_X);
-    case 0xb5:
-        execData->opCodeName = "LDA";
-        return lda(ZERO_PAGE_X);
-    case 0xb6:
-        execData->opCodeName = "LDX";
-        return ldx(ZERO_PAGE_Y);
-    case 0xb8:
-        execData->opCodeName = "CLV";
-        return clv();
-    case 0xb9:
-        execData->opCodeName = "LDA";
-        return lda(ABSOLUTE_Y);
-    case 0xba:
-        execData->opCodeName = "TSX";
-        return tsx();
-    case 0xbc:
-        execData->opCodeName = "LDY";
-        return ldy(ABSOLUTE_X);
-    case 0xbd:
-        execData->opCodeName = "LDA";
-        return lda(ABSOLUTE_X);
-    case 0xbe:
-        execData->opCodeName = "LDX";
-        return ldx(ABSOLUTE_Y);
-    case 0xc0:
-        execData->opCodeName = "CPY";
-        return cpy(IMMEDIATE);
-    case 0xc1:
-        execData->opCodeName = "CMP";
-        return cmp(INDEXED_INDIRECT);
-    case 0xc4:
-        execData->opCodeName = "CPY";
-        return cpy(ZERO_PAGE);
-    case 0xc5:
-        execData->opCodeName = "CMP";
-        return cmp(ZERO_PAGE);
-    case 0xc6:
-        execData->opCodeName = "DEC";
-        dec(ZERO_PAGE);
-        return;
-    case 0xc8:
-        execData->opCodeName = "INY";
-        return iny();
-    case 0xc9:
-        execData->opCodeName = "CMP";
-        return cmp(IMMEDIATE);
-    case 0xca:
-        execData->opCodeName = "DEX";
-        return dex();
-    case 0xcc:
-        execData->opCodeName = "CPY";
-        return cpy(ABSOLUTE);
-    case 0xcd:
-        execData->opCodeName = "CMP";
-        return cmp(ABSOLUTE);
-    case 0xce:
-        execData->opCodeName = "DEC";
-        dec(ABSOLUTE);
-        return;
-    case 0xd0:
-        execData->opCodeName = "BNE";
-        return bne();
-    case 0xd1:
-        execData->opCodeName = "CMP";
-        return cmp(INDIRECT_INDEXED);
-    case 0xd5:
-        execData->opCodeName = "CMP";
-        return cmp(ZERO_PAGE_X);
-    case 0xd6:
-        execData->opCodeName = "DEC";
-        dec(ZERO_PAGE_X);
-        return;
-    case 0xd8:
-        execData->opCodeName = "CLD";
-        return cld();
-    case 0xd9:
-        execData->opCodeName = "CMP";
-        return cmp(ABSOLUTE_Y);
-    case 0xdd:
-        execData->opCodeName = "CMP";
-        return cmp(ABSOLUTE_X);
-    case 0xde:
-        execData->opCodeName = "DEC";
-        dec(ABSOLUTE_X);
-        return;
-    case 0xe0:
-        execData->opCodeName = "CPX";
-        return cpx(IMMEDIATE);
-    case 0xe1:
-        execData->opCodeName = "SBC";
-        return sbc(INDEXED_INDIRECT);
-    case 0xe4:
-        execData->opCodeName = "CPX";
-        return cpx(ZERO_PAGE);
-    case 0xe5:
-        execData->opCodeName = "SBC";
-        return sbc(ZERO_PAGE);
-    case 0xe6:
-        execData->opCodeName = "INC";
-        inc(ZERO_PAGE);
-        return;
-    case 0xe8:
-        execData->opCodeName = "INX";
-        return inx();
-    case 0xe9:
-        execData->opCodeName = "SBC";
-        return sbc(IMMEDIATE);
-    case 0xea:
-        execData->opCodeName = "NOP";
-        return nop(IMPLIED);
-    case 0xec:
-        execData->opCodeName = "CPX";
-        return cpx(ABSOLUTE);
-    case 0xed:
-        execData->opCodeName = "SBC";
-        return sbc(ABSOLUTE);
-    case 0xee:
-        execData->opCodeName = "INC";
-        inc(ABSOLUTE);
-        return;
-    case 0xf0:
-        execData->opCodeName = "BEQ";
-        return beq();
-    case 0xf1:
-        execData->opCodeName = "SBC";
-        return sbc(INDIRECT_INDEXED);
-    case 0xf5:
-        execData->opCodeName = "SBC";
-        return sbc(ZERO_PAGE_X);
-    case 0xf6:
-        execData->opCodeName = "INC";
-        inc(ZERO_PAGE_X);
-        return;
-    case 0xf8:
-        execData->opCodeName = "SED";
-        return sed();
-    case 0xf9:
-        execData->opCodeName = "SBC";
-        return sbc(ABSOLUTE_Y);
-    case 0xfd:
-        execData->opCodeName = "SBC";
-        return sbc(ABSOLUTE_X);
-    case 0xfe:
-        execData->opCodeName = "INC";
-        inc(ABSOLUTE_X);
-        return;
+        if (block->runs++ != Jit::THRESHOLD)
+            return 0;
+        block->code = jit->compile(block);
+        if (block->code == NULL)
+            return 0;
+    }
+
+    if (cycles + block->maxCycles >= end)
+        return 0;
+    return block->code(this);
+#else
+    return 0;
+#endif
+}
 
-    // Illegal opcodes
-    case 0x1a: case 0x3a: case 0x5a: case 0x7a: case 0xda: case 0xfa: // NOP
-    case 0x02: case 0x12: case 0x22: case 0x32: case 0x42: case 0x52: case 0x62: case 0x72: case 0x92: case 0xB2: case 0xD2: case 0xF2: // JAM
-        execData->opCodeName = "*NOP";
-        return nop(IMPLIED);
-    case 0x80: case 0x82: case 0x89: case 0xc2: case 0xe2:
-        execData->opCodeName = "*NOP";
-        return nop(IMMEDIATE);
-    case 0x04: case 0x44: case 0x64:
-        execData->opCodeName = "*NOP";
-        return nop(ZERO_PAGE);
-    case 0x14: case 0x34: case 0x54: case 0x74: case 0xd4: case 0xf4:
-        execData->opCodeName = "*NOP";
-        return nop(ZERO_PAGE_X);
-    case 0x0c:
-        execData->opCodeName = "*NOP";
-        return nop(ABSOLUTE);
-    case 0x1c: case 0x3c: case 0x5c: case 0x7c: case 0xdc: case 0xfc:
-        execData->opCodeName = "*NOP";
-        return nop(ABSOLUTE_X);
-    case 0x07:
-        execData->opCodeName = "*SLO";
-        return slo(ZERO_PAGE);
-    case 0x17:
-        execData->opCodeName = "*SLO";
-        return slo(ZERO_PAGE_X);
-    case 0x0f:
-        execData->opCodeName = "*SLO";
-        return slo(ABSOLUTE);
-    case 0x1f:
-        execData->opCodeName = "*SLO";
-        return slo(ABSOLUTE_X);
-    case 0x1b:
-        execData->opCodeName = "*SLO";
-        return slo(ABSOLUTE_Y);
-    case 0x03:
-        execData->opCodeName = "*SLO";
-        return slo(INDEXED_INDIRECT);
-    case 0x13:
-        execData->opCodeName = "*SLO";
-        return slo(INDIRECT_INDEXED);
-    case 0x27:
-        execData->opCodeName = "*RLA";
-        return rla(ZERO_PAGE);
-    case 0x37:
-        execData->opCodeName = "*RLA";
-        return rla(ZERO_PAGE_X);
-    case 0x2f:
-        execData->opCodeName = "*RLA";
-        return rla(ABSOLUTE);
-    case 0x3f:
-        execData->opCodeName = "*RLA";
-        return rla(ABSOLUTE_X);
-    case 0x3b:
-        execData->opCodeName = "*RLA";
-        return rla(ABSOLUTE_Y);
-    case 0x23:
-        execData->opCodeName = "*RLA";
-        return rla(INDEXED_INDIRECT);
-    case 0x33:
-        execData->opCodeName = "*RLA";
-        return rla(INDIRECT_INDEXED);
-    case 0x47:
-        execData->opCodeName = "*SRE";
-        return sre(ZERO_PAGE);
-    case 0x57:
-        execData->opCodeName = "*SRE";
-        return sre(ZERO_PAGE_X);
-    case 0x4f:
-        execData->opCodeName = "*SRE";
-        return sre(ABSOLUTE);
-    case 0x5f:
-        execData->opCodeName = "*SRE";
-        return sre(ABSOLUTE_X);
-    case 0x5b:
-        execData->opCodeName = "*SRE";
-        return sre(ABSOLUTE_Y);
-    case 0x43:
-        execData->opCodeName = "*SRE";
-        return sre(INDEXED_INDIRECT);
-    case 0x53:
-        execData->opCodeName = "*SRE";
-        return sre(INDIRECT_INDEXED);
-    case 0x67:
-        execData->opCodeName = "*RRA";
-        return rra(ZERO_PAGE);
-    case 0x77:
-        execData->opCodeName = "*RRA";
-        return rra(ZERO_PAGE_X);
-    case 0x6f:
-        execData->opCodeName = "*RRA";
-        return rra(ABSOLUTE);
-    case 0x7f:
-        execData->opCodeName = "*RRA";
-        return rra(ABSOLUTE_X);
-    case 0x7b:
-        execData->opCodeName = "*RRA";
-        return rra(ABSOLUTE_Y);
-    case 0x63:
-        execData->opCodeName = "*RRA";
-        return rra(INDEXED_INDIRECT);
-    case 0x73:
-        execData->opCodeName = "*RRA";
-        return rra(INDIRECT_INDEXED);
-    case 0x87:
-        execData->opCodeName = "*SAX";
-        return sax(ZERO_PAGE);
-    case 0x97:
-        execData->opCodeName = "*SAX";
-        return sax(ZERO_PAGE_Y);
-    case 0x8f:
-        execData->opCodeName = "*SAX";
-        return sax(ABSOLUTE);
-    case 0x83:
-        execData->opCodeName = "*SAX";
-        return sax(INDEXED_INDIRECT);
-    case 0xa7:
-        execData->opCodeName = "*LAX";
-        return lax(ZERO_PAGE);
-    case 0xb7:
-        execData->opCodeName = "*LAX";
-        return lax(ZERO_PAGE_Y);
-    case 0xaf:
-        execData->opCodeName = "*LAX";
-        return lax(ABSOLUTE);
-    case 0xbf:
-        execData->opCodeName = "*LAX";
-        return lax(ABSOLUTE_Y);
-    case 0xa3:
-        execData->opCodeName = "*LAX";
-        return lax(INDEXED_INDIRECT);
-    case 0xb3:
-        execData->opCodeName = "*LAX";
-        return lax(INDIRECT_INDEXED);
-    case 0xc7:
-        execData->opCodeName = "*DCP";
-        return dcp(ZERO_PAGE);
-    case 0xd7:
-        execData->opCodeName = "*DCP";
-        return dcp(ZERO_PAGE_X);
-    case 0xcf:
-        execData->opCodeName = "*DCP";
-        return dcp(ABSOLUTE);
-    case 0xdf:
-        execData->opCodeName = "*DCP";
-        return dcp(ABSOLUTE_X);
-    case 0xdb:
-        execData->opCodeName = "*DCP";
-        return dcp(ABSOLUTE_Y);
-    case 0xc3:
-        execData->opCodeName = "*DCP";
-        return dcp(INDEXED_INDIRECT);
-    case 0xd3:
-        execData->opCodeName = "*DCP";
-        return dcp(INDIRECT_INDEXED);
-    case 0x4b:
-        execData->opCodeName = "*ALR";
-        return alr(IMMEDIATE);
-    case 0x0b: case 0x2b:
-        execData->opCodeName = "*ANC";
-        return anc(IMMEDIATE);
-    case 0x6b:
-        execData->opCodeName = "*ARR";
-        return arr(IMMEDIATE);
-    case 0xe7:
-        execData->opCodeName = "*ISB";
-        return isb(ZERO_PAGE);
-    case 0xf7:
-        execData->opCodeName = "*ISB";
-        return isb(ZERO_PAGE_X);
-    case 0xef:
-        execData->opCodeName = "*ISB";
-        return isb(ABSOLUTE);
-    case 0xff:
-        execData->opCodeName = "*ISB";
-        return isb(ABSOLUTE_X);
-    case 0xfb:
-        execData->opCodeName = "*ISB";
-        return isb(ABSOLUTE_Y);
-    case 0xe3:
-        execData->opCodeName = "*ISB";
-        return isb(INDEXED_INDIRECT);
-    case 0xf3:
-        execData->opCodeName = "*ISB";
-        return isb(INDIRECT_INDEXED);
-    case 0xeb:
-        execData->opCodeName = "*SBC";
-        return sbc(IMMEDIATE);
-    case 0xbb:
-        execData->opCodeName = "*LAS";
-        return las(ABSOLUTE_Y);
-
-    default:
-        if (opCode == 0x9f || opCode == 0x93) {
-            std::cout << "UNSTABLE OPCODE SHA: " << std::hex << (int)opCode << std::endl;
-        } else if (opCode == 0x9e) {
-            std::cout << "UNSTABLE OPCODE SHX: " << std::hex << (int)opCode << std::endl;
-        } else if (opCode == 0x9c) {
-            std::cout << "UNSTABLE OPCODE SHY: " << std::hex << (int)opCode << std::endl;
-        } else if (opCode == 0x8b) {
-            std::cout << "UNSTABLE OPCODE ANE: " << std::hex << (int)opCode << std::endl;
-        } else if (opCode == 0xab) {
-            std::cout << "UNSTABLE OPCODE LXA: " << std::hex << (int)opCode << std::endl;
-        } else if (opCode == 0x9b) {
-            std::cout << "UNSTABLE OPCODE TAS: " << std::hex << (int)opCode << std::endl;
-        } else {
-            std::cout << "UNKNOWN OPCODE: " << std::hex << (int)opCode << std::endl;
+bool Cpu::setTranslatedRom(const TranslatedRom *rom)
+{
+    translated = NULL;
+    if (rom != NULL && TranslatedRom::computeChecksum(bus) != rom->checksum)
+        return false;
+    translated = rom;
+    return true;
+}
+
+// Runs translated blocks one after the other, the interpreter runs one instruction whenever pc is not the start of a
+// translated block. A block only runs when it fits in the budget, so runCycles() stops on the same instruction.
+// The registers stay in a GuestState while blocks follow each other, and are only copied back for the interpreter.
+// Translated code only accesses RAM and ROM, the interpreter runs the instructions that access devices, which see
+// the cycles of the Cpu.
+void Cpu::runTranslated()
+{
+    while (cycles < end)
+    {
+        const TranslatedBlock *block = translated->find(pc);
+        if (block == NULL || cycles + block->maxCycles >= end)
+        {
+            if (step() == 0)
+                return; // Stopped on BRK
+            continue;
+        }
+
+        unsigned long long start = cycles;
+        GuestState state = {cycles, pc, a, x, y, sp, status, negativeResult, overflowResult, zeroResult, carry};
+        bool exited = false; // Before I/O, pc can be the start of a block
+        do
+        {
+            exited = !block->run(state, bus);
+            block = exited ? NULL : translated->find(state.pc);
         }
-        exit(1);
+        while (block != NULL && state.cycles + block->maxCycles < end);
+        translatedCycles += state.cycles - start;
+
+        cycles += state.cycles - start; // Keeps the cycles a write stalled the Cpu for, see stall()
+        pc = state.pc;
+        a = state.a;
+        x = state.x;
+        y = state.y;
+        sp = state.sp;
+        status = state.status;
+        negativeResult = state.negativeResult;
+        overflowResult = state.overflowResult;
+        zeroResult = state.zeroResult;
+        carry = state.carry;
+        if (exited && step() == 0)
+            return;
     }
 }
 
+// Runs one iteration of a block that branches back to its own start without writing memory. When the registers and
+// flags are the same afterwards every next iteration is the same as well, as nothing else changes memory while the
+// Cpu runs. The cycles of all whole iterations that end before the budget are then added at once, the caller runs the
+// last partial iteration so runCycles() still stops on the same instruction.
+// A loop that reads I/O is only the same every iteration when the devices are stable within the budget, see
+// setStableIo(). They can change between budgets, e.g. the vblank flag of the Ppu, so the iteration can leave the loop.
+// Returns whether it did, the caller continues at pc then instead of at the start of the block.
+bool Cpu::skipIdleLoop(Block *block)
+{
+    if (block->readsIo && !stableIo)
+    {
+        block->entry = block->instructions[0].handler; // Reading again could change what it reads
+        return false;
+    }
+    if (cycles + block->maxCycles >= end)
+        return false; // The iteration could overshoot the budget
+
+    unsigned char before[5] = {a, x, y, sp, getStatus()};
+    unsigned long long start = cycles;
+
+    for (int i = 0; i < block->count; i++)
+    {
+        const DecodedInstruction &instruction = block->instructions[i];
+        operand = instruction.operand;
+        pc = instruction.nextPc;
+        (this->*instruction.execute)();
+        cycles += instruction.cycles;
+        if (instruction.pageCrossPenalty)
+            cycles += pageCrossed;
+    }
+
+    if (pc != block->start)
+        return true; // Left the loop, it can still be an idle loop next time
+
+    unsigned char after[5] = {a, x, y, sp, getStatus()};
+    if (!std::equal(before, before + 5, after))
+    {
+        block->entry = block->instructions[0].handler; // Changes registers every iteration, e.g. a delay loop
+        return false;
+    }
+
+    unsigned long long period = cycles - start;
+    unsigned long long skipped = (end - 1 - cycles) / period * period;
+    cycles += skipped;
+    skippedCycles += skipped;
+    return false;
+}
+
+// Record the state before execution, with the effective address the instruction will resolve and the value there.
+// Only the run loops that trace call this, so the handlers don't check for tracing. Memory is peeked, so tracing
+// doesn't change what the program sees.
+void Cpu::startTrace(unsigned char opCode)
+{
+    const OpCode &op = OPCODES[opCode];
+    execData.pc = pc;
+    execData.opCode = opCode;
+    execData.opCodeName = op.name;
+    execData.addressingMode = op.mode;
+    execData.paramCount = op.bytes - 1;
+    execData.params[0] = op.bytes > 1 ? bus->peek(pc + 1) : 0;
+    execData.params[1] = op.bytes > 2 ? bus->peek(pc + 2) : 0;
+    execData.a = a;
+    execData.x = x;
+    execData.y = y;
+    execData.sp = sp;
+    execData.status = getStatus();
+    execData.cycles = cycles;
+
+    unsigned short operand = (execData.params[1] << 8) | execData.params[0];
+    unsigned short nextPc = pc + op.bytes;
+    unsigned short address;
+    switch (op.mode)
+    {
+    case IMPLIED:
+    case ACCUMULATOR:
+        return;
+    case IMMEDIATE:
+        address = nextPc - 1;
+        break;
+    case ZERO_PAGE:
+    case ABSOLUTE:
+        address = operand;
+        break;
+    case ZERO_PAGE_X:
+        address = (operand + x) % 256;
+        break;
+    case ZERO_PAGE_Y:
+        address = (operand + y) % 256;
+        break;
+    case ABSOLUTE_X:
+        address = operand + x;
+        break;
+    case ABSOLUTE_Y:
+        address = operand + y;
+        break;
+    case INDIRECT:
+        // Same page wrap as jmp()
+        address = (bus->peek((operand & 0xff00) | ((operand + 1) & 0xff)) << 8) | bus->peek(operand);
+        break;
+    case INDEXED_INDIRECT:
+        address = (bus->peek((operand + x + 1) % 256) << 8) | bus->peek((operand + x) % 256);
+        break;
+    case INDIRECT_INDEXED:
+        address = ((bus->peek((operand + 1) % 256) << 8) | bus->peek(operand)) + y;
+        break;
+    case RELATIVE:
+        address = nextPc + (signed char) operand;
+        break;
+    }
+    execData.address = address;
+    execData.value = bus->peek(address);
+}
+
+void Cpu::execOpCode(unsigned char opCode)
+{
+    const OpCode &op = OPCODES[opCode];
+    fetchOperand(op.bytes);
+    (this->*op.execute)();
+
+    // pageCrossed is always set by the opcodes with a penalty, they use an indexed addressing mode
+    cycles += op.cycles;
+    if (op.pageCrossPenalty)
+        cycles += pageCrossed;
+}
+
+template <unsigned char opCode>
+void Cpu::unstable()
+{
+    std::cout << "UNSTABLE OPCODE " << (OPCODES[opCode].name + 1) << ": " << std::hex << (int)opCode << std::endl;
+    exit(1);
+}
+
+template <unsigned char opCode>
+void Cpu::unknown()
+{
+    std::cout << "UNKNOWN OPCODE: " << std::hex << (int)opCode << std::endl;
+    exit(1);
+}
+
 // The BRK instruction forces the generation of an interrupt request. The program counter and processor status are pushed on the stack then the IRQ interrupt vector at $FFFE/F is loaded into the PC and the break flag in the status set to one.
 void Cpu::brk()
 {
     pushStack_16(pc);
-    pushStack(status);
+    pushStack(getStatus());
     pc = bus->read_16(bus->BREAK_VECTOR_ADDR);
     status = status | 0b0001'0000;
 }
 
 // The NOP instruction causes no changes to the processor other than the normal incrementing of the program counter to the next instruction.
-void Cpu::nop(AddressingMode addressingMode)
+template <AddressingMode mode>
+void Cpu::nop()
 {
-    getAddress(addressingMode); // Because of illegal opcodes
+    getAddress<mode>(); // Because of illegal opcodes
 }
 
 // Adds the contents of a memory location to the accumulator together with the carry bit. If overflow occurs the carry bit is set, this enables multiple byte addition to be performed.
-void Cpu::adc(AddressingMode addressingMode)
+template <AddressingMode mode>
+void Cpu::adc()
 {
-    adc_value(bus->read(getAddress(addressingMode)));
+    adc_value(readValue<mode>());
 }
 
 void Cpu::adc_value(unsigned char value)
@@ -805,18 +938,16 @@ void Cpu::adc_value(unsigned char value)
     // - Two negative numbers are added, and the result is a positive number.
     // Simplification: Sign of both inputs is different from the sign of the result.
     // Overflow occurs if (M^result) & (N^result) & 0b1000'0000 is nonzero.
-    if ((a ^ result) & (value ^ result) & 0b1000'0000)
-        status = status | 0b0100'0000;
-    else
-        status = status & 0b1011'1111;
+    overflowResult = (a ^ result) & (value ^ result);
 
     a = result;
 }
 
 // Subtracts the contents of a memory location to the accumulator together with the not of the carry bit. If overflow occurs the carry bit is clear, this enables multiple byte subtraction to be performed.
-void Cpu::sbc(AddressingMode addressingMode)
+template <AddressingMode mode>
+void Cpu::sbc()
 {
-    sbc_value(bus->read(getAddress(addressingMode)));
+    sbc_value(readValue<mode>());
 }
 
 void Cpu::sbc_value(unsigned char value)
@@ -825,10 +956,7 @@ void Cpu::sbc_value(unsigned char value)
     updateZeroAndNegativeFlag(result);
     
     // clear carry flag if bit 7 overflow
-    if (result > 0xff)
-        status = status & 0b1111'1110;
-    else
-        status = status | 0b0000'0001;
+    carry = result <= 0xff;
 
     // Overflow flag. Set if result if two's complement is outside -128, +127 range.
     // This can only happen if:
@@ -836,10 +964,7 @@ void Cpu::sbc_value(unsigned char value)
     // - Negative minus positive, and the result is a positive number.
     // Simplification: Sign of first input and result are different. Sign of second input and result are same.
     // Overflow occurs if (M^result) & (~N^result) & 0b1000'0000 is nonzero.
-    if ((a ^ result) & ((~value) ^ result) & 0b1000'0000)
-        status = status | 0b0100'0000;
-    else
-        status = status & 0b1011'1111;
+    overflowResult = (a ^ result) & ((~value) ^ result);
 
     a = result;
 }
@@ -847,7 +972,7 @@ void Cpu::sbc_value(unsigned char value)
 // Set the carry flag to one.
 void Cpu::sec()
 {
-    status = status | 0b0000'0001;
+    carry = 1;
 }
 
 // Set the decimal flag to one.
@@ -863,23 +988,26 @@ void Cpu::sei()
 }
 
 // Stores the contents of the accumulator into memory.
-void Cpu::sta(AddressingMode addressingMode)
+template <AddressingMode mode>
+void Cpu::sta()
 {
-    unsigned short address = getAddress(addressingMode);
+    unsigned short address = getAddress<mode>();
     bus->write_8(address, a);
 }
 
 // Stores the contents of the X register into memory.
-void Cpu::stx(AddressingMode addressingMode)
+template <AddressingMode mode>
+void Cpu::stx()
 {
-    unsigned short address = getAddress(addressingMode);
+    unsigned short address = getAddress<mode>();
     bus->write_8(address, x);
 }
 
 // Stores the contents of the Y register into memory.
-void Cpu::sty(AddressingMode addressingMode)
+template <AddressingMode mode>
+void Cpu::sty()
 {
-    unsigned short address = getAddress(addressingMode);
+    unsigned short address = getAddress<mode>();
     bus->write_8(address, y);
 }
 
@@ -890,131 +1018,133 @@ void Cpu::cli()
 }
 
 // A logical AND is performed, bit by bit, on the accumulator contents using the contents of a byte of memory.
-void Cpu::andOp(AddressingMode addressingMode)
+template <AddressingMode mode>
+void Cpu::andOp()
 {
-    a = a & bus->read(getAddress(addressingMode));
+    a = a & readValue<mode>();
     updateZeroAndNegativeFlag(a);
 }
 
 // An inclusive OR is performed, bit by bit, on the accumulator contents using the contents of a byte of memory.
-void Cpu::ora(AddressingMode addressingMode)
+template <AddressingMode mode>
+void Cpu::ora()
 {
-    a = a | bus->read(getAddress(addressingMode));
+    a = a | readValue<mode>();
     updateZeroAndNegativeFlag(a);
 }
 
 // An exclusive OR is performed, bit by bit, on the accumulator contents using the contents of a byte of memory.
-void Cpu::eor(AddressingMode addressingMode)
+template <AddressingMode mode>
+void Cpu::eor()
 {
-    a = a ^ bus->read(getAddress(addressingMode));
+    a = a ^ readValue<mode>();
     updateZeroAndNegativeFlag(a);
 }
 
 // Test if one or more bits are set in a target memory location. The mask pattern in A is ANDed with the value in memory to set or clear the zero flag, but the result is not kept. 
 // Bits 7 and 6 of the value from memory are copied into the N and V flags.
-void Cpu::bit(AddressingMode addressingMode)
+template <AddressingMode mode>
+void Cpu::bit()
 {
-    unsigned char mem = bus->read(getAddress(addressingMode));
+    unsigned char mem = readValue<mode>();
     unsigned char result = a & mem;
-    updateZeroFlag(result);
-    updateNegativeFlag(mem);
-    updateOverflowFlag(mem);
+    zeroResult = result;
+    negativeResult = mem;
+    overflowResult = mem << 1; // Bit 6 of memory
 }
 
 // This operation shifts all the bits of the accumulator or memory contents one bit left. Bit 0 is set to 0 and bit 7 is placed in the carry flag.
-unsigned char Cpu::asl(AddressingMode addressingMode)
+template <AddressingMode mode>
+unsigned char Cpu::asl()
 {
     unsigned char originalValue;
     unsigned char modifiedValue;
-    if (addressingMode == ACCUMULATOR) {
+    if constexpr (mode == ACCUMULATOR) {
         originalValue = a;
         a = a << 1;
         modifiedValue = a;
-        execData->address = "A";
     } else {
-        unsigned short addr = getAddress(addressingMode);
+        unsigned short addr = getAddress<mode>();
         originalValue = bus->read(addr);
         modifiedValue = originalValue << 1;
         bus->write_8(addr, modifiedValue);
     }
 
     updateZeroAndNegativeFlag(modifiedValue);
-    status = (status & ~0x01) | (originalValue >> 7); // set carry flag
+    carry = originalValue >> 7;
     return modifiedValue;
 }
 
 // Each of the bits in A or M is shift one place to the right. The bit that was in bit 0 is shifted into the carry flag. Bit 7 is set to zero.
-unsigned char Cpu::lsr(AddressingMode addressingMode)
+template <AddressingMode mode>
+unsigned char Cpu::lsr()
 {
     unsigned char originalValue;
     unsigned char modifiedValue;
-    if (addressingMode == ACCUMULATOR) {
+    if constexpr (mode == ACCUMULATOR) {
         originalValue = a;
         a = a >> 1;
         modifiedValue = a;
-        execData->address = "A";
     } else {
-        unsigned short addr = getAddress(addressingMode);
+        unsigned short addr = getAddress<mode>();
         originalValue = bus->read(addr);
         modifiedValue = originalValue >> 1;
         bus->write_8(addr, modifiedValue);
     }
 
     updateZeroAndNegativeFlag(modifiedValue);
-    status = (status & ~0x01) | (originalValue & 0x01); // set carry flag
+    carry = originalValue & 0x01;
     return modifiedValue;
 }
 
 // Move each of the bits in either A or M one place to the left. Bit 0 is filled with the current value of the carry flag whilst the old bit 7 becomes the new carry flag value.
-unsigned char Cpu::rol(AddressingMode addressingMode)
+template <AddressingMode mode>
+unsigned char Cpu::rol()
 {
     unsigned char originalValue;
     unsigned char modifiedValue;
-    if (addressingMode == ACCUMULATOR) {
+    if constexpr (mode == ACCUMULATOR) {
         originalValue = a;
-        a = (a << 1) | (status & 0x01);
+        a = (a << 1) | carry;
         modifiedValue = a;
-        execData->address = "A";
     } else {
-        unsigned short address = getAddress(addressingMode);
+        unsigned short address = getAddress<mode>();
         originalValue = bus->read(address);
-        modifiedValue = (originalValue << 1) | (status & 0x01);
+        modifiedValue = (originalValue << 1) | carry;
         bus->write_8(address, modifiedValue);
     }
 
     updateZeroAndNegativeFlag(modifiedValue);
-    unsigned char newCarry = (originalValue & 0b1000'0000) >> 7;
-    status = (status & ~0x01) | newCarry; // set carry flag
+    carry = (originalValue & 0b1000'0000) >> 7;
     return modifiedValue;
 }
 
 // Move each of the bits in either A or M one place to the right. Bit 7 is filled with the current value of the carry flag whilst the old bit 0 becomes the new carry flag value.
-unsigned char Cpu::ror(AddressingMode addressingMode)
+template <AddressingMode mode>
+unsigned char Cpu::ror()
 {
     unsigned char originalValue;
     unsigned char modifiedValue;
-    if (addressingMode == ACCUMULATOR) {
+    if constexpr (mode == ACCUMULATOR) {
         originalValue = a;
-        a = (a >> 1) | ((status & 0x01) << 7);
+        a = (a >> 1) | (carry << 7);
         modifiedValue = a;
-        execData->address = "A";
     } else {
-        unsigned short address = getAddress(addressingMode);
+        unsigned short address = getAddress<mode>();
         originalValue = bus->read(address);
-        modifiedValue = (originalValue >> 1) | ((status & 0x01) << 7);
+        modifiedValue = (originalValue >> 1) | (carry << 7);
         bus->write_8(address, modifiedValue);
     }
 
     updateZeroAndNegativeFlag(modifiedValue);
-    unsigned char newCarry = (originalValue & 0b0000'0001);
-    status = (status & ~0x01) | newCarry; // set carry flag
+    carry = originalValue & 0b0000'0001;
     return modifiedValue;
 }
 
 // The JSR instruction pushes the address (minus one) of the return point on to the stack and then sets the program counter to the target memory address.
 void Cpu::jsr()
 {
-    unsigned short address = getAddress(ABSOLUTE);
+    unsigned short address = getAddress<ABSOLUTE>();
     pushStack_16(pc - 1);
     pc = address;
 }
@@ -1028,7 +1158,7 @@ void Cpu::rts()
 // Set the carry flag to zero.
 void Cpu::clc()
 {
-    status = status & 0b1111'1110;
+    carry = 0;
 }
 
 // Set the decimal flag to zero.
@@ -1040,26 +1170,24 @@ void Cpu::cld()
 // Clears the overflow flag.
 void Cpu::clv()
 {
-    status = status & 0b1011'1111;
+    overflowResult = 0;
 }
 
 // Sets the program counter to the address specified by the operand.
-void Cpu::jmp(AddressingMode addressingMode)
+template <AddressingMode mode>
+void Cpu::jmp()
 {
     unsigned short address;
 
     // 6502 does not correctly fetch the target address if the indirect vector falls on a page boundary (e.g. $xxFF where xx is any value from $00 to $FF). 
     // In this case fetches the LSB from $xxFF as expected but takes the MSB from $xx00.
-    if (addressingMode == INDIRECT && bus->read(pc) == 0xff) {
-        unsigned short addr = bus->read_16(pc);
+    if (mode == INDIRECT && (operand & 0xff) == 0xff) {
+        unsigned short addr = operand;
         unsigned short p1 = bus->read(addr);
         unsigned short p2 = bus->read(addr & 0xff00);
         address = (p2 << 8) | p1;
-        execData->param1 = {bus->read(pc)};
-        execData->param2 = {bus->read(pc+1)};
-        execData->address = "($" + ExecutionData::toHex_16(addr) + ") = " + ExecutionData::toHex_16(address);
     } else {
-        address = getAddress(addressingMode);
+        address = getAddress<mode>();
     }
     
     pc = address;
@@ -1068,101 +1196,82 @@ void Cpu::jmp(AddressingMode addressingMode)
 // If the carry flag is clear then add the relative displacement to the program counter to cause a branch to a new location.
 void Cpu::bcc()
 {
-    execData->param1 = {bus->read_signed(pc)};
-    execData->address = "$" + ExecutionData::toHex_16(pc + bus->read_signed(pc) + 1);
-    if (getCarry() == 0)
-        pc += bus->read_signed(pc);
-    pc++;
+    branch(getCarry() == 0);
 }
 
 // If the carry flag is set then add the relative displacement to the program counter to cause a branch to a new location.
 void Cpu::bcs()
 {
-    execData->param1 = {bus->read_signed(pc)};
-    execData->address = "$" + ExecutionData::toHex_16(pc + bus->read_signed(pc) + 1);
-    if (getCarry() == 1)
-        pc += bus->read_signed(pc);
-    pc++;
+    branch(getCarry() == 1);
 }
 
 // If the zero flag is set then add the relative displacement to the program counter to cause a branch to a new location.
 void Cpu::beq()
 {
-    execData->param1 = {bus->read_signed(pc)};
-    execData->address = "$" + ExecutionData::toHex_16(pc + bus->read_signed(pc) + 1);
-    if (getZero() == 1)
-        pc += bus->read_signed(pc);
-    pc++;
+    branch(getZero() == 1);
 }
 
 // If the zero flag is clear then add the relative displacement to the program counter to cause a branch to a new location.
 void Cpu::bne()
 {
-    execData->param1 = {bus->read_signed(pc)};
-    execData->address = "$" + ExecutionData::toHex_16(pc + bus->read_signed(pc) + 1);
-    if (getZero() == 0)
-        pc += bus->read_signed(pc);
-    pc++;
+    branch(getZero() == 0);
 }
 
 // If the negative flag is set then add the relative displacement to the program counter to cause a branch to a new location.
 void Cpu::bmi()
 {
-    execData->param1 = {bus->read_signed(pc)};
-    execData->address = "$" + ExecutionData::toHex_16(pc + bus->read_signed(pc) + 1);
-    if (getNegative() == 1)
-        pc += bus->read_signed(pc);
-    pc++;
+    branch(getNegative() == 1);
 }
 
 // If the negative flag is clear then add the relative displacement to the program counter to cause a branch to a new location.
 void Cpu::bpl()
 {
-    execData->param1 = {bus->read_signed(pc)};
-    execData->address = "$" + ExecutionData::toHex_16(pc + bus->read_signed(pc) + 1);
-    if (getNegative() == 0)
-        pc += bus->read_signed(pc);
-    pc++;
+    branch(getNegative() == 0);
 }
 
 // If the overflow flag is clear then add the relative displacement to the program counter to cause a branch to a new location.
 void Cpu::bvc()
 {
-    execData->param1 = {bus->read_signed(pc)};
-    execData->address = "$" + ExecutionData::toHex_16(pc + bus->read_signed(pc) + 1);
-    if (getOverflow() == 0)
-        pc += bus->read_signed(pc);
-    pc++;
+    branch(getOverflow() == 0);
 }
 
 // If the overflow flag is set then add the relative displacement to the program counter to cause a branch to a new location.
 void Cpu::bvs()
 {
-    execData->param1 = {bus->read_signed(pc)};
-    execData->address = "$" + ExecutionData::toHex_16(pc + bus->read_signed(pc) + 1);
-    if (getOverflow() == 1)
-        pc += bus->read_signed(pc);
-    pc++;
+    branch(getOverflow() == 1);
+}
+
+// A taken branch costs one extra cycle, and another one if it jumps to a different page.
+void Cpu::branch(bool condition)
+{
+    unsigned short target = pc + (signed char) operand;
+    if (condition) {
+        cycles += ((pc ^ target) & 0xff00) ? 2 : 1;
+        pc = target;
+    }
 }
 
 // Loads a byte of memory into the accumulator setting the zero and negative flags as appropriate.
-void Cpu::lda(AddressingMode addressingMode)
+template <AddressingMode mode>
+void Cpu::lda()
 {
-    a = bus->read(getAddress(addressingMode));
+    a = readValue<mode>();
     updateZeroAndNegativeFlag(a);
 }
 
 // Loads a byte of memory into the X register setting the zero and negative flags as appropriate.
-void Cpu::ldx(AddressingMode addressingMode)
+template <AddressingMode mode>
+void Cpu::ldx()
 {
-    x = bus->read(getAddress(addressingMode));
+    x = readValue<mode>();
     updateZeroAndNegativeFlag(x);
 }
 
 // Loads a byte of memory into the Y register setting the zero and negative flags as appropriate.
-void Cpu::ldy(AddressingMode addressingMode)
+template <AddressingMode mode>
+void Cpu::ldy()
 {
-    y = bus->read(getAddress(addressingMode));
+    y = readValue<mode>();
     updateZeroAndNegativeFlag(y);
 }
 
@@ -1208,9 +1317,10 @@ void Cpu::tya()
 }
 
 // This instruction compares the contents of the accumulator with another memory held value and sets the zero and carry flags as appropriate.
-void Cpu::cmp(AddressingMode addressingMode)
+template <AddressingMode mode>
+void Cpu::cmp()
 {
-    unsigned char mem = bus->read(getAddress(addressingMode));
+    unsigned char mem = readValue<mode>();
     cmp_value(mem);
 }
 
@@ -1219,48 +1329,32 @@ void Cpu::cmp_value(unsigned char value)
     unsigned char result = a - value;
 
     // Set carry flag if A >= M
-    if (a >= value) {
-        status = status | 0b0000'0001;
-    } else {
-        status = status & 0b1111'1110;
-    }
-
-    updateZeroFlag(result);
-    updateNegativeFlag(result);
+    carry = a >= value;
+    updateZeroAndNegativeFlag(result);
 }
 
 // This instruction compares the contents of the X register with another memory held value and sets the zero and carry flags as appropriate.
-void Cpu::cpx(AddressingMode addressingMode)
+template <AddressingMode mode>
+void Cpu::cpx()
 {
-    unsigned char mem = bus->read(getAddress(addressingMode));
+    unsigned char mem = readValue<mode>();
     unsigned char result = x - mem;
 
     // Set carry flag if X >= M
-    if (x >= mem) {
-        status = status | 0b0000'0001;
-    } else {
-        status = status & 0b1111'1110;
-    }
-
-    updateZeroFlag(result);
-    updateNegativeFlag(result);
+    carry = x >= mem;
+    updateZeroAndNegativeFlag(result);
 }
 
 // This instruction compares the contents of the Y register with another memory held value and sets the zero and carry flags as appropriate.
-void Cpu::cpy(AddressingMode addressingMode)
+template <AddressingMode mode>
+void Cpu::cpy()
 {
-    unsigned char mem = bus->read(getAddress(addressingMode));
+    unsigned char mem = readValue<mode>();
     unsigned char result = y - mem;
 
     // Set carry flag if Y >= M
-    if (y >= mem) {
-        status = status | 0b0000'0001;
-    } else {
-        status = status & 0b1111'1110;
-    }
-
-    updateZeroFlag(result);
-    updateNegativeFlag(result);
+    carry = y >= mem;
+    updateZeroAndNegativeFlag(result);
 }
 
 // Pushes a copy of the accumulator on to the stack.
@@ -1273,7 +1367,7 @@ void Cpu::pha()
 // B flag: https://wiki.nesdev.org/w/index.php?title=Status_flags
 void Cpu::php()
 {
-    pushStack(status | 0b0011'0000);
+    pushStack(getStatus() | 0b0011'0000);
 }
 
 // Pulls an 8 bit value from the stack and into the accumulator. The zero and negative flags are set as appropriate.
@@ -1287,11 +1381,10 @@ void Cpu::pla()
 // Ignore b flag: https://wiki.nesdev.org/w/index.php?title=Status_flags
 void Cpu::plp()
 {
-    #ifdef NES_LOG_TEST
-        status = (pullStack() & 0b1110'1111) | 0b0010'0000; // Not clearing 5 because of test log. Doesn't matter because register doesn't exist.
-    #else
-        status = pullStack() & 0b1100'1111; // bit 5 and 4 do not exist and should be ignored.
-    #endif
+    if (cpuMode == NESTEST_LOG)
+        setStatus((pullStack() & 0b1110'1111) | 0b0010'0000); // Not clearing 5 because of test log. Doesn't matter because register doesn't exist.
+    else
+        setStatus(pullStack() & 0b1100'1111); // bit 5 and 4 do not exist and should be ignored.
 }
 
 // The RTI instruction is used at the end of an interrupt processing routine. It pulls the processor flags from the stack followed by the program counter.
@@ -1299,18 +1392,18 @@ void Cpu::plp()
 void Cpu::rti()
 {
     
-    #ifdef NES_LOG_TEST
-        status = pullStack() & 0b1110'1111 | 0b0010'0000; // Not clearing 5 because of test log. Doesn't matter because register doesn't exist.
-    #else
-        status = pullStack() & 0b1100'1111; // bit 5 and 4 do not exist and should be ignored.
-    #endif
+    if (cpuMode == NESTEST_LOG)
+        setStatus((pullStack() & 0b1110'1111) | 0b0010'0000); // Not clearing 5 because of test log. Doesn't matter because register doesn't exist.
+    else
+        setStatus(pullStack() & 0b1100'1111); // bit 5 and 4 do not exist and should be ignored.
     pc = pullStack_16();
 }
 
 // Subtracts one from the value held at a specified memory location setting the zero and negative flags as appropriate.
-unsigned char Cpu::dec(AddressingMode addressingMode)
+template <AddressingMode mode>
+unsigned char Cpu::dec()
 {
-    unsigned short addr = getAddress(addressingMode);
+    unsigned short addr = getAddress<mode>();
     unsigned char mem = bus->read(addr);
     bus->write_8(addr, mem - 1);
     updateZeroAndNegativeFlag(mem - 1);
@@ -1332,9 +1425,10 @@ void Cpu::dey()
 }
 
 // Adds one to the value held at a specified memory location setting the zero and negative flags as appropriate.
-unsigned char Cpu::inc(AddressingMode addressingMode)
+template <AddressingMode mode>
+unsigned char Cpu::inc()
 {
-    unsigned short addr = getAddress(addressingMode);
+    unsigned short addr = getAddress<mode>();
     unsigned char mem = bus->read(addr);
     bus->write_8(addr, mem + 1);
     updateZeroAndNegativeFlag(mem + 1);
@@ -1357,78 +1451,84 @@ void Cpu::iny()
 
 // Shift left one bit in memory, then OR accumulator with memory.
 // ASL oper + ORA oper
-void Cpu::slo(AddressingMode addressingMode)
+template <AddressingMode mode>
+void Cpu::slo()
 {
-    unsigned char val = asl(addressingMode);
+    unsigned char val = asl<mode>();
     a = a | val;
     updateZeroAndNegativeFlag(a);
 }
 
 // Rotate one bit left in memory, then AND accumulator with memory.
 // ROL oper + AND oper
-void Cpu::rla(AddressingMode addressingMode)
+template <AddressingMode mode>
+void Cpu::rla()
 {
-    unsigned char val = rol(addressingMode);
+    unsigned char val = rol<mode>();
     a = a & val;
     updateZeroAndNegativeFlag(a);
 }
 
 // Shift right one bit in memory, then EOR accumulator with memory.
 // LSR oper + EOR oper
-void Cpu::sre(AddressingMode addressingMode)
+template <AddressingMode mode>
+void Cpu::sre()
 {
-    unsigned char val = lsr(addressingMode);
+    unsigned char val = lsr<mode>();
     a = a ^ val;
     updateZeroAndNegativeFlag(a);
 }
 
 // Rotate one bit right in memory, then add memory to accumulator (with carry).
 // ROR oper + ADC oper
-void Cpu::rra(AddressingMode addressingMode)
+template <AddressingMode mode>
+void Cpu::rra()
 {
-    unsigned char val = ror(addressingMode);
+    unsigned char val = ror<mode>();
     adc_value(val);
 }
 
 // A and X are put on the bus at the same time (resulting effectively in an AND operation) and stored in M
-void Cpu::sax(AddressingMode addressingMode)
+template <AddressingMode mode>
+void Cpu::sax()
 {
-    bus->write_8(getAddress(addressingMode), a & x);
+    bus->write_8(getAddress<mode>(), a & x);
 }
 
 // LDA oper + LDX oper
 // Load accumulator and X register with memory.
-void Cpu::lax(AddressingMode addressingMode)
+template <AddressingMode mode>
+void Cpu::lax()
 {
-    unsigned char val = bus->read(getAddress(addressingMode));
+    unsigned char val = readValue<mode>();
     x = val;
     a = val;
     updateZeroAndNegativeFlag(val);
 }
 
 // DEC oper + CMP oper
-void Cpu::dcp(AddressingMode addressingMode)
+template <AddressingMode mode>
+void Cpu::dcp()
 {
-    unsigned char value = dec(addressingMode);
+    unsigned char value = dec<mode>();
     cmp_value(value);
 }
 
 // AND oper + LSR
 // AND byte with accumulator, then shift right one bit in accumu-lator.
-void Cpu::alr(AddressingMode addressingMode)
+template <AddressingMode mode>
+void Cpu::alr()
 {
-    andOp(addressingMode);
-    lsr(ACCUMULATOR);
+    andOp<mode>();
+    lsr<ACCUMULATOR>();
 }
 
 // AND byte with accumulator. If result is negative then carry is set.
-void Cpu::anc(AddressingMode addressingMode)
+template <AddressingMode mode>
+void Cpu::anc()
 {
-    andOp(addressingMode);
-    if (a & (1 << 7))
-        status = status | 0b0000'0001;
-    else
-        status = status & 0b1111'1110;
+    andOp<mode>();
+    carry = a >> 7;
 }
 
 // AND byte with accumulator, then rotate one bit right in accu-mulator  (AND oper + ROR)
@@ -1437,38 +1537,34 @@ void Cpu::anc(AddressingMode addressingMode)
 // - If both bits are 0: clear C and V.
 // - If only bit 5 is 1: set V, clear C.
 // - If only bit 6 is 1: set C and V.
-void Cpu::arr(AddressingMode addressingMode)
+template <AddressingMode mode>
+void Cpu::arr()
 {
-    andOp(addressingMode);
-    ror(ACCUMULATOR);
+    andOp<mode>();
+    ror<ACCUMULATOR>();
 
     unsigned char bit5 = (a & 0b0010'0000) >> 5;
     unsigned char bit6 = (a & 0b0100'0000) >> 6;
     
-    if (bit6 == 1)
-        status = status | 0b0000'0001; // set carry
-    else
-        status = status & 0b1111'1110; // clear carry
-    
-    if ((bit5 ^ bit6) == 1)
-        status = status | 0b0100'0000; // set overflow
-    else
-        status = status & 0b1011'1111; // clear overflow
+    carry = bit6;
+    overflowResult = (bit5 ^ bit6) << 7;
 
 }
 
 // INC oper + SBC oper
 // Increase memory by one, then subtract memory from accu-mulator (with borrow).
-void Cpu::isb(AddressingMode addressingMode)
+template <AddressingMode mode>
+void Cpu::isb()
 {
-    unsigned char value = inc(addressingMode);
+    unsigned char value = inc<mode>();
     sbc_value(value);
 }
 
 // AND memory with stack pointer, transfer result to accu-mulator, X register and stack pointer.
-void Cpu::las(AddressingMode addressingMode)
+template <AddressingMode mode>
+void Cpu::las()
 {
-    unsigned char mem = bus->read(getAddress(addressingMode));
+    unsigned char mem = readValue<mode>();
     unsigned char result = mem & sp;
     a = result;
     x = result;
@@ -1476,45 +1572,23 @@ void Cpu::las(AddressingMode addressingMode)
     updateZeroAndNegativeFlag(result);
 }
 
-void Cpu::updateZeroAndNegativeFlag(unsigned char result)
+// N, Z, C and V are not kept in status, they are only combined into it when the status is read.
+unsigned char Cpu::getStatus()
 {
-    updateZeroFlag(result);
-    updateNegativeFlag(result);
+    return (status & 0b0011'1100)
+        | (negativeResult & 0b1000'0000)
+        | ((overflowResult & 0b1000'0000) >> 1)
+        | (zeroResult == 0 ? 0b0000'0010 : 0)
+        | carry;
 }
 
-// Set zero flag if result = 0
-void Cpu::updateZeroFlag(unsigned char result)
+void Cpu::setStatus(unsigned char value)
 {
-    if (result == 0)
-        status = status | 0b00000010;
-    else
-        status = status & 0b11111101;
-}
-
-// Set negative flag if bit 7 of result is set
-void Cpu::updateNegativeFlag(unsigned char result)
-{
-    if (result & (1 << 7))
-        status = status | 0b1000'0000;
-    else
-        status = status & 0b0111'1111;
-}
-
-void Cpu::updateOverflowFlag(unsigned char result)
-{
-    if (result & (1 << 6))
-        status = status | 0b0100'0000;
-    else
-        status = status & 0b1011'1111;
-}
-
-void Cpu::updateCarryFlag(unsigned short result)
-{
-    // set carry flag if bit 7 overflow
-    if (result > 0xff)
-        status = status | 0b0000'0001;
-    else
-        status = status & 0b1111'1110;
+    status = value;
+    negativeResult = value;
+    overflowResult = value << 1;
+    zeroResult = ~value & 0b0000'0010;
+    carry = value & 0b0000'0001;
 }
 
 void Cpu::pushStack(unsigned char value)
@@ -1545,98 +1619,62 @@ unsigned short Cpu::pullStack_16()
     return (p2 << 8) | p1;
 }
 
-unsigned short Cpu::getAddress(AddressingMode addressingMode)
+// The operand bytes are already fetched, pc points to the next instruction.
+template <AddressingMode mode>
+unsigned short Cpu::getAddress()
 {
     unsigned short out;
-    int increment = 1;
 
-    switch (addressingMode)
-    {
-    case IMPLIED:
+    if constexpr (mode == IMPLIED || mode == ACCUMULATOR) {
         return 0;
-    case IMMEDIATE:
-        out = pc;
-        execData->param1 = {bus->read(pc)};
-        execData->address = "#$" + ExecutionData::toHex(*execData->param1);
-        break;
-    case ZERO_PAGE:
-        out = bus->read(pc);
-        execData->param1 = {bus->read(pc)};
-        execData->address = "$" + ExecutionData::toHex(*execData->param1) + " = " + ExecutionData::toHex(bus->read(*execData->param1));
-        break;
-    case ZERO_PAGE_X:
-        out = (bus->read(pc) + x) % 256;
-        execData->param1 = {bus->read(pc)};
-        execData->address = "$" + ExecutionData::toHex(bus->read(pc)) + ",X @ " + ExecutionData::toHex(out) + " = " + ExecutionData::toHex(bus->read(out));
-        break;
-    case ZERO_PAGE_Y:
-        out = (bus->read(pc) + y) % 256;
-        execData->param1 = {bus->read(pc)};
-        execData->address = "$" + ExecutionData::toHex(bus->read(pc)) + ",Y @ " + ExecutionData::toHex(out) + " = " + ExecutionData::toHex(bus->read(out));
-        break;
-    case ABSOLUTE:
-    {
-        out = bus->read_16(pc);
-        execData->param1 = {bus->read(pc)};
-        execData->param2 = {bus->read(pc+1)};
-        execData->address = "$" + ExecutionData::toHex_16(out) + " = " + ExecutionData::toHex(bus->read(out));
-        increment = 2;
-        break;
-    }
-    case ABSOLUTE_X:
-        out = bus->read_16(pc) + x;
-        execData->param1 = {bus->read(pc)};
-        execData->param2 = {bus->read(pc+1)};
-        execData->address = "$" + ExecutionData::toHex_16(bus->read_16(pc)) + ",X @ " + ExecutionData::toHex_16(out) + " = " + ExecutionData::toHex(bus->read(out));
-        increment = 2;
-        break;
-    case ABSOLUTE_Y:
-        out = bus->read_16(pc) + y;
-        execData->param1 = {bus->read(pc)};
-        execData->param2 = {bus->read(pc+1)};
-        execData->address = "$" + ExecutionData::toHex_16(bus->read_16(pc)) + ",Y @ " + ExecutionData::toHex_16(out) + " = " + ExecutionData::toHex(bus->read(out));
-        increment = 2;
-        break;
-    case INDIRECT: 
-    {
-        unsigned short addr = bus->read_16(pc);
-        out = bus->read_16(addr);
-        execData->param1 = {bus->read(pc)};
-        execData->param2 = {bus->read(pc+1)};
-        execData->address = "($" + ExecutionData::toHex_16(addr) + ") = " + ExecutionData::toHex_16(out);
-        increment = 2;
-        break;
-    }
-    case INDEXED_INDIRECT:
-    {
-        unsigned char addr = (bus->read(pc) + x);
+    } else if constexpr (mode == IMMEDIATE) {
+        out = pc - 1;
+    } else if constexpr (mode == ZERO_PAGE) {
+        out = operand;
+    } else if constexpr (mode == ZERO_PAGE_X) {
+        out = (operand + x) % 256;
+    } else if constexpr (mode == ZERO_PAGE_Y) {
+        out = (operand + y) % 256;
+    } else if constexpr (mode == ABSOLUTE) {
+        out = operand;
+    } else if constexpr (mode == ABSOLUTE_X) {
+        out = operand + x;
+        pageCrossed = (operand ^ out) & 0xff00;
+    } else if constexpr (mode == ABSOLUTE_Y) {
+        out = operand + y;
+        pageCrossed = (operand ^ out) & 0xff00;
+    } else if constexpr (mode == INDIRECT) {
+        out = bus->read_16(operand);
+    } else if constexpr (mode == INDEXED_INDIRECT) {
+        unsigned char addr = (operand + x);
         out = bus->read_16_zero_page_wrap(addr);
-        execData->address = "($" + ExecutionData::toHex(bus->read(pc)) + ",X) @ " + ExecutionData::toHex(addr) + " = " + ExecutionData::toHex_16(out) + " = " + ExecutionData::toHex(bus->read(out));
-        execData->param1 = {bus->read(pc)};
-        break;
-    }
-    case INDIRECT_INDEXED:
-    {
-        unsigned char addr = bus->read(pc);
-        out = bus->read_16_zero_page_wrap(addr) + y;
-        execData->address = "($" + ExecutionData::toHex(addr) + "),Y = " + ExecutionData::toHex_16(bus->read_16_zero_page_wrap(addr)) + " @ " + ExecutionData::toHex_16(out) + " = " + ExecutionData::toHex(bus->read(out));
-        execData->param1 = {bus->read(pc)};
-        break;
-    }
-    default:
-        std::cout << "Unexpected addressing mode " << addressingMode << std::endl;
-        exit(1);
+    } else if constexpr (mode == INDIRECT_INDEXED) {
+        unsigned short base = bus->read_16_zero_page_wrap(operand);
+        out = base + y;
+        pageCrossed = (base ^ out) & 0xff00;
+    } else {
+        static_assert(mode != RELATIVE, "Branches read their own offset");
     }
 
-    pc += increment;
     return out;
 }
 
+// Value at the effective address, an immediate value is the operand itself.
+template <AddressingMode mode>
+unsigned char Cpu::readValue()
+{
+    if constexpr (mode == IMMEDIATE) {
+        return operand;
+    } else {
+        return bus->read(getAddress<mode>());
+    }
+}
+
 void Cpu::print()
 {
     std::cout << "Program Counter: " << pc << std::endl;
     std::cout << "Register A: " << std::hex << (int)a << std::endl;
     std::cout << "Register X: " << std::hex << (int)x << std::endl;
     std::cout << "Register Y: " << std::hex << (int)y << std::endl;
-    std::cout << "Status: " << std::bitset<8>(status) << std::endl;
+    std::cout << "Status: " << std::bitset<8>(getStatus()) << std::endl;
 }
\ No newline at end of file
@@ -1,65 +1,151 @@
 #pragma once
 
 #include "addressing_mode.cpp"
+#include "cpu_mode.h"
 #include "execution_data.h"
+#include "opcode.h"
 
 class Bus;
+class BlockCache;
+struct Block;
+class Jit;
+class TraceSink;
+struct TranslatedRom;
 
 class Cpu
 {
+    friend class Jit; // Compiled code keeps the registers in host registers and stores them back
+
 public:
-    Cpu(Bus *bus) : execData(NULL), bus(bus) { }
+    // Indexed by opcode, drives dispatch and tracing.
+    static const OpCode OPCODES[256];
+
+    Cpu(Bus *bus) : bus(bus), cpuMode(INSTRUCTION_TESTS), entry(-1), traceSink(NULL), blockCache(NULL), jit(NULL), translated(NULL), cycles(0), end(0), skippedCycles(0), translatedCycles(0) { }
+    ~Cpu();
 
+    // Loads the program counter from the reset vector and puts registers in their power up state.
+    void reset();
+
+    // Resets and runs until the mode halts, or forever. NESTEST_LOG logs to std::cout unless there is a trace sink.
     void run();
 
+    // Runs whole instructions until at least budget cycles have passed, the last instruction can overshoot.
+    // Returns the cycles that were run, which is less than budget when stopped on a BRK or by stop().
+    unsigned long long runCycles(unsigned long long budget);
+    // Ends runCycles() after the current instruction, e.g. when a device raised an interrupt. Translated code
+    // continues to the end of its block.
+    void stop() { end = 0; }
+
+    // Runs one instruction and returns its cycles.
+    int step();
+
+    // Interrupts, taken between instructions: push pc and status and continue at the vector, in 7 cycles.
+    void nmi();
+    // Ignored while the interrupt disable flag is set, returns whether it was taken.
+    bool irq();
+    // The Cpu was halted for cycles, e.g. during OAM DMA.
+    void stall(unsigned int cycles) { this->cycles += cycles; }
+
+    // INSTRUCTION_TESTS by default, the power up state of a mode is set by the next reset().
+    void setMode(CpuMode mode) { cpuMode = mode; }
+    CpuMode getMode() { return cpuMode; }
+
+    // reset() starts at address instead of the reset vector, e.g. $C000 for the automated nestest. -1 uses the vector.
+    void setEntry(int address) { entry = address; }
+
+    // Off by default. Lets idle loops that read memory mapped I/O be fast-forwarded, e.g. polling for vertical blank.
+    // The caller makes sure that the devices keep returning the same values until the end of every budget of
+    // runCycles() and that reading them again changes nothing, like a Nes does by ending the budget where the Ppu could
+    // change its flags. Set it before running, loops that were found to read I/O without it aren't checked again.
+    void setStableIo(bool stable) { stableIo = stable; }
+
+    // Every executed instruction is passed to the sink, NULL disables tracing.
+    void setTraceSink(TraceSink *sink) { traceSink = sink; }
+
+    // Runs decoded basic blocks instead of decoding every instruction again, disabling drops the cached blocks.
+    // Also disables the JIT, which compiles the blocks of the replaced cache.
+    void setBlockCache(bool enabled);
+    // NULL when disabled.
+    BlockCache *getBlockCache() { return blockCache; }
+
+    // Compiles hot blocks to machine code, enabling the block cache as well.
+    // Returns false when the build or platform has no JIT (NES_JIT), disabling always succeeds.
+    bool setJit(bool enabled);
+    // NULL when disabled.
+    Jit *getJit() { return jit; }
+
+    // Runs the code NES_AOT translated ahead of time wherever it covers pc, everything else is interpreted.
+    // Returns false, leaving it disabled, when the PRG ROM on the bus is not the one that was translated. NULL disables.
+    bool setTranslatedRom(const TranslatedRom *rom);
+
     int getPC() { return pc; };
     unsigned char getA() { return a; };
     unsigned char getX() { return x; };
     unsigned char getY() { return y; };
     unsigned char getSP() { return sp; };
-    unsigned char getStatus() { return status; };
-    unsigned char getZero() { return (status & 0b0000'0010) >> 1; }
+    unsigned char getStatus();
+    unsigned char getZero() { return zeroResult == 0; }
+    unsigned long long getCycles() { return cycles; }
+    // Part of the cycles that was fast-forwarded in idle loops, see skipIdleLoop().
+    unsigned long long getSkippedCycles() { return skippedCycles; }
+    // Part of the cycles that ran in translated code, see setTranslatedRom().
+    unsigned long long getTranslatedCycles() { return translatedCycles; }
 
 private:
     void resetInterrupt();
+    void interrupt(unsigned short vector);
     void resetState();
     void execOpCode(unsigned char opCode);
-    void updateZeroAndNegativeFlag(unsigned char result);
-    void updateZeroFlag(unsigned char result);
-    void updateNegativeFlag(unsigned char result);
-    void updateOverflowFlag(unsigned char result);
-    void updateCarryFlag(unsigned short result);
+    // Instantiated per mode and for whether there is a trace sink, see CpuMode.
+    // The run loops stop at end
+    template <CpuMode mode, bool tracing> void runWith();
+    template <CpuMode mode, bool tracing> void runLoop();
+    template <CpuMode mode, bool tracing> void runThreaded();
+    template <CpuMode mode, bool tracing> void runBlocks();
+    template <CpuMode mode, bool tracing> bool halts(unsigned char opCode);
+    template <CpuMode mode, bool tracing> void finishTrace();
+    bool skipIdleLoop(Block *block);
+    int runCompiled(Block *block);
+    void runTranslated();
+    void setStatus(unsigned char value);
     void pushStack(unsigned char value);
     void pushStack_16(unsigned short value);
     unsigned char pullStack();
     unsigned short pullStack_16();
     void print();
-    void logLine();
+    void startTrace(unsigned char opCode);
+
+    // Adapts read-modify-write handlers, which return the written value, to the signature used in OPCODES.
+    template <unsigned char (Cpu::*handler)()>
+    void modify() { (this->*handler)(); }
+
+    template <unsigned char opCode> void unstable();
+    template <unsigned char opCode> void unknown();
 
     void brk();
-    void nop(AddressingMode addressingMode);
-    void adc(AddressingMode addressingMode);
+    template <AddressingMode mode> void nop();
+    template <AddressingMode mode> void adc();
     void adc_value(unsigned char value);
-    void sbc(AddressingMode addressingMode);
+    template <AddressingMode mode> void sbc();
     void sbc_value(unsigned char value);
     void sec();
     void sed();
     void sei();
-    void sta(AddressingMode addressingMode);
-    void stx(AddressingMode addressingMode);
-    void sty(AddressingMode addressingMode);
-    void bit(AddressingMode addressingMode);
-    void andOp(AddressingMode addressingMode);
-    void ora(AddressingMode addressingMode);
-    void eor(AddressingMode addressingMode);
-    unsigned char asl(AddressingMode addressingMode);
-    unsigned char rol(AddressingMode addressingMode);
-    unsigned char ror(AddressingMode addressingMode);
+    template <AddressingMode mode> void sta();
+    template <AddressingMode mode> void stx();
+    template <AddressingMode mode> void sty();
+    template <AddressingMode mode> void bit();
+    template <AddressingMode mode> void andOp();
+    template <AddressingMode mode> void ora();
+    template <AddressingMode mode> void eor();
+    template <AddressingMode mode> unsigned char asl();
+    template <AddressingMode mode> unsigned char rol();
+    template <AddressingMode mode> unsigned char ror();
     void clc();
     void cld();
     void cli();
     void clv();
-    void jmp(AddressingMode addressingMode);
+    template <AddressingMode mode> void jmp();
     void bcc();
     void bcs();
     void beq();
@@ -68,20 +154,21 @@ private:
     void bpl();
     void bvc();
     void bvs();
-    void lda(AddressingMode addressingMode);
-    void ldx(AddressingMode addressingMode);
-    void ldy(AddressingMode addressingMode);
+    void branch(bool condition);
+    template <AddressingMode mode> void lda();
+    template <AddressingMode mode> void ldx();
+    template <AddressingMode mode> void ldy();
     void tax();
     void tay();
     void tsx();
     void txa();
     void txs();
     void tya();
-    void cmp(AddressingMode addressingMode);
+    template <AddressingMode mode> void cmp();
     void cmp_value(unsigned char value);
-    void cpx(AddressingMode addressingMode);
-    void cpy(AddressingMode addressingMode);
-    unsigned char lsr(AddressingMode addressingMode);
+    template <AddressingMode mode> void cpx();
+    template <AddressingMode mode> void cpy();
+    template <AddressingMode mode> unsigned char lsr();
     void jsr();
     void rts();
     void pha();
@@ -89,32 +176,50 @@ private:
     void pla();
     void plp();
     void rti();
-    unsigned char dec(AddressingMode addressingMode);
+    template <AddressingMode mode> unsigned char dec();
     void dex();
     void dey();
-    unsigned char inc(AddressingMode addressingMode);
+    template <AddressingMode mode> unsigned char inc();
     void inx();
     void iny();
 
-    void slo(AddressingMode AddressingMode);
-    void rla(AddressingMode AddressingMode);
-    void sre(AddressingMode AddressingMode);
-    void rra(AddressingMode AddressingMode);
-    void sax(AddressingMode AddressingMode);
-    void lax(AddressingMode AddressingMode);
-    void dcp(AddressingMode AddressingMode);
-    void alr(AddressingMode AddressingMode);
-    void anc(AddressingMode AddressingMode);
-    void arr(AddressingMode AddressingMode);
-    void isb(AddressingMode AddressingMode);
-    void las(AddressingMode AddressingMode);
-
-    unsigned short getAddress(AddressingMode addressingMode);
+    template <AddressingMode mode> void slo();
+    template <AddressingMode mode> void rla();
+    template <AddressingMode mode> void sre();
+    template <AddressingMode mode> void rra();
+    template <AddressingMode mode> void sax();
+    template <AddressingMode mode> void lax();
+    template <AddressingMode mode> void dcp();
+    template <AddressingMode mode> void alr();
+    template <AddressingMode mode> void anc();
+    template <AddressingMode mode> void arr();
+    template <AddressingMode mode> void isb();
+    template <AddressingMode mode> void las();
+
+    template <AddressingMode mode> unsigned short getAddress();
+    template <AddressingMode mode> unsigned char readValue();
+
+    void fetchOperand(unsigned char bytes);
 
     Bus *bus;
-    ExecutionData *execData;
+    CpuMode cpuMode;
+    int entry;
+    TraceSink *traceSink;
+    BlockCache *blockCache;
+    Jit *jit;
+    const TranslatedRom *translated;
+    ExecutionData execData;
+
+    unsigned long long cycles;
+    unsigned long long end; // Of the budget of runCycles(), 0 after stop()
+    unsigned long long skippedCycles;
+    unsigned long long translatedCycles;
+    unsigned int loggedInstructions; // Since the last reset, only counted in NESTEST_LOG
+    bool pageCrossed; // Set by the indexed addressing modes
+    bool stableIo = false;
 
     unsigned short pc;
+    unsigned short operand; // Operand bytes of the current instruction
     unsigned char sp;
     unsigned char a;
     unsigned char x;
@@ -130,8 +235,26 @@ private:
     // I: Interrupt Disable
     // Z: Zero
     // C: Carry
+    // Only s, B, D and I are stored here, use getStatus() for the complete value.
     unsigned char status;
 
+    // Flags are evaluated lazily: instructions store the value the flag depends on, without any bit twiddling on status.
+    unsigned char negativeResult; // N is bit 7
+    unsigned char overflowResult; // V is bit 7
+    unsigned char zeroResult;     // Z is set if 0
+    unsigned char carry;          // C, 0 or 1
+
+    void updateZeroAndNegativeFlag(unsigned char result)
+    {
+        zeroResult = result;
+        negativeResult = result;
+    }
+
+    void updateCarryFlag(unsigned short result)
+    {
+        carry = result > 0xff;
+    }
+
     unsigned short getSP_16()
     {
         return 0x0100 | (0x0100 | sp);
@@ -139,16 +262,16 @@ private:
 
     unsigned char getCarry()
     {
-        return status & 0b0000'0001;
+        return carry;
     }
 
     unsigned char getNegative()
     {
-        return (status & 0b1000'0000) ? 1 : 0;
+        return negativeResult >> 7;
     }
 
     unsigned char getOverflow()
     {
-        return (status & 0b0100'0000) ? 1 : 0;
+        return overflowResult >> 7;
     }
 };
@@ -0,0 +1,13 @@
+#pragma once
+
+// What the Cpu emulates besides the instructions: power up state, when it halts, and what is logged.
+// The run loops are instantiated per mode, so the checks a mode doesn't need are compiled out. See Cpu::setMode().
+enum CpuMode
+{
+    NES_HARDWARE,      // Power up state of the NES, BRK is run like any other instruction
+    INSTRUCTION_TESTS, // Status 0, halts on BRK
+    NESTEST_LOG        // Status 0x24 like the nestest log, PLP and RTI keep bit 5. Halts on BRK or when the log is complete
+};
+
+// Lines in the nestest log, test/roms/01-expected-log.txt.
+const unsigned int NESTEST_LOG_LENGTH = 8991;
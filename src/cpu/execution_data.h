@@ -1,77 +1,102 @@
 #pragma once
 
-#include <iomanip>
-#include <iostream>
-#include <optional>
+#include <cstdio>
+#include <ostream>
 #include <string>
-#include <sstream>
 
+#include "addressing_mode.cpp"
+
+// Raw record of one executed instruction, captured before the instruction changes any state.
+// Only plain bytes are stored, formatting into the nestest log format happens in toString() when the record is output.
 class ExecutionData {
 public:
     unsigned short pc;
-    unsigned char opCode; 
-    unsigned char a, x, y; 
-    unsigned char sp, status; 
-    std::optional<unsigned char> param1;
-    std::optional<unsigned char> param2;
-    std::string opCodeName;
-    std::string address;
-
-    ExecutionData(): param1(std::nullopt), param2(std::nullopt) {
-    }
+    unsigned char opCode;
+    unsigned char params[2];
+    unsigned char paramCount;
+    unsigned char a, x, y;
+    unsigned char sp, status;
+    unsigned long long cycles; // Before execution
+    const char *opCodeName;
+    AddressingMode addressingMode;
+    unsigned short address; // Effective address
+    unsigned char value;    // Memory at the effective address, before execution
 
-    void setRegisters(unsigned char a, unsigned char x, unsigned char y, unsigned char sp, unsigned char status)
+    void logLine(std::ostream &out) const
     {
-        this->a = a;
-        this->x = x;
-        this->y = y;
-        this->sp = sp;
-        this->status = status;
+        out << toString() << '\n';
     }
 
-    void logLine()
+    std::string toString() const
     {
-        // PC
-        std::cout << std::setfill(' ') << std::left << std::setw(6) << toHex_16(pc);
-        
-        // CPU Opcode
-        std::ostringstream opCodeFormatted;
-        opCodeFormatted << toHex(opCode);
-        if (param1) opCodeFormatted << ' ' << toHex(*param1);
-        if (param2) opCodeFormatted << ' ' << toHex(*param2);
-        std::cout << std::setfill(' ') << std::left << std::setw(9) << opCodeFormatted.str();
-
-        // Assembly
-        std::cout << (opCodeName.length() == 3 ? " " : "") << std::setfill(' ') << std::left << std::setw(4) << opCodeName << (opCodeName.length() == 3 ? "" : " ");
-
-        // Address
-        if (opCode == 0x4c || opCode == 0x20) { // Absolute JMP and JSR
-            std::cout << std::setfill(' ') << std::left << std::setw(28) << ("$" + toHex(*param2) + toHex(*param1));
-        } else {
-            std::cout << std::setfill(' ') << std::left << std::setw(28) << address;
+        char bytes[9];
+        switch (paramCount)
+        {
+        case 0:
+            snprintf(bytes, sizeof(bytes), "%02X", opCode);
+            break;
+        case 1:
+            snprintf(bytes, sizeof(bytes), "%02X %02X", opCode, params[0]);
+            break;
+        default:
+            snprintf(bytes, sizeof(bytes), "%02X %02X %02X", opCode, params[0], params[1]);
         }
 
-        // Registers
-        std::cout << "A:" << std::hex << toHex(a);
-        std::cout << " X:" << std::hex << toHex(x);
-        std::cout << " Y:" << std::hex << toHex(y);
-        std::cout << " P:" << std::hex << toHex(status);
-        std::cout << " SP:" << std::hex << toHex(sp);
-
-        std::cout << std::endl;
+        char line[96];
+        snprintf(line, sizeof(line), "%04X  %-9s%4s %-28sA:%02X X:%02X Y:%02X P:%02X SP:%02X",
+                 pc, bytes, opCodeName, formatAddress().c_str(), a, x, y, status, sp);
+        return line;
     }
 
-    static std::string toHex(unsigned char byte)
+private:
+    std::string formatAddress() const
     {
-        std::ostringstream formatted;
-        formatted << std::setfill('0') << std::setw(2) << std::uppercase << std::hex << (int) byte;
-        return formatted.str();
-    }
+        unsigned short operand = (params[1] << 8) | params[0];
+        char formatted[32];
 
-    static std::string toHex_16(unsigned short bytes)
-    {
-        std::ostringstream formatted;
-        formatted << std::setfill('0') << std::setw(4) << std::uppercase << std::hex << bytes;
-        return formatted.str();
+        switch (addressingMode)
+        {
+        case IMPLIED:
+            return "";
+        case ACCUMULATOR:
+            return "A";
+        case IMMEDIATE:
+            snprintf(formatted, sizeof(formatted), "#$%02X", params[0]);
+            break;
+        case ZERO_PAGE:
+            snprintf(formatted, sizeof(formatted), "$%02X = %02X", params[0], value);
+            break;
+        case ZERO_PAGE_X:
+            snprintf(formatted, sizeof(formatted), "$%02X,X @ %02X = %02X", params[0], address, value);
+            break;
+        case ZERO_PAGE_Y:
+            snprintf(formatted, sizeof(formatted), "$%02X,Y @ %02X = %02X", params[0], address, value);
+            break;
+        case ABSOLUTE:
+            if (opCode == 0x4c || opCode == 0x20) // Absolute JMP and JSR
+                snprintf(formatted, sizeof(formatted), "$%04X", operand);
+            else
+                snprintf(formatted, sizeof(formatted), "$%04X = %02X", address, value);
+            break;
+        case ABSOLUTE_X:
+            snprintf(formatted, sizeof(formatted), "$%04X,X @ %04X = %02X", operand, address, value);
+            break;
+        case ABSOLUTE_Y:
+            snprintf(formatted, sizeof(formatted), "$%04X,Y @ %04X = %02X", operand, address, value);
+            break;
+        case INDIRECT:
+            snprintf(formatted, sizeof(formatted), "($%04X) = %04X", operand, address);
+            break;
+        case INDEXED_INDIRECT:
+            snprintf(formatted, sizeof(formatted), "($%02X,X) @ %02X = %04X = %02X", params[0], (params[0] + x) & 0xff, address, value);
+            break;
+        case INDIRECT_INDEXED:
+            snprintf(formatted, sizeof(formatted), "($%02X),Y = %04X @ %04X = %02X", params[0], (address - y) & 0xffff, address, value);
+            break;
+        case RELATIVE:
+            snprintf(formatted, sizeof(formatted), "$%04X", address);
+            break;
+        }
+        return formatted;
     }
 };
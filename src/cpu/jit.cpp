@@ -0,0 +1,783 @@
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <string>
+#include <vector>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "cpu.h"
+#include "jit.h"
+#include "../bus.h"
+
+// Host registers, numbered as in the instruction encoding.
+enum Reg { RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9, R10, R11, R12, R13, R14, R15 };
+
+// Guest state while a compiled block runs, every register holds a value of 0-255 except CYCLES.
+// Nothing is called from compiled code, so the caller saved registers can be used as well. RAX, RCX and RDX are scratch.
+static const Reg A = RBX, X = RBP, Y = R15, SP = RSI;
+static const Reg CARRY = R8, NEGATIVE = R9, ZERO = R10, OVERFLOW = R11;
+static const Reg CYCLES = R14, CPU = R12, RAM = R13, BUS = RDI;
+
+enum Alu { ADD = 0, OR = 1, AND = 4, SUB = 5, XOR = 6, CMP = 7 };
+enum Condition { BELOW = 0x2, ABOVE_EQUAL = 0x3, EQUAL = 0x4, NOT_EQUAL = 0x5 };
+
+// [base + index * scale + disp], index is -1 for none.
+struct Mem
+{
+    Reg base;
+    int index;
+    int scale;
+    int disp;
+};
+
+static Mem at(Reg base, int disp) { return {base, -1, 1, disp}; }
+static Mem at(Reg base, Reg index, int scale, int disp) { return {base, index, scale, disp}; }
+
+// Emits the few x86-64 instructions the translator needs. 32-bit operations unless noted.
+class Assembler
+{
+public:
+    std::vector<unsigned char> code;
+
+    void mov(Reg dst, Reg src, bool wide = false) { registers(wide, false, {0x89}, src, dst); }
+    void movImm(Reg dst, unsigned int imm) { rex(false, 0, 0, dst, false); byte(0xb8 + (dst & 7)); dword(imm); }
+    void movImm64(Reg dst, const void *pointer)
+    {
+        rex(true, 0, 0, dst, false);
+        byte(0xb8 + (dst & 7));
+        uint64_t value = (uintptr_t) pointer;
+        dword(value);
+        dword(value >> 32);
+    }
+
+    void loadByte(Reg dst, Mem m) { memory(0, false, false, {0x0f, 0xb6}, dst, m); } // Zero extended
+    void storeByte(Mem m, Reg src) { memory(0, false, true, {0x88}, src, m); }
+    void storeByteImm(Mem m, unsigned char imm) { memory(0, false, false, {0xc6}, 0, m); byte(imm); }
+    void storeWord(Mem m, Reg src) { memory(0x66, false, false, {0x89}, src, m); }
+    void storeWordImm(Mem m, unsigned short imm) { memory(0x66, false, false, {0xc7}, 0, m); byte(imm); byte(imm >> 8); }
+    void load64(Reg dst, Mem m) { memory(0, true, false, {0x8b}, dst, m); }
+    void store64(Mem m, Reg src) { memory(0, true, false, {0x89}, src, m); }
+
+    void alu(Alu op, Reg dst, Reg src, bool wide = false) { registers(wide, false, {(unsigned char) (op << 3 | 1)}, src, dst); }
+    void aluImm(Alu op, Reg dst, int imm, bool wide = false)
+    {
+        if (imm >= -128 && imm <= 127)
+        {
+            registers(wide, false, {0x83}, op, dst);
+            byte(imm);
+        }
+        else
+        {
+            registers(wide, false, {0x81}, op, dst);
+            dword(imm);
+        }
+    }
+    void aluByteImm(Alu op, Mem m, unsigned char imm) { memory(0, false, false, {0x80}, op, m); byte(imm); }
+    void cmpWordZero(Mem m) { memory(0x66, false, false, {0x83}, CMP, m); byte(0); }
+
+    void shl(Reg r, unsigned char count) { registers(false, false, {0xc1}, 4, r); byte(count); }
+    void shr(Reg r, unsigned char count) { registers(false, false, {0xc1}, 5, r); byte(count); }
+    void notOp(Reg r) { registers(false, false, {0xf7}, 2, r); }
+    void test(Reg a, Reg b, bool wide = false) { registers(wide, false, {0x85}, b, a); }
+    void testImm(Reg r, unsigned int imm) { registers(false, false, {0xf7}, 0, r); dword(imm); }
+
+    // r = condition ? 1 : 0
+    void set(Condition condition, Reg r)
+    {
+        registers(false, true, {0x0f, (unsigned char) (0x90 + condition)}, 0, r);
+        registers(false, true, {0x0f, 0xb6}, r, r);
+    }
+
+    // Jumps return the position of their displacement, for bind().
+    int jump(Condition condition) { byte(0x0f); byte(0x80 + condition); return displacement(); }
+    int jump() { byte(0xe9); return displacement(); }
+    // Points the jump at the next emitted instruction.
+    void bind(int jump)
+    {
+        int32_t distance = code.size() - (jump + 4);
+        memcpy(&code[jump], &distance, 4);
+    }
+
+    void push(Reg r) { rex(false, 0, 0, r, false); byte(0x50 + (r & 7)); }
+    void pop(Reg r) { rex(false, 0, 0, r, false); byte(0x58 + (r & 7)); }
+    void ret() { byte(0xc3); }
+
+private:
+    void byte(unsigned char value) { code.push_back(value); }
+    void dword(uint32_t value)
+    {
+        for (int i = 0; i < 4; i++)
+            byte(value >> (8 * i));
+    }
+
+    int displacement()
+    {
+        dword(0);
+        return code.size() - 4;
+    }
+
+    // Without a REX prefix byte registers 4-7 are AH-BH instead of SPL-DIL.
+    void rex(bool wide, int reg, int index, int base, bool force)
+    {
+        unsigned char prefix = 0x40 | wide << 3 | (reg >> 3 & 1) << 2 | (index >> 3 & 1) << 1 | (base >> 3 & 1);
+        if (prefix != 0x40 || force)
+            byte(prefix);
+    }
+
+    void registers(bool wide, bool byteRegisters, std::initializer_list<unsigned char> opCode, int reg, int rm)
+    {
+        bool force = byteRegisters && ((reg >= 4 && reg < 8) || (rm >= 4 && rm < 8));
+        rex(wide, reg, 0, rm, force);
+        for (unsigned char b : opCode)
+            byte(b);
+        byte(0xc0 | (reg & 7) << 3 | (rm & 7));
+    }
+
+    // Always a 32-bit displacement, which avoids the special cases of RBP and R13 as base.
+    void memory(unsigned char prefix, bool wide, bool byteRegister, std::initializer_list<unsigned char> opCode, int reg, Mem m)
+    {
+        if (prefix)
+            byte(prefix);
+        rex(wide, reg, m.index < 0 ? 0 : m.index, m.base, byteRegister && reg >= 4 && reg < 8);
+        for (unsigned char b : opCode)
+            byte(b);
+
+        bool sib = m.index >= 0 || (m.base & 7) == RSP;
+        byte(0x80 | (reg & 7) << 3 | (sib ? 4 : m.base & 7));
+        if (sib)
+        {
+            int scale = m.scale == 8 ? 3 : m.scale == 4 ? 2 : m.scale == 2 ? 1 : 0;
+            byte(scale << 6 | (m.index >= 0 ? m.index & 7 : 4) << 3 | (m.base & 7));
+        }
+        dword(m.disp);
+    }
+};
+
+// Translates the instructions of one block, see Jit.
+class Translator
+{
+public:
+    Assembler as;
+
+    Translator(const Jit::Layout &layout) : layout(layout) {}
+
+    // Returns the number of translated instructions, the code exits to the interpreter at the first one that isn't.
+    int translate(const Block *block);
+
+private:
+    // Leaves the block before the instruction at pc, when the jump is taken.
+    struct SideExit
+    {
+        int jump;
+        unsigned short pc;
+        unsigned int cycles;
+        int executed;
+    };
+
+    const Jit::Layout &layout;
+    std::vector<SideExit> sideExits;
+    std::vector<int> toEpilogue;
+
+    // Current instruction
+    const DecodedInstruction *instruction;
+    unsigned short pc;
+    int index;
+    unsigned int cycles; // Base cycles of the instructions before it
+    bool ended;          // Control flow instruction, which emitted its own exits
+
+    bool translateInstruction();
+    bool effectiveAddress(bool write, Mem &memory);
+    bool readValue();
+    void hostAddress(bool write);
+
+    void setZeroAndNegative(Reg value);
+    void shift(const std::string &name, Reg value);
+    void compare(Reg reg);
+    void branch(Condition taken);
+
+    void exitIf(Condition condition);
+    void exit(int exitPc, unsigned int exitCycles, int executed);
+    void prologue();
+    void epilogue();
+};
+
+int Translator::translate(const Block *block)
+{
+    prologue();
+
+    cycles = 0;
+    pc = block->start;
+    ended = false;
+    for (index = 0; index < block->count && !ended; index++)
+    {
+        instruction = &block->instructions[index];
+
+        size_t size = as.code.size();
+        size_t exits = sideExits.size();
+        if (!translateInstruction())
+        {
+            as.code.resize(size);
+            sideExits.resize(exits);
+            break;
+        }
+
+        cycles += instruction->cycles;
+        pc = instruction->nextPc;
+    }
+
+    if (!ended)
+        exit(pc, cycles, index); // pc is the end of the block, or the untranslated instruction
+
+    for (SideExit &sideExit : sideExits)
+    {
+        as.bind(sideExit.jump);
+        exit(sideExit.pc, sideExit.cycles, sideExit.executed);
+    }
+
+    epilogue();
+    return index;
+}
+
+bool Translator::translateInstruction()
+{
+    const OpCode &op = Cpu::OPCODES[instruction->opCode];
+    std::string name = op.name;
+    Mem memory;
+
+    if (name == "LDA" || name == "LDX" || name == "LDY")
+    {
+        if (!readValue())
+            return false;
+        Reg reg = name == "LDA" ? A : name == "LDX" ? X : Y;
+        as.mov(reg, RAX);
+        setZeroAndNegative(reg);
+    }
+    else if (name == "STA" || name == "STX" || name == "STY")
+    {
+        if (!effectiveAddress(true, memory))
+            return false;
+        as.storeByte(memory, name == "STA" ? A : name == "STX" ? X : Y);
+    }
+    else if (name == "TAX" || name == "TAY" || name == "TXA" || name == "TYA" || name == "TSX")
+    {
+        Reg from = name[1] == 'A' ? A : name[1] == 'X' ? X : name[1] == 'Y' ? Y : SP;
+        Reg to = name[2] == 'A' ? A : name[2] == 'X' ? X : Y;
+        as.mov(to, from);
+        setZeroAndNegative(to);
+    }
+    else if (name == "TXS")
+    {
+        as.mov(SP, X);
+    }
+    else if (name == "INX" || name == "INY" || name == "DEX" || name == "DEY")
+    {
+        Reg reg = name[2] == 'X' ? X : Y;
+        as.aluImm(name[0] == 'I' ? ADD : SUB, reg, 1);
+        as.aluImm(AND, reg, 0xff);
+        setZeroAndNegative(reg);
+    }
+    else if (name == "CLC" || name == "SEC")
+    {
+        as.movImm(CARRY, name == "SEC");
+    }
+    else if (name == "CLV")
+    {
+        as.movImm(OVERFLOW, 0);
+    }
+    else if (name == "CLI" || name == "SEI" || name == "CLD" || name == "SED")
+    {
+        unsigned char bit = name[2] == 'I' ? 0b0000'0100 : 0b0000'1000;
+        if (name[0] == 'C')
+            as.aluByteImm(AND, at(CPU, layout.status), ~bit);
+        else
+            as.aluByteImm(OR, at(CPU, layout.status), bit);
+    }
+    else if (name == "AND" || name == "ORA" || name == "EOR")
+    {
+        if (!readValue())
+            return false;
+        as.alu(name == "AND" ? AND : name == "ORA" ? OR : XOR, A, RAX);
+        setZeroAndNegative(A);
+    }
+    else if (name == "ADC")
+    {
+        if (!readValue())
+            return false;
+        // result = a + value + carry, overflow = (a ^ result) & (value ^ result)
+        as.mov(RCX, A);
+        as.alu(ADD, RCX, RAX);
+        as.alu(ADD, RCX, CARRY);
+        as.mov(CARRY, RCX);
+        as.shr(CARRY, 8);
+        as.mov(RDX, A);
+        as.alu(XOR, RDX, RCX);
+        as.alu(XOR, RAX, RCX);
+        as.alu(AND, RDX, RAX);
+        as.aluImm(AND, RDX, 0xff);
+        as.mov(OVERFLOW, RDX);
+        as.mov(A, RCX);
+        as.aluImm(AND, A, 0xff);
+        setZeroAndNegative(A);
+    }
+    else if (name == "SBC")
+    {
+        if (!readValue())
+            return false;
+        // result = a - value - 1 + carry, carry is set when it doesn't borrow, overflow = (a ^ result) & (~value ^ result)
+        as.mov(RCX, A);
+        as.alu(SUB, RCX, RAX);
+        as.aluImm(SUB, RCX, 1);
+        as.alu(ADD, RCX, CARRY);
+        as.aluImm(CMP, RCX, 0x100);
+        as.set(BELOW, CARRY);
+        as.mov(RDX, A);
+        as.alu(XOR, RDX, RCX);
+        as.notOp(RAX);
+        as.alu(XOR, RAX, RCX);
+        as.alu(AND, RDX, RAX);
+        as.aluImm(AND, RDX, 0xff);
+        as.mov(OVERFLOW, RDX);
+        as.mov(A, RCX);
+        as.aluImm(AND, A, 0xff);
+        setZeroAndNegative(A);
+    }
+    else if (name == "CMP" || name == "CPX" || name == "CPY")
+    {
+        if (!readValue())
+            return false;
+        compare(name == "CMP" ? A : name == "CPX" ? X : Y);
+    }
+    else if (name == "BIT")
+    {
+        if (!readValue())
+            return false;
+        as.mov(NEGATIVE, RAX);
+        as.mov(ZERO, A);
+        as.alu(AND, ZERO, RAX);
+        as.mov(OVERFLOW, RAX);
+        as.shl(OVERFLOW, 1);
+        as.aluImm(AND, OVERFLOW, 0xff);
+    }
+    else if (name == "ASL" || name == "LSR" || name == "ROL" || name == "ROR" || name == "INC" || name == "DEC")
+    {
+        if (op.mode == ACCUMULATOR)
+        {
+            shift(name, A);
+            return true;
+        }
+
+        if (!effectiveAddress(true, memory))
+            return false;
+        as.loadByte(RAX, memory);
+        if (name == "INC" || name == "DEC")
+        {
+            as.aluImm(name == "INC" ? ADD : SUB, RAX, 1);
+            as.aluImm(AND, RAX, 0xff);
+            setZeroAndNegative(RAX);
+        }
+        else
+        {
+            shift(name, RAX);
+        }
+        as.storeByte(memory, RAX);
+    }
+    else if (name == "NOP" && op.mode == IMPLIED)
+    {
+    }
+    else if (name == "PHA" || name == "JSR")
+    {
+        as.cmpWordZero(at(BUS, layout.watchedPages + 2 * 0x01)); // Stack page
+        exitIf(NOT_EQUAL);
+        if (name == "PHA")
+        {
+            as.storeByte(at(RAM, SP, 1, 0x100), A);
+            as.aluImm(SUB, SP, 1);
+            as.aluImm(AND, SP, 0xff);
+        }
+        else
+        {
+            unsigned short returnAddress = instruction->nextPc - 1;
+            as.storeByteImm(at(RAM, SP, 1, 0x100), returnAddress >> 8);
+            as.aluImm(SUB, SP, 1);
+            as.aluImm(AND, SP, 0xff);
+            as.storeByteImm(at(RAM, SP, 1, 0x100), returnAddress & 0xff);
+            as.aluImm(SUB, SP, 1);
+            as.aluImm(AND, SP, 0xff);
+            exit(instruction->operand, cycles + instruction->cycles, index + 1);
+            ended = true;
+        }
+    }
+    else if (name == "PLA")
+    {
+        as.aluImm(ADD, SP, 1);
+        as.aluImm(AND, SP, 0xff);
+        as.loadByte(A, at(RAM, SP, 1, 0x100));
+        setZeroAndNegative(A);
+    }
+    else if (name == "RTS")
+    {
+        as.aluImm(ADD, SP, 1);
+        as.aluImm(AND, SP, 0xff);
+        as.loadByte(RAX, at(RAM, SP, 1, 0x100));
+        as.aluImm(ADD, SP, 1);
+        as.aluImm(AND, SP, 0xff);
+        as.loadByte(RCX, at(RAM, SP, 1, 0x100));
+        as.shl(RCX, 8);
+        as.alu(OR, RCX, RAX);
+        as.aluImm(ADD, RCX, 1);
+        as.storeWord(at(CPU, layout.pc), RCX);
+        exit(-1, cycles + instruction->cycles, index + 1);
+        ended = true;
+    }
+    else if (name == "JMP" && op.mode == ABSOLUTE)
+    {
+        exit(instruction->operand, cycles + instruction->cycles, index + 1);
+        ended = true;
+    }
+    else if (op.mode == RELATIVE)
+    {
+        Reg flag = name == "BCC" || name == "BCS" ? CARRY : name == "BEQ" || name == "BNE" ? ZERO : name == "BMI" || name == "BPL" ? NEGATIVE : OVERFLOW;
+        if (flag == CARRY || flag == ZERO)
+            as.test(flag, flag);
+        else
+            as.testImm(flag, 0x80);
+
+        // Carry and bit 7 are set when not equal, the zero flag is set when its value is equal to 0
+        bool takenWhenZero = name == "BCC" || name == "BEQ" || name == "BPL" || name == "BVC";
+        branch(takenWhenZero ? EQUAL : NOT_EQUAL);
+    }
+    else
+    {
+        return false;
+    }
+
+    return true;
+}
+
+// Emits the host address of the operand into memory, with the page cross penalty and the checks that exit to the
+// interpreter. RAM is addressed through the RAM register, other pages are looked up in the page table of the Bus when
+// the code runs, as a mapper can switch them. False when the address is constant and memory mapped I/O, the
+// interpreter handles those and nothing is emitted then.
+bool Translator::effectiveAddress(bool write, Mem &memory)
+{
+    AddressingMode mode = Cpu::OPCODES[instruction->opCode].mode;
+    unsigned short operand = instruction->operand;
+
+    if (mode == ZERO_PAGE || mode == ABSOLUTE)
+    {
+        if (!layout.pages[operand >> 8])
+            return false; // I/O pages stay I/O
+        if (write)
+        {
+            as.cmpWordZero(at(BUS, layout.watchedPages + 2 * (operand >> 8)));
+            exitIf(NOT_EQUAL);
+        }
+        if (operand < Bus::RAM_END)
+        {
+            memory = at(RAM, operand % Bus::RAM_SIZE);
+        }
+        else
+        {
+            as.load64(RCX, at(BUS, (write ? layout.writePages : layout.readPages) + 8 * (operand >> 8)));
+            as.test(RCX, RCX, true);
+            exitIf(EQUAL); // Write to read only memory
+            memory = at(RCX, operand & 0xff);
+        }
+        return true;
+    }
+
+    switch (mode)
+    {
+    case ZERO_PAGE_X:
+    case ZERO_PAGE_Y:
+        as.mov(RCX, mode == ZERO_PAGE_X ? X : Y);
+        as.aluImm(ADD, RCX, operand);
+        as.aluImm(AND, RCX, 0xff);
+        break;
+    case ABSOLUTE_X:
+    case ABSOLUTE_Y:
+        as.movImm(RAX, operand); // Base for the page cross check
+        as.mov(RCX, mode == ABSOLUTE_X ? X : Y);
+        as.aluImm(ADD, RCX, operand);
+        as.aluImm(AND, RCX, 0xffff);
+        break;
+    case INDEXED_INDIRECT:
+        as.mov(RDX, X);
+        as.aluImm(ADD, RDX, operand);
+        as.aluImm(AND, RDX, 0xff);
+        as.loadByte(RAX, at(RAM, RDX, 1, 0));
+        as.aluImm(ADD, RDX, 1);
+        as.aluImm(AND, RDX, 0xff); // The pointer wraps around in the zero page
+        as.loadByte(RCX, at(RAM, RDX, 1, 0));
+        as.shl(RCX, 8);
+        as.alu(OR, RCX, RAX);
+        break;
+    case INDIRECT_INDEXED:
+        as.loadByte(RAX, at(RAM, operand & 0xff));
+        as.loadByte(RCX, at(RAM, (operand + 1) & 0xff));
+        as.shl(RCX, 8);
+        as.alu(OR, RCX, RAX);
+        as.mov(RAX, RCX);
+        as.alu(ADD, RCX, Y);
+        as.aluImm(AND, RCX, 0xffff);
+        break;
+    default:
+        return false;
+    }
+
+    if (instruction->pageCrossPenalty)
+    {
+        // RAX holds the base address, the penalty is only added once the instruction can't exit anymore
+        as.alu(XOR, RAX, RCX);
+        as.testImm(RAX, 0xff00);
+        as.set(NOT_EQUAL, RAX);
+    }
+    if (write)
+    {
+        as.mov(RDX, RCX);
+        as.shr(RDX, 8);
+        as.cmpWordZero(at(BUS, RDX, 2, layout.watchedPages));
+        exitIf(NOT_EQUAL);
+    }
+
+    if (mode == ZERO_PAGE_X || mode == ZERO_PAGE_Y)
+    {
+        memory = at(RAM, RCX, 1, 0);
+    }
+    else
+    {
+        hostAddress(write);
+        memory = at(RCX, 0);
+    }
+
+    if (instruction->pageCrossPenalty)
+        as.alu(ADD, CYCLES, RAX, true);
+    return true;
+}
+
+// Emits the operand value into RAX.
+bool Translator::readValue()
+{
+    if (Cpu::OPCODES[instruction->opCode].mode == IMMEDIATE)
+    {
+        as.movImm(RAX, instruction->operand);
+        return true;
+    }
+
+    Mem memory;
+    if (!effectiveAddress(false, memory))
+        return false;
+    as.loadByte(RAX, memory);
+    return true;
+}
+
+// Replaces the address in RCX by its host address, exits when the page has no memory.
+void Translator::hostAddress(bool write)
+{
+    as.mov(RDX, RCX);
+    as.shr(RDX, 8);
+    as.load64(RDX, at(BUS, RDX, 8, write ? layout.writePages : layout.readPages));
+    as.test(RDX, RDX, true);
+    exitIf(EQUAL); // Memory mapped I/O, or a write to read only memory
+    as.aluImm(AND, RCX, 0xff);
+    as.alu(ADD, RCX, RDX, true);
+}
+
+void Translator::setZeroAndNegative(Reg value)
+{
+    as.mov(ZERO, value);
+    as.mov(NEGATIVE, value);
+}
+
+// ASL, LSR, ROL or ROR of the value in a register, RCX is left alone.
+void Translator::shift(const std::string &name, Reg value)
+{
+    as.mov(RDX, value);
+    if (name == "ASL" || name == "ROL")
+    {
+        as.shl(value, 1);
+        if (name == "ROL")
+            as.alu(OR, value, CARRY);
+        as.aluImm(AND, value, 0xff);
+        as.shr(RDX, 7);
+    }
+    else
+    {
+        as.shr(value, 1);
+        if (name == "ROR")
+        {
+            as.shl(CARRY, 7);
+            as.alu(OR, value, CARRY);
+        }
+        as.aluImm(AND, RDX, 1);
+    }
+    as.mov(CARRY, RDX);
+    setZeroAndNegative(value);
+}
+
+// Compares the register with the value in RAX.
+void Translator::compare(Reg reg)
+{
+    as.mov(RCX, reg);
+    as.alu(SUB, RCX, RAX);
+    as.set(ABOVE_EQUAL, CARRY);
+    as.aluImm(AND, RCX, 0xff);
+    setZeroAndNegative(RCX);
+}
+
+// The flag is already tested, both ways leave the block.
+void Translator::branch(Condition taken)
+{
+    unsigned short next = instruction->nextPc;
+    unsigned short target = next + (signed char) instruction->operand;
+    unsigned int notTakenCycles = cycles + instruction->cycles;
+
+    int jump = as.jump(taken);
+    exit(next, notTakenCycles, index + 1);
+    as.bind(jump);
+    exit(target, notTakenCycles + (((next ^ target) & 0xff00) ? 2 : 1), index + 1);
+    ended = true;
+}
+
+// Side exit before the current instruction when the condition holds, emitted after the block.
+void Translator::exitIf(Condition condition)
+{
+    sideExits.push_back({as.jump(condition), pc, cycles, index});
+}
+
+// Stores pc, unless it is -1 because the code already did, and adds the cycles.
+void Translator::exit(int exitPc, unsigned int exitCycles, int executed)
+{
+    if (exitPc >= 0)
+        as.storeWordImm(at(CPU, layout.pc), exitPc);
+    if (exitCycles)
+        as.aluImm(ADD, CYCLES, exitCycles, true);
+    as.movImm(RAX, executed);
+    toEpilogue.push_back(as.jump());
+}
+
+// int block(Cpu *cpu)
+void Translator::prologue()
+{
+    for (Reg reg : {RBX, RBP, R12, R13, R14, R15})
+        as.push(reg);
+
+    as.mov(CPU, RDI, true);
+    as.movImm64(RAM, layout.ram);
+    as.movImm64(BUS, layout.bus);
+    as.loadByte(A, at(CPU, layout.a));
+    as.loadByte(X, at(CPU, layout.x));
+    as.loadByte(Y, at(CPU, layout.y));
+    as.loadByte(SP, at(CPU, layout.sp));
+    as.loadByte(CARRY, at(CPU, layout.carry));
+    as.loadByte(NEGATIVE, at(CPU, layout.negativeResult));
+    as.loadByte(ZERO, at(CPU, layout.zeroResult));
+    as.loadByte(OVERFLOW, at(CPU, layout.overflowResult));
+    as.load64(CYCLES, at(CPU, layout.cycles));
+}
+
+void Translator::epilogue()
+{
+    for (int jump : toEpilogue)
+        as.bind(jump);
+
+    as.storeByte(at(CPU, layout.a), A);
+    as.storeByte(at(CPU, layout.x), X);
+    as.storeByte(at(CPU, layout.y), Y);
+    as.storeByte(at(CPU, layout.sp), SP);
+    as.storeByte(at(CPU, layout.carry), CARRY);
+    as.storeByte(at(CPU, layout.negativeResult), NEGATIVE);
+    as.storeByte(at(CPU, layout.zeroResult), ZERO);
+    as.storeByte(at(CPU, layout.overflowResult), OVERFLOW);
+    as.store64(at(CPU, layout.cycles), CYCLES);
+
+    for (Reg reg : {R15, R14, R13, R12, RBP, RBX})
+        as.pop(reg);
+    as.ret();
+}
+
+#define OFFSET(member) (int) ((char *) &cpu->member - (char *) cpu)
+#define BUS_OFFSET(member) (int) ((char *) &bus->member - (char *) bus)
+
+Jit::Jit(Cpu *cpu, Bus *bus, BlockCache *blockCache) : blockCache(blockCache), flushes(blockCache->getFlushes())
+{
+    layout.pc = OFFSET(pc);
+    layout.cycles = OFFSET(cycles);
+    layout.a = OFFSET(a);
+    layout.x = OFFSET(x);
+    layout.y = OFFSET(y);
+    layout.sp = OFFSET(sp);
+    layout.status = OFFSET(status);
+    layout.negativeResult = OFFSET(negativeResult);
+    layout.overflowResult = OFFSET(overflowResult);
+    layout.zeroResult = OFFSET(zeroResult);
+    layout.carry = OFFSET(carry);
+    layout.bus = bus;
+    layout.ram = bus->ram;
+    layout.pages = bus->readPages;
+    layout.readPages = BUS_OFFSET(readPages);
+    layout.writePages = BUS_OFFSET(writePages);
+    layout.watchedPages = BUS_OFFSET(watchedPages);
+
+    // The arena is mapped twice, code is written through one mapping and runs from the other, so no page is writable
+    // and executable at once
+    int fd = memfd_create("nes-jit", MFD_CLOEXEC);
+    if (fd < 0)
+        return;
+    if (ftruncate(fd, ARENA_SIZE) == 0)
+    {
+        void *executable = mmap(NULL, ARENA_SIZE, PROT_READ | PROT_EXEC, MAP_SHARED, fd, 0);
+        void *writable = mmap(NULL, ARENA_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (executable != MAP_FAILED && writable != MAP_FAILED)
+        {
+            arena = (unsigned char *) executable;
+            arenaWritable = (unsigned char *) writable;
+        }
+        else
+        {
+            if (executable != MAP_FAILED)
+                munmap(executable, ARENA_SIZE);
+            if (writable != MAP_FAILED)
+                munmap(writable, ARENA_SIZE);
+        }
+    }
+    close(fd); // The mappings keep the memory
+}
+
+#undef OFFSET
+#undef BUS_OFFSET
+
+Jit::~Jit()
+{
+    if (arena)
+    {
+        munmap(arena, ARENA_SIZE);
+        munmap(arenaWritable, ARENA_SIZE);
+    }
+}
+
+CompiledBlock Jit::compile(const Block *block)
+{
+    // Flushed blocks took their code with them
+    if (blockCache->getFlushes() != flushes)
+    {
+        flushes = blockCache->getFlushes();
+        used = 0;
+    }
+
+    Translator translator(layout);
+    int translated = translator.translate(block);
+    std::vector<unsigned char> &code = translator.as.code;
+    if (translated == 0 || used + code.size() > ARENA_SIZE)
+        return NULL; // A full arena is reused after the next flush
+
+    memcpy(arenaWritable + used, code.data(), code.size());
+    unsigned char *start = arena + used;
+    used += (code.size() + 15) & ~(size_t) 15;
+
+    compiledBlocks++;
+    compiledInstructions += translated;
+    return (CompiledBlock) start;
+}
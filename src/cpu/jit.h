@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+
+#include "block_cache.h"
+
+class Bus;
+class Cpu;
+
+// Translates hot blocks of the BlockCache to x86-64 machine code (System V calling convention).
+// Within a compiled block a, x, y, sp, the lazy flag values and the cycle counter are kept in host registers.
+// Instructions that can't be translated, and accesses that have to go through the interpreter, end the compiled code
+// with a side exit: the registers are stored back and the block runner continues at that instruction. These are
+// reads and writes of memory mapped I/O, writes to read only memory and writes to a page with cached blocks, so the
+// interpreter invalidates the overwritten blocks and their code. Memory outside RAM is found through the page table
+// of the Bus when the code runs, so it follows the banks a mapper switches in.
+// The code of a block is dropped together with the block, the arena is reused after the BlockCache was flushed.
+// The arena is never writable and executable through the same mapping (W^X).
+class Jit
+{
+public:
+    // Runs of a block before it is compiled.
+    static const unsigned int THRESHOLD = 16;
+    static const size_t ARENA_SIZE = 32 << 20;
+
+    Jit(Cpu *cpu, Bus *bus, BlockCache *blockCache);
+    ~Jit();
+
+    // False when the arena couldn't be mapped.
+    bool isAvailable() { return arena != NULL; }
+
+    // NULL when the first instruction of the block can't be translated.
+    CompiledBlock compile(const Block *block);
+
+    unsigned long long getCompiledBlocks() { return compiledBlocks; }
+    unsigned long long getCompiledInstructions() { return compiledInstructions; }
+
+    // Where the compiled code finds the guest state, offsets are relative to the Cpu or the Bus.
+    struct Layout
+    {
+        int pc, cycles, a, x, y, sp, status, negativeResult, overflowResult, zeroResult, carry;
+        int readPages, writePages, watchedPages;
+        Bus *bus;
+        unsigned char *ram;
+        const unsigned char *const *pages; // Read page table, to find the I/O pages while translating
+    };
+
+private:
+    BlockCache *blockCache;
+    Layout layout;
+
+    unsigned char *arena = NULL; // Executable, the same memory as arenaWritable
+    unsigned char *arenaWritable = NULL;
+    size_t used = 0;
+    unsigned long long flushes; // Of the BlockCache when the arena was last reset
+
+    unsigned long long compiledBlocks = 0;
+    unsigned long long compiledInstructions = 0;
+};
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "addressing_mode.cpp"
+
+class Cpu;
+
+// Static description of one of the 256 opcodes, see Cpu::OPCODES.
+struct OpCode
+{
+    const char *name;
+    AddressingMode mode;
+    void (Cpu::*execute)();       // Handler instantiated for mode
+    unsigned char bytes;          // Including the opcode itself
+    unsigned char cycles;         // Base cycles
+    bool pageCrossPenalty;        // One extra cycle if the effective address crosses a page
+    bool official;
+};
+
+// Calls the macro X with every opcode from 0x00 to 0xff.
+#define FOR_EACH_OPCODE_ROW(X, high) \
+    X(0x##high##0) X(0x##high##1) X(0x##high##2) X(0x##high##3) X(0x##high##4) X(0x##high##5) X(0x##high##6) X(0x##high##7) \
+    X(0x##high##8) X(0x##high##9) X(0x##high##a) X(0x##high##b) X(0x##high##c) X(0x##high##d) X(0x##high##e) X(0x##high##f)
+#define FOR_EACH_OPCODE(X) \
+    FOR_EACH_OPCODE_ROW(X, 0) \
+    FOR_EACH_OPCODE_ROW(X, 1) \
+    FOR_EACH_OPCODE_ROW(X, 2) \
+    FOR_EACH_OPCODE_ROW(X, 3) \
+    FOR_EACH_OPCODE_ROW(X, 4) \
+    FOR_EACH_OPCODE_ROW(X, 5) \
+    FOR_EACH_OPCODE_ROW(X, 6) \
+    FOR_EACH_OPCODE_ROW(X, 7) \
+    FOR_EACH_OPCODE_ROW(X, 8) \
+    FOR_EACH_OPCODE_ROW(X, 9) \
+    FOR_EACH_OPCODE_ROW(X, a) \
+    FOR_EACH_OPCODE_ROW(X, b) \
+    FOR_EACH_OPCODE_ROW(X, c) \
+    FOR_EACH_OPCODE_ROW(X, d) \
+    FOR_EACH_OPCODE_ROW(X, e) \
+    FOR_EACH_OPCODE_ROW(X, f)
+
+// Opcode pairs that the block cache runs as one fused handler, chosen with NES_PAIR_PROFILE.
+#define FOR_EACH_FUSED_PAIR(X) \
+    X(0xa9, 0x85) /* LDA #imm; STA zp */      \
+    X(0xa9, 0x8d) /* LDA #imm; STA abs */     \
+    X(0xa5, 0x85) /* LDA zp; STA zp */        \
+    X(0xad, 0x8d) /* LDA abs; STA abs */      \
+    X(0xca, 0xd0) /* DEX; BNE */              \
+    X(0x88, 0xd0) /* DEY; BNE */              \
+    X(0xc9, 0xf0) /* CMP #imm; BEQ */         \
+    X(0xc9, 0xd0) /* CMP #imm; BNE */         \
+    X(0xe6, 0xd0) /* INC zp; BNE */           \
+    X(0xad, 0x10) /* LDA abs; BPL, e.g. waiting for vblank in $2002 */ \
+    X(0x2c, 0x10) /* BIT abs; BPL */
+
+struct FusedPair
+{
+    unsigned char first, second;
+};
+
+#define FUSED_PAIR(first, second) {first, second},
+constexpr FusedPair FUSED_PAIRS[] = { FOR_EACH_FUSED_PAIR(FUSED_PAIR) };
+#undef FUSED_PAIR
+constexpr int FUSED_PAIR_COUNT = sizeof(FUSED_PAIRS) / sizeof(FUSED_PAIRS[0]);
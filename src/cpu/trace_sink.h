@@ -0,0 +1,110 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdio>
+#include <ostream>
+#include <vector>
+
+#include "execution_data.h"
+
+// Receives a record of every executed instruction while attached to a Cpu.
+// When no sink is attached the Cpu does not record anything.
+class TraceSink
+{
+public:
+    virtual ~TraceSink() {}
+    virtual void trace(const ExecutionData &data) = 0;
+};
+
+// Writes every instruction as a line in the nestest log format.
+class LogTraceSink : public TraceSink
+{
+public:
+    LogTraceSink(std::ostream &out) : out(out) {}
+
+    void trace(const ExecutionData &data) override
+    {
+        data.logLine(out);
+    }
+
+private:
+    std::ostream &out;
+};
+
+// Keeps the raw records, they are only formatted when printed.
+class BufferTraceSink : public TraceSink
+{
+public:
+    std::vector<ExecutionData> records;
+
+    void trace(const ExecutionData &data) override
+    {
+        records.push_back(data);
+    }
+
+    void print(std::ostream &out) const
+    {
+        for (const ExecutionData &data : records)
+            data.logLine(out);
+    }
+};
+
+// Counts how often every opcode is directly followed by another, to choose the pairs the block cache fuses.
+class PairProfileTraceSink : public TraceSink
+{
+public:
+    struct Pair
+    {
+        unsigned char first, second;
+        unsigned long long count;
+    };
+
+    unsigned long long instructions = 0;
+
+    PairProfileTraceSink() : counts(0x10000, 0) {}
+
+    void trace(const ExecutionData &data) override
+    {
+        if (instructions++ > 0)
+            counts[previous << 8 | data.opCode]++;
+        previous = data.opCode;
+        names[data.opCode] = data.opCodeName;
+        modes[data.opCode] = data.addressingMode;
+    }
+
+    // Most frequent pairs first.
+    std::vector<Pair> top(size_t n) const
+    {
+        std::vector<Pair> pairs;
+        for (int i = 0; i < 0x10000; i++)
+            if (counts[i] > 0)
+                pairs.push_back({(unsigned char) (i >> 8), (unsigned char) i, counts[i]});
+        std::sort(pairs.begin(), pairs.end(), [](const Pair &a, const Pair &b) { return a.count > b.count; });
+        if (pairs.size() > n)
+            pairs.resize(n);
+        return pairs;
+    }
+
+    void print(std::ostream &out, size_t n) const
+    {
+        char line[80];
+        for (const Pair &pair : top(n))
+        {
+            snprintf(line, sizeof(line), "%02X %-4s %-16s %02X %-4s %-16s %10llu %5.2f%%",
+                     pair.first, names[pair.first], MODE_NAMES[modes[pair.first]],
+                     pair.second, names[pair.second], MODE_NAMES[modes[pair.second]],
+                     pair.count, 100.0 * pair.count / (instructions - 1));
+            out << line << '\n';
+        }
+    }
+
+private:
+    static constexpr const char *MODE_NAMES[] = {
+        "implied", "immediate", "zero page", "zero page,X", "zero page,Y", "absolute", "absolute,X", "absolute,Y",
+        "indirect", "(indirect,X)", "(indirect),Y", "accumulator", "relative"};
+
+    std::vector<unsigned long long> counts;
+    unsigned char previous = 0;
+    const char *names[256] = {};
+    AddressingMode modes[256] = {};
+};
@@ -0,0 +1,148 @@
+#pragma once
+
+#include "../bus.h"
+
+// Registers and lazy flags as in Cpu, for the code NES_AOT translates ahead of time (see src/aot).
+// The helpers do the same as the Cpu handlers they are named after.
+struct GuestState
+{
+    unsigned long long cycles;
+    unsigned short pc;
+    unsigned char a;
+    unsigned char x;
+    unsigned char y;
+    unsigned char sp;
+    unsigned char status; // Only s, B, D and I, like Cpu::status
+    unsigned char negativeResult;
+    unsigned char overflowResult;
+    unsigned char zeroResult;
+    unsigned char carry;
+
+    void updateZeroAndNegativeFlag(unsigned char result)
+    {
+        zeroResult = result;
+        negativeResult = result;
+    }
+
+    unsigned char getStatus()
+    {
+        return (status & 0b0011'1100)
+            | (negativeResult & 0b1000'0000)
+            | ((overflowResult & 0b1000'0000) >> 1)
+            | (zeroResult == 0 ? 0b0000'0010 : 0)
+            | carry;
+    }
+
+    void pushStack(Bus *bus, unsigned char value)
+    {
+        bus->write_8(0x0100 | sp, value);
+        sp--;
+    }
+
+    unsigned char pullStack(Bus *bus)
+    {
+        sp++;
+        return bus->read(0x0100 | sp);
+    }
+
+    void adc(unsigned char value)
+    {
+        unsigned short result = a + value + carry;
+        updateZeroAndNegativeFlag(result);
+        carry = result > 0xff;
+        overflowResult = (a ^ result) & (value ^ result);
+        a = result;
+    }
+
+    void sbc(unsigned char value)
+    {
+        unsigned short result = a - (value + (carry ? 0 : 1));
+        updateZeroAndNegativeFlag(result);
+        carry = result <= 0xff;
+        overflowResult = (a ^ result) & ((~value) ^ result);
+        a = result;
+    }
+
+    // CMP, CPX and CPY
+    void compare(unsigned char reg, unsigned char value)
+    {
+        unsigned char result = reg - value;
+        carry = reg >= value;
+        updateZeroAndNegativeFlag(result);
+    }
+
+    void bit(unsigned char value)
+    {
+        zeroResult = a & value;
+        negativeResult = value;
+        overflowResult = value << 1;
+    }
+
+    unsigned char asl(unsigned char value)
+    {
+        unsigned char result = value << 1;
+        updateZeroAndNegativeFlag(result);
+        carry = value >> 7;
+        return result;
+    }
+
+    unsigned char lsr(unsigned char value)
+    {
+        unsigned char result = value >> 1;
+        updateZeroAndNegativeFlag(result);
+        carry = value & 0x01;
+        return result;
+    }
+
+    unsigned char rol(unsigned char value)
+    {
+        unsigned char result = (value << 1) | carry;
+        updateZeroAndNegativeFlag(result);
+        carry = (value & 0b1000'0000) >> 7;
+        return result;
+    }
+
+    unsigned char ror(unsigned char value)
+    {
+        unsigned char result = (value >> 1) | (carry << 7);
+        updateZeroAndNegativeFlag(result);
+        carry = value & 0b0000'0001;
+        return result;
+    }
+};
+
+// Translated code of the block that starts at start. It runs the whole block, adds its cycles and sets pc to the
+// address where execution continues. Returns false when it stopped before an instruction that accesses I/O instead,
+// with pc at that instruction, which the Cpu interprets so the devices see its cycles.
+struct TranslatedBlock
+{
+    unsigned short start;
+    unsigned short maxCycles; // With every penalty, the Cpu interprets a block that could overshoot the budget
+    bool (*run)(GuestState &state, Bus *bus);
+};
+
+// Generated by NES_AOT for one NROM image, see Cpu::setTranslatedRom().
+struct TranslatedRom
+{
+    const char *name;
+    unsigned int checksum; // Of the PRG ROM it was translated from, see computeChecksum()
+    int blockCount;
+    const TranslatedBlock *blocks;
+    const unsigned short *index; // Indexed by pc - $8000, 1 + index in blocks or 0 when no block starts there
+
+    // NULL when no block starts at pc.
+    const TranslatedBlock *find(unsigned short pc) const
+    {
+        unsigned short number = pc >= 0x8000 ? index[pc - 0x8000] : 0;
+        return number != 0 ? &blocks[number - 1] : NULL;
+    }
+
+    // FNV-1a of $8000-$FFF9 on the bus. The vectors are left out, tests and tools point the reset vector elsewhere.
+    static unsigned int computeChecksum(Bus *bus)
+    {
+        unsigned int hash = 2166136261u;
+        for (unsigned int address = 0x8000; address < 0xfffa; address++)
+            hash = (hash ^ bus->read(address)) * 16777619u;
+        return hash;
+    }
+};
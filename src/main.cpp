@@ -1,20 +1,104 @@
+#include <fstream>
 #include <iostream>
+#include <memory>
+#include <stdexcept>
 #include <string>
+#include <vector>
 #include <stdlib.h>
 
 #include "cpu/cpu.h"
 #include "bus.h"
-#include "bus.h"
+#include "nes.h"
+#include "ppu/frame_converter.h"
 #include "rom.cpp"
 
 using std::string;
 
-int main(int, char**) {
-    Bus bus;
-    Rom rom("../../test/roms/01.nes");
-    bus.insertDisk(&rom);
-    bus.write_16(bus.RESET_VECTOR_ADDR, 0xc000);
+// Writes the frame as a binary PPM image.
+static void writePpm(const string &file, Nes &nes)
+{
+    std::vector<uint32_t> rgba(Ppu::WIDTH * Ppu::HEIGHT);
+    FrameConverter().toRgba(nes.getFrame(), nes.getEmphasis(), rgba.data());
+
+    std::ofstream out(file, std::ios::binary);
+    out << "P6\n" << Ppu::WIDTH << " " << Ppu::HEIGHT << "\n255\n";
+    for (uint32_t color : rgba)
+    {
+        char pixel[3] = {(char) color, (char) (color >> 8), (char) (color >> 16)};
+        out.write(pixel, 3);
+    }
+}
+
+// Usage: NES [--log | --hardware] [rom.nes]
+//        NES --frames N [--ppm image.ppm] [--ppu scanlines | dots | auto] [--pipelined]
+//            [--threads N] rom.nes
+// Runs the ROM from its reset vector, or nestest from $C000 until its final BRK when no ROM is given. --log prints
+// the nestest log instead of the registers, --hardware starts in the power up state of the NES and doesn't halt on BRK.
+// --frames runs the ROM on the whole console, Cpu and Ppu, for N frames without a display, and --ppm saves the last.
+// --ppu picks how the Ppu renders, auto by default: by dots only for frames after writes in the middle of a line.
+// --pipelined draws the frames on a second thread, --threads draws the lines of a frame on N threads.
+int main(int argc, char** argv) {
+    CpuMode mode = INSTRUCTION_TESTS;
+    string file;
+    int frames = 0;
+    string image;
+    PpuRenderer renderer = AUTO;
+    bool pipelined = false;
+    int threads = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        if (arg == "--log")
+            mode = NESTEST_LOG;
+        else if (arg == "--hardware")
+            mode = NES_HARDWARE;
+        else if (arg == "--frames" && i + 1 < argc)
+            frames = atoi(argv[++i]);
+        else if (arg == "--ppm" && i + 1 < argc)
+            image = argv[++i];
+        else if (arg == "--ppu" && i + 1 < argc)
+        {
+            string name = argv[++i];
+            renderer = name == "scanlines" ? SCANLINES : name == "dots" ? DOTS : AUTO;
+        }
+        else if (arg == "--pipelined")
+            pipelined = true;
+        else if (arg == "--threads" && i + 1 < argc)
+            threads = atoi(argv[++i]);
+        else
+            file = arg;
+    }
+
+    try
+    {
+        std::shared_ptr<const Rom> rom = std::make_shared<const Rom>(file.empty() ? "../../test/roms/01.nes" : file);
+        if (frames > 0)
+        {
+            Nes nes;
+            nes.getPpu().setRenderer(renderer);
+            nes.getPpu().setThreads(threads);
+            nes.setPipelined(pipelined);
+            nes.insertDisk(rom);
+            for (int frame = 0; frame < frames; frame++)
+                nes.runFrame();
+            nes.flush();
+            if (!image.empty())
+                writePpm(image, nes);
+            return 0;
+        }
+
+        Bus bus;
+        bus.insertDisk(rom);
 
-    Cpu cpu(&bus);
-    cpu.run();
-}
\ No newline at end of file
+        Cpu cpu(&bus);
+        cpu.setMode(mode);
+        if (file.empty())
+            cpu.setEntry(0xc000);
+        cpu.run();
+    }
+    catch (const std::invalid_argument &e)
+    {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+}
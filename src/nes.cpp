@@ -0,0 +1,114 @@
+#include <variant>
+
+#include "nes.h"
+#include "cartridge/cartridge.h"
+
+Nes::Nes() : cpu(&bus), ppu(&bus, &cpu), sync(CATCH_UP)
+{
+    cpu.setMode(NES_HARDWARE);
+    cpu.setStableIo(true); // runFrame() ends the budget of the Cpu where the Ppu changes the status flags
+    if (!cpu.setJit(true))
+        cpu.setBlockCache(true);
+    reset();
+}
+
+void Nes::insertDisk(std::shared_ptr<const Rom> rom)
+{
+    bus.insertDisk(rom);
+    reset();
+}
+
+void Nes::reset()
+{
+    cpu.reset();
+    ppu.reset(cpu.getCycles() * 3);
+    ppu.setRasterizing(!pipelined);
+    renderThread.reset(); // Before the new one copies the cartridge
+    shown = 0;
+    if (pipelined)
+        renderThread.reset(new RenderThread(bus, cpu.getCycles() * 3, ppu.getThreads()));
+    bus.setIoListener(renderThread ? this : NULL); // Accesses between frames are replayed as well
+}
+
+void Nes::runFrame()
+{
+    bus.setIoListener(this);
+    running = true;
+    if (renderThread)
+        renderThread->setRenderer(ppu.getRenderer());
+    unsigned long long frame = ppu.getFrameCount();
+    while (true)
+    {
+        ppu.runTo(cpu.getCycles() * 3);
+        if (ppu.getFrameCount() != frame)
+        {
+            if (renderThread)
+            {
+                renderThread->endFrame(cpu.getCycles() * 3);
+                renderThread->waitForFrames(frame);
+                shown = frame;
+            }
+            break;
+        }
+
+        if (interrupt())
+            continue;
+        if (sync == LOCKSTEP || irqAsserted())
+            cpu.step(); // An IRQ waits for the program to clear the interrupt flag
+        else
+            cpu.runCycles((ppu.nextEvent() + 2) / 3 - cpu.getCycles());
+    }
+    running = false;
+    bus.setIoListener(renderThread ? this : NULL);
+}
+
+void Nes::flush()
+{
+    if (renderThread)
+    {
+        renderThread->waitForFrames(ppu.getFrameCount());
+        shown = ppu.getFrameCount();
+    }
+}
+
+// The Ppu catches up to the dot of the access first, so reads see what happened before it and writes change what
+// follows. Writes that can change when the next event is, or raise an NMI, end the run.
+void Nes::accessing(unsigned short address, bool write)
+{
+    if (!running)
+        return;
+    accessDot = (cpu.getCycles() + ACCESS_CYCLE) * 3;
+    ppu.runTo(accessDot);
+    bool scrollOrData = address < 0x4000 && (address & 7) >= 5;
+    if (write && !scrollOrData)
+        cpu.stop();
+}
+
+// Pipelined, the RenderThread replays what changes the Ppu: its registers, OAM DMA and the registers of the mapper.
+void Nes::accessed(unsigned short address, unsigned char value, bool write)
+{
+    if (!renderThread)
+        return;
+    if (address == Ppu::OAM_DMA && write)
+        renderThread->copyOam(accessDot, running, ppu);
+    else if (address < 0x4000 || (address >= 0x4020 && write))
+        renderThread->access(accessDot, running, address, value, write);
+}
+
+bool Nes::interrupt()
+{
+    if (ppu.takeNmi())
+    {
+        cpu.nmi();
+        return true;
+    }
+    return irqAsserted() && cpu.irq();
+}
+
+// The IRQ of MMC3 stays asserted until the program acknowledges it.
+bool Nes::irqAsserted()
+{
+    Cartridge *cartridge = bus.getCartridge();
+    Mmc3 *mmc3 = cartridge ? std::get_if<Mmc3>(&cartridge->getMapper()) : NULL;
+    return mmc3 && mmc3->irqPending;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <memory>
+
+#include "bus.h"
+#include "cpu/cpu.h"
+#include "ppu/ppu.h"
+#include "render_thread.h"
+
+// How the Ppu keeps up with the Cpu.
+enum PpuSync
+{
+    LOCKSTEP, // The Cpu runs one instruction at a time, the Ppu catches up before every instruction. The reference.
+    CATCH_UP, // The Cpu runs until the next line the program could notice, or until it accesses a device
+};
+
+// The console: the Cpu and the Ppu on one Bus. The Cpu leads, the Ppu catches up, 3 dots per Cpu cycle, whenever the
+// Cpu accesses a device or reaches a line that raises an interrupt or changes the status flags.
+// Both ways of syncing render the same frames, interrupts are taken between instructions either way.
+// Pipelined, a RenderThread draws the frames on another core while the Cpu runs the next frame.
+class Nes : private IoListener
+{
+public:
+    Nes();
+    Nes(const Nes &) = delete; // The Bus points into the Nes
+    Nes &operator=(const Nes &) = delete;
+
+    // Inserts the ROM and resets, throws std::invalid_argument for unsupported mappers.
+    void insertDisk(std::shared_ptr<const Rom> rom);
+    // Resets the Cpu from the reset vector and the Ppu to the first line of a frame.
+    void reset();
+    // CATCH_UP by default.
+    void setSync(PpuSync sync) { this->sync = sync; }
+    // Off by default. Takes effect at the next reset, which starts the RenderThread from the state of the Ppu, with as
+    // many threads as the Ppu (see Ppu::setThreads()).
+    void setPipelined(bool pipelined) { this->pipelined = pipelined; }
+
+    // Runs until the Ppu completed the frame. Accesses between frames, e.g. by tests, don't move the Ppu.
+    // Pipelined, it also waits until the frame before is drawn.
+    void runFrame();
+    // Pipelined, waits until the frame that ran last is drawn, so getFrame() returns it.
+    void flush();
+    // Palette indices, see Ppu::getFrame(). Pipelined, the frame before the one that ran last, unless flushed.
+    const unsigned char *getFrame() { return renderThread ? renderThread->getFrame(shown) : ppu.getFrame(); }
+    // Of the lines of getFrame(), see Ppu::getEmphasis().
+    const unsigned char *getEmphasis() { return renderThread ? renderThread->getEmphasis(shown) : ppu.getEmphasis(); }
+
+    Bus &getBus() { return bus; }
+    Cpu &getCpu() { return cpu; }
+    Ppu &getPpu() { return ppu; }
+
+private:
+    // Of an instruction, counted from 0. Programs access the registers with absolute loads and stores, which do that on
+    // their last cycle.
+    static const int ACCESS_CYCLE = 3;
+
+    Bus bus;
+    Cpu cpu;
+    Ppu ppu;
+    PpuSync sync;
+    bool pipelined = false;
+    std::unique_ptr<RenderThread> renderThread;
+    unsigned long long shown = 0; // Pipelined, the frame getFrame() returns
+    bool running = false; // In runFrame()
+    unsigned long long accessDot; // What the Ppu caught up to for the current access
+
+    void accessing(unsigned short address, bool write) override;
+    void accessed(unsigned short address, unsigned char value, bool write) override;
+    bool interrupt();
+    bool irqAsserted();
+};
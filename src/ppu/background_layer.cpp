@@ -0,0 +1,106 @@
+#include <cstring>
+
+#include "background_layer.h"
+
+void BackgroundLayer::invalidate()
+{
+    for (int table = 0; table < 4; table++)
+        for (int row = 0; row < ROWS; row++)
+        {
+            for (int column = 0; column < 32; column++)
+                dirtyTiles[table][row][column] = true;
+            dirtyRows[table][row] = true;
+            versions[table][row]++;
+        }
+}
+
+void BackgroundLayer::written(unsigned short offset)
+{
+    int table = offset >> 10;
+    int index = offset & 0x3ff;
+    if (index < ROWS * 32)
+    {
+        markDirty(table, index >> 5, index & 0x1f);
+        return;
+    }
+
+    // A byte of the attribute table has the palettes of 4x4 tiles
+    int top = ((index - 0x3c0) >> 3) * 4;
+    int left = (index & 0x07) * 4;
+    for (int row = top; row < top + 4 && row < ROWS; row++)
+        for (int column = left; column < left + 4; column++)
+            markDirty(table, row, column);
+}
+
+void BackgroundLayer::update(const TileCache &tiles, int patternTable)
+{
+    int first = patternTable / TileCache::TILES_PER_BANK;
+    if (patternTable != this->patternTable)
+    {
+        this->patternTable = patternTable;
+        for (int bank = first; bank < first + 4; bank++)
+            decodes[bank] = tiles.getDecodeCount(bank);
+        invalidate();
+        return;
+    }
+
+    // Banks of the pattern table that were decoded again, a bit each
+    unsigned char changed = 0;
+    for (int bank = first; bank < first + 4; bank++)
+    {
+        if (tiles.getDecodeCount(bank) != decodes[bank])
+        {
+            decodes[bank] = tiles.getDecodeCount(bank);
+            changed |= 1 << (bank - first);
+        }
+    }
+    if (!changed)
+        return;
+
+    // Only the tiles that were rendered with a pattern of those banks
+    for (int table = 0; table < 4; table++)
+        for (int row = 0; row < ROWS; row++)
+            for (int column = 0; column < 32; column++)
+                if (changed & (1 << (tileNumbers[table][row][column] / TileCache::TILES_PER_BANK)))
+                    markDirty(table, row, column);
+}
+
+const unsigned char *BackgroundLayer::getLine(int table, int line, const unsigned char *vram, const TileCache &tiles)
+{
+    int row = line >> 3;
+    if (dirtyRows[table][row])
+    {
+        for (int column = 0; column < 32; column++)
+            if (dirtyTiles[table][row][column])
+                renderTile(table, row, column, vram, tiles);
+        dirtyRows[table][row] = false;
+    }
+    return pixels[table][line];
+}
+
+void BackgroundLayer::markDirty(int table, int row, int column)
+{
+    if (!dirtyTiles[table][row][column])
+    {
+        dirtyTiles[table][row][column] = true;
+        dirtyRows[table][row] = true;
+    }
+    versions[table][row]++;
+}
+
+void BackgroundLayer::renderTile(int table, int row, int column, const unsigned char *vram, const TileCache &tiles)
+{
+    const unsigned char *nametable = vram + table * 0x400;
+    unsigned char tile = nametable[row * 32 + column];
+    unsigned char attribute = nametable[0x3c0 + (row >> 2) * 8 + (column >> 2)];
+    int shift = ((row & 0x02) << 1) | (column & 0x02);
+    unsigned char palette = (attribute >> shift) & 0x03;
+
+    for (int y = 0; y < 8; y++)
+    {
+        uint64_t pixels = TileCache::colorRow(tiles.getRow(patternTable + tile, y), palette);
+        memcpy(this->pixels[table][row * 8 + y] + column * 8, &pixels, 8);
+    }
+    tileNumbers[table][row][column] = tile;
+    dirtyTiles[table][row][column] = false;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "tile_cache.h"
+
+// The 4 nametables of vram pre-rendered to background colors 0-15 (palette * 4 + pixel), a byte per pixel, so the
+// scanline renderer copies a line instead of fetching 33 tiles. A tile is only rendered again after its nametable
+// byte, its attribute byte or the bank of its pattern changed.
+class BackgroundLayer
+{
+public:
+    static const int ROWS = 30; // Of tiles, the attribute table is below them
+    static const int WIDTH = 256;
+
+    // Every tile is rendered again, e.g. after a reset.
+    void invalidate();
+    // A byte of the nametables changed, offset 0-0xFFF in vram.
+    void written(unsigned short offset);
+    // Marks the tiles whose pattern was decoded again since the last update, or all of them when the background
+    // moved to the other pattern table (0 or 256).
+    void update(const TileCache &tiles, int patternTable);
+
+    // Line 0-239 of nametable 0-3, renders the tiles of the row that changed first.
+    const unsigned char *getLine(int table, int line, const unsigned char *vram, const TileCache &tiles);
+    // Changes whenever a tile of the row changes, before it is rendered again.
+    unsigned int getVersion(int table, int row) { return versions[table][row]; }
+
+private:
+    unsigned char pixels[4][ROWS * 8][WIDTH];
+    bool dirtyTiles[4][ROWS][32];
+    bool dirtyRows[4][ROWS];
+    unsigned char tileNumbers[4][ROWS][32] = {}; // Of the pattern the tile was rendered with
+    unsigned int versions[4][ROWS] = {};
+    unsigned int decodes[8] = {};
+    int patternTable = -1;
+
+    void markDirty(int table, int row, int column);
+    void renderTile(int table, int row, int column, const unsigned char *vram, const TileCache &tiles);
+};
@@ -0,0 +1,291 @@
+#include "frame_converter.h"
+#include "palette.h"
+#include "ppu.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define NES_X86_SIMD
+#include <immintrin.h>
+#endif
+
+// The emphasis bits of PPUMASK make the colors of the other bits darker, approximated as 3/4 of the channel for each
+// of them.
+static unsigned int emphasize(unsigned int rgb, unsigned char emphasis)
+{
+    unsigned int result = 0;
+    for (int channel = 0; channel < 3; channel++) // Red is emphasis bit 0 and the highest byte
+    {
+        unsigned int value = (rgb >> (16 - channel * 8)) & 0xff;
+        for (int bit = 0; bit < 3; bit++)
+        {
+            if (bit != channel && (emphasis & (1 << bit)))
+                value = value * 3 / 4;
+        }
+        result |= value << (16 - channel * 8);
+    }
+    return result;
+}
+
+// Splits the 64 values of a byte in tables of 16, each xor-ed with the one before it.
+static void splitTables(const unsigned char *values, unsigned char tables[4][16])
+{
+    for (int table = 0; table < 4; table++)
+    {
+        for (int i = 0; i < 16; i++)
+            tables[table][i] = values[table * 16 + i] ^ (table > 0 ? values[(table - 1) * 16 + i] : 0);
+    }
+}
+
+FrameConverter::FrameConverter()
+{
+    for (int emphasis = 0; emphasis < 8; emphasis++)
+    {
+        unsigned char bytes[5][64];
+        for (int index = 0; index < 64; index++)
+        {
+            unsigned int rgb = emphasize(NES_PALETTE[index], emphasis);
+            unsigned char r = rgb >> 16, g = rgb >> 8, b = rgb;
+            rgbaColors[emphasis][index] = r | g << 8 | b << 16 | 0xffu << 24;
+            uint16_t rgb565 = (r >> 3) << 11 | (g >> 2) << 5 | b >> 3;
+            rgb565Colors[emphasis][index] = rgb565;
+
+            bytes[0][index] = r;
+            bytes[1][index] = g;
+            bytes[2][index] = b;
+            bytes[3][index] = rgb565 & 0xff;
+            bytes[4][index] = rgb565 >> 8;
+        }
+        for (int byte = 0; byte < 3; byte++)
+            splitTables(bytes[byte], rgbaTables[emphasis][byte]);
+        for (int byte = 0; byte < 2; byte++)
+            splitTables(bytes[3 + byte], rgb565Tables[emphasis][byte]);
+    }
+
+    simd = SCALAR;
+    setSimd(AVX2) || setSimd(SSSE3);
+}
+
+bool FrameConverter::isSupported(Simd simd)
+{
+#ifdef NES_X86_SIMD
+    if (simd == SSSE3)
+        return __builtin_cpu_supports("ssse3");
+    if (simd == AVX2)
+        return __builtin_cpu_supports("avx2");
+#endif
+    return simd == SCALAR;
+}
+
+bool FrameConverter::setSimd(Simd simd)
+{
+    if (!isSupported(simd))
+        return false;
+    this->simd = simd;
+    return true;
+}
+
+#ifdef NES_X86_SIMD
+
+// The byte of the table for each index 0-63, given as index - 16 * table: pshufb looks up the low 4 bits and gives 0
+// for the negative ones, so only the tables up to the one of the index are xor-ed together.
+__attribute__((target("ssse3")))
+static inline __m128i lookup(const __m128i tables[4], const __m128i indices[4])
+{
+    __m128i result = _mm_shuffle_epi8(tables[0], indices[0]);
+    for (int table = 1; table < 4; table++)
+        result = _mm_xor_si128(result, _mm_shuffle_epi8(tables[table], indices[table]));
+    return result;
+}
+
+__attribute__((target("ssse3")))
+static inline void loadIndices(const unsigned char *pixels, __m128i indices[4])
+{
+    indices[0] = _mm_and_si128(_mm_loadu_si128((const __m128i *) pixels), _mm_set1_epi8(0x3f));
+    for (int table = 1; table < 4; table++)
+        indices[table] = _mm_sub_epi8(indices[0], _mm_set1_epi8(table * 16));
+}
+
+__attribute__((target("ssse3")))
+static void toRgbaSsse3(const unsigned char *frame, const unsigned char *emphasis, uint32_t *out,
+                        const unsigned char (*rgbaTables)[3][4][16])
+{
+    for (int y = 0; y < Ppu::HEIGHT; y++)
+    {
+        __m128i tables[3][4];
+        for (int byte = 0; byte < 3; byte++)
+            for (int table = 0; table < 4; table++)
+                tables[byte][table] = _mm_load_si128((const __m128i *) rgbaTables[emphasis[y] & 7][byte][table]);
+
+        for (int x = 0; x < Ppu::WIDTH; x += 16)
+        {
+            __m128i indices[4];
+            loadIndices(frame + x, indices);
+            __m128i r = lookup(tables[0], indices);
+            __m128i g = lookup(tables[1], indices);
+            __m128i b = lookup(tables[2], indices);
+            __m128i a = _mm_set1_epi8(-1);
+
+            __m128i rgLow = _mm_unpacklo_epi8(r, g), rgHigh = _mm_unpackhi_epi8(r, g);
+            __m128i baLow = _mm_unpacklo_epi8(b, a), baHigh = _mm_unpackhi_epi8(b, a);
+            __m128i *pixels = (__m128i *) (out + x);
+            _mm_storeu_si128(pixels, _mm_unpacklo_epi16(rgLow, baLow));
+            _mm_storeu_si128(pixels + 1, _mm_unpackhi_epi16(rgLow, baLow));
+            _mm_storeu_si128(pixels + 2, _mm_unpacklo_epi16(rgHigh, baHigh));
+            _mm_storeu_si128(pixels + 3, _mm_unpackhi_epi16(rgHigh, baHigh));
+        }
+        frame += Ppu::WIDTH;
+        out += Ppu::WIDTH;
+    }
+}
+
+__attribute__((target("ssse3")))
+static void toRgb565Ssse3(const unsigned char *frame, const unsigned char *emphasis, uint16_t *out,
+                          const unsigned char (*rgb565Tables)[2][4][16])
+{
+    for (int y = 0; y < Ppu::HEIGHT; y++)
+    {
+        __m128i tables[2][4];
+        for (int byte = 0; byte < 2; byte++)
+            for (int table = 0; table < 4; table++)
+                tables[byte][table] = _mm_load_si128((const __m128i *) rgb565Tables[emphasis[y] & 7][byte][table]);
+
+        for (int x = 0; x < Ppu::WIDTH; x += 16)
+        {
+            __m128i indices[4];
+            loadIndices(frame + x, indices);
+            __m128i low = lookup(tables[0], indices);
+            __m128i high = lookup(tables[1], indices);
+
+            __m128i *pixels = (__m128i *) (out + x);
+            _mm_storeu_si128(pixels, _mm_unpacklo_epi8(low, high));
+            _mm_storeu_si128(pixels + 1, _mm_unpackhi_epi8(low, high));
+        }
+        frame += Ppu::WIDTH;
+        out += Ppu::WIDTH;
+    }
+}
+
+// Like the SSSE3 versions, with the same tables in both 128 bit lanes.
+__attribute__((target("avx2")))
+static inline __m256i lookup(const __m256i tables[4], const __m256i indices[4])
+{
+    __m256i result = _mm256_shuffle_epi8(tables[0], indices[0]);
+    for (int table = 1; table < 4; table++)
+        result = _mm256_xor_si256(result, _mm256_shuffle_epi8(tables[table], indices[table]));
+    return result;
+}
+
+__attribute__((target("avx2")))
+static inline void loadIndices(const unsigned char *pixels, __m256i indices[4])
+{
+    indices[0] = _mm256_and_si256(_mm256_loadu_si256((const __m256i *) pixels), _mm256_set1_epi8(0x3f));
+    for (int table = 1; table < 4; table++)
+        indices[table] = _mm256_sub_epi8(indices[0], _mm256_set1_epi8(table * 16));
+}
+
+__attribute__((target("avx2")))
+static void toRgbaAvx2(const unsigned char *frame, const unsigned char *emphasis, uint32_t *out,
+                       const unsigned char (*rgbaTables)[3][4][16])
+{
+    for (int y = 0; y < Ppu::HEIGHT; y++)
+    {
+        __m256i tables[3][4];
+        for (int byte = 0; byte < 3; byte++)
+            for (int table = 0; table < 4; table++)
+                tables[byte][table] = _mm256_broadcastsi128_si256(
+                    _mm_load_si128((const __m128i *) rgbaTables[emphasis[y] & 7][byte][table]));
+
+        for (int x = 0; x < Ppu::WIDTH; x += 32)
+        {
+            __m256i indices[4];
+            loadIndices(frame + x, indices);
+            __m256i r = lookup(tables[0], indices);
+            __m256i g = lookup(tables[1], indices);
+            __m256i b = lookup(tables[2], indices);
+            __m256i a = _mm256_set1_epi8(-1);
+
+            // Unpacking stays within the lanes: pixels 0-15 are in the low lanes, 16-31 in the high ones
+            __m256i rgLow = _mm256_unpacklo_epi8(r, g), rgHigh = _mm256_unpackhi_epi8(r, g);
+            __m256i baLow = _mm256_unpacklo_epi8(b, a), baHigh = _mm256_unpackhi_epi8(b, a);
+            __m256i pixels0 = _mm256_unpacklo_epi16(rgLow, baLow); // 0-3 and 16-19
+            __m256i pixels4 = _mm256_unpackhi_epi16(rgLow, baLow);
+            __m256i pixels8 = _mm256_unpacklo_epi16(rgHigh, baHigh);
+            __m256i pixels12 = _mm256_unpackhi_epi16(rgHigh, baHigh);
+
+            __m256i *pixels = (__m256i *) (out + x);
+            _mm256_storeu_si256(pixels, _mm256_permute2x128_si256(pixels0, pixels4, 0x20));
+            _mm256_storeu_si256(pixels + 1, _mm256_permute2x128_si256(pixels8, pixels12, 0x20));
+            _mm256_storeu_si256(pixels + 2, _mm256_permute2x128_si256(pixels0, pixels4, 0x31));
+            _mm256_storeu_si256(pixels + 3, _mm256_permute2x128_si256(pixels8, pixels12, 0x31));
+        }
+        frame += Ppu::WIDTH;
+        out += Ppu::WIDTH;
+    }
+}
+
+__attribute__((target("avx2")))
+static void toRgb565Avx2(const unsigned char *frame, const unsigned char *emphasis, uint16_t *out,
+                         const unsigned char (*rgb565Tables)[2][4][16])
+{
+    for (int y = 0; y < Ppu::HEIGHT; y++)
+    {
+        __m256i tables[2][4];
+        for (int byte = 0; byte < 2; byte++)
+            for (int table = 0; table < 4; table++)
+                tables[byte][table] = _mm256_broadcastsi128_si256(
+                    _mm_load_si128((const __m128i *) rgb565Tables[emphasis[y] & 7][byte][table]));
+
+        for (int x = 0; x < Ppu::WIDTH; x += 32)
+        {
+            __m256i indices[4];
+            loadIndices(frame + x, indices);
+            __m256i low = lookup(tables[0], indices);
+            __m256i high = lookup(tables[1], indices);
+
+            __m256i pixels0 = _mm256_unpacklo_epi8(low, high); // 0-7 and 16-23
+            __m256i pixels8 = _mm256_unpackhi_epi8(low, high);
+            __m256i *pixels = (__m256i *) (out + x);
+            _mm256_storeu_si256(pixels, _mm256_permute2x128_si256(pixels0, pixels8, 0x20));
+            _mm256_storeu_si256(pixels + 1, _mm256_permute2x128_si256(pixels0, pixels8, 0x31));
+        }
+        frame += Ppu::WIDTH;
+        out += Ppu::WIDTH;
+    }
+}
+
+#endif
+
+void FrameConverter::toRgba(const unsigned char *frame, const unsigned char *emphasis, uint32_t *out) const
+{
+#ifdef NES_X86_SIMD
+    if (simd == AVX2)
+        return toRgbaAvx2(frame, emphasis, out, rgbaTables);
+    if (simd == SSSE3)
+        return toRgbaSsse3(frame, emphasis, out, rgbaTables);
+#endif
+    for (int y = 0; y < Ppu::HEIGHT; y++)
+    {
+        const uint32_t *colors = rgbaColors[emphasis[y] & 7];
+        for (int x = 0; x < Ppu::WIDTH; x++)
+            out[x] = colors[frame[x] & 0x3f];
+        frame += Ppu::WIDTH;
+        out += Ppu::WIDTH;
+    }
+}
+
+void FrameConverter::toRgb565(const unsigned char *frame, const unsigned char *emphasis, uint16_t *out) const
+{
+#ifdef NES_X86_SIMD
+    if (simd == AVX2)
+        return toRgb565Avx2(frame, emphasis, out, rgb565Tables);
+    if (simd == SSSE3)
+        return toRgb565Ssse3(frame, emphasis, out, rgb565Tables);
+#endif
+    for (int y = 0; y < Ppu::HEIGHT; y++)
+    {
+        const uint16_t *colors = rgb565Colors[emphasis[y] & 7];
+        for (int x = 0; x < Ppu::WIDTH; x++)
+            out[x] = colors[frame[x] & 0x3f];
+        frame += Ppu::WIDTH;
+        out += Ppu::WIDTH;
+    }
+}
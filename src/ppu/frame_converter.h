@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+
+// Converts the frame of the Ppu, palette indices, to colors for images and video: RGBA8888 or RGB565, with the color
+// emphasis of each line. The colors are looked up 16 or 32 pixels at a time with SSSE3 or AVX2 when the cpu has
+// them, the scalar loop is the reference.
+class FrameConverter
+{
+public:
+    enum Simd
+    {
+        SCALAR,
+        SSSE3,
+        AVX2,
+    };
+
+    // Uses the widest instructions the cpu supports.
+    FrameConverter();
+
+    static bool isSupported(Simd simd);
+    // Returns false and keeps the current instructions when they aren't supported.
+    bool setSimd(Simd simd);
+    Simd getSimd() { return simd; }
+
+    // Ppu::WIDTH * Ppu::HEIGHT pixels, with the emphasis of every line, see Ppu::getEmphasis(). RGBA8888 is 0xAABBGGRR,
+    // the bytes R, G, B, A in memory on x86. RGB565 has red in the highest bits.
+    void toRgba(const unsigned char *frame, const unsigned char *emphasis, uint32_t *out) const;
+    void toRgb565(const unsigned char *frame, const unsigned char *emphasis, uint16_t *out) const;
+
+    // A single pixel, index 0-63 and emphasis 0-7.
+    uint32_t rgba(unsigned char index, unsigned char emphasis) const { return rgbaColors[emphasis & 7][index & 0x3f]; }
+    uint16_t rgb565(unsigned char index, unsigned char emphasis) const
+    {
+        return rgb565Colors[emphasis & 7][index & 0x3f];
+    }
+
+private:
+    Simd simd;
+
+    uint32_t rgbaColors[8][64];
+    uint16_t rgb565Colors[8][64];
+    // The bytes of the colors by emphasis and byte: R, G and B, or the low and high byte of RGB565. Split in 4 tables
+    // of 16 colors, each xor-ed with the one before, so a lookup is the xor of the tables up to the one of the index.
+    alignas(16) unsigned char rgbaTables[8][3][4][16];
+    alignas(16) unsigned char rgb565Tables[8][2][4][16];
+};
@@ -0,0 +1,75 @@
+#include "line_pool.h"
+
+LinePool::LinePool(int threads)
+{
+    for (int i = 1; i < threads; i++)
+        workers.emplace_back(&LinePool::runWorker, this);
+}
+
+LinePool::~LinePool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    started.notify_all();
+    for (std::thread &worker : workers)
+        worker.join();
+}
+
+void LinePool::run(int count, const std::function<void(int)> &work)
+{
+    if (workers.empty())
+    {
+        for (int i = 0; i < count; i++)
+            work(i);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        this->work = &work;
+        this->count = count;
+        next.store(0, std::memory_order_relaxed);
+        busy = (int) workers.size();
+        generation++;
+    }
+    started.notify_all();
+    take();
+
+    std::unique_lock<std::mutex> lock(mutex);
+    finished.wait(lock, [this] { return busy == 0; });
+}
+
+void LinePool::runWorker()
+{
+    unsigned long long seen = 0;
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            started.wait(lock, [&] { return stopping || generation != seen; });
+            if (stopping)
+                return;
+            seen = generation;
+        }
+        take();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            busy--;
+        }
+        finished.notify_one();
+    }
+}
+
+// Takes the next piece of work until there is none left.
+void LinePool::take()
+{
+    while (true)
+    {
+        int i = next.fetch_add(1, std::memory_order_relaxed);
+        if (i >= count)
+            return;
+        (*work)(i);
+    }
+}
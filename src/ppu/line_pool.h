@@ -0,0 +1,39 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Threads that share the work of drawing lines. The thread that calls run() is one of them, so a pool of 1 thread
+// doesn't start any.
+class LinePool
+{
+public:
+    explicit LinePool(int threads);
+    ~LinePool();
+    LinePool(const LinePool &) = delete;
+    LinePool &operator=(const LinePool &) = delete;
+
+    int getThreads() { return (int) workers.size() + 1; }
+    // Calls work(0) up to work(count - 1) spread over the threads, returns when all of them returned.
+    void run(int count, const std::function<void(int)> &work);
+
+private:
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable started;
+    std::condition_variable finished;
+    unsigned long long generation = 0; // Of the run, workers wait for the next one
+    int busy = 0; // Workers in the run
+    bool stopping = false;
+
+    const std::function<void(int)> *work = nullptr;
+    int count = 0;
+    std::atomic<int> next{0};
+
+    void runWorker();
+    void take();
+};
@@ -0,0 +1,723 @@
+#include <algorithm>
+#include <cstring>
+#include <variant>
+
+#include "ppu.h"
+#include "../cartridge/cartridge.h"
+#include "../cpu/cpu.h"
+
+Ppu::Ppu(Bus *bus, Cpu *cpu) : bus(bus), cpu(cpu)
+{
+    bus->mapIo(0x20, 0x20, this);
+    bus->mapIo(OAM_DMA >> 8, 1, this);
+    reset();
+}
+
+void Ppu::reset(unsigned long long start)
+{
+    control = 0;
+    mask = 0;
+    status = 0;
+    oamAddress = 0;
+    latch = 0;
+    readBuffer = 0;
+    v = 0;
+    t = 0;
+    fineX = 0;
+    w = false;
+    scanline = 0;
+    dot = 0;
+    lineStart = start;
+    now = start;
+    oddFrame = false;
+    frameCount = 0;
+    nmi = false;
+    memset(vram, 0, sizeof(vram));
+    memset(palette, 0, sizeof(palette));
+    paletteWrites = 0;
+    memset(oam, 0, sizeof(oam));
+    memset(frame, 0, sizeof(frame));
+    memset(emphasis, 0, sizeof(emphasis));
+    memset(lineKeys, 0, sizeof(lineKeys));
+    dots = false;
+    midLineWrites = false;
+    backgroundPixels[0] = backgroundPixels[1] = 0;
+    nextTile = 0;
+    nextPalette = 0;
+    nextRow = 0;
+    memset(spriteLine, 0, sizeof(spriteLine));
+    tiles.invalidate();
+    layer.invalidate();
+    deferredCount = 0;
+    snapshotCount = 0;
+}
+
+void Ppu::setThreads(int threads)
+{
+    drawLines();
+    pool.reset(threads > 0 ? new LinePool(threads) : nullptr);
+}
+
+const unsigned char *Ppu::getFrame()
+{
+    drawLines();
+    return frame;
+}
+
+unsigned char Ppu::read(unsigned short address)
+{
+    if (address >= 0x4000)
+        return 0xff; // $4014 is write only, the rest of the page is not connected
+
+    switch (address & 7)
+    {
+        case 2:
+        {
+            unsigned char value = (status & 0xe0) | (latch & 0x1f);
+            status &= ~VBLANK;
+            w = false;
+            latch = value;
+            return value;
+        }
+        case 4:
+            latch = oam[oamAddress];
+            return latch;
+        case 7:
+        {
+            unsigned short vramAddress = v & 0x3fff;
+            if (vramAddress >= 0x3f00)
+            {
+                // Palette reads aren't buffered, the buffer gets the nametable byte below
+                latch = (latch & 0xc0) | (readMemory(vramAddress) & 0x3f);
+                readBuffer = readMemory(vramAddress - 0x1000);
+            }
+            else
+            {
+                latch = readBuffer;
+                readBuffer = readMemory(vramAddress);
+            }
+            incrementAddress();
+            return latch;
+        }
+        default:
+            return latch; // Write only
+    }
+}
+
+// Same as read(), without clearing vertical blank or moving the address and the read buffer.
+unsigned char Ppu::peek(unsigned short address)
+{
+    if (address >= 0x4000)
+        return 0xff;
+
+    switch (address & 7)
+    {
+        case 2:
+            return (status & 0xe0) | (latch & 0x1f);
+        case 4:
+            return oam[oamAddress];
+        case 7:
+        {
+            unsigned short vramAddress = v & 0x3fff;
+            if (vramAddress >= 0x3f00)
+                return (latch & 0xc0) | (readMemory(vramAddress) & 0x3f);
+            return readBuffer;
+        }
+        default:
+            return latch;
+    }
+}
+
+void Ppu::write(unsigned short address, unsigned char value)
+{
+    if (address == OAM_DMA)
+    {
+        oamDma(value);
+        return;
+    }
+    if (address >= 0x4000)
+        return;
+
+    latch = value;
+    int reg = address & 7;
+    if ((reg <= 1 || reg == 5 || reg == 6) && inPicture())
+        midLineWrites = true;
+    switch (reg)
+    {
+        case 0:
+            if ((value & GENERATE_NMI) && !(control & GENERATE_NMI) && (status & VBLANK))
+                nmi = true;
+            control = value;
+            t = (t & ~0x0c00) | ((value & 0x03) << 10);
+            break;
+        case 1:
+            mask = value;
+            break;
+        case 3:
+            oamAddress = value;
+            break;
+        case 4:
+            detachLines();
+            oam[oamAddress++] = value;
+            break;
+        case 5:
+            if (!w)
+            {
+                t = (t & ~0x001f) | (value >> 3);
+                fineX = value & 0x07;
+            }
+            else
+            {
+                t = (t & ~0x73e0) | ((value & 0x07) << 12) | ((value & 0xf8) << 2);
+            }
+            w = !w;
+            break;
+        case 6:
+            if (!w)
+            {
+                t = (t & 0x00ff) | ((value & 0x3f) << 8);
+            }
+            else
+            {
+                t = (t & 0xff00) | value;
+                v = t;
+            }
+            w = !w;
+            break;
+        case 7:
+            writeMemory(v & 0x3fff, value);
+            incrementAddress();
+            break;
+    }
+}
+
+int Ppu::runScanline()
+{
+    unsigned long long start = lineStart;
+    if (dots || dot > 0)
+    {
+        int line = scanline;
+        while (scanline == line)
+            runDot();
+    }
+    else
+    {
+        runLine();
+    }
+    return lineStart - start;
+}
+
+void Ppu::runTo(unsigned long long clock)
+{
+    now = clock;
+    unsigned long long frameEnd = frameCount + 1;
+    while (lineStart + dot <= clock && frameCount != frameEnd)
+    {
+        if (dots || dot > 0)
+            runDot();
+        else
+            runLine();
+    }
+}
+
+void Ppu::runLine()
+{
+    int length = DOTS_PER_LINE;
+    bool rendering = mask & (SHOW_BACKGROUND | SHOW_SPRITES);
+
+    if (scanline < HEIGHT)
+    {
+        if (rendering)
+        {
+            // The address was copied from t at the end of the previous line: all of it on the pre-render line,
+            // only the horizontal position otherwise
+            if (scanline == 0)
+                v = t;
+            else
+                v = (v & ~0x041f) | (t & 0x041f);
+            if (!rasterizing)
+                predictStatus(scanline);
+            else if (pool)
+                deferLine(scanline);
+            else
+                renderLine(scanline);
+            incrementY();
+            clockScanlineCounter();
+        }
+        else
+        {
+            memset(frame + scanline * WIDTH, palette[0], WIDTH);
+            lineKeys[scanline].valid = false;
+        }
+        emphasis[scanline] = mask >> 5;
+    }
+    else if (scanline == VBLANK_LINE)
+    {
+        status |= VBLANK;
+        if (control & GENERATE_NMI)
+            nmi = true;
+    }
+    else if (scanline == PRE_RENDER_LINE)
+    {
+        status &= ~(VBLANK | SPRITE_0_HIT | SPRITE_OVERFLOW);
+        if (rendering)
+        {
+            clockScanlineCounter();
+            if (oddFrame)
+                length--; // The first dot of the next frame is skipped
+        }
+    }
+
+    endLine(length);
+}
+
+void Ppu::endLine(int length)
+{
+    lineStart += length;
+    if (++scanline == HEIGHT)
+        drawLines();
+    else if (scanline == LINES_PER_FRAME)
+    {
+        scanline = 0;
+        oddFrame = !oddFrame;
+        frameCount++;
+    }
+    else if (scanline == PRE_RENDER_LINE)
+    {
+        // The pre-render line fetches the first tiles of the next frame, so the renderer can change here
+        dots = renderer == DOTS || (renderer == AUTO && midLineWrites);
+        midLineWrites = false;
+    }
+}
+
+// Whether the registers are accessed while a visible line is drawn, after its first pixel and before its last.
+bool Ppu::inPicture()
+{
+    if (!(mask & (SHOW_BACKGROUND | SHOW_SPRITES)))
+        return false;
+    if (dot > 0)
+        return scanline < HEIGHT && dot > 1 && dot <= WIDTH;
+    // The scanline renderer ran the line before on its first dot
+    long long x = (long long) now - (long long) (lineStart - DOTS_PER_LINE);
+    return scanline > 0 && scanline <= HEIGHT && x > 0 && x < WIDTH;
+}
+
+unsigned long long Ppu::nextEvent()
+{
+    int line = scanline <= VBLANK_LINE ? VBLANK_LINE : PRE_RENDER_LINE;
+    if (scanline < HEIGHT)
+        line = std::min(line, nextSpriteEvent());
+    line = std::min(line, nextIrq());
+    if (line == scanline && dot > 0)
+        return lineStart + dot;
+    return lineStart + (unsigned long long) (line - scanline) * DOTS_PER_LINE; // Only the last line can be shorter
+}
+
+// The next visible line that can set sprite 0 hit or sprite overflow: one that sprite 0 is on, or that has more
+// than 8 sprites.
+int Ppu::nextSpriteEvent()
+{
+    if (!(mask & SHOW_SPRITES))
+        return PRE_RENDER_LINE;
+    int height = control & SPRITES_8X16 ? 16 : 8;
+
+    int line = PRE_RENDER_LINE;
+    if ((mask & SHOW_BACKGROUND) && !(status & SPRITE_0_HIT))
+    {
+        int top = oam[0] + 1;
+        if (top + height > scanline && top < HEIGHT)
+            line = std::max(top, scanline);
+    }
+
+    if (!(status & SPRITE_OVERFLOW))
+    {
+        // Sprites per line: +1 on the first line of a sprite and -1 after the last
+        int changes[HEIGHT + 16 + 1] = {};
+        for (int i = 0; i < 64; i++)
+        {
+            int top = oam[i * 4] + 1;
+            if (top < HEIGHT)
+            {
+                changes[top]++;
+                changes[top + height]--;
+            }
+        }
+        int sprites = 0;
+        for (int y = 0; y < line && y < HEIGHT; y++)
+        {
+            sprites += changes[y];
+            if (sprites > 8 && y >= scanline)
+                return dots ? std::max(y - 1, scanline) : y; // The dot renderer evaluates on the line before
+        }
+    }
+    return line;
+}
+
+// The line that makes MMC3 raise its IRQ, by counting the lines on a copy of its counter.
+int Ppu::nextIrq()
+{
+    Cartridge *cartridge = bus->getCartridge();
+    Mmc3 *mmc3 = cartridge ? std::get_if<Mmc3>(&cartridge->getMapper()) : NULL;
+    if (mmc3 == NULL || !mmc3->irqEnabled || !(mask & (SHOW_BACKGROUND | SHOW_SPRITES)))
+        return PRE_RENDER_LINE;
+
+    Mmc3 counter = *mmc3;
+    counter.irqPending = false;
+    for (int line = scanline; line < PRE_RENDER_LINE; line++)
+    {
+        if (line >= HEIGHT)
+            line = PRE_RENDER_LINE - 1; // Not counted during vertical blank
+        else
+        {
+            counter.clockScanline();
+            if (counter.irqPending)
+                return line;
+        }
+    }
+    return PRE_RENDER_LINE;
+}
+
+bool Ppu::takeNmi()
+{
+    bool raised = nmi;
+    nmi = false;
+    return raised;
+}
+
+unsigned char Ppu::peekMemory(unsigned short address)
+{
+    return readMemory(address & 0x3fff);
+}
+
+unsigned char Ppu::readMemory(unsigned short address)
+{
+    if (address < 0x2000)
+    {
+        Cartridge *cartridge = bus->getCartridge();
+        return cartridge ? cartridge->readChr(address) : 0;
+    }
+    if (address < 0x3f00)
+        return vram[nametableOffset(address)];
+    return palette[paletteIndex(address)];
+}
+
+void Ppu::writeMemory(unsigned short address, unsigned char value)
+{
+    if (address < 0x2000)
+    {
+        Cartridge *cartridge = bus->getCartridge();
+        if (cartridge)
+            cartridge->writeChr(address, value);
+    }
+    else if (address < 0x3f00)
+    {
+        unsigned short offset = nametableOffset(address);
+        detachLines();
+        vram[offset] = value;
+        layer.written(offset);
+    }
+    else
+    {
+        palette[paletteIndex(address)] = value & 0x3f;
+        paletteWrites++;
+    }
+}
+
+// Offset in vram of a nametable address ($2000-$3EFF), the cartridge decides which of the 4 nametables are the same.
+unsigned short Ppu::nametableOffset(unsigned short address)
+{
+    int table = (address >> 10) & 3;
+    Cartridge *cartridge = bus->getCartridge();
+    switch (cartridge ? cartridge->getMirroring() : HORIZONTAL)
+    {
+        case HORIZONTAL: table >>= 1; break;
+        case VERTICAL: table &= 1; break;
+        case SINGLE_SCREEN_LOWER: table = 0; break;
+        case SINGLE_SCREEN_UPPER: table = 1; break;
+        case FOUR_SCREEN: break;
+    }
+    return table * 0x400 + (address & 0x3ff);
+}
+
+// $3F10, $3F14, $3F18 and $3F1C are the same bytes as $3F00, $3F04, $3F08 and $3F0C.
+int Ppu::paletteIndex(unsigned short address)
+{
+    int index = address & 0x1f;
+    if ((index & 0x13) == 0x10)
+        index &= ~0x10;
+    return index;
+}
+
+void Ppu::incrementAddress()
+{
+    v = (v + (control & INCREMENT_32 ? 32 : 1)) & 0x7fff;
+}
+
+void Ppu::renderLine(int y)
+{
+    tiles.update(bus->getCartridge());
+    layer.update(tiles, control & BACKGROUND_TABLE ? 256 : 0);
+
+    // Colors 0x10-0x1F and the flags of the front most sprite, 0 is transparent, and room for sprites at the edge
+    unsigned char sprites[WIDTH + 8] = {};
+    bool anySprites = (mask & SHOW_SPRITES) && renderSprites(y, sprites);
+
+    // The frame keeps the line of the frame before when nothing that it shows changed
+    LineKey key = {};
+    int coarseY = (v >> 5) & 0x1f;
+    key.valid = !anySprites && coarseY < BackgroundLayer::ROWS;
+    key.v = v;
+    key.fineX = fineX;
+    key.mask = mask;
+    key.tables[0] = nametableOffset(0x2000 | (v & 0x0c00)) >> 10;
+    key.tables[1] = nametableOffset(0x2000 | ((v ^ 0x0400) & 0x0c00)) >> 10;
+    if (coarseY < BackgroundLayer::ROWS)
+    {
+        key.versions[0] = layer.getVersion(key.tables[0], coarseY);
+        key.versions[1] = layer.getVersion(key.tables[1], coarseY);
+    }
+    key.paletteWrites = paletteWrites;
+    if (key.valid && key == lineKeys[y])
+        return;
+    lineKeys[y] = key;
+
+    // Colors 0-15 from fine x on, 0 is transparent. One tile more than the screen for the fine scroll.
+    unsigned char background[WIDTH + 8] = {};
+    if (mask & SHOW_BACKGROUND)
+        renderBackground(background);
+
+    if (compose(background + fineX, sprites, mask, palette, frame + y * WIDTH))
+        status |= SPRITE_0_HIT;
+}
+
+// Draws the background pixels, 0 is transparent, and the sprite pixels over or behind them, with the colors of the
+// palette and the left column hidden like mask says. Returns whether sprite 0 hit.
+bool Ppu::compose(unsigned char *pixels, unsigned char *sprites, unsigned char mask, const unsigned char *palette,
+    unsigned char *out) const
+{
+    if (!(mask & SHOW_BACKGROUND_LEFT))
+        memset(pixels, 0, 8);
+    if (!(mask & SHOW_SPRITES_LEFT))
+        memset(sprites, 0, 8);
+    return compositor.compose(pixels, sprites, palette, mask & GREYSCALE ? 0x30 : 0x3f, out);
+}
+
+// Tiles from the one at v on, moving into the next nametable on the right. Copied from the BackgroundLayer, except
+// below the last row of tiles, where the attribute table is drawn as tiles.
+void Ppu::renderBackground(unsigned char *line)
+{
+    int coarseX = v & 0x1f;
+    int coarseY = (v >> 5) & 0x1f;
+    int fineY = (v >> 12) & 0x07;
+    if (coarseY < BackgroundLayer::ROWS)
+    {
+        int left = nametableOffset(0x2000 | (v & 0x0c00)) >> 10;
+        int right = nametableOffset(0x2000 | ((v ^ 0x0400) & 0x0c00)) >> 10;
+        int width = (32 - coarseX) * 8;
+        memcpy(line, layer.getLine(left, coarseY * 8 + fineY, vram, tiles) + coarseX * 8, width);
+        memcpy(line + width, layer.getLine(right, coarseY * 8 + fineY, vram, tiles), WIDTH + 8 - width);
+        return;
+    }
+
+    const unsigned char *nametables[4];
+    for (int table = 0; table < 4; table++)
+        nametables[table] = vram + nametableOffset(0x2000 + table * 0x400);
+    fetchTiles(nametables, tiles, control & BACKGROUND_TABLE ? 256 : 0, v, line);
+}
+
+// The 33 tiles of a line from the one at v on, read from the nametables.
+void Ppu::fetchTiles(const unsigned char *const *nametables, const TileCache &tiles, int patternTable,
+    unsigned short v, unsigned char *line)
+{
+    int fineY = (v >> 12) & 0x07;
+    unsigned short address = v;
+    for (int tile = 0; tile < WIDTH / 8 + 1; tile++)
+    {
+        const unsigned char *nametable = nametables[(address >> 10) & 3];
+        uint64_t row = tiles.getRow(patternTable + nametable[address & 0x3ff], fineY);
+
+        // A byte of the attribute table has the palettes of 4x4 tiles, 2 bits per 2x2 tiles
+        unsigned char attribute = nametable[0x3c0 | ((address >> 4) & 0x38) | ((address >> 2) & 0x07)];
+        int shift = ((address >> 4) & 0x04) | (address & 0x02);
+        row = TileCache::colorRow(row, (attribute >> shift) & 0x03);
+        memcpy(line + tile * 8, &row, 8);
+
+        if ((address & 0x001f) == 31)
+            address = (address & ~0x001f) ^ 0x0400;
+        else
+            address++;
+    }
+}
+
+// The first 8 sprites on the line, see SpriteCompositor::draw(). Returns whether the line has any.
+bool Ppu::renderSprites(int y, unsigned char *line)
+{
+    int found = compositor.draw(oam, tiles, y, control & SPRITES_8X16 ? 16 : 8, control & SPRITE_TABLE ? 256 : 0,
+        line);
+    if (found > 8)
+        status |= SPRITE_OVERFLOW;
+    return found > 0;
+}
+
+// The status flags that drawing the line sets, without drawing it: sprite overflow for a ninth sprite on the line,
+// and sprite 0 hit, which only needs the background under the opaque pixels of sprite 0. Sprite 0 is in front of
+// the others, so those pixels are its own.
+void Ppu::predictStatus(int y)
+{
+    if (!(mask & SHOW_SPRITES))
+        return;
+    tiles.update(bus->getCartridge());
+    int height = control & SPRITES_8X16 ? 16 : 8;
+
+    if (!(status & SPRITE_OVERFLOW) && __builtin_popcountll(compositor.evaluate(oam, y, height)) > 8)
+        status |= SPRITE_OVERFLOW;
+
+    int row = y - 1 - oam[0];
+    if ((status & SPRITE_0_HIT) || !(mask & SHOW_BACKGROUND) || row < 0 || row >= height)
+        return;
+    layer.update(tiles, control & BACKGROUND_TABLE ? 256 : 0);
+    unsigned char background[WIDTH + 8];
+    renderBackground(background);
+    uint64_t pixels = SpriteCompositor::spriteRow(oam, tiles, row, height, control & SPRITE_TABLE ? 256 : 0);
+    for (int x = oam[3]; x < oam[3] + 8 && x < WIDTH - 1; x++, pixels >>= 8)
+    {
+        bool hidden = x < 8 && (mask & (SHOW_BACKGROUND_LEFT | SHOW_SPRITES_LEFT))
+            != (SHOW_BACKGROUND_LEFT | SHOW_SPRITES_LEFT);
+        if ((pixels & 0x03) && (background[fineX + x] & 0x03) && !hidden)
+        {
+            status |= SPRITE_0_HIT;
+            return;
+        }
+    }
+}
+
+// Records what the line shows and works out its status flags, it is drawn with the other lines of the frame in
+// drawLines(). The shared memory is copied when it changes before then, see detachLines().
+void Ppu::deferLine(int y)
+{
+    Cartridge *cartridge = bus->getCartridge();
+    if (tiles.isStale(cartridge))
+        detachLines();
+    tiles.update(cartridge);
+    predictStatus(y);
+
+    LineState &line = lines[y];
+    line.v = v;
+    line.fineX = fineX;
+    line.control = control;
+    line.mask = mask;
+    memcpy(line.palette, palette, sizeof(palette));
+    for (int table = 0; table < 4; table++)
+        line.nametables[table] = nametableOffset(0x2000 + table * 0x400);
+    line.tiles = &tiles;
+    line.vram = vram;
+    line.oam = oam;
+    deferred[deferredCount++] = y;
+    lineKeys[y].valid = false;
+}
+
+// Lines that were deferred read the tiles, nametables and OAM as they are now, so they get a copy before those
+// change.
+void Ppu::detachLines()
+{
+    if (deferredCount == 0 || lines[deferred[deferredCount - 1]].vram != vram)
+        return; // The last one has a copy already, and so do the ones before
+
+    if (snapshotCount == (int) snapshots.size())
+        snapshots.emplace_back(new Snapshot());
+    Snapshot &snapshot = *snapshots[snapshotCount++];
+    snapshot.tiles = tiles;
+    memcpy(snapshot.vram, vram, sizeof(vram));
+    memcpy(snapshot.oam, oam, sizeof(oam));
+    for (int i = deferredCount - 1; i >= 0 && lines[deferred[i]].vram == vram; i--)
+    {
+        LineState &line = lines[deferred[i]];
+        line.tiles = &snapshot.tiles;
+        line.vram = snapshot.vram;
+        line.oam = snapshot.oam;
+    }
+}
+
+// Draws the deferred lines on the threads of the pool.
+void Ppu::drawLines()
+{
+    if (deferredCount == 0)
+        return;
+    pool->run(deferredCount, [this](int i) { drawLine(lines[deferred[i]], deferred[i], frame + deferred[i] * WIDTH); });
+    deferredCount = 0;
+    snapshotCount = 0;
+}
+
+// Like renderLine(), but only from the state of the line, so any thread can draw it.
+void Ppu::drawLine(const LineState &line, int y, unsigned char *out) const
+{
+    unsigned char background[WIDTH + 8] = {};
+    if (line.mask & SHOW_BACKGROUND)
+    {
+        const unsigned char *nametables[4];
+        for (int table = 0; table < 4; table++)
+            nametables[table] = line.vram + line.nametables[table];
+        fetchTiles(nametables, *line.tiles, line.control & BACKGROUND_TABLE ? 256 : 0, line.v, background);
+    }
+    unsigned char sprites[WIDTH + 8] = {};
+    if (line.mask & SHOW_SPRITES)
+        compositor.draw(line.oam, *line.tiles, y, line.control & SPRITES_8X16 ? 16 : 8,
+            line.control & SPRITE_TABLE ? 256 : 0, sprites);
+    compose(background + line.fineX, sprites, line.mask, line.palette, out);
+}
+
+// Next line of the nametable, from the bottom of one to the top of the one below.
+void Ppu::incrementY()
+{
+    if ((v & 0x7000) != 0x7000)
+    {
+        v += 0x1000;
+        return;
+    }
+
+    v &= ~0x7000;
+    int coarseY = (v >> 5) & 0x1f;
+    if (coarseY == 29)
+    {
+        coarseY = 0;
+        v ^= 0x0800;
+    }
+    else if (coarseY == 31)
+    {
+        coarseY = 0; // Past the attribute table, wraps without switching nametables
+    }
+    else
+    {
+        coarseY++;
+    }
+    v = (v & ~0x03e0) | (coarseY << 5);
+}
+
+// MMC3 counts the lines the Ppu fetches tiles on.
+void Ppu::clockScanlineCounter()
+{
+    Cartridge *cartridge = bus->getCartridge();
+    if (cartridge == NULL)
+        return;
+    if (Mmc3 *mmc3 = std::get_if<Mmc3>(&cartridge->getMapper()))
+        mmc3->clockScanline();
+}
+
+// Copies a page of CPU memory to OAM, from the current OAM address on, wrapping around to the start. The Cpu is
+// halted for 513 cycles, one more when the copy starts on an odd cycle.
+void Ppu::oamDma(unsigned char page)
+{
+    detachLines();
+    unsigned char data[256];
+    bus->readPage(page, data);
+    memcpy(oam + oamAddress, data, 256 - oamAddress);
+    memcpy(oam, data + 256 - oamAddress, oamAddress);
+    cpu->stall(513 + (cpu->getCycles() & 1));
+}
+
+// A byte of OAM DMA that happened on another Ppu.
+void Ppu::writeOam(unsigned char index, unsigned char value)
+{
+    detachLines();
+    oam[index] = value;
+}
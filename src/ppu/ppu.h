@@ -0,0 +1,260 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "background_layer.h"
+#include "line_pool.h"
+#include "sprite_compositor.h"
+#include "tile_cache.h"
+#include "../bus.h"
+
+class Cpu;
+
+// How the Ppu renders, see Ppu::setRenderer().
+enum PpuRenderer
+{
+    SCANLINES, // A whole line at once
+    DOTS, // A dot at a time like the hardware, for games that write the registers in the middle of a line
+    AUTO, // Dots for the frame after one with writes to $2000, $2001, $2005 or $2006 in the middle of a line
+};
+
+// The picture processing unit, https://www.nesdev.org/wiki/PPU. Its registers are on the Bus at $2000-$2007, mirrored
+// up to $3FFF, and OAM DMA at $4014. The Bus maps devices a page at a time, so the Ppu has all of $4000-$40FF: the APU
+// and controller registers there read $FF and ignore writes, like the open bus, until there are devices for them.
+// Renders a whole scanline at once, with the registers as they are at the start of the line: writes take effect on
+// the next line, which is where games change the scroll for split screens anyway. Rendering reads the tile rows from
+// the TileCache, so the pattern tables are only decoded when the Cartridge changes them, and copies the background
+// from the BackgroundLayer, so only tiles that changed are rendered again. A line without sprites that shows the same
+// as in the frame before isn't rendered at all.
+// With threads, the scanline renderer only records the state of each line and draws the lines of the frame at once,
+// spread over the threads (see setThreads()).
+// The dot renderer (ppu_dots.cpp) does what the hardware does on every dot instead, so writes take effect on the next
+// pixel. It is a lot slower, AUTO only uses it for frames that need it.
+// The Ppu has a clock in dots and only runs when it is told to catch up, see runTo().
+// The frame holds palette indices 0-63, see palette.h for the colors.
+class Ppu : public MemoryMappedIo
+{
+public:
+    static const int WIDTH = 256;
+    static const int HEIGHT = 240;
+    static const int DOTS_PER_LINE = 341;
+    static const int LINES_PER_FRAME = 262;
+    static const int VBLANK_LINE = 241;
+    static const int PRE_RENDER_LINE = 261;
+
+    static const unsigned short OAM_DMA = 0x4014;
+
+    // Maps the registers into the Bus. The Cpu is stalled by OAM DMA.
+    Ppu(Bus *bus, Cpu *cpu);
+    Ppu(const Ppu &) = delete; // The Bus points to the Ppu
+    Ppu &operator=(const Ppu &) = delete;
+
+    // Power up state, the next line is the first of a frame and starts at dot start. Renders the first frame by
+    // scanlines.
+    void reset(unsigned long long start = 0);
+    // AUTO by default. Takes effect at the pre-render line, which fetches the first tiles of the next frame.
+    void setRenderer(PpuRenderer renderer) { this->renderer = renderer; }
+    PpuRenderer getRenderer() { return renderer; }
+    // Whether the current frame is rendered a dot at a time.
+    bool isRenderingDots() { return dots; }
+    // On by default. Without rasterizing, the scanline renderer doesn't draw the frame and only works out the status
+    // flags drawing would set, for a Ppu that answers the Cpu while another one draws, see RenderThread. Frames of the
+    // dot renderer are drawn either way.
+    void setRasterizing(bool rasterizing) { this->rasterizing = rasterizing; }
+    // Off (0) by default. With 1 or more threads, the scanline renderer records the registers, palette and memory a
+    // line reads when it runs, and draws all lines of the frame at once on that many threads (the calling one
+    // included) at the end of the picture. The frames are the same.
+    void setThreads(int threads);
+    int getThreads() { return pool ? pool->getThreads() : 0; }
+    // The widest the cpu supports by default, see SpriteCompositor. Returns false when simd isn't supported.
+    bool setSpriteSimd(SpriteCompositor::Simd simd) { return compositor.setSimd(simd); }
+
+    unsigned char read(unsigned short address) override;
+    void write(unsigned short address, unsigned char value) override;
+    // The registers as they are at the current dot, the Ppu isn't caught up.
+    unsigned char peek(unsigned short address) override;
+
+    // Renders the rest of the scanline, or does what the Ppu does on the line outside of the picture, e.g. entering
+    // vertical blank. Returns the number of dots of the line, 340 for the short pre-render line of odd frames.
+    int runScanline();
+    // Runs the dots up to and including dot, the scanline renderer runs a line on its first dot. Stops at the end of
+    // the frame.
+    void runTo(unsigned long long dot);
+    // The line that runs next, 0-261, or that the dot renderer is in.
+    int getScanline() { return scanline; }
+    // The dot the line that runs next starts at.
+    unsigned long long getLineStart() { return lineStart; }
+    // The start of the next line that changes what the Cpu can see when nothing is written in the meantime: the
+    // status flags, an NMI or an IRQ of the cartridge. Lines in between can run whenever the Cpu reads or writes.
+    // The dot renderer changes those in the middle of the line, so it returns its next dot while in such a line.
+    unsigned long long nextEvent();
+    // Completed frames.
+    unsigned long long getFrameCount() { return frameCount; }
+
+    // Whether an NMI was raised since the last call: at vertical blank, or by enabling it during vertical blank.
+    bool takeNmi();
+
+    // WIDTH * HEIGHT palette indices. Draws the lines that were recorded for threads first.
+    const unsigned char *getFrame();
+    // The color emphasis bits of PPUMASK (bits 5-7, shifted down) for every line.
+    const unsigned char *getEmphasis() { return emphasis; }
+
+    // Memory as the Ppu sees it: pattern tables, nametables and palette. For tests and debugging.
+    unsigned char peekMemory(unsigned short address);
+
+private:
+    friend class RenderThread; // Copies OAM after OAM DMA, see writeOam()
+
+    // PPUCTRL
+    static const unsigned char INCREMENT_32 = 0x04;
+    static const unsigned char SPRITE_TABLE = 0x08;
+    static const unsigned char BACKGROUND_TABLE = 0x10;
+    static const unsigned char SPRITES_8X16 = 0x20;
+    static const unsigned char GENERATE_NMI = 0x80;
+    // PPUMASK
+    static const unsigned char GREYSCALE = 0x01;
+    static const unsigned char SHOW_BACKGROUND_LEFT = 0x02;
+    static const unsigned char SHOW_SPRITES_LEFT = 0x04;
+    static const unsigned char SHOW_BACKGROUND = 0x08;
+    static const unsigned char SHOW_SPRITES = 0x10;
+    // PPUSTATUS
+    static const unsigned char SPRITE_OVERFLOW = 0x20;
+    static const unsigned char SPRITE_0_HIT = 0x40;
+    static const unsigned char VBLANK = 0x80;
+
+    // Flags of a pixel in the sprite line, next to the color 0x10-0x1F
+    static const unsigned char BEHIND_BACKGROUND = SpriteCompositor::BEHIND_BACKGROUND;
+    static const unsigned char SPRITE_0 = SpriteCompositor::SPRITE_0;
+
+    // What a line of the scanline renderer shows besides sprites, see renderLine().
+    struct LineKey
+    {
+        bool valid; // Without sprites, and the background comes from the BackgroundLayer
+        unsigned short v;
+        unsigned char fineX;
+        unsigned char mask;
+        unsigned char tables[2]; // Nametables in vram of the tiles at v and of the ones on the right
+        unsigned int versions[2]; // Of the rows of tiles in the BackgroundLayer
+        unsigned int paletteWrites;
+
+        bool operator==(const LineKey &other) const
+        {
+            return valid == other.valid && v == other.v && fineX == other.fineX && mask == other.mask
+                && tables[0] == other.tables[0] && tables[1] == other.tables[1] && versions[0] == other.versions[0]
+                && versions[1] == other.versions[1] && paletteWrites == other.paletteWrites;
+        }
+    };
+
+    // What a line reads when it is drawn on a thread, see deferLine(). The memory is that of the Ppu until it changes.
+    struct LineState
+    {
+        unsigned short v;
+        unsigned char fineX;
+        unsigned char control;
+        unsigned char mask;
+        unsigned char palette[32];
+        unsigned short nametables[4]; // Offsets in vram
+        const TileCache *tiles;
+        const unsigned char *vram;
+        const unsigned char *oam;
+    };
+
+    // A copy of the memory lines read, from before it changed.
+    struct Snapshot
+    {
+        TileCache tiles;
+        unsigned char vram[0x1000];
+        unsigned char oam[256];
+    };
+
+    Bus *bus;
+    Cpu *cpu;
+    TileCache tiles;
+    BackgroundLayer layer;
+    SpriteCompositor compositor;
+
+    unsigned char control;
+    unsigned char mask;
+    unsigned char status;
+    unsigned char oamAddress;
+    unsigned char latch; // Last value on the data bus of the registers, what write only registers read as
+    unsigned char readBuffer; // PPUDATA reads return the value of the previous read
+
+    // https://www.nesdev.org/wiki/PPU_scrolling: the current VRAM address, the temporary one, which is the top left of
+    // the screen, fine x scroll and the write toggle of PPUSCROLL and PPUADDR.
+    unsigned short v;
+    unsigned short t;
+    unsigned char fineX;
+    bool w;
+
+    int scanline;
+    int dot; // Of the line that the dot renderer is in, 0 between lines
+    unsigned long long lineStart;
+    unsigned long long now; // What the last catch up ran to, when the registers are accessed
+    bool oddFrame;
+    unsigned long long frameCount;
+    bool nmi;
+
+    unsigned char vram[0x1000]; // 2KB on the NES, four screen cartridges add the other 2KB
+    unsigned char palette[32];
+    unsigned int paletteWrites;
+    unsigned char oam[256];
+
+    unsigned char frame[WIDTH * HEIGHT];
+    unsigned char emphasis[HEIGHT];
+    LineKey lineKeys[HEIGHT]; // Of the lines in the frame
+
+    std::unique_ptr<LinePool> pool; // Null without threads
+    LineState lines[HEIGHT];
+    int deferred[HEIGHT]; // Lines that aren't drawn yet
+    int deferredCount = 0;
+    std::vector<std::unique_ptr<Snapshot>> snapshots; // Kept for the next frames
+    int snapshotCount = 0; // In use
+
+    PpuRenderer renderer = AUTO;
+    bool rasterizing = true;
+    bool dots;
+    bool midLineWrites; // In this frame
+
+    // Dot renderer: the background colors of the next 16 pixels, 0-15 a byte each from the lowest byte on, the tile
+    // being fetched, and the sprites of the line, evaluated at the end of the line before.
+    uint64_t backgroundPixels[2];
+    unsigned char nextTile;
+    unsigned char nextPalette;
+    uint64_t nextRow;
+    unsigned char spriteLine[WIDTH + 8];
+
+    unsigned char readMemory(unsigned short address);
+    void writeMemory(unsigned short address, unsigned char value);
+    unsigned short nametableOffset(unsigned short address);
+    static int paletteIndex(unsigned short address);
+    void incrementAddress();
+
+    void runLine();
+    void runDot();
+    void fetchBackground();
+    void renderPixel(int x);
+    void endLine(int length);
+    bool inPicture();
+
+    void renderLine(int y);
+    void renderBackground(unsigned char *line);
+    bool renderSprites(int y, unsigned char *line);
+    void predictStatus(int y);
+    void deferLine(int y);
+    void detachLines();
+    void drawLines();
+    void drawLine(const LineState &line, int y, unsigned char *out) const;
+    bool compose(unsigned char *pixels, unsigned char *sprites, unsigned char mask, const unsigned char *palette,
+        unsigned char *out) const;
+    static void fetchTiles(const unsigned char *const *nametables, const TileCache &tiles, int patternTable,
+        unsigned short v, unsigned char *line);
+    void incrementY();
+    void clockScanlineCounter();
+    int nextSpriteEvent();
+    int nextIrq();
+
+    void oamDma(unsigned char page);
+    void writeOam(unsigned char index, unsigned char value);
+};
@@ -0,0 +1,137 @@
+#include <cstring>
+
+#include "ppu.h"
+
+// The dot renderer of the Ppu, https://www.nesdev.org/wiki/PPU_rendering. The background is fetched a tile at a time,
+// two tiles ahead of the pixels, with the registers as they are on that dot. Sprites are evaluated at the end of the
+// line before the one they are on.
+
+void Ppu::runDot()
+{
+    bool rendering = mask & (SHOW_BACKGROUND | SHOW_SPRITES);
+    int length = DOTS_PER_LINE;
+
+    if (scanline < HEIGHT || scanline == PRE_RENDER_LINE)
+    {
+        if (rendering)
+        {
+            fetchBackground();
+            if (dot == 257)
+            {
+                memset(spriteLine, 0, sizeof(spriteLine));
+                if ((mask & SHOW_SPRITES) && scanline + 1 < HEIGHT)
+                    renderSprites(scanline + 1, spriteLine);
+            }
+            if (dot == 260)
+                clockScanlineCounter();
+            if (scanline == PRE_RENDER_LINE && oddFrame)
+                length--; // The first dot of the next frame is skipped
+        }
+
+        if (scanline < HEIGHT)
+        {
+            if (dot == 0)
+            {
+                emphasis[scanline] = mask >> 5;
+                lineKeys[scanline].valid = false; // The scanline renderer renders it again
+            }
+            else if (dot <= WIDTH)
+                renderPixel(dot - 1);
+        }
+    }
+
+    if (dot == 1)
+    {
+        if (scanline == VBLANK_LINE)
+        {
+            status |= VBLANK;
+            if (control & GENERATE_NMI)
+                nmi = true;
+        }
+        else if (scanline == PRE_RENDER_LINE)
+        {
+            status &= ~(VBLANK | SPRITE_0_HIT | SPRITE_OVERFLOW);
+        }
+    }
+
+    if (++dot == length)
+    {
+        dot = 0;
+        endLine(length);
+    }
+}
+
+// One dot of the background fetches, the address in v moves along with them.
+void Ppu::fetchBackground()
+{
+    if ((dot >= 2 && dot <= 257) || (dot >= 322 && dot <= 337))
+    {
+        backgroundPixels[0] = (backgroundPixels[0] >> 8) | (backgroundPixels[1] << 56);
+        backgroundPixels[1] >>= 8;
+        if ((dot & 7) == 1)
+            backgroundPixels[1] = nextRow; // The tile that was fetched in the last 8 dots is next in line
+    }
+
+    if ((dot >= 1 && dot <= 256) || (dot >= 321 && dot <= 336))
+    {
+        switch ((dot - 1) & 7)
+        {
+            case 0:
+                nextTile = readMemory(0x2000 | (v & 0x0fff));
+                break;
+            case 2:
+            {
+                unsigned char attribute = readMemory(0x23c0 | (v & 0x0c00) | ((v >> 4) & 0x38) | ((v >> 2) & 0x07));
+                nextPalette = (attribute >> (((v >> 4) & 0x04) | (v & 0x02))) & 0x03;
+                break;
+            }
+            case 4:
+                tiles.update(bus->getCartridge());
+                nextRow = TileCache::colorRow(tiles.getRow((control & BACKGROUND_TABLE ? 256 : 0) + nextTile, v >> 12),
+                    nextPalette);
+                break;
+            case 7:
+                // Next tile, into the nametable on the right after the last one
+                if ((v & 0x001f) == 31)
+                    v = (v & ~0x001f) ^ 0x0400;
+                else
+                    v++;
+                break;
+        }
+    }
+
+    if (dot == 256)
+        incrementY();
+    else if (dot == 257)
+        v = (v & ~0x041f) | (t & 0x041f);
+    else if (scanline == PRE_RENDER_LINE && dot >= 280 && dot <= 304)
+        v = (v & ~0x7be0) | (t & 0x7be0);
+}
+
+void Ppu::renderPixel(int x)
+{
+    if (!(mask & (SHOW_BACKGROUND | SHOW_SPRITES)))
+    {
+        frame[scanline * WIDTH + x] = palette[0];
+        return;
+    }
+
+    unsigned char color = 0;
+    if ((mask & SHOW_BACKGROUND) && (x >= 8 || (mask & SHOW_BACKGROUND_LEFT)))
+    {
+        unsigned char pixel = backgroundPixels[0] >> (fineX * 8);
+        if (pixel & 0x03)
+            color = pixel & 0x0f;
+    }
+    unsigned char sprite = 0;
+    if ((mask & SHOW_SPRITES) && (x >= 8 || (mask & SHOW_SPRITES_LEFT)))
+        sprite = spriteLine[x];
+    if (sprite)
+    {
+        if ((sprite & SPRITE_0) && color && x != WIDTH - 1)
+            status |= SPRITE_0_HIT;
+        if (!color || !(sprite & BEHIND_BACKGROUND))
+            color = sprite & 0x1f;
+    }
+    frame[scanline * WIDTH + x] = palette[color] & (mask & GREYSCALE ? 0x30 : 0x3f);
+}
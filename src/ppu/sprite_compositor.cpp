@@ -0,0 +1,267 @@
+#include "sprite_compositor.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define NES_X86_SIMD
+#include <immintrin.h>
+#endif
+
+SpriteCompositor::SpriteCompositor()
+{
+    simd = SCALAR;
+    setSimd(AVX2) || setSimd(SSSE3);
+}
+
+bool SpriteCompositor::isSupported(Simd simd)
+{
+#ifdef NES_X86_SIMD
+    if (simd == SSSE3)
+        return __builtin_cpu_supports("ssse3");
+    if (simd == AVX2)
+        return __builtin_cpu_supports("avx2");
+#endif
+    return simd == SCALAR;
+}
+
+bool SpriteCompositor::setSimd(Simd simd)
+{
+    if (!isSupported(simd))
+        return false;
+    this->simd = simd;
+    return true;
+}
+
+uint64_t SpriteCompositor::spriteRow(const unsigned char *sprite, const TileCache &tiles, int row, int height,
+    int patternTable)
+{
+    unsigned char attributes = sprite[2];
+    if (attributes & 0x80)
+        row = height - 1 - row;
+    int tile;
+    if (height == 16)
+        tile = (sprite[1] & 0x01) * 256 + (sprite[1] & 0xfe) + (row >> 3);
+    else
+        tile = patternTable + sprite[1];
+    uint64_t pixels = tiles.getRow(tile, row & 0x07);
+    if (attributes & 0x40)
+        pixels = TileCache::flip(pixels);
+    return pixels;
+}
+
+#ifdef NES_X86_SIMD
+
+// The y of 16 sprites, a byte each: the first byte of every entry, packed down from 32 to 16 to 8 bits. A sprite is on
+// the line when line - 1 - y is 0 to height - 1, compared as unsigned bytes: y is at most line - 1, and the
+// difference is at most height - 1.
+__attribute__((target("ssse3")))
+static uint64_t evaluateSsse3(const unsigned char *oam, int y, int height)
+{
+    __m128i line = _mm_set1_epi8(y - 1);
+    __m128i last = _mm_set1_epi8(height - 1);
+    __m128i low = _mm_set1_epi32(0xff);
+    uint64_t found = 0;
+    for (int group = 0; group < 4; group++)
+    {
+        const __m128i *entries = (const __m128i *) (oam + group * 64);
+        __m128i ys[4];
+        for (int i = 0; i < 4; i++)
+            ys[i] = _mm_and_si128(_mm_loadu_si128(entries + i), low);
+        __m128i tops = _mm_packus_epi16(_mm_packs_epi32(ys[0], ys[1]), _mm_packs_epi32(ys[2], ys[3]));
+
+        __m128i above = _mm_cmpeq_epi8(_mm_max_epu8(tops, line), line);
+        __m128i row = _mm_subs_epu8(line, tops);
+        __m128i inside = _mm_cmpeq_epi8(_mm_min_epu8(row, last), row);
+        found |= (uint64_t) (unsigned int) _mm_movemask_epi8(_mm_and_si128(above, inside)) << (group * 16);
+    }
+    return found;
+}
+
+// Like the SSSE3 version, 32 sprites at a time. Packing stays within the 128 bit lanes, which leaves groups of 4
+// sprites in the order 0, 2, 4, 6, 1, 3, 5, 7.
+__attribute__((target("avx2")))
+static uint64_t evaluateAvx2(const unsigned char *oam, int y, int height)
+{
+    __m256i line = _mm256_set1_epi8(y - 1);
+    __m256i last = _mm256_set1_epi8(height - 1);
+    __m256i low = _mm256_set1_epi32(0xff);
+    __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    uint64_t found = 0;
+    for (int group = 0; group < 2; group++)
+    {
+        const __m256i *entries = (const __m256i *) (oam + group * 128);
+        __m256i ys[4];
+        for (int i = 0; i < 4; i++)
+            ys[i] = _mm256_and_si256(_mm256_loadu_si256(entries + i), low);
+        __m256i tops = _mm256_packus_epi16(_mm256_packs_epi32(ys[0], ys[1]), _mm256_packs_epi32(ys[2], ys[3]));
+        tops = _mm256_permutevar8x32_epi32(tops, order);
+
+        __m256i above = _mm256_cmpeq_epi8(_mm256_max_epu8(tops, line), line);
+        __m256i row = _mm256_subs_epu8(line, tops);
+        __m256i inside = _mm256_cmpeq_epi8(_mm256_min_epu8(row, last), row);
+        found |= (uint64_t) (unsigned int) _mm256_movemask_epi8(_mm256_and_si256(above, inside)) << (group * 32);
+    }
+    return found;
+}
+
+// The opaque pixels of the sprite where the line is still transparent.
+__attribute__((target("ssse3")))
+static void drawSpanSsse3(uint64_t pixels, unsigned char flags, unsigned char *line)
+{
+    __m128i zero = _mm_setzero_si128();
+    __m128i sprite = _mm_loadl_epi64((const __m128i *) &pixels);
+    __m128i current = _mm_loadl_epi64((const __m128i *) line);
+    __m128i covered = _mm_xor_si128(_mm_cmpeq_epi8(current, zero), _mm_set1_epi8(-1));
+    __m128i keep = _mm_or_si128(_mm_cmpeq_epi8(sprite, zero), covered);
+    __m128i colored = _mm_or_si128(sprite, _mm_set1_epi8(flags));
+    __m128i result = _mm_or_si128(_mm_and_si128(keep, current), _mm_andnot_si128(keep, colored));
+    _mm_storel_epi64((__m128i *) line, result);
+}
+
+// 16 pixels: the sprite where the background is transparent or the sprite isn't behind it, and the color of the
+// palette, the low 4 bits of the index looked up in the table of colors 0-15 or 16-31.
+__attribute__((target("ssse3")))
+static bool composeSsse3(const unsigned char *pixels, const unsigned char *sprites, const unsigned char *palette,
+    unsigned char colorMask, unsigned char *out)
+{
+    __m128i zero = _mm_setzero_si128();
+    __m128i lowColors = _mm_loadu_si128((const __m128i *) palette);
+    __m128i highColors = _mm_loadu_si128((const __m128i *) (palette + 16));
+    __m128i behindFlag = _mm_set1_epi8(SpriteCompositor::BEHIND_BACKGROUND);
+    __m128i sprite0Flag = _mm_set1_epi8(SpriteCompositor::SPRITE_0);
+    __m128i high = _mm_set1_epi8(0x10);
+    unsigned int hits = 0;
+    for (int x = 0; x < SpriteCompositor::WIDTH; x += 16)
+    {
+        __m128i background = _mm_loadu_si128((const __m128i *) (pixels + x));
+        __m128i sprite = _mm_loadu_si128((const __m128i *) (sprites + x));
+
+        __m128i transparent = _mm_cmpeq_epi8(_mm_and_si128(background, _mm_set1_epi8(0x03)), zero);
+        __m128i color = _mm_andnot_si128(transparent, background);
+        __m128i behind = _mm_cmpeq_epi8(_mm_and_si128(sprite, behindFlag), behindFlag);
+        __m128i sprite0 = _mm_cmpeq_epi8(_mm_and_si128(sprite, sprite0Flag), sprite0Flag);
+        unsigned int hit = _mm_movemask_epi8(_mm_andnot_si128(transparent, sprite0));
+        hits |= x == SpriteCompositor::WIDTH - 16 ? hit & 0x7fff : hit;
+
+        __m128i hidden = _mm_or_si128(_mm_cmpeq_epi8(sprite, zero), _mm_andnot_si128(transparent, behind));
+        color = _mm_or_si128(_mm_and_si128(hidden, color),
+            _mm_andnot_si128(hidden, _mm_and_si128(sprite, _mm_set1_epi8(0x1f))));
+
+        __m128i upper = _mm_cmpeq_epi8(_mm_and_si128(color, high), high);
+        __m128i value = _mm_or_si128(_mm_and_si128(upper, _mm_shuffle_epi8(highColors, color)),
+            _mm_andnot_si128(upper, _mm_shuffle_epi8(lowColors, color)));
+        _mm_storeu_si128((__m128i *) (out + x), _mm_and_si128(value, _mm_set1_epi8(colorMask)));
+    }
+    return hits != 0;
+}
+
+// Like the SSSE3 version, with the same tables in both 128 bit lanes.
+__attribute__((target("avx2")))
+static bool composeAvx2(const unsigned char *pixels, const unsigned char *sprites, const unsigned char *palette,
+    unsigned char colorMask, unsigned char *out)
+{
+    __m256i zero = _mm256_setzero_si256();
+    __m256i lowColors = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) palette));
+    __m256i highColors = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) (palette + 16)));
+    __m256i behindFlag = _mm256_set1_epi8(SpriteCompositor::BEHIND_BACKGROUND);
+    __m256i sprite0Flag = _mm256_set1_epi8(SpriteCompositor::SPRITE_0);
+    __m256i high = _mm256_set1_epi8(0x10);
+    unsigned int hits = 0;
+    for (int x = 0; x < SpriteCompositor::WIDTH; x += 32)
+    {
+        __m256i background = _mm256_loadu_si256((const __m256i *) (pixels + x));
+        __m256i sprite = _mm256_loadu_si256((const __m256i *) (sprites + x));
+
+        __m256i transparent = _mm256_cmpeq_epi8(_mm256_and_si256(background, _mm256_set1_epi8(0x03)), zero);
+        __m256i color = _mm256_andnot_si256(transparent, background);
+        __m256i behind = _mm256_cmpeq_epi8(_mm256_and_si256(sprite, behindFlag), behindFlag);
+        __m256i sprite0 = _mm256_cmpeq_epi8(_mm256_and_si256(sprite, sprite0Flag), sprite0Flag);
+        unsigned int hit = _mm256_movemask_epi8(_mm256_andnot_si256(transparent, sprite0));
+        hits |= x == SpriteCompositor::WIDTH - 32 ? hit & 0x7fffffff : hit;
+
+        __m256i hidden = _mm256_or_si256(_mm256_cmpeq_epi8(sprite, zero), _mm256_andnot_si256(transparent, behind));
+        color = _mm256_blendv_epi8(_mm256_and_si256(sprite, _mm256_set1_epi8(0x1f)), color, hidden);
+
+        __m256i upper = _mm256_cmpeq_epi8(_mm256_and_si256(color, high), high);
+        __m256i value = _mm256_blendv_epi8(_mm256_shuffle_epi8(lowColors, color),
+            _mm256_shuffle_epi8(highColors, color), upper);
+        _mm256_storeu_si256((__m256i *) (out + x), _mm256_and_si256(value, _mm256_set1_epi8(colorMask)));
+    }
+    return hits != 0;
+}
+
+#endif
+
+uint64_t SpriteCompositor::evaluate(const unsigned char *oam, int y, int height) const
+{
+    if (y <= 0)
+        return 0; // Sprites are never on the first line
+#ifdef NES_X86_SIMD
+    if (simd == AVX2)
+        return evaluateAvx2(oam, y, height);
+    if (simd == SSSE3)
+        return evaluateSsse3(oam, y, height);
+#endif
+    uint64_t found = 0;
+    for (int i = 0; i < 64; i++)
+    {
+        int row = y - 1 - oam[i * 4];
+        if (row >= 0 && row < height)
+            found |= 1ULL << i;
+    }
+    return found;
+}
+
+int SpriteCompositor::draw(const unsigned char *oam, const TileCache &tiles, int y, int height, int patternTable,
+    unsigned char *line) const
+{
+    uint64_t found = evaluate(oam, y, height);
+    int count = __builtin_popcountll(found);
+    for (int drawn = 0; found && drawn < 8; drawn++, found &= found - 1)
+    {
+        int i = __builtin_ctzll(found);
+        const unsigned char *sprite = oam + i * 4;
+        uint64_t pixels = spriteRow(sprite, tiles, y - 1 - sprite[0], height, patternTable);
+        unsigned char attributes = sprite[2];
+        unsigned char flags = 0x10 | ((attributes & 0x03) << 2) | (attributes & 0x20 ? BEHIND_BACKGROUND : 0)
+            | (i == 0 ? SPRITE_0 : 0);
+#ifdef NES_X86_SIMD
+        if (simd != SCALAR)
+        {
+            drawSpanSsse3(pixels, flags, line + sprite[3]);
+            continue;
+        }
+#endif
+        for (int x = sprite[3]; x < sprite[3] + 8; x++, pixels >>= 8)
+        {
+            unsigned char pixel = pixels & 0x03;
+            if (pixel && !line[x])
+                line[x] = flags | pixel;
+        }
+    }
+    return count;
+}
+
+bool SpriteCompositor::compose(const unsigned char *pixels, const unsigned char *sprites, const unsigned char *palette,
+    unsigned char colorMask, unsigned char *out) const
+{
+#ifdef NES_X86_SIMD
+    if (simd == AVX2)
+        return composeAvx2(pixels, sprites, palette, colorMask, out);
+    if (simd == SSSE3)
+        return composeSsse3(pixels, sprites, palette, colorMask, out);
+#endif
+    bool hit = false;
+    for (int x = 0; x < WIDTH; x++)
+    {
+        unsigned char color = pixels[x] & 0x03 ? pixels[x] : 0;
+        unsigned char sprite = sprites[x];
+        if (sprite)
+        {
+            if ((sprite & SPRITE_0) && color && x != WIDTH - 1)
+                hit = true;
+            if (!color || !(sprite & BEHIND_BACKGROUND))
+                color = sprite & 0x1f;
+        }
+        out[x] = palette[color] & colorMask;
+    }
+    return hit;
+}
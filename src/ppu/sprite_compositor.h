@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+
+#include "tile_cache.h"
+
+// The sprites of a scanline: which of the 64 in OAM are on the line, the line of the first 8 of them, and the line
+// composited over the background. All 64 entries are compared with the line at once and give a bitmask, sprites are
+// drawn 8 pixels at a time and the line is composited 16 or 32 pixels at a time, with SSSE3 or AVX2 when the cpu has
+// them. The scalar loops are the reference.
+class SpriteCompositor
+{
+public:
+    enum Simd
+    {
+        SCALAR,
+        SSSE3,
+        AVX2,
+    };
+
+    static const int WIDTH = 256;
+
+    // Flags of a pixel in the sprite line, next to the color 0x10-0x1F
+    static const unsigned char BEHIND_BACKGROUND = 0x20;
+    static const unsigned char SPRITE_0 = 0x40;
+
+    // Uses the widest instructions the cpu supports.
+    SpriteCompositor();
+
+    static bool isSupported(Simd simd);
+    // Returns false and keeps the current instructions when they aren't supported.
+    bool setSimd(Simd simd);
+    Simd getSimd() const { return simd; }
+
+    // Bit i is set when sprite i of OAM is on line y, sprites are drawn one line below their y. Height is 8 or 16.
+    uint64_t evaluate(const unsigned char *oam, int y, int height) const;
+    // Draws the first 8 sprites on line y in OAM order, the first one in front where they overlap: colors
+    // 0x10-0x1F and the flags, 0 is transparent. Line has 8 bytes more than WIDTH, for sprites at the right edge.
+    // 8x8 sprites come from pattern table 0 or 256. Returns how many sprites are on the line, 9 or more overflow.
+    int draw(const unsigned char *oam, const TileCache &tiles, int y, int height, int patternTable,
+        unsigned char *line) const;
+    // The background pixels, colors 0-15 where 0 is transparent, with the sprite line over or behind them, as
+    // palette indices and-ed with colorMask. Returns whether sprite 0 hit, which it doesn't in the last column.
+    bool compose(const unsigned char *pixels, const unsigned char *sprites, const unsigned char *palette,
+        unsigned char colorMask, unsigned char *out) const;
+
+    // Pixels 0-3 of row 0 to height - 1 of a sprite, flipped like its attributes say.
+    static uint64_t spriteRow(const unsigned char *sprite, const TileCache &tiles, int row, int height,
+        int patternTable);
+
+private:
+    Simd simd;
+};
@@ -0,0 +1,71 @@
+#include <cstring>
+
+#include "tile_cache.h"
+#include "../cartridge/cartridge.h"
+
+void TileCache::update(Cartridge *cartridge)
+{
+    if (cartridge == NULL)
+    {
+        if (this->cartridge != NULL || !valid)
+        {
+            memset(rows, 0, sizeof(rows));
+            for (int slot = 0; slot < 8; slot++)
+                decodes[slot]++;
+        }
+        this->cartridge = NULL;
+        valid = true;
+        return;
+    }
+
+    bool inserted = cartridge != this->cartridge || !valid;
+    this->cartridge = cartridge;
+    valid = true;
+    for (int slot = 0; slot < 8; slot++)
+    {
+        const unsigned char *bank = cartridge->getChrBank(slot);
+        unsigned int version = cartridge->getChrVersion(slot);
+        if (inserted || bank != banks[slot] || version != versions[slot])
+        {
+            decodeBank(slot, bank);
+            decodes[slot]++;
+            banks[slot] = bank;
+            versions[slot] = version;
+        }
+    }
+}
+
+bool TileCache::isStale(Cartridge *cartridge) const
+{
+    if (!valid || cartridge != this->cartridge)
+        return true;
+    if (cartridge == NULL)
+        return false;
+    for (int slot = 0; slot < 8; slot++)
+        if (cartridge->getChrBank(slot) != banks[slot] || cartridge->getChrVersion(slot) != versions[slot])
+            return true;
+    return false;
+}
+
+uint64_t TileCache::decode(unsigned char low, unsigned char high)
+{
+    uint64_t row = 0;
+    for (int pixel = 0; pixel < 8; pixel++)
+    {
+        int bit = 7 - pixel;
+        uint64_t value = ((low >> bit) & 1) | (((high >> bit) & 1) << 1);
+        row |= value << (pixel * 8);
+    }
+    return row;
+}
+
+void TileCache::decodeBank(int slot, const unsigned char *bank)
+{
+    uint64_t *row = rows + slot * TILES_PER_BANK * 8;
+    for (int tile = 0; tile < TILES_PER_BANK; tile++)
+    {
+        const unsigned char *planes = bank + tile * 16;
+        for (int y = 0; y < 8; y++)
+            *row++ = decode(planes[y], planes[y + 8]);
+    }
+}
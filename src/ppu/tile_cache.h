@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+
+class Cartridge;
+
+// The 512 tiles of the pattern tables, decoded from planar 2 bits per pixel to one byte per pixel (0-3), so the
+// renderer gets the 8 pixels of a tile row in one 64 bit load. The leftmost pixel is the lowest byte.
+// A 1KB bank of 64 tiles is only decoded again after the Cartridge switched it or wrote its CHR RAM.
+class TileCache
+{
+public:
+    static const int TILES = 512;
+    static const int TILES_PER_BANK = 64;
+
+    // Decodes the banks that changed since the last update, clears everything without a cartridge.
+    void update(Cartridge *cartridge);
+    // Whether the next update decodes anything.
+    bool isStale(Cartridge *cartridge) const;
+    // The next update decodes every bank, e.g. after another cartridge was inserted.
+    void invalidate() { valid = false; }
+
+    // Row 0-7 of tile 0-511, where tiles 256-511 are the pattern table at $1000.
+    uint64_t getRow(int tile, int row) const { return rows[tile * 8 + row]; }
+    // Changes whenever bank 0-7, tiles bank * 64 up to the next bank, is decoded again or cleared.
+    unsigned int getDecodeCount(int bank) const { return decodes[bank]; }
+
+    // The leftmost pixel moves to the highest byte.
+    static uint64_t flip(uint64_t row) { return __builtin_bswap64(row); }
+    // Adds palette 0-3 to the opaque pixels, colors 0-15 for the background.
+    static uint64_t colorRow(uint64_t row, unsigned char palette)
+    {
+        uint64_t opaque = (row | (row >> 1)) & 0x0101010101010101ULL;
+        return row | opaque * (palette << 2);
+    }
+
+    // One row: the 8 pixels of the low and high bit planes.
+    static uint64_t decode(unsigned char low, unsigned char high);
+
+private:
+    uint64_t rows[TILES * 8] = {};
+    const unsigned char *banks[8] = {};
+    unsigned int versions[8] = {};
+    unsigned int decodes[8] = {};
+    Cartridge *cartridge = nullptr;
+    bool valid = false;
+
+    void decodeBank(int slot, const unsigned char *bank);
+};
@@ -0,0 +1,150 @@
+#include <cstring>
+
+#include "render_thread.h"
+#include "cartridge/cartridge.h"
+
+RenderThread::RenderThread(Bus &bus, unsigned long long start, int threads)
+    : ppu(&this->bus, nullptr), queue(new Event[QUEUE_SIZE]), head(0), tail(0), drawn(0), stopping(false),
+      threadWaiting(false), nesWaiting(false)
+{
+    if (bus.getCartridge())
+        this->bus.insertDisk(*bus.getCartridge());
+    ppu.reset(start);
+    ppu.setThreads(threads);
+    thread = std::thread(&RenderThread::run, this);
+}
+
+RenderThread::~RenderThread()
+{
+    stopping.store(true);
+    wakeThread();
+    thread.join();
+}
+
+void RenderThread::access(unsigned long long dot, bool catchUp, unsigned short address, unsigned char value,
+    bool write)
+{
+    push({dot, address, value, write ? WRITE : READ, catchUp});
+}
+
+// OAM DMA isn't replayed, the thread's Bus doesn't have the memory it copies from.
+void RenderThread::copyOam(unsigned long long dot, bool catchUp, const Ppu &ppu)
+{
+    for (int i = 0; i < 256; i++)
+        push({dot, (unsigned short) i, ppu.oam[i], OAM, catchUp});
+}
+
+void RenderThread::setRenderer(PpuRenderer renderer)
+{
+    push({0, 0, (unsigned char) renderer, RENDERER, false});
+}
+
+void RenderThread::endFrame(unsigned long long dot)
+{
+    push({dot, 0, 0, END_FRAME, true});
+}
+
+void RenderThread::waitForFrames(unsigned long long count)
+{
+    if (drawn.load(std::memory_order_acquire) >= count)
+        return;
+    std::unique_lock<std::mutex> lock(mutex);
+    nesWaiting.store(true);
+    replayed.wait(lock, [&] { return drawn.load() >= count; });
+    nesWaiting.store(false);
+}
+
+void RenderThread::push(const Event &event)
+{
+    unsigned int next = head.load(std::memory_order_relaxed);
+    if (next - tail.load(std::memory_order_acquire) == QUEUE_SIZE)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        nesWaiting.store(true);
+        replayed.wait(lock, [&] { return next - tail.load() != QUEUE_SIZE; }); // Full
+        nesWaiting.store(false);
+    }
+    queue[next & (QUEUE_SIZE - 1)] = event;
+    head.store(next + 1);
+    wakeThread();
+}
+
+void RenderThread::run()
+{
+    while (!stopping.load(std::memory_order_acquire))
+    {
+        unsigned int next = tail.load(std::memory_order_relaxed);
+        unsigned int end = head.load();
+        if (next == end)
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            threadWaiting.store(true);
+            pushed.wait(lock, [&] { return head.load() != next || stopping.load(); });
+            threadWaiting.store(false);
+            continue;
+        }
+        for (; next != end; next++)
+            replay(queue[next & (QUEUE_SIZE - 1)]);
+        tail.store(end);
+        wakeNes();
+    }
+}
+
+// The flags and the counters they wait for are sequentially consistent, so either the waiting side sees the new
+// count before it sleeps, or this sees the flag and wakes it. The lock makes sure it is asleep by then.
+void RenderThread::wakeThread()
+{
+    if (threadWaiting.load())
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pushed.notify_one();
+    }
+}
+
+void RenderThread::wakeNes()
+{
+    if (nesWaiting.load())
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        replayed.notify_one();
+    }
+}
+
+void RenderThread::replay(const Event &event)
+{
+    if (event.catchUp)
+    {
+        unsigned long long frame = ppu.getFrameCount();
+        ppu.runTo(event.dot);
+        if (ppu.getFrameCount() != frame)
+        {
+            // The buffer of the frame before the last one, the Nes doesn't look at that anymore
+            int buffer = frame & 1;
+            memcpy(frames[buffer], ppu.getFrame(), sizeof(frames[buffer]));
+            memcpy(emphasis[buffer], ppu.getEmphasis(), sizeof(emphasis[buffer]));
+            drawn.store(frame + 1);
+            wakeNes();
+        }
+    }
+
+    switch (event.type)
+    {
+        case READ:
+            ppu.read(event.address);
+            break;
+        case WRITE:
+            if (event.address < 0x4000)
+                ppu.write(event.address, event.value);
+            else
+                bus.write_8(event.address, event.value);
+            break;
+        case OAM:
+            ppu.writeOam(event.address, event.value);
+            break;
+        case RENDERER:
+            ppu.setRenderer((PpuRenderer) event.value);
+            break;
+        case END_FRAME:
+            break;
+    }
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "bus.h"
+#include "ppu/ppu.h"
+
+// Draws the frames of a Nes on a second thread, a frame behind the Cpu. The Nes records every access to the Ppu
+// registers and every write to the cartridge with the dot it happens at, and the thread replays them on a Ppu of its
+// own, with a copy of the cartridge. Both Ppus go through the same states, so the frames are the same as when the
+// Ppu of the Nes draws them, while that one only works out what the Cpu sees (see Ppu::setRasterizing()).
+// The accesses go through a queue with a single writer and a single reader and no locks, the Cpu only waits when the
+// queue is full or when the thread is more than a frame behind. Either side that waits sleeps on a condition variable
+// and says so in a flag, the other side only takes the lock to wake it when the flag is set.
+class RenderThread
+{
+public:
+    // Starts from a Ppu that was just reset to start at dot start, with a copy of the cartridge of bus. The Ppu draws
+    // its lines on threads like Ppu::setThreads().
+    RenderThread(Bus &bus, unsigned long long start, int threads);
+    ~RenderThread(); // Drops what wasn't replayed yet
+    RenderThread(const RenderThread &) = delete;
+    RenderThread &operator=(const RenderThread &) = delete;
+
+    // An access that changes the Ppu or the cartridge. The Ppu catches up to dot first, unless catchUp is false for
+    // accesses between frames, where it didn't move.
+    void access(unsigned long long dot, bool catchUp, unsigned short address, unsigned char value, bool write);
+    // All of OAM, after OAM DMA.
+    void copyOam(unsigned long long dot, bool catchUp, const Ppu &ppu);
+    // Takes effect where the Ppu of the Nes takes it, see Ppu::setRenderer().
+    void setRenderer(PpuRenderer renderer);
+    // The Ppu of the Nes completed its frame when it caught up to dot.
+    void endFrame(unsigned long long dot);
+
+    // Waits until count frames are drawn.
+    void waitForFrames(unsigned long long count);
+    // Frame count and its emphasis once it is drawn, blank for 0. Stays the same until frame count + 2 is drawn.
+    const unsigned char *getFrame(unsigned long long count) { return frames[(count + 1) & 1]; }
+    const unsigned char *getEmphasis(unsigned long long count) { return emphasis[(count + 1) & 1]; }
+
+private:
+    enum Type : unsigned char
+    {
+        READ,
+        WRITE,
+        OAM, // Address is the index in OAM
+        RENDERER, // Value is a PpuRenderer
+        END_FRAME,
+    };
+
+    struct Event
+    {
+        unsigned long long dot;
+        unsigned short address;
+        unsigned char value;
+        Type type;
+        bool catchUp;
+    };
+
+    static const int QUEUE_SIZE = 1 << 16; // Events, a power of 2
+
+    Bus bus;
+    Ppu ppu;
+
+    std::unique_ptr<Event[]> queue;
+    std::atomic<unsigned int> head; // Next event the Nes writes
+    std::atomic<unsigned int> tail; // Next event the thread replays
+
+    unsigned char frames[2][Ppu::WIDTH * Ppu::HEIGHT] = {};
+    unsigned char emphasis[2][Ppu::HEIGHT] = {};
+    std::atomic<unsigned long long> drawn; // Frames
+
+    std::atomic<bool> stopping;
+    std::thread thread;
+
+    std::mutex mutex;
+    std::condition_variable pushed; // The thread waits for events
+    std::condition_variable replayed; // The Nes waits for room in the queue or for a frame
+    std::atomic<bool> threadWaiting;
+    std::atomic<bool> nesWaiting;
+
+    void push(const Event &event);
+    void run();
+    void replay(const Event &event);
+    void wakeThread();
+    void wakeNes();
+};
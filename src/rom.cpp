@@ -1,75 +1,166 @@
 #pragma once
 
 #include <iostream>
+#include <stdexcept>
 #include <string>
 
-using std::string;
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
-class Header {
-public:
-    const int num16kbBanks;
-    const bool hasTrainer;
+#include "cartridge/rom_image.h"
+
+using std::string;
 
-    Header(int num16kbBanks, bool hasTrainer) : num16kbBanks(num16kbBanks), hasTrainer(hasTrainer) {}
+// The iNES header, https://www.nesdev.org/wiki/INES. NES 2.0 headers (https://www.nesdev.org/wiki/NES_2.0) add the
+// submapper and the RAM sizes, and allow larger ROMs.
+struct Header
+{
+    bool nes2;
+    int mapper;
+    int submapper;
+    int prgRomSize; // In bytes
+    int chrRomSize; // 0 when the cartridge has CHR RAM
+    int prgRamSize;
+    int prgNvramSize; // Battery backed
+    int chrRamSize;
+    int chrNvramSize;
+    Mirroring mirroring;
+    bool battery;
+    bool hasTrainer;
+    int timing; // 0 NTSC, 1 PAL, 2 both, 3 Dendy
 };
 
+// A ROM file mapped read only into memory. PRG and CHR point into the mapping, so their pages are only read from the
+// file when they're touched, and processes loading the same file share them. It never changes after loading, so one
+// Rom can be shared by any number of Buses, see Bus::insertDisk().
+// Throws std::invalid_argument when the file can't be read or isn't an iNES file.
 class Rom
 {
 public:
-    Rom(string file) : file(file), prg(NULL) {}
-    int size = 0;
+    Rom(string file) : file(file)
+    {
+        int fd = open(file.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw std::invalid_argument("ROM file not found: " + file); // TODO custom exception
+
+        struct stat info;
+        if (fstat(fd, &info) == 0 && info.st_size >= HEADER_SIZE)
+        {
+            size = info.st_size;
+            void *mapped = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            data = mapped == MAP_FAILED ? NULL : (const unsigned char *) mapped;
+        }
+        close(fd);
+        if (data == NULL)
+            throw std::invalid_argument("Can't read ROM file: " + file);
 
-    unsigned char *getPrgData() {
-        if (prg == NULL) {
-            read();
+        try
+        {
+            header = readHeader();
+        }
+        catch (...)
+        {
+            munmap((void *) data, size);
+            throw;
         }
-        return prg;
     }
 
-private:
+    ~Rom()
+    {
+        munmap((void *) data, size);
+    }
 
-    const int HEADER_SIZE = 16;
-    const int TRAINER_SIZE = 512;
-    const int KB_16_IN_BYTES = 16 * 1024;
+    Rom(const Rom &) = delete; // Owns the mapping
+    Rom &operator=(const Rom &) = delete;
 
-    string file;
-    unsigned char *prg;
+    const Header &getHeader() const { return header; }
+
+    const unsigned char *getPrg() const { return data + prgStart(); }
+    // NULL when the cartridge has CHR RAM.
+    const unsigned char *getChr() const { return header.chrRomSize ? getPrg() + header.prgRomSize : NULL; }
+    // NULL when there is none.
+    const unsigned char *getTrainer() const { return header.hasTrainer ? data + HEADER_SIZE : NULL; }
 
-    void read()
+    // The data stays owned by the Rom.
+    RomImage getImage() const
     {
-        FILE *file = fopen("../../test/roms/01.nes", "r+");
-        if (file == NULL)
-            throw std::invalid_argument("ROM file not found: " + this->file); // TODO custom exception
-
-        Header header = readHeader(file);
-        prg = readPrg(file, header);
-        
-        fclose(file);
+        return {header.mapper, header.mirroring, getPrg(), header.prgRomSize, getChr(), header.chrRomSize, getTrainer(),
+                header.prgRamSize + header.prgNvramSize, header.chrRamSize + header.chrNvramSize};
     }
 
-    Header readHeader(FILE *file) {
-        unsigned char *header = (unsigned char *) malloc(HEADER_SIZE); // TODO not cleaned up
-        fread(header, sizeof(unsigned char), HEADER_SIZE, file);
-        
-        string nesString = string(header, header+4);
-        if ("NES" != nesString)
+private:
+
+    static const int HEADER_SIZE = 16;
+    static const int TRAINER_SIZE = 512;
+    static const int KB_16_IN_BYTES = 16 * 1024;
+    static const int KB_8_IN_BYTES = 8 * 1024;
+
+    string file;
+    const unsigned char *data = NULL;
+    size_t size = 0;
+    Header header;
+
+    size_t prgStart() const { return HEADER_SIZE + (header.hasTrainer ? TRAINER_SIZE : 0); }
+
+    Header readHeader()
+    {
+        string nesString = string(data, data + 4);
+        if ("NES\x1a" != nesString)
             throw std::invalid_argument("ROM has invalid start of header: " + nesString);
 
-        unsigned char controlByte1 = header[6];
-        bool hasTrainer = controlByte1 & 0b0000'0100;
-        
-        return Header(header[4], hasTrainer);
+        Header header = {};
+        unsigned char controlByte1 = data[6];
+        unsigned char controlByte2 = data[7];
+        header.nes2 = (controlByte2 & 0b0000'1100) == 0b0000'1000;
+        header.mapper = (controlByte1 >> 4) | (controlByte2 & 0xf0);
+        header.hasTrainer = controlByte1 & 0b0000'0100;
+        header.battery = controlByte1 & 0b0000'0010;
+        header.mirroring = controlByte1 & 0b0000'1000 ? FOUR_SCREEN : controlByte1 & 0b0000'0001 ? VERTICAL : HORIZONTAL;
+
+        if (header.nes2)
+        {
+            header.mapper |= (data[8] & 0x0f) << 8;
+            header.submapper = data[8] >> 4;
+            header.prgRomSize = romSize(data[4], data[9] & 0x0f, KB_16_IN_BYTES);
+            header.chrRomSize = romSize(data[5], data[9] >> 4, KB_8_IN_BYTES);
+            header.prgRamSize = ramSize(data[10] & 0x0f);
+            header.prgNvramSize = ramSize(data[10] >> 4);
+            header.chrRamSize = ramSize(data[11] & 0x0f);
+            header.chrNvramSize = ramSize(data[11] >> 4);
+            header.timing = data[12] & 0x03;
+        }
+        else
+        {
+            header.prgRomSize = data[4] * KB_16_IN_BYTES;
+            header.chrRomSize = data[5] * KB_8_IN_BYTES;
+            int prgRam = (data[8] ? data[8] : 1) * KB_8_IN_BYTES; // 0 means 8KB for compatibility
+            (header.battery ? header.prgNvramSize : header.prgRamSize) = prgRam;
+            header.chrRamSize = header.chrRomSize ? 0 : KB_8_IN_BYTES;
+            header.timing = data[9] & 0x01;
+        }
+
+        size_t prgStart = HEADER_SIZE + (header.hasTrainer ? TRAINER_SIZE : 0);
+        if (prgStart + header.prgRomSize + header.chrRomSize > size)
+            throw std::invalid_argument("ROM file is shorter than its header says: " + file);
+        return header;
+    }
+
+    // The most significant nibble 0xF means the size is 2^exponent * (multiplier * 2 + 1) bytes.
+    static int romSize(unsigned char lsb, unsigned char msb, int unit)
+    {
+        if (msb != 0x0f)
+            return (msb << 8 | lsb) * unit;
+        int exponent = lsb >> 2;
+        if (exponent > 24)
+            throw std::invalid_argument("ROM size in header is too large");
+        return (1 << exponent) * ((lsb & 0x03) * 2 + 1);
     }
 
-    unsigned char *readPrg(FILE *file, Header &header)
+    // Shift counts, 0 is no RAM
+    static int ramSize(unsigned char shift)
     {
-        int start = HEADER_SIZE + (header.hasTrainer ? TRAINER_SIZE : 0);
-        int size = header.num16kbBanks * KB_16_IN_BYTES;
-
-        unsigned char *data = (unsigned char *) malloc(size);
-        fseek(file, start, SEEK_SET);
-        fread(data, sizeof(unsigned char), size, file);
-        this->size = size;
-        return data;
+        return shift ? 64 << shift : 0;
     }
 };
@@ -0,0 +1,290 @@
+#include <stdexcept>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "bus.h"
+#include "cartridge/cartridge.h"
+#include "cpu/block_cache.h"
+#include "cpu/cpu.h"
+
+class CartridgeTest : public ::testing::Test
+{
+public:
+  CartridgeTest() {
+    bus = new Bus();
+  }
+
+  ~CartridgeTest()
+  {
+    delete bus;
+  }
+protected:
+  Bus *bus;
+  std::vector<unsigned char> prg;
+  std::vector<unsigned char> chr;
+
+  // Every byte of an 8KB PRG bank or a 1KB CHR bank holds the number of its bank
+  void insert(int mapper, int prgBanks, int chrBanks, Mirroring mirroring = HORIZONTAL)
+  {
+    prg.resize(prgBanks * 0x2000);
+    for (size_t i = 0; i < prg.size(); i++)
+      prg[i] = i / 0x2000;
+    chr.resize(chrBanks * 0x400);
+    for (size_t i = 0; i < chr.size(); i++)
+      chr[i] = i / 0x400;
+
+    RomImage image = {mapper, mirroring, prg.data(), (int) prg.size(), chrBanks ? chr.data() : NULL, (int) chr.size()};
+    cartridge = new Cartridge(bus, image);
+  }
+
+  // PRG banks at $8000, $A000, $C000 and $E000
+  std::vector<int> prgBanks()
+  {
+    return {bus->read(0x8000), bus->read(0xa000), bus->read(0xc000), bus->read(0xe000)};
+  }
+
+  // CHR banks of the 8 1KB slots
+  std::vector<int> chrBanks()
+  {
+    std::vector<int> banks;
+    for (int address = 0; address < 0x2000; address += 0x400)
+      banks.push_back(cartridge->readChr(address));
+    return banks;
+  }
+
+  void writeMmc1(unsigned short address, unsigned char value)
+  {
+    for (int i = 0; i < 5; i++)
+      bus->write_8(address, value >> i & 1);
+  }
+
+  void TearDown() override
+  {
+    delete cartridge;
+  }
+
+  Cartridge *cartridge = NULL;
+};
+
+TEST_F(CartridgeTest, NromMirrors16kb)
+{
+  // when
+  insert(0, 2, 8);
+
+  // then
+  EXPECT_EQ(prgBanks(), std::vector<int>({0, 1, 0, 1}));
+  EXPECT_EQ(chrBanks(), std::vector<int>({0, 1, 2, 3, 4, 5, 6, 7}));
+}
+
+TEST_F(CartridgeTest, RomIsReadOnly)
+{
+  // given
+  insert(0, 4, 8);
+
+  // when
+  bus->write_8(0x8000, 0x42);
+
+  // then
+  EXPECT_EQ(bus->read(0x8000), 0);
+  EXPECT_EQ(prg[0], 0);
+}
+
+TEST_F(CartridgeTest, PrgRamIsWritable)
+{
+  // given
+  insert(0, 4, 8);
+
+  // when
+  bus->write_8(0x6123, 0x42);
+
+  // then
+  EXPECT_EQ(bus->read(0x6123), 0x42);
+}
+
+TEST_F(CartridgeTest, UnsupportedMapperThrows)
+{
+  EXPECT_THROW(insert(5, 4, 8), std::invalid_argument);
+}
+
+TEST_F(CartridgeTest, Mmc1SwitchesPrgBankThroughShiftRegister)
+{
+  // given
+  insert(1, 16, 8);
+  EXPECT_EQ(prgBanks(), std::vector<int>({0, 1, 14, 15})); // Last bank fixed at $C000
+
+  // when
+  writeMmc1(0xe000, 3); // 16KB bank 3
+
+  // then
+  EXPECT_EQ(prgBanks(), std::vector<int>({6, 7, 14, 15}));
+}
+
+TEST_F(CartridgeTest, Mmc1ControlSelectsModes)
+{
+  // given
+  insert(1, 16, 32);
+
+  // when
+  writeMmc1(0x8000, 0b1'00'10); // 4KB CHR, 32KB PRG, vertical mirroring
+  writeMmc1(0xa000, 5);
+  writeMmc1(0xc000, 2);
+  writeMmc1(0xe000, 3);
+
+  // then
+  EXPECT_EQ(cartridge->getMirroring(), VERTICAL);
+  EXPECT_EQ(prgBanks(), std::vector<int>({4, 5, 6, 7})); // The low bit is ignored
+  EXPECT_EQ(chrBanks(), std::vector<int>({20, 21, 22, 23, 8, 9, 10, 11}));
+}
+
+TEST_F(CartridgeTest, Mmc1ResetsShiftRegisterOnBit7)
+{
+  // given
+  insert(1, 16, 8);
+  bus->write_8(0xe000, 1);
+  bus->write_8(0xe000, 1);
+
+  // when
+  bus->write_8(0xe000, 0x80);
+  writeMmc1(0xe000, 2);
+
+  // then
+  EXPECT_EQ(prgBanks(), std::vector<int>({4, 5, 14, 15}));
+}
+
+TEST_F(CartridgeTest, UxRomSwitchesFirstBank)
+{
+  // given
+  insert(2, 16, 0);
+
+  // when
+  bus->write_8(0xc123, 5);
+
+  // then
+  EXPECT_EQ(prgBanks(), std::vector<int>({10, 11, 14, 15}));
+}
+
+TEST_F(CartridgeTest, UxRomHasChrRam)
+{
+  // given
+  insert(2, 16, 0);
+
+  // when
+  cartridge->writeChr(0x1234, 0x42);
+
+  // then
+  EXPECT_EQ(cartridge->readChr(0x1234), 0x42);
+}
+
+TEST_F(CartridgeTest, CnRomSwitchesChr)
+{
+  // given
+  insert(3, 4, 32);
+
+  // when
+  bus->write_8(0x8000, 2);
+
+  // then
+  EXPECT_EQ(chrBanks(), std::vector<int>({16, 17, 18, 19, 20, 21, 22, 23}));
+  cartridge->writeChr(0, 0x42); // CHR ROM
+  EXPECT_EQ(cartridge->readChr(0), 16);
+}
+
+TEST_F(CartridgeTest, AxRomSwitches32kbAndSingleScreen)
+{
+  // given
+  insert(7, 16, 0);
+
+  // when
+  bus->write_8(0x8000, 0x12);
+
+  // then
+  EXPECT_EQ(prgBanks(), std::vector<int>({8, 9, 10, 11}));
+  EXPECT_EQ(cartridge->getMirroring(), SINGLE_SCREEN_UPPER);
+}
+
+TEST_F(CartridgeTest, Mmc3SwitchesBanks)
+{
+  // given
+  insert(4, 16, 64);
+
+  // when
+  for (int i = 0; i < 8; i++)
+  {
+    bus->write_8(0x8000, i);
+    bus->write_8(0x8001, 10 + i);
+  }
+
+  // then
+  EXPECT_EQ(prgBanks(), std::vector<int>({0, 1, 14, 15})); // Banks wrap around
+  EXPECT_EQ(chrBanks(), std::vector<int>({10, 11, 10, 11, 12, 13, 14, 15}));
+}
+
+TEST_F(CartridgeTest, Mmc3InvertsPrgAndChr)
+{
+  // given
+  insert(4, 16, 64);
+  bus->write_8(0x8000, 0);
+  bus->write_8(0x8001, 20);
+  bus->write_8(0x8000, 2);
+  bus->write_8(0x8001, 30);
+  bus->write_8(0x8000, 6);
+  bus->write_8(0x8001, 3);
+
+  // when
+  bus->write_8(0x8000, 0xc0);
+
+  // then
+  EXPECT_EQ(prgBanks(), std::vector<int>({14, 1, 3, 15}));
+  EXPECT_EQ(chrBanks()[0], 30);
+  EXPECT_EQ(chrBanks()[4], 20);
+  EXPECT_EQ(chrBanks()[5], 21);
+}
+
+TEST_F(CartridgeTest, Mmc3IrqAfterLatchedScanlines)
+{
+  // given
+  insert(4, 16, 64);
+  bus->write_8(0xc000, 2); // Latch
+  bus->write_8(0xc001, 0); // Reload
+  bus->write_8(0xe001, 0); // Enable
+  Mmc3 &mmc3 = std::get<Mmc3>(cartridge->getMapper());
+
+  // when
+  mmc3.clockScanline();
+  mmc3.clockScanline();
+  bool early = mmc3.irqPending;
+  mmc3.clockScanline();
+
+  // then
+  EXPECT_FALSE(early);
+  EXPECT_TRUE(mmc3.irqPending);
+  bus->write_8(0xe000, 0); // Acknowledge
+  EXPECT_FALSE(mmc3.irqPending);
+}
+
+TEST_F(CartridgeTest, BankSwitchDropsCachedBlocks)
+{
+  // given
+  insert(2, 4, 0);
+  prg[0x0000] = 0xe8; // Bank 0: INX; BRK
+  prg[0x0001] = 0x00;
+  prg[0x4000] = 0xc8; // Bank 1: INY; BRK
+  prg[0x4001] = 0x00;
+  Cpu cpu(bus);
+  cpu.setBlockCache(true);
+  cpu.setEntry(0x8000);
+  cpu.reset();
+  cpu.runCycles(100);
+  ASSERT_EQ(cpu.getX(), 1);
+
+  // when
+  bus->write_8(0x8000, 1);
+  cpu.reset();
+  cpu.runCycles(100);
+
+  // then
+  EXPECT_EQ(cpu.getX(), 0);
+  EXPECT_EQ(cpu.getY(), 1);
+  EXPECT_EQ(cpu.getBlockCache()->getInvalidations(), 1);
+}
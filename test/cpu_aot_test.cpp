@@ -0,0 +1,141 @@
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "bus.h"
+#include "cpu/cpu.h"
+#include "cpu/trace_sink.h"
+#include "cpu/translated_rom.h"
+
+// Generated by NES_AOT from nestest with entry $C000, see test/CMakeLists.txt.
+extern const TranslatedRom nestest;
+
+class CpuAotTest : public ::testing::Test
+{
+public:
+  CpuAotTest() {
+    bus = new Bus();
+    cpu = new Cpu(bus);
+    otherBus = new Bus();
+    interpreter = new Cpu(otherBus);
+  }
+
+  ~CpuAotTest()
+  {
+    delete interpreter;
+    delete otherBus;
+    delete cpu;
+    delete bus;
+  }
+
+  void SetUp() override
+  {
+    std::ifstream in(NES_TEST_ROM, std::ios::binary);
+    std::vector<unsigned char> rom((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    ASSERT_GT(rom.size(), 16 + 0x4000);
+    for (Bus *b : {bus, otherBus})
+    {
+      b->readData(rom.data() + 16, 0x4000);
+      b->write_16(b->RESET_VECTOR_ADDR, 0xc000);
+    }
+    cpu->reset();
+    interpreter->reset();
+  }
+protected:
+  Bus *bus;
+  Cpu *cpu;
+  Bus *otherBus;
+  Cpu *interpreter;
+
+  void expectSameState()
+  {
+    EXPECT_EQ(cpu->getCycles(), interpreter->getCycles());
+    EXPECT_EQ(cpu->getPC(), interpreter->getPC());
+    EXPECT_EQ(cpu->getA(), interpreter->getA());
+    EXPECT_EQ(cpu->getX(), interpreter->getX());
+    EXPECT_EQ(cpu->getY(), interpreter->getY());
+    EXPECT_EQ(cpu->getSP(), interpreter->getSP());
+    EXPECT_EQ(cpu->getStatus(), interpreter->getStatus());
+    for (int address = 0; address < 0x800; address++)
+      ASSERT_EQ(bus->read(address), otherBus->read(address)) << "at " << address;
+  }
+};
+
+TEST_F(CpuAotTest, NestestEndsInSameStateAsInterpreter)
+{
+  // given
+  ASSERT_TRUE(cpu->setTranslatedRom(&nestest));
+
+  // when
+  std::streambuf *coutBuffer = std::cout.rdbuf(nullptr); // Cpu::run prints the registers
+  cpu->run();
+  interpreter->run();
+  std::cout.rdbuf(coutBuffer);
+
+  // then
+  expectSameState();
+  EXPECT_GT(cpu->getTranslatedCycles(), cpu->getCycles() / 2);
+}
+
+TEST_F(CpuAotTest, BudgetStopsOnSameInstructionAsInterpreter)
+{
+  // given
+  ASSERT_TRUE(cpu->setTranslatedRom(&nestest));
+
+  for (unsigned long long budget : {1ULL, 7ULL, 100ULL, 1234ULL, 29781ULL})
+  {
+    // when
+    cpu->runCycles(budget);
+    interpreter->runCycles(budget);
+
+    // then
+    expectSameState();
+  }
+  EXPECT_GT(cpu->getTranslatedCycles(), 0);
+}
+
+TEST_F(CpuAotTest, OtherRomIsRejected)
+{
+  // given
+  unsigned char patch[1] = {0xea};
+  bus->write(0xc5f5, patch, 1);
+
+  // when
+  bool enabled = cpu->setTranslatedRom(&nestest);
+
+  // then
+  EXPECT_FALSE(enabled);
+  cpu->runCycles(1000);
+  EXPECT_EQ(cpu->getTranslatedCycles(), 0);
+}
+
+TEST_F(CpuAotTest, TracingInterpretsEveryInstruction)
+{
+  // given
+  BufferTraceSink sink;
+  ASSERT_TRUE(cpu->setTranslatedRom(&nestest));
+  cpu->setTraceSink(&sink);
+
+  // when
+  cpu->runCycles(1000);
+
+  // then
+  EXPECT_EQ(cpu->getTranslatedCycles(), 0);
+  EXPECT_FALSE(sink.records.empty());
+}
+
+TEST_F(CpuAotTest, DisablingInterpretsEverything)
+{
+  // given
+  ASSERT_TRUE(cpu->setTranslatedRom(&nestest));
+
+  // when
+  bool disabled = cpu->setTranslatedRom(NULL);
+  cpu->runCycles(1000);
+
+  // then
+  EXPECT_TRUE(disabled);
+  EXPECT_EQ(cpu->getTranslatedCycles(), 0);
+}
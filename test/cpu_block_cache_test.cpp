@@ -0,0 +1,314 @@
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "bus.h"
+#include "cpu/block_cache.h"
+#include "cpu/cpu.h"
+#include "cpu/trace_sink.h"
+
+class CpuBlockCacheTest : public ::testing::Test
+{
+public:
+  CpuBlockCacheTest() {
+    bus = new Bus();
+    cpu = new Cpu(bus);
+    cpu->setBlockCache(true);
+  }
+
+  ~CpuBlockCacheTest()
+  {
+    delete cpu;
+    delete bus;
+  }
+protected:
+  Bus *bus;
+  Cpu *cpu;
+
+  void readData(unsigned char *data, int length)
+  {
+    bus->readData(data, length);
+    bus->write_16(bus->RESET_VECTOR_ADDR, 0x8000);
+    cpu->reset();
+  }
+};
+
+TEST_F(CpuBlockCacheTest, SameStateAsInterpreter)
+{
+  // given
+  // LDX #$20; loop: TXA; ADC #$35; STA $10; ROL A; DEX; BNE loop
+  unsigned char data[11] = {0xa2, 0x20, 0x8a, 0x69, 0x35, 0x85, 0x10, 0x2a, 0xca, 0xd0, 0xf7};
+  Bus otherBus;
+  Cpu interpreter(&otherBus);
+  otherBus.readData(data, 11);
+  otherBus.write_16(otherBus.RESET_VECTOR_ADDR, 0x8000);
+  interpreter.reset();
+
+  // when
+  readData(data, 11);
+  cpu->runCycles(500);
+  interpreter.runCycles(500);
+
+  // then
+  EXPECT_EQ(cpu->getCycles(), interpreter.getCycles());
+  EXPECT_EQ(cpu->getPC(), interpreter.getPC());
+  EXPECT_EQ(cpu->getA(), interpreter.getA());
+  EXPECT_EQ(cpu->getX(), interpreter.getX());
+  EXPECT_EQ(cpu->getStatus(), interpreter.getStatus());
+  EXPECT_EQ(bus->read(0x10), otherBus.read(0x10));
+}
+
+TEST_F(CpuBlockCacheTest, LoopIsDecodedOnce)
+{
+  // given
+  unsigned char data[5] = {0xa2, 0x0a, 0xca, 0xd0, 0xfd}; // LDX #$0a; loop: DEX; BNE loop
+
+  // when
+  readData(data, 5);
+  cpu->runCycles(2 + 10 * 5 - 1);
+
+  // then
+  EXPECT_EQ(cpu->getX(), 0);
+  EXPECT_EQ(cpu->getBlockCache()->getMisses(), 2); // The first iteration runs in the block at $8000
+  EXPECT_EQ(cpu->getBlockCache()->getHits(), 7);   // The second one in the idle loop check, X changes so it is no idle loop
+}
+
+TEST_F(CpuBlockCacheTest, WriteToBlockInvalidatesIt)
+{
+  // given
+  unsigned char data[6] = {0x20, 0x00, 0x03, 0x20, 0x00, 0x03}; // JSR $0300; JSR $0300
+  unsigned char subroutine[6] = {0xa0, 0x07, 0xee, 0x01, 0x03, 0x60}; // LDY #$07; INC $0301; RTS
+  bus->write(0x0300, subroutine, 6);
+
+  // when
+  readData(data, 6);
+  cpu->runCycles(2 * (6 + 2 + 6 + 6));
+
+  // then
+  EXPECT_EQ(cpu->getY(), 0x08);
+  EXPECT_EQ(cpu->getBlockCache()->getInvalidations(), 2); // Both calls overwrite the subroutine
+}
+
+TEST_F(CpuBlockCacheTest, WriteAheadInRunningBlockIsExecuted)
+{
+  // given
+  unsigned char data[4] = {0xee, 0x05, 0x80, 0xea}; // INC $8005; NOP; LDX #$10
+  unsigned char ldx[2] = {0xa2, 0x10};
+
+  // when
+  readData(data, 4);
+  bus->write(0x8004, ldx, 2);
+  cpu->runCycles(6 + 2 + 2);
+
+  // then
+  EXPECT_EQ(cpu->getX(), 0x11);
+}
+
+TEST_F(CpuBlockCacheTest, WriteOutsideBlocksKeepsThem)
+{
+  // given
+  unsigned char data[7] = {0xa2, 0x05, 0x86, 0x10, 0xca, 0xd0, 0xfb}; // LDX #$05; loop: STX $10; DEX; BNE loop
+
+  // when
+  readData(data, 7);
+  cpu->runCycles(2 + 5 * 8 - 1);
+
+  // then
+  EXPECT_EQ(cpu->getX(), 0);
+  EXPECT_EQ(cpu->getBlockCache()->getInvalidations(), 0);
+}
+
+TEST_F(CpuBlockCacheTest, FullCacheIsFlushed)
+{
+  // given
+  int jumps = BlockCache::MAX_BLOCKS + 10;
+  std::vector<unsigned char> data;
+  for (int i = 0; i < jumps; i++)
+  {
+    unsigned short next = 0x8000 + 3 * (i + 1);
+    data.insert(data.end(), {0x4c, (unsigned char) (next & 0xff), (unsigned char) (next >> 8)}); // JMP next
+  }
+  bus->write(0x8000, data.data(), data.size());
+  bus->write_16(bus->RESET_VECTOR_ADDR, 0x8000);
+  cpu->reset();
+
+  // when
+  cpu->runCycles(3 * jumps);
+
+  // then
+  EXPECT_EQ(cpu->getPC(), 0x8000 + 3 * jumps);
+  EXPECT_EQ(cpu->getBlockCache()->getFlushes(), 1);
+}
+
+TEST_F(CpuBlockCacheTest, FusedPairsMatchInterpreter)
+{
+  // given
+  unsigned char data[] = {
+    0xa9, 0x05, 0x85, 0x10,       // LDA #$05; STA $10
+    0xa9, 0x83, 0x8d, 0x00, 0x02, // LDA #$83; STA $0200
+    0xa5, 0x10, 0x85, 0x11,       // LDA $10; STA $11
+    0xad, 0x00, 0x02, 0x8d, 0x01, 0x02, // LDA $0200; STA $0201
+    0xa2, 0x03, 0xca, 0xd0, 0xfd, // LDX #$03; loop: DEX; BNE loop
+    0xa0, 0x02, 0x88, 0xd0, 0xfd, // LDY #$02; loop: DEY; BNE loop
+    0xc9, 0x83, 0xf0, 0x00,       // CMP #$83; BEQ +0
+    0xc9, 0x01, 0xd0, 0x00,       // CMP #$01; BNE +0
+    0xe6, 0x12, 0xd0, 0x00,       // INC $12; BNE +0
+    0xad, 0x01, 0x02, 0x10, 0x00, // LDA $0201; BPL +0
+    0x2c, 0x00, 0x02, 0x10, 0x00, // BIT $0200; BPL +0
+    0x4c, 0x00, 0x80};            // JMP $8000
+  Bus otherBus;
+  Cpu interpreter(&otherBus);
+  otherBus.readData(data, sizeof(data));
+  otherBus.write_16(otherBus.RESET_VECTOR_ADDR, 0x8000);
+  interpreter.reset();
+  readData(data, sizeof(data));
+
+  for (int i = 0; i < 300; i++)
+  {
+    // when
+    cpu->runCycles(3);
+    interpreter.runCycles(3);
+
+    // then
+    ASSERT_EQ(cpu->getCycles(), interpreter.getCycles());
+    ASSERT_EQ(cpu->getPC(), interpreter.getPC());
+    ASSERT_EQ(cpu->getA(), interpreter.getA());
+    ASSERT_EQ(cpu->getX(), interpreter.getX());
+    ASSERT_EQ(cpu->getY(), interpreter.getY());
+    ASSERT_EQ(cpu->getStatus(), interpreter.getStatus());
+    ASSERT_EQ(bus->read(0x12), otherBus.read(0x12));
+  }
+}
+
+TEST_F(CpuBlockCacheTest, BudgetCanEndInsideFusedPair)
+{
+  // given
+  unsigned char data[4] = {0xa9, 0x05, 0x85, 0x10}; // LDA #$05; STA $10
+
+  // when
+  readData(data, 4);
+  int cycles = cpu->runCycles(2);
+
+  // then
+  EXPECT_EQ(cycles, 2);
+  EXPECT_EQ(cpu->getPC(), 0x8002);
+  EXPECT_EQ(bus->read(0x10), 0);
+}
+
+TEST_F(CpuBlockCacheTest, FusedPairIsTracedAsTwoInstructions)
+{
+  // given
+  unsigned char data[4] = {0xa9, 0x05, 0x85, 0x10}; // LDA #$05; STA $10
+  BufferTraceSink sink;
+  cpu->setTraceSink(&sink);
+
+  // when
+  readData(data, 4);
+  cpu->runCycles(5);
+
+  // then
+  ASSERT_EQ(sink.records.size(), 2);
+  EXPECT_EQ(sink.records[0].opCode, 0xa9);
+  EXPECT_EQ(sink.records[1].opCode, 0x85);
+  EXPECT_EQ(sink.records[1].a, 0x05);
+  EXPECT_EQ(bus->read(0x10), 0x05);
+}
+
+TEST_F(CpuBlockCacheTest, JumpToItselfIsFastForwarded)
+{
+  // given
+  unsigned char data[3] = {0x4c, 0x00, 0x80}; // JMP $8000
+
+  // when
+  readData(data, 3);
+  unsigned long long cycles = cpu->runCycles(1000000);
+
+  // then
+  EXPECT_EQ(cycles, 1000002); // Whole JMPs of 3 cycles
+  EXPECT_EQ(cpu->getPC(), 0x8000);
+  EXPECT_GT(cpu->getSkippedCycles(), 999000);
+}
+
+TEST_F(CpuBlockCacheTest, PollingLoopStopsOnSameInstructionAsInterpreter)
+{
+  // given
+  unsigned char data[7] = {0xa2, 0x07, 0xad, 0x02, 0x20, 0x10, 0xfb}; // LDX #$07; wait: LDA $2002; BPL wait
+  Bus otherBus;
+  Cpu interpreter(&otherBus);
+  otherBus.readData(data, 7);
+  otherBus.write_16(otherBus.RESET_VECTOR_ADDR, 0x8000);
+  interpreter.reset();
+
+  cpu->setStableIo(true); // The latched registers read the same until they are written
+
+  // when
+  readData(data, 7);
+  for (unsigned long long budget : {10000ULL, 12345ULL, 1ULL, 29781ULL})
+  {
+    cpu->runCycles(budget);
+    interpreter.runCycles(budget);
+
+    // then
+    ASSERT_EQ(cpu->getCycles(), interpreter.getCycles());
+    ASSERT_EQ(cpu->getPC(), interpreter.getPC());
+    ASSERT_EQ(cpu->getA(), interpreter.getA());
+    ASSERT_EQ(cpu->getStatus(), interpreter.getStatus());
+  }
+  EXPECT_GT(cpu->getSkippedCycles(), 0);
+}
+
+// Reads $00 a number of times, then $80.
+class CountingIo : public MemoryMappedIo
+{
+public:
+  int reads = 0;
+
+  unsigned char read(unsigned short address) override { return ++reads < 1000 ? 0x00 : 0x80; }
+  void write(unsigned short address, unsigned char value) override {}
+  unsigned char peek(unsigned short address) override { return reads + 1 < 1000 ? 0x00 : 0x80; }
+};
+
+TEST_F(CpuBlockCacheTest, PollingLoopOfChangingIoIsNotFastForwarded)
+{
+  // given
+  unsigned char data[7] = {0xa9, 0x00, 0xad, 0x00, 0x50, 0x10, 0xfb}; // LDA #$00; wait: LDA $5000; BPL wait
+  CountingIo device;
+
+  // when
+  readData(data, 7);
+  bus->mapIo(0x50, 1, &device);
+  cpu->runCycles(10000);
+
+  // then
+  EXPECT_EQ(cpu->getSkippedCycles(), 0);
+  EXPECT_EQ(device.reads, 1000);
+  EXPECT_EQ(cpu->getPC(), 0x8007);
+}
+
+TEST_F(CpuBlockCacheTest, LoopThatChangesRegistersIsNotFastForwarded)
+{
+  // given
+  unsigned char data[5] = {0xa2, 0x00, 0xca, 0xd0, 0xfd}; // LDX #$00; loop: DEX; BNE loop
+
+  // when
+  readData(data, 5);
+  cpu->runCycles(2 + 255 * 5 + 4);
+
+  // then
+  EXPECT_EQ(cpu->getX(), 0);
+  EXPECT_EQ(cpu->getPC(), 0x8005);
+  EXPECT_EQ(cpu->getSkippedCycles(), 0);
+}
+
+TEST_F(CpuBlockCacheTest, LoopThatWritesIsNotFastForwarded)
+{
+  // given
+  unsigned char data[5] = {0x85, 0x10, 0x4c, 0x00, 0x80}; // loop: STA $10; JMP loop
+
+  // when
+  readData(data, 5);
+  cpu->runCycles(10000);
+
+  // then
+  EXPECT_EQ(cpu->getSkippedCycles(), 0);
+}
@@ -0,0 +1,206 @@
+#include "gtest/gtest.h"
+
+#include "bus.h"
+#include "cpu/cpu.h"
+
+class CpuCyclesTest : public ::testing::Test
+{
+public:
+  CpuCyclesTest() {
+    bus = new Bus();
+    cpu = new Cpu(bus);
+  }
+
+  ~CpuCyclesTest() 
+  {
+    delete cpu;
+    delete bus;
+  }
+protected:
+  Bus *bus;
+  Cpu *cpu;
+
+  void readData(unsigned char *data, int length)
+  {
+    bus->readData(data, length);
+    bus->write_16(bus->RESET_VECTOR_ADDR, 0x8000);
+    cpu->reset();
+  }
+};
+
+TEST_F(CpuCyclesTest, ResetTakesSevenCycles)
+{
+  // given
+  unsigned char data[1] = {0x00};
+
+  // when
+  readData(data, 1);
+
+  // then
+  EXPECT_EQ(cpu->getCycles(), 7);
+}
+
+TEST_F(CpuCyclesTest, StepReturnsBaseCycles)
+{
+  // given
+  unsigned char data[6] = {0xa9, 0x01, 0x8d, 0x00, 0x02, 0x00}; // LDA #01; STA $0200
+
+  // when
+  readData(data, 6);
+
+  // then
+  EXPECT_EQ(cpu->step(), 2);
+  EXPECT_EQ(cpu->step(), 4);
+  EXPECT_EQ(cpu->getCycles(), 7 + 2 + 4);
+}
+
+TEST_F(CpuCyclesTest, AbsoluteXWithoutPageCross)
+{
+  // given
+  unsigned char data[5] = {0xa2, 0x01, 0xbd, 0x00, 0x02}; // LDX #01; LDA $0200,X
+
+  // when
+  readData(data, 5);
+  cpu->step();
+
+  // then
+  EXPECT_EQ(cpu->step(), 4);
+}
+
+TEST_F(CpuCyclesTest, AbsoluteXWithPageCross)
+{
+  // given
+  unsigned char data[5] = {0xa2, 0x01, 0xbd, 0xff, 0x02}; // LDX #01; LDA $02ff,X
+
+  // when
+  readData(data, 5);
+  cpu->step();
+
+  // then
+  EXPECT_EQ(cpu->step(), 5);
+}
+
+TEST_F(CpuCyclesTest, AbsoluteYWithPageCross)
+{
+  // given
+  unsigned char data[5] = {0xa0, 0x01, 0xb9, 0xff, 0x02}; // LDY #01; LDA $02ff,Y
+
+  // when
+  readData(data, 5);
+  cpu->step();
+
+  // then
+  EXPECT_EQ(cpu->step(), 5);
+}
+
+TEST_F(CpuCyclesTest, StoreHasNoPageCrossPenalty)
+{
+  // given
+  unsigned char data[5] = {0xa2, 0x01, 0x9d, 0xff, 0x02}; // LDX #01; STA $02ff,X
+
+  // when
+  readData(data, 5);
+  cpu->step();
+
+  // then
+  EXPECT_EQ(cpu->step(), 5);
+}
+
+TEST_F(CpuCyclesTest, IndirectIndexedWithPageCross)
+{
+  // given
+  bus->write_16(0x10, 0x02ff);
+  unsigned char data[4] = {0xa0, 0x01, 0xb1, 0x10}; // LDY #01; LDA ($10),Y
+
+  // when
+  readData(data, 4);
+  cpu->step();
+
+  // then
+  EXPECT_EQ(cpu->step(), 6);
+}
+
+TEST_F(CpuCyclesTest, BranchNotTaken)
+{
+  // given
+  unsigned char data[3] = {0x18, 0xb0, 0x10}; // CLC; BCS +10
+
+  // when
+  readData(data, 3);
+  cpu->step();
+
+  // then
+  EXPECT_EQ(cpu->step(), 2);
+  EXPECT_EQ(cpu->getPC(), 0x8003);
+}
+
+TEST_F(CpuCyclesTest, BranchTaken)
+{
+  // given
+  unsigned char data[3] = {0x38, 0xb0, 0x10}; // SEC; BCS +10
+
+  // when
+  readData(data, 3);
+  cpu->step();
+
+  // then
+  EXPECT_EQ(cpu->step(), 3);
+  EXPECT_EQ(cpu->getPC(), 0x8013);
+}
+
+TEST_F(CpuCyclesTest, BranchTakenToOtherPage)
+{
+  // given
+  unsigned char data[3] = {0x38, 0xb0, 0xf0}; // SEC; BCS -10
+
+  // when
+  readData(data, 3);
+  cpu->step();
+
+  // then
+  EXPECT_EQ(cpu->step(), 4);
+  EXPECT_EQ(cpu->getPC(), 0x7ff3);
+}
+
+TEST_F(CpuCyclesTest, RunCyclesStopsAfterBudget)
+{
+  // given
+  unsigned char data[5] = {0xe8, 0x4c, 0x00, 0x80, 0x00}; // loop: INX; JMP loop
+
+  // when
+  readData(data, 5);
+  unsigned long long ran = cpu->runCycles(100);
+
+  // then
+  EXPECT_EQ(ran, 100); // 20 iterations of 2 + 3 cycles
+  EXPECT_EQ(cpu->getX(), 20);
+  EXPECT_EQ(cpu->getCycles(), 107);
+}
+
+TEST_F(CpuCyclesTest, RunCyclesFinishesLastInstruction)
+{
+  // given
+  unsigned char data[5] = {0xe8, 0x4c, 0x00, 0x80, 0x00}; // loop: INX; JMP loop
+
+  // when
+  readData(data, 5);
+  unsigned long long ran = cpu->runCycles(101);
+
+  // then
+  EXPECT_EQ(ran, 102);
+  EXPECT_EQ(cpu->getX(), 21);
+}
+
+TEST_F(CpuCyclesTest, RunCyclesStopsOnBrk)
+{
+  // given
+  unsigned char data[3] = {0xe8, 0xe8, 0x00}; // INX; INX
+
+  // when
+  readData(data, 3);
+  unsigned long long ran = cpu->runCycles(100);
+
+  // then
+  EXPECT_EQ(ran, 4);
+  EXPECT_EQ(cpu->getPC(), 0x8002);
+}
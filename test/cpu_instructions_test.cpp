@@ -892,6 +892,38 @@ TEST_F(CpuTest, PLP)
   EXPECT_EQ(cpu->getStatus(), 0b0000'1001);
 }
 
+TEST_F(CpuTest, PHP_pushes_result_flags)
+{
+  // given
+  unsigned char data[5] = {0xa9, 0x80, 0x38, 0x08, 0x00}; // LDA #80; SEC; PHP
+
+  // when
+  readData(data, 5);
+
+  // then
+  EXPECT_EQ(bus->read(0x01fd), 0b1011'0001);
+}
+
+TEST_F(CpuTest, PLP_restores_flags_for_branches)
+{
+  // given
+  unsigned char data[13] = {
+    0xa9, 0xc2, 0x48, 0x28, // LDA #c2; PHA; PLP; (N, V and Z set)
+    0xf0, 0x02,             // BEQ +2
+    0xa2, 0x01,             // LDX #01
+    0x70, 0x02,             // BVS +2
+    0xa0, 0x01,             // LDY #01
+    0x00};
+
+  // when
+  readData(data, 13);
+
+  // then
+  EXPECT_EQ(cpu->getX(), 0);
+  EXPECT_EQ(cpu->getY(), 0);
+  EXPECT_EQ(cpu->getStatus(), 0b1100'0010);
+}
+
 TEST_F(CpuTest, ROL_ACCUMULATOR_NO_CARRY)
 {
   // given
@@ -0,0 +1,248 @@
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "bus.h"
+#include "cpu/block_cache.h"
+#include "cpu/cpu.h"
+#include "cpu/jit.h"
+
+class CpuJitTest : public ::testing::Test
+{
+public:
+  CpuJitTest() {
+    bus = new Bus();
+    cpu = new Cpu(bus);
+    otherBus = new Bus();
+    interpreter = new Cpu(otherBus);
+  }
+
+  ~CpuJitTest()
+  {
+    delete interpreter;
+    delete otherBus;
+    delete cpu;
+    delete bus;
+  }
+
+  void SetUp() override
+  {
+    if (!cpu->setJit(true))
+      GTEST_SKIP() << "No JIT in this build";
+  }
+protected:
+  Bus *bus;
+  Cpu *cpu;
+  Bus *otherBus;
+  Cpu *interpreter;
+
+  // Same program for the JIT and the interpreter
+  void readData(unsigned char *data, int length)
+  {
+    for (Bus *b : {bus, otherBus})
+    {
+      b->readData(data, length);
+      b->write_16(b->RESET_VECTOR_ADDR, 0x8000);
+    }
+    cpu->reset();
+    interpreter->reset();
+  }
+
+  void runCycles(unsigned long long budget)
+  {
+    cpu->runCycles(budget);
+    interpreter->runCycles(budget);
+  }
+
+  void expectSameState()
+  {
+    EXPECT_EQ(cpu->getCycles(), interpreter->getCycles());
+    EXPECT_EQ(cpu->getPC(), interpreter->getPC());
+    EXPECT_EQ(cpu->getA(), interpreter->getA());
+    EXPECT_EQ(cpu->getX(), interpreter->getX());
+    EXPECT_EQ(cpu->getY(), interpreter->getY());
+    EXPECT_EQ(cpu->getSP(), interpreter->getSP());
+    EXPECT_EQ(cpu->getStatus(), interpreter->getStatus());
+    for (int address = 0; address < 0x800; address++)
+      ASSERT_EQ(bus->read(address), otherBus->read(address)) << "at " << address;
+  }
+};
+
+TEST_F(CpuJitTest, HotBlockIsCompiled)
+{
+  // given
+  unsigned char data[5] = {0xa2, 0x00, 0xca, 0xd0, 0xfd}; // LDX #$00; loop: DEX; BNE loop
+
+  // when
+  readData(data, 5);
+  runCycles(1000);
+
+  // then
+  EXPECT_EQ(cpu->getJit()->getCompiledBlocks(), 1);
+  expectSameState();
+}
+
+TEST_F(CpuJitTest, CompiledCodeIsNotWritable)
+{
+  // given
+  unsigned char data[5] = {0xa2, 0x00, 0xca, 0xd0, 0xfd}; // LDX #$00; loop: DEX; BNE loop
+  readData(data, 5);
+  runCycles(1000);
+  Block *block = cpu->getBlockCache()->get(0x8002);
+  ASSERT_NE(block->code, nullptr);
+  unsigned long code = (unsigned long) block->code;
+
+  // when
+  std::string permissions;
+  std::ifstream maps("/proc/self/maps");
+  for (std::string line; std::getline(maps, line);)
+  {
+    unsigned long start, end;
+    char dash;
+    std::istringstream fields(line);
+    fields >> std::hex >> start >> dash >> end >> permissions;
+    if (code >= start && code < end)
+      break;
+    permissions.clear();
+  }
+
+  // then
+  EXPECT_EQ(permissions.substr(0, 3), "r-x");
+}
+
+TEST_F(CpuJitTest, ArithmeticMatchesInterpreter)
+{
+  // given
+  // loop: LDX #$00
+  // inner: TXA; ADC #$35; EOR #$5a; ROL A; STA $10,X; CMP #$40; SBC #$11; BIT $10; AND #$7f; ORA $11; LSR A; ROR $12
+  //        INC $13; DEC $14; ASL $15; CLC; DEX; BNE inner
+  //        SEC; CLV; INY; STY $16; JMP loop
+  unsigned char data[] = {
+    0xa2, 0x00,
+    0x8a, 0x69, 0x35, 0x49, 0x5a, 0x2a, 0x95, 0x10, 0xc9, 0x40, 0xe9, 0x11, 0x24, 0x10, 0x29, 0x7f, 0x05, 0x11, 0x4a,
+    0x66, 0x12, 0xe6, 0x13, 0xc6, 0x14, 0x06, 0x15, 0x18, 0xca, 0xd0, 0xe1,
+    0x38, 0xb8, 0xc8, 0x84, 0x16, 0x4c, 0x00, 0x80};
+  readData(data, sizeof(data));
+
+  for (unsigned long long budget : {1000ULL, 7ULL, 29781ULL, 12345ULL, 100000ULL})
+  {
+    // when
+    runCycles(budget);
+
+    // then
+    expectSameState();
+  }
+  EXPECT_GE(cpu->getJit()->getCompiledInstructions(), 18); // At least the inner loop
+}
+
+TEST_F(CpuJitTest, IndexedAddressingMatchesInterpreter)
+{
+  // given
+  // LDA #$f0; STA $20; LDA #$02; STA $21      pointer $02f0 at $20
+  // loop: LDA $02f0,X; STA $0300,Y; LDA ($20),Y; STA ($20,X); INC $0280,X; LDX $30,Y; STX $40,Y; LDY $50,X
+  //       INY; INX; CPX #$90; BNE loop; CPY #$10; BEQ loop; JMP loop
+  unsigned char data[] = {
+    0xa9, 0xf0, 0x85, 0x20, 0xa9, 0x02, 0x85, 0x21,
+    0xbd, 0xf0, 0x02, 0x99, 0x00, 0x03, 0xb1, 0x20, 0x81, 0x20, 0xfe, 0x80, 0x02, 0xb6, 0x30, 0x96, 0x40, 0xb4, 0x50,
+    0xc8, 0xe8, 0xe0, 0x90, 0xd0, 0xe7, 0xc0, 0x10, 0xf0, 0xe3, 0x4c, 0x08, 0x80};
+  readData(data, sizeof(data));
+
+  for (int i = 0; i < 50; i++)
+  {
+    // when
+    runCycles(997);
+
+    // then
+    expectSameState();
+  }
+  EXPECT_GT(cpu->getJit()->getCompiledBlocks(), 0);
+}
+
+TEST_F(CpuJitTest, SubroutinesMatchInterpreter)
+{
+  // given
+  // loop: JSR sub; INX; JMP loop
+  // sub:  PHA; TXA; PHA; PLA; TAY; PLA; ADC #$03; TSX; TXS; RTS
+  unsigned char data[] = {
+    0x20, 0x07, 0x80, 0xe8, 0x4c, 0x00, 0x80,
+    0x48, 0x8a, 0x48, 0x68, 0xa8, 0x68, 0x69, 0x03, 0xba, 0x9a, 0x60};
+  readData(data, sizeof(data));
+
+  // when
+  runCycles(50000);
+
+  // then
+  expectSameState();
+  EXPECT_GT(cpu->getJit()->getCompiledBlocks(), 2);
+}
+
+TEST_F(CpuJitTest, WriteToCompiledCodeMatchesInterpreter)
+{
+  // given
+  // loop: LDY #$00; INC $8001; LDA $8001; STA $10; JMP loop   increments the operand of LDY
+  unsigned char data[] = {0xa0, 0x00, 0xee, 0x01, 0x80, 0xad, 0x01, 0x80, 0x85, 0x10, 0x4c, 0x00, 0x80};
+  readData(data, sizeof(data));
+
+  // when
+  runCycles(20000);
+
+  // then
+  expectSameState();
+  EXPECT_GT(cpu->getBlockCache()->getInvalidations(), 100);
+}
+
+TEST_F(CpuJitTest, MemoryMappedIoIsLeftToInterpreter)
+{
+  // given
+  unsigned char data[8] = {0xe8, 0xad, 0x02, 0x20, 0x8d, 0x00, 0x40, 0x4c}; // loop: INX; LDA $2002; STA $4000; JMP loop
+  unsigned char jump[2] = {0x00, 0x80};
+
+  // when
+  readData(data, 8);
+  bus->write(0x8008, jump, 2);
+  otherBus->write(0x8008, jump, 2);
+  runCycles(10000);
+
+  // then
+  EXPECT_EQ(cpu->getJit()->getCompiledInstructions(), 1); // Only INX, the rest runs in the interpreter
+  expectSameState();
+}
+
+TEST_F(CpuJitTest, NestestEndsInSameStateAsInterpreter)
+{
+  // given
+  std::ifstream in(NES_TEST_ROM, std::ios::binary);
+  std::vector<unsigned char> rom((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+  ASSERT_GT(rom.size(), 16 + 0x4000);
+  readData(rom.data() + 16, 0x4000);
+  for (Bus *b : {bus, otherBus})
+    b->write_16(b->RESET_VECTOR_ADDR, 0xc000);
+
+  // when
+  std::streambuf *coutBuffer = std::cout.rdbuf(nullptr); // Cpu::run prints the registers
+  for (unsigned int i = 0; i < 2 * Jit::THRESHOLD; i++) // Blocks only get hot when the ROM runs again
+  {
+    cpu->run();
+    interpreter->run();
+  }
+  std::cout.rdbuf(coutBuffer);
+
+  // then
+  expectSameState();
+  EXPECT_GT(cpu->getJit()->getCompiledBlocks(), 0);
+}
+
+TEST_F(CpuJitTest, DisablingKeepsBlockCache)
+{
+  // when
+  bool disabled = cpu->setJit(false);
+
+  // then
+  EXPECT_TRUE(disabled);
+  EXPECT_EQ(cpu->getJit(), nullptr);
+  EXPECT_NE(cpu->getBlockCache(), nullptr);
+}
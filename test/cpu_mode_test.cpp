@@ -0,0 +1,130 @@
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "bus.h"
+#include "cpu/cpu.h"
+#include "cpu/trace_sink.h"
+
+class CpuModeTest : public ::testing::Test
+{
+public:
+  CpuModeTest() {
+    bus = new Bus();
+    cpu = new Cpu(bus);
+  }
+
+  ~CpuModeTest()
+  {
+    delete cpu;
+    delete bus;
+  }
+protected:
+  Bus *bus;
+  Cpu *cpu;
+
+  void readData(unsigned char *data, int length)
+  {
+    bus->readData(data, length);
+    bus->write_16(bus->RESET_VECTOR_ADDR, 0x8000);
+  }
+
+  void readNestest()
+  {
+    std::ifstream in(NES_TEST_ROM, std::ios::binary);
+    std::vector<unsigned char> rom((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    ASSERT_GT(rom.size(), 16 + 0x4000);
+    bus->readData(rom.data() + 16, 0x4000);
+    bus->write_16(bus->RESET_VECTOR_ADDR, 0xc000);
+  }
+};
+
+TEST_F(CpuModeTest, InstructionTestsByDefault)
+{
+  EXPECT_EQ(cpu->getMode(), INSTRUCTION_TESTS);
+}
+
+TEST_F(CpuModeTest, PowerUpStatusDependsOnMode)
+{
+  // given
+  unsigned char data[1] = {0xea};
+  readData(data, 1);
+
+  for (std::pair<CpuMode, unsigned char> expected : {std::make_pair(NES_HARDWARE, 0x34), std::make_pair(INSTRUCTION_TESTS, 0x00), std::make_pair(NESTEST_LOG, 0x24)})
+  {
+    // when
+    cpu->setMode(expected.first);
+    cpu->reset();
+
+    // then
+    EXPECT_EQ(cpu->getStatus(), expected.second);
+  }
+}
+
+TEST_F(CpuModeTest, InstructionTestsHaltOnBrk)
+{
+  // given
+  unsigned char data[3] = {0xe8, 0x00, 0xe8}; // INX; BRK; INX
+  readData(data, 3);
+  cpu->reset();
+
+  // when
+  unsigned long long cycles = cpu->runCycles(100);
+
+  // then
+  EXPECT_EQ(cycles, 2);
+  EXPECT_EQ(cpu->getX(), 1);
+  EXPECT_EQ(cpu->getPC(), 0x8001);
+}
+
+TEST_F(CpuModeTest, NesHardwareRunsBrk)
+{
+  // given
+  unsigned char data[3] = {0xe8, 0x00, 0xe8}; // INX; BRK; INX
+  readData(data, 3);
+  cpu->setMode(NES_HARDWARE);
+  cpu->reset();
+
+  // when
+  unsigned long long cycles = cpu->runCycles(9);
+
+  // then
+  EXPECT_EQ(cycles, 9);
+  EXPECT_EQ(cpu->getSP(), 0xfd - 3); // Pushed pc and status
+}
+
+TEST_F(CpuModeTest, NestestLogHaltsWhenLogIsComplete)
+{
+  // given
+  readNestest();
+  BufferTraceSink sink;
+  cpu->setMode(NESTEST_LOG);
+  cpu->setTraceSink(&sink);
+
+  for (bool blockCache : {false, true})
+  {
+    // when
+    sink.records.clear();
+    cpu->setBlockCache(blockCache);
+    cpu->run();
+
+    // then
+    EXPECT_EQ(sink.records.size(), NESTEST_LOG_LENGTH);
+  }
+}
+
+TEST_F(CpuModeTest, UntracedNestestLogRunsUntilBrk)
+{
+  // given
+  readNestest();
+  cpu->setMode(NESTEST_LOG);
+  cpu->reset();
+
+  // when
+  cpu->runCycles(1000000); // Unlike run(), doesn't log to std::cout
+
+  // then
+  EXPECT_EQ(cpu->getPC(), 0x0004); // Final BRK of nestest
+}
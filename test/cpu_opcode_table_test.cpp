@@ -0,0 +1,95 @@
+#include <string>
+
+#include "gtest/gtest.h"
+
+#include "bus.h"
+#include "cpu/cpu.h"
+
+class CpuOpCodeTableTest : public ::testing::Test
+{
+public:
+  CpuOpCodeTableTest() {
+    bus = new Bus();
+    cpu = new Cpu(bus);
+  }
+
+  ~CpuOpCodeTableTest() 
+  {
+    delete cpu;
+    delete bus;
+  }
+protected:
+  Bus *bus;
+  Cpu *cpu;
+
+  void readData(unsigned char *data, int length)
+  {
+    bus->readData(data, length);
+    bus->write_16(bus->RESET_VECTOR_ADDR, 0x8000);
+    cpu->run();
+  }
+
+  bool changesControlFlow(const OpCode &op)
+  {
+    std::string name = op.name;
+    return op.mode == RELATIVE || name == "BRK" || name == "JMP" || name == "JSR" || name == "RTS" || name == "RTI";
+  }
+
+  bool supported(int opCode)
+  {
+    // Unstable opcodes and SBX are not implemented
+    for (int unsupported : {0x8b, 0x93, 0x9b, 0x9c, 0x9e, 0x9f, 0xab, 0xcb})
+      if (opCode == unsupported)
+        return false;
+    return true;
+  }
+};
+
+TEST_F(CpuOpCodeTableTest, HasAllOfficialOpCodes)
+{
+  int official = 0;
+  for (const OpCode &op : Cpu::OPCODES) {
+    if (op.official) {
+      official++;
+      EXPECT_EQ(std::string(op.name).length(), 3);
+    } else {
+      EXPECT_EQ(op.name[0], '*');
+    }
+  }
+  EXPECT_EQ(official, 151);
+}
+
+TEST_F(CpuOpCodeTableTest, CyclesAreInRange)
+{
+  for (const OpCode &op : Cpu::OPCODES) {
+    EXPECT_GE(op.cycles, 2);
+    EXPECT_LE(op.cycles, 8);
+  }
+  EXPECT_EQ(Cpu::OPCODES[0xbd].cycles, 4); // LDA $nnnn,X
+  EXPECT_TRUE(Cpu::OPCODES[0xbd].pageCrossPenalty);
+  EXPECT_FALSE(Cpu::OPCODES[0x9d].pageCrossPenalty); // STA $nnnn,X
+}
+
+TEST_F(CpuOpCodeTableTest, ProgramCounterAdvancesByLength)
+{
+  for (int opCode = 0; opCode < 256; opCode++) {
+    const OpCode &op = Cpu::OPCODES[opCode];
+    if (changesControlFlow(op) || !supported(opCode))
+      continue;
+
+    // given
+    Bus bus;
+    Cpu cpu(&bus);
+    unsigned char data[4] = {(unsigned char) opCode, 0x00, 0x00, 0x00};
+    for (int i = op.bytes; i < 4; i++)
+      data[i] = 0x00; // BRK
+    bus.readData(data, 4);
+    bus.write_16(bus.RESET_VECTOR_ADDR, 0x8000);
+
+    // when
+    cpu.run();
+
+    // then
+    EXPECT_EQ(cpu.getPC(), 0x8000 + op.bytes) << op.name << " " << opCode;
+  }
+}
@@ -0,0 +1,128 @@
+#include <sstream>
+
+#include "gtest/gtest.h"
+
+#include "bus.h"
+#include "cpu/cpu.h"
+#include "cpu/trace_sink.h"
+
+class CpuTraceTest : public ::testing::Test
+{
+public:
+  CpuTraceTest() {
+    bus = new Bus();
+    cpu = new Cpu(bus);
+  }
+
+  ~CpuTraceTest() 
+  {
+    delete cpu;
+    delete bus;
+  }
+protected:
+  Bus *bus;
+  Cpu *cpu;
+  BufferTraceSink sink;
+
+  void readData(unsigned char *data, int length)
+  {
+    bus->readData(data, length);
+    bus->write_16(bus->RESET_VECTOR_ADDR, 0x8000);
+    cpu->run();
+  }
+};
+
+TEST_F(CpuTraceTest, RecordsEveryInstruction)
+{
+  // given
+  unsigned char data[6] = {0xa9, 0x40, 0xaa, 0xe8, 0xca, 0x00}; // LDA #40; TAX; INX; DEX
+  cpu->setTraceSink(&sink);
+
+  // when
+  readData(data, 6);
+
+  // then
+  ASSERT_EQ(sink.records.size(), 4);
+  EXPECT_EQ(sink.records[0].pc, 0x8000);
+  EXPECT_EQ(sink.records[0].opCode, 0xa9);
+  EXPECT_EQ(sink.records[0].paramCount, 1);
+  EXPECT_EQ(sink.records[0].params[0], 0x40);
+  EXPECT_EQ(sink.records[1].a, 0x40);
+  EXPECT_EQ(sink.records[3].x, 0x41);
+}
+
+TEST_F(CpuTraceTest, FormatsNestestLogLines)
+{
+  // given
+  bus->write_8(0x0010, 0x33);
+  unsigned char data[11] = {
+    0xa5, 0x10,       // LDA $10
+    0xb5, 0x0f,       // LDA $0f,X
+    0x8d, 0x00, 0x02, // STA $0200
+    0x4c, 0x0a, 0x80, // JMP $800a
+    0x00};
+  cpu->setTraceSink(&sink);
+
+  // when
+  readData(data, 11);
+
+  // then
+  std::ostringstream log;
+  sink.print(log);
+  EXPECT_EQ(log.str(),
+    "8000  A5 10     LDA $10 = 33                    A:00 X:00 Y:00 P:00 SP:FD\n"
+    "8002  B5 0F     LDA $0F,X @ 0F = 00             A:33 X:00 Y:00 P:00 SP:FD\n"
+    "8004  8D 00 02  STA $0200 = 00                  A:00 X:00 Y:00 P:02 SP:FD\n"
+    "8007  4C 0A 80  JMP $800A                       A:00 X:00 Y:00 P:02 SP:FD\n");
+}
+
+TEST_F(CpuTraceTest, FormatsBranchTarget)
+{
+  // given
+  unsigned char data[4] = {0x38, 0xb0, 0x00, 0x00}; // SEC; BCS +0
+  cpu->setTraceSink(&sink);
+
+  // when
+  readData(data, 4);
+
+  // then
+  ASSERT_EQ(sink.records.size(), 2);
+  EXPECT_EQ(sink.records[1].toString(), "8001  B0 00     BCS $8003                       A:00 X:00 Y:00 P:01 SP:FD");
+}
+
+TEST_F(CpuTraceTest, RecordsNothingWithoutSink)
+{
+  // given
+  unsigned char data[3] = {0xa9, 0x40, 0x00}; // LDA #40
+  cpu->setTraceSink(&sink);
+  cpu->setTraceSink(NULL);
+
+  // when
+  readData(data, 3);
+
+  // then
+  EXPECT_TRUE(sink.records.empty());
+  EXPECT_EQ(cpu->getA(), 0x40);
+}
+
+TEST_F(CpuTraceTest, PairProfileCountsConsecutiveOpcodes)
+{
+  // given
+  unsigned char data[6] = {0xa2, 0x03, 0xca, 0xd0, 0xfd, 0x00}; // LDX #03; loop: DEX; BNE loop
+  PairProfileTraceSink profile;
+  cpu->setTraceSink(&profile);
+
+  // when
+  readData(data, 6);
+
+  // then
+  std::vector<PairProfileTraceSink::Pair> top = profile.top(2);
+  ASSERT_EQ(top.size(), 2);
+  EXPECT_EQ(top[0].first, 0xca);
+  EXPECT_EQ(top[0].second, 0xd0);
+  EXPECT_EQ(top[0].count, 3);
+  EXPECT_EQ(top[1].first, 0xd0);
+  EXPECT_EQ(top[1].second, 0xca);
+  EXPECT_EQ(top[1].count, 2);
+  EXPECT_EQ(profile.instructions, 7);
+}
@@ -0,0 +1,88 @@
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "ppu/frame_converter.h"
+#include "ppu/palette.h"
+#include "ppu/ppu.h"
+
+class FrameConverterTest : public ::testing::Test
+{
+public:
+  FrameConverterTest() : frame(Ppu::WIDTH * Ppu::HEIGHT), emphasis(Ppu::HEIGHT) {
+    // Every index on every line, shifted by the line, and every emphasis
+    for (int i = 0; i < Ppu::WIDTH * Ppu::HEIGHT; i++)
+      frame[i] = (i + i / Ppu::WIDTH) & 0x3f;
+    for (int y = 0; y < Ppu::HEIGHT; y++)
+      emphasis[y] = y & 7;
+  }
+
+protected:
+  FrameConverter converter;
+  std::vector<unsigned char> frame;
+  std::vector<unsigned char> emphasis;
+};
+
+TEST_F(FrameConverterTest, ConvertsPaletteColors)
+{
+  // when
+  uint32_t rgba = converter.rgba(0x21, 0);
+  uint16_t rgb565 = converter.rgb565(0x21, 0);
+
+  // then
+  EXPECT_EQ(NES_PALETTE[0x21], 0x64b0ffu);
+  EXPECT_EQ(rgba, 0xffffb064u);
+  EXPECT_EQ(rgb565, (0x64 >> 3) << 11 | (0xb0 >> 2) << 5 | 0xff >> 3);
+}
+
+TEST_F(FrameConverterTest, EmphasisDarkensOtherColors)
+{
+  // when
+  uint32_t red = converter.rgba(0x30, 1);
+  uint32_t all = converter.rgba(0x30, 7);
+
+  // then
+  EXPECT_EQ(red, 0xffbfbeffu); // White is 0xfffeff
+  EXPECT_EQ(all, 0xff8f8e8fu);
+}
+
+TEST_F(FrameConverterTest, SimdMatchesScalar)
+{
+  // given
+  std::vector<uint32_t> rgba(frame.size());
+  std::vector<uint16_t> rgb565(frame.size());
+  ASSERT_TRUE(converter.setSimd(FrameConverter::SCALAR));
+  converter.toRgba(frame.data(), emphasis.data(), rgba.data());
+  converter.toRgb565(frame.data(), emphasis.data(), rgb565.data());
+  EXPECT_EQ(rgba[Ppu::WIDTH + 2], converter.rgba(3, 1));
+  EXPECT_EQ(rgb565[Ppu::WIDTH + 2], converter.rgb565(3, 1));
+
+  for (FrameConverter::Simd simd : {FrameConverter::SSSE3, FrameConverter::AVX2})
+  {
+    if (!converter.setSimd(simd))
+      continue;
+    std::vector<uint32_t> simdRgba(frame.size());
+    std::vector<uint16_t> simdRgb565(frame.size());
+
+    // when
+    converter.toRgba(frame.data(), emphasis.data(), simdRgba.data());
+    converter.toRgb565(frame.data(), emphasis.data(), simdRgb565.data());
+
+    // then
+    EXPECT_EQ(simdRgba, rgba) << simd;
+    EXPECT_EQ(simdRgb565, rgb565) << simd;
+  }
+}
+
+TEST_F(FrameConverterTest, UnsupportedSimdIsRefused)
+{
+  // given
+  converter.setSimd(FrameConverter::SCALAR);
+
+  // when
+  bool avx2 = converter.setSimd(FrameConverter::AVX2);
+
+  // then
+  EXPECT_EQ(avx2, FrameConverter::isSupported(FrameConverter::AVX2));
+  EXPECT_EQ(converter.getSimd(), avx2 ? FrameConverter::AVX2 : FrameConverter::SCALAR);
+}
@@ -33,4 +33,128 @@ TEST_F(BusTest, BusWritesTwoByteValue)
   EXPECT_EQ(memory.read(0), 0x34);
   EXPECT_EQ(memory.read(1), 0x12);
   EXPECT_EQ(memory.read_16(0), 0x1234);
-}
\ No newline at end of file
+}
+
+TEST_F(BusTest, RamIsMirrored)
+{
+  // when
+  memory.write_8(0x0123, 0x42);
+
+  // then
+  EXPECT_EQ(memory.read(0x0923), 0x42);
+  EXPECT_EQ(memory.read(0x1123), 0x42);
+  EXPECT_EQ(memory.read(0x1923), 0x42);
+}
+
+TEST_F(BusTest, ReadTwoByteValueWrapsAroundAddressSpace)
+{
+  // given
+  memory.write_8(0xffff, 0x34);
+  memory.write_8(0x0000, 0x12);
+
+  // when
+  unsigned short value = memory.read_16(0xffff);
+
+  // then
+  EXPECT_EQ(value, 0x1234);
+}
+
+TEST_F(BusTest, UnconnectedIoReadsFF)
+{
+  // when
+  memory.write_8(0x4015, 0x00);
+
+  // then
+  EXPECT_EQ(memory.read(0x4015), 0xff);
+}
+
+class RecordingIo : public MemoryMappedIo
+{
+public:
+  unsigned short lastAddress = 0;
+  unsigned char lastValue = 0;
+
+  unsigned char read(unsigned short address) override { lastAddress = address; return 0x99; }
+  void write(unsigned short address, unsigned char value) override { lastAddress = address; lastValue = value; }
+  unsigned char peek(unsigned short address) override { return 0x98; }
+};
+
+TEST_F(BusTest, IoPagesGoToDevice)
+{
+  // given
+  RecordingIo device;
+  memory.mapIo(0x60, 2, &device);
+
+  // when
+  memory.write_8(0x6101, 0x55);
+
+  // then
+  EXPECT_EQ(device.lastAddress, 0x6101);
+  EXPECT_EQ(device.lastValue, 0x55);
+  EXPECT_EQ(memory.read(0x6002), 0x99);
+  EXPECT_EQ(device.lastAddress, 0x6002);
+}
+
+TEST_F(BusTest, PeekDoesNotReadDevice)
+{
+  // given
+  RecordingIo device;
+  memory.mapIo(0x60, 1, &device);
+  memory.write_8(0x0010, 0x42);
+
+  // when
+  unsigned char io = memory.peek(0x6003);
+  unsigned char ram = memory.peek(0x0810); // Mirror of $0010
+
+  // then
+  EXPECT_EQ(io, 0x98);
+  EXPECT_EQ(device.lastAddress, 0);
+  EXPECT_EQ(ram, 0x42);
+}
+
+TEST_F(BusTest, WritesToReadOnlyMemoryGoToDevice)
+{
+  // given
+  unsigned char rom[256] = {0xab};
+  RecordingIo mapper;
+  memory.mapIo(0x80, 1, &mapper);
+  memory.mapMemory(0x80, 1, rom, false);
+
+  // when
+  memory.write_8(0x8000, 0x07);
+
+  // then
+  EXPECT_EQ(memory.read(0x8000), 0xab);
+  EXPECT_EQ(mapper.lastValue, 0x07);
+}
+
+TEST_F(BusTest, PageOfMemoryIsReadAtOnce)
+{
+  // given
+  for (int i = 0; i < 256; i++)
+    memory.write_8(0x0300 + i, i);
+  unsigned char data[256];
+
+  // when
+  memory.readPage(0x0b, data); // Mirror of $0300
+
+  // then
+  for (int i = 0; i < 256; i++)
+    ASSERT_EQ(data[i], i);
+}
+
+TEST_F(BusTest, PageOfIoIsReadFromDevice)
+{
+  // given
+  RecordingIo device;
+  memory.mapIo(0x60, 1, &device);
+  unsigned char data[256];
+
+  // when
+  memory.readPage(0x60, data);
+
+  // then
+  EXPECT_EQ(data[0], 0x99);
+  EXPECT_EQ(data[255], 0x99);
+  EXPECT_EQ(device.lastAddress, 0x60ff);
+}
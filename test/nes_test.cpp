@@ -0,0 +1,427 @@
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "cpu/trace_sink.h"
+#include "cpu/translated_rom.h"
+#include "nes.h"
+
+// Generated by NES_AOT from nestest with entry $C000, see test/CMakeLists.txt.
+extern const TranslatedRom nestest;
+
+// Runs the same program on a Nes that syncs the Ppu in lockstep and on one that lets it catch up, frame by frame. The
+// one that catches up can also draw on its RenderThread.
+class NesTest : public ::testing::Test
+{
+public:
+  NesTest() : prg(0x8000, 0xea) {
+    lockstep.setSync(LOCKSTEP);
+  }
+
+protected:
+  Nes lockstep;
+  Nes catchUp;
+  std::vector<unsigned char> prg;
+  std::vector<unsigned char> chr;
+
+  void insert(int mapper, Mirroring mirroring)
+  {
+    RomImage image = {mapper, mirroring, prg.data(), (int) prg.size(), chr.empty() ? NULL : chr.data(), (int) chr.size()};
+    for (Nes *nes : {&lockstep, &catchUp})
+    {
+      nes->getBus().insertDisk(image);
+      nes->reset();
+    }
+  }
+
+  void setRenderer(PpuRenderer renderer)
+  {
+    for (Nes *nes : {&lockstep, &catchUp})
+      nes->getPpu().setRenderer(renderer);
+  }
+
+  void copy(std::vector<unsigned char> code, int offset)
+  {
+    std::copy(code.begin(), code.end(), prg.begin() + offset);
+  }
+
+  // Random pattern tables, nametables and palette, and sprites in RAM at $0200 for OAM DMA.
+  void fillMemory(unsigned int seed)
+  {
+    for (Nes *nes : {&lockstep, &catchUp})
+    {
+      unsigned int random = seed;
+      auto next = [&random]() { random = random * 1103515245 + 12345; return (unsigned char) (random >> 16); };
+      Bus &bus = nes->getBus();
+      bus.write_8(0x2006, 0x00);
+      bus.write_8(0x2006, 0x00);
+      for (int i = 0; i < 0x2000 + 0x800; i++)
+        bus.write_8(0x2007, next());
+      bus.write_8(0x2006, 0x3f);
+      bus.write_8(0x2006, 0x00);
+      for (int i = 0; i < 32; i++)
+        bus.write_8(0x2007, next());
+      for (int i = 0; i < 64; i++)
+      {
+        unsigned char y = i < 12 ? 140 : next(); // Sprite 0 and 11 others on the same lines
+        std::vector<unsigned char> sprite = {y, next(), next(), i == 0 ? (unsigned char) 100 : next()};
+        for (int j = 0; j < 4; j++)
+          bus.write_8(0x0200 + i * 4 + j, sprite[j]);
+      }
+    }
+  }
+
+  void insertNestest()
+  {
+    std::ifstream in(NES_TEST_ROM, std::ios::binary);
+    std::vector<unsigned char> rom((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    ASSERT_EQ(rom.size(), 16 + 0x4000 + 0x2000);
+    prg.assign(rom.begin() + 16, rom.begin() + 16 + 0x4000);
+    chr.assign(rom.begin() + 16 + 0x4000, rom.end());
+    insert(0, HORIZONTAL);
+  }
+
+  // Scrolls the part of the screen below sprite 0 a pixel further every frame, with writes in the middle of the line.
+  void insertSprite0Split()
+  {
+    copy({0xa9, 0x80, 0x8d, 0x00, 0x20, // LDA #$80; STA $2000
+          0xa9, 0x1e, 0x8d, 0x01, 0x20, // LDA #$1E; STA $2001
+          0x2c, 0x02, 0x20, 0x70, 0xfb, // BIT $2002; BVS *-3
+          0x2c, 0x02, 0x20, 0x50, 0xfb, // BIT $2002; BVC *-3
+          0xa5, 0x00, 0x8d, 0x05, 0x20, 0x8d, 0x05, 0x20, // LDA $00; STA $2005; STA $2005
+          0x4c, 0x0a, 0x80}, 0); // JMP $800A
+    copy({0xa9, 0x02, 0x8d, 0x14, 0x40, // LDA #$02; STA $4014
+          0xe6, 0x00, // INC $00
+          0xa9, 0x00, 0x8d, 0x05, 0x20, 0x8d, 0x05, 0x20, // LDA #0; STA $2005; STA $2005
+          0x40}, 0x30); // RTI
+    prg[0x7ffa] = 0x30; prg[0x7ffb] = 0x80;
+    prg[0x7ffc] = 0x00; prg[0x7ffd] = 0x80;
+    insert(0, VERTICAL);
+    fillMemory(12345);
+  }
+
+  // Scrolls every 32 lines from the MMC3 IRQ, a pixel further every time.
+  void insertMmc3Split()
+  {
+    copy({0xa9, 0x80, 0x8d, 0x00, 0x20, // LDA #$80; STA $2000
+          0xa9, 0x1e, 0x8d, 0x01, 0x20, // LDA #$1E; STA $2001
+          0xa9, 0x20, 0x8d, 0x00, 0xc0, // LDA #32; STA $C000
+          0x8d, 0x01, 0xc0, 0x8d, 0x01, 0xe0, // STA $C001; STA $E001
+          0x58, 0x4c, 0x16, 0xe0}, 0x6000); // CLI; JMP $E016
+    copy({0x8d, 0x00, 0xe0, 0x8d, 0x01, 0xe0, // STA $E000; STA $E001
+          0xe6, 0x01, 0xa5, 0x01, // INC $01; LDA $01
+          0x8d, 0x05, 0x20, 0x8d, 0x05, 0x20, // STA $2005; STA $2005
+          0x40}, 0x6020); // RTI
+    copy({0xa9, 0x00, 0x8d, 0x05, 0x20, 0x8d, 0x05, 0x20, 0x40}, 0x6040); // LDA #0; STA $2005; STA $2005; RTI
+    prg[0x7ffa] = 0x40; prg[0x7ffb] = 0xe0;
+    prg[0x7ffc] = 0x00; prg[0x7ffd] = 0xe0;
+    prg[0x7ffe] = 0x20; prg[0x7fff] = 0xe0;
+    insert(4, VERTICAL);
+    fillMemory(54321);
+  }
+
+  // Switches to the next of 4 CHR ROM banks of CNROM on every NMI.
+  void insertChrBankSwitch()
+  {
+    copy({0xa9, 0x80, 0x8d, 0x00, 0x20, // LDA #$80; STA $2000
+          0xa9, 0x1e, 0x8d, 0x01, 0x20, // LDA #$1E; STA $2001
+          0x4c, 0x0a, 0x80}, 0); // JMP $800A
+    copy({0xe6, 0x02, 0xa5, 0x02, 0x29, 0x03, // INC $02; LDA $02; AND #3
+          0x8d, 0x00, 0x80, 0x40}, 0x30); // STA $8000; RTI
+    prg[0x7ffa] = 0x30; prg[0x7ffb] = 0x80;
+    prg[0x7ffc] = 0x00; prg[0x7ffd] = 0x80;
+    chr.resize(4 * 0x2000);
+    unsigned int random = 777;
+    for (unsigned char &value : chr)
+      value = (random = random * 1103515245 + 12345) >> 16;
+    insert(3, VERTICAL);
+    fillMemory(777);
+  }
+
+  void expectSameFrames(int frames)
+  {
+    for (int frame = 0; frame < frames; frame++)
+    {
+      lockstep.runFrame();
+      catchUp.runFrame();
+      catchUp.flush();
+
+      ASSERT_EQ(memcmp(lockstep.getFrame(), catchUp.getFrame(), Ppu::WIDTH * Ppu::HEIGHT), 0) << "frame " << frame;
+      ASSERT_EQ(memcmp(lockstep.getEmphasis(), catchUp.getEmphasis(), Ppu::HEIGHT), 0);
+      ASSERT_EQ(lockstep.getCpu().getCycles(), catchUp.getCpu().getCycles()) << "frame " << frame;
+      ASSERT_EQ(lockstep.getCpu().getPC(), catchUp.getCpu().getPC());
+      for (int address = 0; address < 0x800; address++)
+        ASSERT_EQ(lockstep.getBus().read(address), catchUp.getBus().read(address)) << "address " << address;
+    }
+  }
+};
+
+TEST_F(NesTest, CatchUpRendersNestestLikeLockstep)
+{
+  // given
+  setRenderer(SCANLINES);
+  insertNestest();
+
+  // then
+  expectSameFrames(60);
+}
+
+TEST_F(NesTest, CatchUpRendersNestestDotsLikeLockstep)
+{
+  // given
+  setRenderer(DOTS);
+  insertNestest();
+
+  // then
+  expectSameFrames(60);
+}
+
+TEST_F(NesTest, CatchUpSeesSprite0HitAndOverflowLikeLockstep)
+{
+  // given
+  setRenderer(SCANLINES);
+  insertSprite0Split();
+
+  // then
+  expectSameFrames(30);
+  EXPECT_GT(catchUp.getBus().read(0x00), 25); // Every NMI ran
+}
+
+TEST_F(NesTest, CatchUpSeesSprite0HitOfDotsLikeLockstep)
+{
+  // given
+  setRenderer(DOTS);
+  insertSprite0Split();
+
+  // then
+  expectSameFrames(30);
+  EXPECT_GT(catchUp.getBus().read(0x00), 25);
+}
+
+TEST_F(NesTest, AutoRendersSplitWithDotsLikeLockstep)
+{
+  // given
+  insertSprite0Split();
+
+  // then
+  expectSameFrames(30);
+  EXPECT_TRUE(catchUp.getPpu().isRenderingDots());
+}
+
+TEST_F(NesTest, CatchUpRaisesMmc3IrqLikeLockstep)
+{
+  // given
+  setRenderer(SCANLINES);
+  insertMmc3Split();
+
+  // then
+  expectSameFrames(30);
+  EXPECT_GT(catchUp.getBus().read(0x01), 100); // 7 IRQs per frame
+}
+
+TEST_F(NesTest, CatchUpRaisesMmc3IrqOfDotsLikeLockstep)
+{
+  // given
+  setRenderer(DOTS);
+  insertMmc3Split();
+
+  // then
+  expectSameFrames(30);
+  EXPECT_GT(catchUp.getBus().read(0x01), 100);
+}
+
+TEST_F(NesTest, PipelinedRendersNestestLikeLockstep)
+{
+  // given
+  catchUp.setPipelined(true);
+  insertNestest();
+
+  // then
+  expectSameFrames(60);
+}
+
+TEST_F(NesTest, PipelinedSeesSprite0HitAndOverflowLikeLockstep)
+{
+  // given
+  setRenderer(SCANLINES);
+  catchUp.setPipelined(true);
+  insertSprite0Split();
+
+  // then
+  expectSameFrames(30);
+  EXPECT_GT(catchUp.getBus().read(0x00), 25);
+}
+
+TEST_F(NesTest, PipelinedRendersSplitWithDotsLikeLockstep)
+{
+  // given
+  catchUp.setPipelined(true);
+  insertSprite0Split();
+
+  // then
+  expectSameFrames(30);
+  EXPECT_TRUE(catchUp.getPpu().isRenderingDots());
+}
+
+TEST_F(NesTest, PipelinedRaisesMmc3IrqLikeLockstep)
+{
+  // given
+  setRenderer(SCANLINES);
+  catchUp.setPipelined(true);
+  insertMmc3Split();
+
+  // then
+  expectSameFrames(30);
+  EXPECT_GT(catchUp.getBus().read(0x01), 100);
+}
+
+TEST_F(NesTest, PipelinedSwitchesChrBanksLikeLockstep)
+{
+  // given
+  catchUp.setPipelined(true);
+  insertChrBankSwitch();
+
+  // then
+  expectSameFrames(10);
+  EXPECT_GT(catchUp.getBus().read(0x02), 8);
+}
+
+TEST_F(NesTest, ThreadsRenderNestestLikeLockstep)
+{
+  // given
+  setRenderer(SCANLINES);
+  catchUp.getPpu().setThreads(3);
+  insertNestest();
+
+  // then
+  expectSameFrames(60);
+}
+
+TEST_F(NesTest, ThreadsSeeSprite0HitAndOverflowLikeLockstep)
+{
+  // given
+  setRenderer(SCANLINES);
+  catchUp.getPpu().setThreads(3);
+  insertSprite0Split();
+
+  // then
+  expectSameFrames(30);
+  EXPECT_GT(catchUp.getBus().read(0x00), 25);
+}
+
+TEST_F(NesTest, ThreadsRenderMmc3SplitLikeLockstep)
+{
+  // given
+  setRenderer(SCANLINES);
+  catchUp.getPpu().setThreads(3);
+  insertMmc3Split();
+
+  // then
+  expectSameFrames(30);
+  EXPECT_GT(catchUp.getBus().read(0x01), 100);
+}
+
+TEST_F(NesTest, ThreadsSwitchChrBanksLikeLockstep)
+{
+  // given
+  catchUp.getPpu().setThreads(3);
+  insertChrBankSwitch();
+
+  // then
+  expectSameFrames(10);
+  EXPECT_GT(catchUp.getBus().read(0x02), 8);
+}
+
+TEST_F(NesTest, PipelinedThreadsSeeSprite0HitAndOverflowLikeLockstep)
+{
+  // given
+  setRenderer(SCANLINES);
+  catchUp.getPpu().setThreads(3);
+  catchUp.setPipelined(true);
+  insertSprite0Split();
+
+  // then
+  expectSameFrames(30);
+  EXPECT_GT(catchUp.getBus().read(0x00), 25);
+}
+
+TEST_F(NesTest, PipelinedThreadsSwitchChrBanksLikeLockstep)
+{
+  // given
+  catchUp.getPpu().setThreads(3);
+  catchUp.setPipelined(true);
+  insertChrBankSwitch();
+
+  // then
+  expectSameFrames(10);
+  EXPECT_GT(catchUp.getBus().read(0x02), 8);
+}
+
+TEST_F(NesTest, TranslatedRomRendersNestestLikeLockstep)
+{
+  // given
+  insertNestest();
+  ASSERT_TRUE(catchUp.getCpu().setTranslatedRom(&nestest));
+
+  // then
+  expectSameFrames(60);
+  EXPECT_GT(catchUp.getCpu().getTranslatedCycles(), 0);
+}
+
+TEST_F(NesTest, PipelinedTranslatedRomRendersNestestLikeLockstep)
+{
+  // given
+  catchUp.setPipelined(true);
+  insertNestest();
+  ASSERT_TRUE(catchUp.getCpu().setTranslatedRom(&nestest));
+
+  // then
+  expectSameFrames(60);
+  EXPECT_GT(catchUp.getCpu().getTranslatedCycles(), 0);
+}
+
+TEST_F(NesTest, PipelinedFrameIsTheOneBefore)
+{
+  // given
+  catchUp.setPipelined(true);
+  insertSprite0Split();
+  std::vector<unsigned char> before(Ppu::WIDTH * Ppu::HEIGHT);
+
+  for (int frame = 0; frame < 10; frame++)
+  {
+    // when
+    lockstep.runFrame();
+    catchUp.runFrame();
+
+    // then
+    ASSERT_EQ(memcmp(catchUp.getFrame(), before.data(), before.size()), 0) << "frame " << frame;
+    before.assign(lockstep.getFrame(), lockstep.getFrame() + before.size());
+  }
+}
+
+TEST_F(NesTest, TraceSinkDoesNotChangeVblankPolling)
+{
+  // given
+  copy({0x2c, 0x02, 0x20, 0x10, 0xfb, // BIT $2002; BPL *-3
+        0xe6, 0x00, // INC $00
+        0x4c, 0x00, 0x80}, 0); // JMP $8000
+  prg[0x7ffc] = 0x00; prg[0x7ffd] = 0x80;
+  insert(0, VERTICAL);
+  BufferTraceSink sink;
+  catchUp.getCpu().setTraceSink(&sink);
+
+  // when
+  for (int frame = 0; frame < 5; frame++)
+  {
+    lockstep.runFrame();
+    catchUp.runFrame();
+  }
+
+  // then
+  EXPECT_EQ(lockstep.getBus().read(0x00), 5);
+  EXPECT_EQ(catchUp.getBus().read(0x00), 5);
+  EXPECT_FALSE(sink.records.empty());
+}
@@ -0,0 +1,713 @@
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "nes.h"
+#include "ppu/tile_cache.h"
+
+class PpuTest : public ::testing::Test
+{
+public:
+  PpuTest() : prg(0x8000, 0xea), chr(0x4000, 0) {
+    nes = new Nes();
+    bus = &nes->getBus();
+    ppu = &nes->getPpu();
+
+    // JMP $8000
+    prg[0] = 0x4c; prg[1] = 0x00; prg[2] = 0x80;
+    prg[0x7ffc] = 0x00; prg[0x7ffd] = 0x80;
+    insert(VERTICAL);
+  }
+
+  ~PpuTest()
+  {
+    delete nes;
+  }
+protected:
+  Nes *nes;
+  Bus *bus;
+  Ppu *ppu;
+  std::vector<unsigned char> prg;
+  std::vector<unsigned char> chr;
+
+  // NROM with CHR RAM, unless there are CHR ROM banks of 8KB
+  void insert(Mirroring mirroring, int mapper = 0, int chrBanks = 0)
+  {
+    RomImage image = {mapper, mirroring, prg.data(), (int) prg.size(), chrBanks ? chr.data() : NULL, chrBanks * 0x2000};
+    bus->insertDisk(image);
+    nes->reset();
+  }
+
+  void writeVram(unsigned short address, std::vector<unsigned char> values)
+  {
+    bus->write_8(0x2006, address >> 8);
+    bus->write_8(0x2006, address & 0xff);
+    for (unsigned char value : values)
+      bus->write_8(0x2007, value);
+  }
+
+  // Scroll to the top left of the first nametable
+  void resetScroll()
+  {
+    bus->write_8(0x2000, 0);
+    bus->write_8(0x2005, 0);
+    bus->write_8(0x2005, 0);
+  }
+
+  // Tile 1 has the same row on every line: pixels 3, 2, 1, 0, 3, 2, 1, 0
+  std::vector<unsigned char> tile()
+  {
+    return {0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xcc, 0xcc, 0xcc, 0xcc, 0xcc, 0xcc, 0xcc, 0xcc};
+  }
+
+  // Tile 1 in the top left corner, background colors 0x0f, 0x01, 0x02, 0x03 and sprite colors 0x11, 0x12, 0x13
+  void drawTile()
+  {
+    writeVram(0x0010, tile());
+    writeVram(0x2000, {0x01});
+    writeVram(0x3f00, {0x0f, 0x01, 0x02, 0x03});
+    writeVram(0x3f11, {0x11, 0x12, 0x13});
+    resetScroll();
+  }
+
+  void writeSprite(int index, unsigned char y, unsigned char tile, unsigned char attributes, unsigned char x)
+  {
+    bus->write_8(0x2003, index * 4);
+    for (unsigned char value : {y, tile, attributes, x})
+      bus->write_8(0x2004, value);
+  }
+
+  void runToLine(int line)
+  {
+    while (ppu->getScanline() != line)
+      ppu->runScanline();
+  }
+
+  std::vector<unsigned char> pixels(int y, int x, int count)
+  {
+    const unsigned char *line = ppu->getFrame() + y * Ppu::WIDTH;
+    return std::vector<unsigned char>(line + x, line + x + count);
+  }
+};
+
+TEST_F(PpuTest, TileRowsAreDecodedToBytes)
+{
+  // when
+  uint64_t row = TileCache::decode(0b1000'0001, 0b1000'0010);
+
+  // then
+  EXPECT_EQ(row, 0x0102000000000003ULL);
+  EXPECT_EQ(TileCache::flip(row), 0x0300000000000201ULL);
+}
+
+TEST_F(PpuTest, RegistersAreMirroredEvery8Bytes)
+{
+  // when
+  bus->write_8(0x3ffe, 0x21);
+  bus->write_8(0x2ff6, 0x08);
+  bus->write_8(0x3007, 0x42);
+
+  // then
+  EXPECT_EQ(ppu->peekMemory(0x2108), 0x42);
+}
+
+TEST_F(PpuTest, DataReadsAreBuffered)
+{
+  // given
+  writeVram(0x2400, {0x11, 0x22});
+
+  // when
+  bus->write_8(0x2006, 0x24);
+  bus->write_8(0x2006, 0x00);
+  unsigned char stale = bus->read(0x2007);
+  unsigned char first = bus->read(0x2007);
+  unsigned char second = bus->read(0x2007);
+
+  // then
+  EXPECT_NE(stale, 0x11);
+  EXPECT_EQ(first, 0x11);
+  EXPECT_EQ(second, 0x22);
+}
+
+TEST_F(PpuTest, PaletteReadsAreNotBufferedAndMirrored)
+{
+  // given
+  writeVram(0x3f10, {0x2a});
+
+  // when
+  bus->write_8(0x2006, 0x3f);
+  bus->write_8(0x2006, 0x00);
+  unsigned char value = bus->read(0x2007);
+
+  // then
+  EXPECT_EQ(value, 0x2a);
+  EXPECT_EQ(ppu->peekMemory(0x3f20), 0x2a);
+}
+
+TEST_F(PpuTest, AddressIncrementsBy32)
+{
+  // when
+  bus->write_8(0x2000, 0x04);
+  writeVram(0x2000, {0x01, 0x02});
+
+  // then
+  EXPECT_EQ(ppu->peekMemory(0x2000), 0x01);
+  EXPECT_EQ(ppu->peekMemory(0x2020), 0x02);
+}
+
+TEST_F(PpuTest, NametablesFollowMirroring)
+{
+  for (Mirroring mirroring : {VERTICAL, HORIZONTAL})
+  {
+    // given
+    insert(mirroring);
+
+    // when
+    writeVram(0x2000, {0x5a});
+
+    // then
+    unsigned short mirror = mirroring == VERTICAL ? 0x2800 : 0x2400;
+    unsigned short other = mirroring == VERTICAL ? 0x2400 : 0x2800;
+    EXPECT_EQ(ppu->peekMemory(mirror), 0x5a);
+    EXPECT_EQ(ppu->peekMemory(other), 0x00);
+    EXPECT_EQ(ppu->peekMemory(0x3000), 0x5a); // $3000-$3EFF mirrors $2000
+  }
+}
+
+TEST_F(PpuTest, StatusReadClearsVblank)
+{
+  // given
+  runToLine(Ppu::VBLANK_LINE + 1);
+
+  // when
+  unsigned char first = bus->read(0x2002);
+  unsigned char second = bus->read(0x2002);
+
+  // then
+  EXPECT_EQ(first & 0x80, 0x80);
+  EXPECT_EQ(second & 0x80, 0x00);
+}
+
+TEST_F(PpuTest, RendersBackgroundTile)
+{
+  // given
+  drawTile();
+  bus->write_8(0x2001, 0x0a);
+
+  // when
+  runToLine(9);
+
+  // then
+  std::vector<unsigned char> row = {0x03, 0x02, 0x01, 0x0f, 0x03, 0x02, 0x01, 0x0f, 0x0f};
+  EXPECT_EQ(pixels(0, 0, 9), row);
+  EXPECT_EQ(pixels(7, 0, 9), row);
+  EXPECT_EQ(pixels(8, 0, 9), std::vector<unsigned char>(9, 0x0f));
+}
+
+TEST_F(PpuTest, FineScrollShiftsBackground)
+{
+  // given
+  drawTile();
+  bus->write_8(0x2005, 2);
+  bus->write_8(0x2005, 3);
+  bus->write_8(0x2001, 0x0a);
+
+  // when
+  runToLine(6);
+
+  // then
+  EXPECT_EQ(pixels(0, 0, 7), std::vector<unsigned char>({0x01, 0x0f, 0x03, 0x02, 0x01, 0x0f, 0x0f}));
+  EXPECT_EQ(pixels(5, 0, 1), std::vector<unsigned char>({0x0f})); // Line 5 is line 8 of the nametable
+}
+
+TEST_F(PpuTest, LeftColumnCanBeHidden)
+{
+  // given
+  drawTile();
+  bus->write_8(0x2001, 0x08);
+
+  // when
+  runToLine(1);
+
+  // then
+  EXPECT_EQ(pixels(0, 0, 8), std::vector<unsigned char>(8, 0x0f));
+}
+
+TEST_F(PpuTest, DisabledRenderingShowsBackdrop)
+{
+  // given
+  drawTile();
+
+  // when
+  runToLine(1);
+
+  // then
+  EXPECT_EQ(pixels(0, 0, 8), std::vector<unsigned char>(8, 0x0f));
+}
+
+TEST_F(PpuTest, SpritesAreDrawnBelowTheirY)
+{
+  // given
+  drawTile();
+  writeSprite(0, 9, 1, 0x40, 20); // Flipped horizontally
+  bus->write_8(0x2001, 0x1e);
+
+  // when
+  runToLine(11);
+
+  // then
+  EXPECT_EQ(pixels(9, 20, 8), std::vector<unsigned char>(8, 0x0f));
+  EXPECT_EQ(pixels(10, 20, 8), std::vector<unsigned char>({0x0f, 0x11, 0x12, 0x13, 0x0f, 0x11, 0x12, 0x13}));
+}
+
+TEST_F(PpuTest, SpriteBehindBackgroundShowsThroughTransparentPixels)
+{
+  // given
+  drawTile();
+  writeSprite(0, 0xff, 1, 0x20, 1); // Never drawn
+  writeSprite(1, 0, 1, 0x20, 1);
+  bus->write_8(0x2001, 0x1e);
+
+  // when
+  runToLine(2);
+
+  // then
+  EXPECT_EQ(pixels(1, 0, 9), std::vector<unsigned char>({0x03, 0x02, 0x01, 0x11, 0x03, 0x02, 0x01, 0x11, 0x0f}));
+}
+
+TEST_F(PpuTest, Sprite0HitsOpaqueBackground)
+{
+  // given
+  drawTile();
+  writeVram(0x2020, {0x01});
+  resetScroll();
+  writeSprite(0, 9, 1, 0, 4);
+  bus->write_8(0x2001, 0x1e);
+
+  // when
+  runToLine(10);
+  unsigned char before = bus->read(0x2002);
+  runToLine(11);
+  unsigned char after = bus->read(0x2002);
+  runToLine(0);
+  unsigned char nextFrame = bus->read(0x2002);
+
+  // then
+  EXPECT_EQ(before & 0x40, 0x00);
+  EXPECT_EQ(after & 0x40, 0x40);
+  EXPECT_EQ(nextFrame & 0x40, 0x00);
+}
+
+TEST_F(PpuTest, NinthSpriteOnLineOverflows)
+{
+  // given
+  drawTile();
+  for (int i = 0; i < 64; i++)
+    writeSprite(i, i < 8 ? 20 : 0xff, 1, 0, i * 8);
+  bus->write_8(0x2001, 0x1e);
+  runToLine(30);
+  unsigned char eight = bus->read(0x2002);
+
+  // when
+  writeSprite(8, 20, 1, 0, 200);
+  runToLine(0);
+  runToLine(30);
+  unsigned char nine = bus->read(0x2002);
+
+  // then
+  EXPECT_EQ(eight & 0x20, 0x00);
+  EXPECT_EQ(nine & 0x20, 0x20);
+  EXPECT_EQ(pixels(21, 200, 8), std::vector<unsigned char>(8, 0x0f));
+}
+
+TEST_F(PpuTest, ChrRamWriteUpdatesTiles)
+{
+  // given
+  drawTile();
+  bus->write_8(0x2001, 0x0a);
+  runToLine(1);
+
+  // when
+  bus->write_8(0x2001, 0x00);
+  writeVram(0x0010, {0x00});
+  writeVram(0x0018, {0x00});
+  resetScroll();
+  bus->write_8(0x2001, 0x0a);
+  runToLine(0);
+  runToLine(2);
+
+  // then
+  EXPECT_EQ(pixels(0, 0, 4), std::vector<unsigned char>(4, 0x0f));
+  EXPECT_EQ(pixels(1, 0, 4), std::vector<unsigned char>({0x03, 0x02, 0x01, 0x0f}));
+}
+
+TEST_F(PpuTest, ChrBankSwitchUpdatesTiles)
+{
+  // given
+  std::vector<unsigned char> pattern = tile();
+  std::copy(pattern.begin(), pattern.end(), chr.begin() + 0x0010); // Tile 1 of bank 0, bank 1 is empty
+  insert(VERTICAL, 3, 2);
+  writeVram(0x2000, {0x01});
+  writeVram(0x3f00, {0x0f, 0x01, 0x02, 0x03});
+  resetScroll();
+  bus->write_8(0x2001, 0x0a);
+  runToLine(1);
+
+  // when
+  bus->write_8(0x8000, 1);
+  runToLine(2);
+
+  // then
+  EXPECT_EQ(pixels(0, 0, 4), std::vector<unsigned char>({0x03, 0x02, 0x01, 0x0f}));
+  EXPECT_EQ(pixels(1, 0, 4), std::vector<unsigned char>(4, 0x0f));
+}
+
+TEST_F(PpuTest, NametableWriteRendersStaticLineAgain)
+{
+  // given
+  drawTile();
+  bus->write_8(0x2001, 0x0a);
+  runToLine(Ppu::VBLANK_LINE);
+
+  // when
+  writeVram(0x2000, {0x00});
+  resetScroll();
+  runToLine(0);
+  runToLine(1);
+
+  // then
+  EXPECT_EQ(pixels(0, 0, 4), std::vector<unsigned char>(4, 0x0f));
+}
+
+TEST_F(PpuTest, AttributeWriteRendersStaticLineAgain)
+{
+  // given
+  drawTile();
+  writeVram(0x3f05, {0x05, 0x06, 0x07});
+  resetScroll();
+  bus->write_8(0x2001, 0x0a);
+  runToLine(Ppu::VBLANK_LINE);
+
+  // when
+  writeVram(0x23c0, {0x01});
+  resetScroll();
+  runToLine(0);
+  runToLine(1);
+
+  // then
+  EXPECT_EQ(pixels(0, 0, 4), std::vector<unsigned char>({0x07, 0x06, 0x05, 0x0f}));
+}
+
+TEST_F(PpuTest, PaletteWriteRendersStaticLineAgain)
+{
+  // given
+  drawTile();
+  bus->write_8(0x2001, 0x0a);
+  runToLine(Ppu::VBLANK_LINE);
+
+  // when
+  writeVram(0x3f03, {0x05});
+  resetScroll();
+  runToLine(0);
+  runToLine(1);
+
+  // then
+  EXPECT_EQ(pixels(0, 0, 4), std::vector<unsigned char>({0x05, 0x02, 0x01, 0x0f}));
+}
+
+TEST_F(PpuTest, ScrollRendersStaticLineAgain)
+{
+  // given
+  drawTile();
+  bus->write_8(0x2001, 0x0a);
+  runToLine(Ppu::VBLANK_LINE);
+
+  // when
+  bus->write_8(0x2005, 1);
+  bus->write_8(0x2005, 0);
+  runToLine(0);
+  runToLine(1);
+
+  // then
+  EXPECT_EQ(pixels(0, 0, 4), std::vector<unsigned char>({0x02, 0x01, 0x0f, 0x03}));
+}
+
+TEST_F(PpuTest, BackgroundTableSwitchRendersStaticLineAgain)
+{
+  // given
+  drawTile();
+  bus->write_8(0x2001, 0x0a);
+  runToLine(Ppu::VBLANK_LINE);
+
+  // when
+  bus->write_8(0x2000, 0x10); // Tile 1 of the pattern table at $1000 is empty
+  runToLine(0);
+  runToLine(1);
+
+  // then
+  EXPECT_EQ(pixels(0, 0, 4), std::vector<unsigned char>(4, 0x0f));
+}
+
+TEST_F(PpuTest, ThreadsDrawLinesWithNametableOfTheirLine)
+{
+  // given
+  ppu->setThreads(2);
+  drawTile();
+  bus->write_8(0x2001, 0x0a);
+  runToLine(1);
+
+  // when
+  writeVram(0x2000, {0x00});
+  bus->write_8(0x2006, 0x10); // Back to fine y 1 of the first row
+  bus->write_8(0x2006, 0x00);
+  runToLine(2);
+
+  // then
+  EXPECT_EQ(pixels(0, 0, 4), std::vector<unsigned char>({0x03, 0x02, 0x01, 0x0f}));
+  EXPECT_EQ(pixels(1, 0, 4), std::vector<unsigned char>(4, 0x0f));
+}
+
+TEST_F(PpuTest, ThreadsDrawLinesWithSpritesOfTheirLine)
+{
+  // given
+  ppu->setThreads(2);
+  drawTile();
+  writeVram(0x2000, {0x00});
+  resetScroll();
+  writeSprite(0, 0, 1, 0x00, 0);
+  bus->write_8(0x2001, 0x1e);
+  runToLine(2);
+
+  // when
+  writeSprite(0, 200, 1, 0x00, 0);
+  runToLine(3);
+
+  // then
+  EXPECT_EQ(pixels(1, 0, 4), std::vector<unsigned char>({0x13, 0x12, 0x11, 0x0f}));
+  EXPECT_EQ(pixels(2, 0, 4), std::vector<unsigned char>(4, 0x0f));
+}
+
+TEST_F(PpuTest, ThreadsDrawLinesWithChrBankOfTheirLine)
+{
+  // given
+  std::vector<unsigned char> pattern = tile();
+  std::copy(pattern.begin(), pattern.end(), chr.begin() + 0x0010); // Tile 1 of bank 0, bank 1 is empty
+  insert(VERTICAL, 3, 2);
+  ppu->setThreads(2);
+  writeVram(0x2000, {0x01});
+  writeVram(0x3f00, {0x0f, 0x01, 0x02, 0x03});
+  resetScroll();
+  bus->write_8(0x2001, 0x0a);
+  runToLine(1);
+
+  // when
+  bus->write_8(0x8000, 1);
+  runToLine(2);
+
+  // then
+  EXPECT_EQ(pixels(0, 0, 4), std::vector<unsigned char>({0x03, 0x02, 0x01, 0x0f}));
+  EXPECT_EQ(pixels(1, 0, 4), std::vector<unsigned char>(4, 0x0f));
+}
+
+TEST_F(PpuTest, OamDmaCopiesPageAndStallsCpu)
+{
+  // given
+  for (int i = 0; i < 256; i++)
+    bus->write_8(0x0200 + i, i);
+  bus->write_8(0x2003, 0x10);
+  unsigned long long cycles = nes->getCpu().getCycles();
+
+  // when
+  bus->write_8(0x4014, 0x02);
+
+  // then
+  unsigned long long stalled = nes->getCpu().getCycles() - cycles;
+  EXPECT_TRUE(stalled == 513 || stalled == 514) << stalled;
+  bus->write_8(0x2003, 0x15);
+  EXPECT_EQ(bus->read(0x2004), 0x05); // Copied from the OAM address on
+}
+
+TEST_F(PpuTest, OamDmaWrapsAroundOam)
+{
+  // given
+  for (int i = 0; i < 256; i++)
+    bus->write_8(0x0200 + i, i);
+  bus->write_8(0x2003, 0xf0);
+
+  // when
+  bus->write_8(0x4014, 0x02);
+
+  // then
+  bus->write_8(0x2003, 0xff);
+  EXPECT_EQ(bus->read(0x2004), 0x0f);
+  bus->write_8(0x2003, 0x00);
+  EXPECT_EQ(bus->read(0x2004), 0x10);
+  bus->write_8(0x2003, 0xef);
+  EXPECT_EQ(bus->read(0x2004), 0xff);
+}
+
+TEST_F(PpuTest, RestOfOamDmaPageIsNotConnected)
+{
+  // given
+  unsigned long long cycles = nes->getCpu().getCycles();
+
+  // when
+  bus->write_8(0x4016, 0x01);
+  bus->write_8(0x4015, 0x0f);
+
+  // then
+  EXPECT_EQ(nes->getCpu().getCycles(), cycles);
+  EXPECT_EQ(bus->read(0x4014), 0xff);
+  EXPECT_EQ(bus->read(0x4016), 0xff);
+  EXPECT_EQ(bus->read(0x4015), 0xff);
+}
+
+TEST_F(PpuTest, FrameTakesCpuCyclesOfItsDots)
+{
+  // given
+  nes->runFrame();
+  unsigned long long cycles = nes->getCpu().getCycles();
+
+  // when
+  for (int i = 0; i < 3; i++)
+    nes->runFrame();
+
+  // then
+  EXPECT_EQ(ppu->getFrameCount(), 4);
+  EXPECT_NEAR(nes->getCpu().getCycles() - cycles, 3 * 341 * 262 / 3, 3);
+}
+
+TEST_F(PpuTest, VblankRaisesNmi)
+{
+  // given
+  unsigned char program[8] = {0xa9, 0x80, 0x8d, 0x00, 0x20, 0x4c, 0x05, 0x80}; // LDA #$80; STA $2000; JMP $8005
+  unsigned char handler[3] = {0xe6, 0x00, 0x40}; // INC $00; RTI
+  std::copy(program, program + 8, prg.begin());
+  std::copy(handler, handler + 3, prg.begin() + 0x10);
+  prg[0x7ffa] = 0x10; prg[0x7ffb] = 0x80;
+  insert(VERTICAL);
+
+  // when
+  nes->runFrame();
+  nes->runFrame();
+
+  // then
+  EXPECT_EQ(bus->read(0x0000), 2);
+}
+
+TEST_F(PpuTest, VblankCanBePolled)
+{
+  // given
+  // LDA #$00; wait: LDA $2002; BPL wait; INC $00; JMP $8000
+  unsigned char program[12] = {0xa9, 0x00, 0xad, 0x02, 0x20, 0x10, 0xfb, 0xe6, 0x00, 0x4c, 0x00, 0x80};
+  std::copy(program, program + 12, prg.begin());
+  insert(VERTICAL);
+
+  // when
+  for (int i = 0; i < 3; i++)
+    nes->runFrame();
+
+  // then
+  EXPECT_EQ(bus->read(0x0000), 3);
+  EXPECT_GT(nes->getCpu().getSkippedCycles(), 0); // The wait is an idle loop
+}
+
+TEST_F(PpuTest, DotsRenderLikeScanlines)
+{
+  // given
+  drawTile();
+  writeVram(0x2001, {0x01, 0x01});
+  writeSprite(0, 20, 1, 0x40, 5);
+  writeSprite(1, 24, 1, 0x20, 3);
+  bus->write_8(0x2005, 3); // Fine scroll
+  bus->write_8(0x2005, 2);
+  bus->write_8(0x2001, 0x1e);
+  ppu->setRenderer(SCANLINES);
+  nes->runFrame();
+  nes->runFrame();
+  std::vector<unsigned char> scanlines(ppu->getFrame(), ppu->getFrame() + Ppu::WIDTH * Ppu::HEIGHT);
+
+  // when
+  ppu->setRenderer(DOTS);
+  nes->runFrame();
+  nes->runFrame();
+
+  // then
+  EXPECT_TRUE(ppu->isRenderingDots());
+  EXPECT_EQ(std::vector<unsigned char>(ppu->getFrame(), ppu->getFrame() + Ppu::WIDTH * Ppu::HEIGHT), scanlines);
+}
+
+class PpuMidLineTest : public PpuTest
+{
+public:
+  PpuMidLineTest() {
+    // LDA #$1E; STA $2001; clear: BIT $2002; BVS clear; hit: BIT $2002; BVC hit; LDA #0; STA $2001;
+    // vblank: BIT $2002; BPL vblank; JMP $8000
+    unsigned char program[] = {0xa9, 0x1e, 0x8d, 0x01, 0x20, 0x2c, 0x02, 0x20, 0x70, 0xfb, 0x2c, 0x02, 0x20, 0x50, 0xfb,
+                               0xa9, 0x00, 0x8d, 0x01, 0x20, 0x2c, 0x02, 0x20, 0x10, 0xfb, 0x4c, 0x00, 0x80};
+    std::copy(program, program + sizeof(program), prg.begin());
+    insert(VERTICAL);
+
+    // Tile 1 everywhere and sprite 0 at x 100 of line 100: rendering is switched off in the middle of the line
+    drawTile();
+    writeVram(0x2000, std::vector<unsigned char>(960, 0x01));
+    writeSprite(0, 99, 1, 0, 100);
+    resetScroll();
+  }
+};
+
+TEST_F(PpuMidLineTest, ScanlinesApplyWritesOnNextLine)
+{
+  // given
+  ppu->setRenderer(SCANLINES);
+
+  // when
+  nes->runFrame();
+  nes->runFrame();
+
+  // then
+  EXPECT_EQ(pixels(100, 248, 1), std::vector<unsigned char>{0x03});
+  EXPECT_EQ(pixels(101, 0, 1), std::vector<unsigned char>{0x0f});
+  EXPECT_FALSE(ppu->isRenderingDots());
+}
+
+TEST_F(PpuMidLineTest, DotsApplyWritesOnNextDot)
+{
+  // given
+  ppu->setRenderer(DOTS);
+
+  // when
+  nes->runFrame();
+  nes->runFrame();
+
+  // then
+  EXPECT_EQ(pixels(100, 0, 1), std::vector<unsigned char>{0x03});
+  EXPECT_EQ(pixels(100, 248, 1), std::vector<unsigned char>{0x0f});
+  EXPECT_EQ(pixels(101, 0, 1), std::vector<unsigned char>{0x0f});
+}
+
+TEST_F(PpuMidLineTest, AutoRendersDotsAfterMidLineWrites)
+{
+  // when
+  nes->runFrame();
+  nes->runFrame();
+
+  // then
+  EXPECT_EQ(ppu->getRenderer(), AUTO);
+  EXPECT_TRUE(ppu->isRenderingDots());
+  EXPECT_EQ(pixels(100, 248, 1), std::vector<unsigned char>{0x0f});
+}
+
+TEST_F(PpuTest, AutoRendersScanlinesWithoutMidLineWrites)
+{
+  // given
+  drawTile();
+  bus->write_8(0x2001, 0x1e);
+
+  // when
+  nes->runFrame();
+  nes->runFrame();
+
+  // then
+  EXPECT_FALSE(ppu->isRenderingDots());
+}
@@ -0,0 +1,184 @@
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <malloc.h>
+
+#include "gtest/gtest.h"
+
+#include "bus.h"
+#include "cartridge/cartridge.h"
+#include "rom.cpp"
+
+class RomTest : public ::testing::Test
+{
+protected:
+  std::string file = testing::TempDir() + "rom_test.nes";
+
+  // Header followed by data filled with the offset of each byte after the header
+  void writeRom(std::vector<unsigned char> header, int dataSize)
+  {
+    header.resize(16);
+    std::ofstream out(file, std::ios::binary);
+    out.write((const char *) header.data(), header.size());
+    for (int i = 0; i < dataSize; i++)
+      out.put((char) i);
+  }
+
+  void TearDown() override
+  {
+    std::remove(file.c_str());
+  }
+};
+
+TEST_F(RomTest, ReadsNestest)
+{
+  // when
+  Rom rom(NES_TEST_ROM);
+
+  // then
+  const Header &header = rom.getHeader();
+  EXPECT_FALSE(header.nes2);
+  EXPECT_EQ(header.mapper, 0);
+  EXPECT_EQ(header.prgRomSize, 0x4000);
+  EXPECT_EQ(header.chrRomSize, 0x2000);
+  EXPECT_EQ(header.mirroring, HORIZONTAL);
+  EXPECT_EQ(rom.getPrg()[0], 0x4c); // JMP $C5F5
+  EXPECT_EQ(rom.getChr(), rom.getPrg() + 0x4000);
+}
+
+TEST_F(RomTest, ReadsInesHeader)
+{
+  // given
+  writeRom({'N', 'E', 'S', 0x1a, 2, 0, 0b0001'0111, 0x40, 0}, 512 + 2 * 0x4000);
+
+  // when
+  Rom rom(file);
+
+  // then
+  const Header &header = rom.getHeader();
+  EXPECT_FALSE(header.nes2);
+  EXPECT_EQ(header.mapper, 0x41);
+  EXPECT_EQ(header.prgRomSize, 0x8000);
+  EXPECT_EQ(header.chrRomSize, 0);
+  EXPECT_EQ(header.chrRamSize, 0x2000);
+  EXPECT_EQ(header.prgNvramSize, 0x2000);
+  EXPECT_EQ(header.mirroring, VERTICAL);
+  EXPECT_TRUE(header.battery);
+  EXPECT_EQ(rom.getTrainer()[1], 1);
+  EXPECT_EQ(rom.getPrg()[0], 512 % 256);
+  EXPECT_EQ(rom.getChr(), nullptr);
+}
+
+TEST_F(RomTest, ReadsNes2Header)
+{
+  // given
+  // Mapper 0x141 submapper 2, 32KB PRG, CHR as exponent: 2^12 * 3, 8KB PRG RAM, 2KB PRG NVRAM, 32KB CHR RAM, PAL
+  writeRom({'N', 'E', 'S', 0x1a, 2, 12 << 2 | 1, 0x18, 0x48, 0x21, 0xf0, 0x57, 0x09, 0x01}, 0x8000 + 0x3000);
+
+  // when
+  Rom rom(file);
+
+  // then
+  const Header &header = rom.getHeader();
+  EXPECT_TRUE(header.nes2);
+  EXPECT_EQ(header.mapper, 0x141);
+  EXPECT_EQ(header.submapper, 2);
+  EXPECT_EQ(header.prgRomSize, 0x8000);
+  EXPECT_EQ(header.chrRomSize, 0x3000);
+  EXPECT_EQ(header.prgRamSize, 0x2000);
+  EXPECT_EQ(header.prgNvramSize, 0x800);
+  EXPECT_EQ(header.chrRamSize, 0x8000);
+  EXPECT_EQ(header.mirroring, FOUR_SCREEN);
+  EXPECT_EQ(header.timing, 1);
+}
+
+TEST_F(RomTest, MissingFileThrows)
+{
+  EXPECT_THROW(Rom(file + ".missing"), std::invalid_argument);
+}
+
+TEST_F(RomTest, InvalidHeaderThrows)
+{
+  // given
+  writeRom({'N', 'E', 'Z', 0x1a, 1, 1}, 0x6000);
+
+  // then
+  EXPECT_THROW(Rom rom(file), std::invalid_argument);
+}
+
+TEST_F(RomTest, TruncatedFileThrows)
+{
+  // given
+  writeRom({'N', 'E', 'S', 0x1a, 2, 1}, 0x8000);
+
+  // then
+  EXPECT_THROW(Rom rom(file), std::invalid_argument);
+}
+
+TEST_F(RomTest, CartridgeMapsRomAndTrainer)
+{
+  // given
+  writeRom({'N', 'E', 'S', 0x1a, 1, 1, 0b0000'0100}, 512 + 0x4000 + 0x2000);
+  std::shared_ptr<const Rom> rom = std::make_shared<const Rom>(file);
+  Bus bus;
+
+  // when
+  bus.insertDisk(rom);
+
+  // then
+  EXPECT_EQ(bus.read(0x7001), 1); // Trainer
+  EXPECT_EQ(bus.read(0x8002), (512 + 2) % 256);
+  EXPECT_EQ(bus.read(0xc002), (512 + 2) % 256);
+  EXPECT_EQ(bus.getCartridge()->readChr(3), (512 + 0x4000 + 3) % 256);
+}
+
+TEST_F(RomTest, BusKeepsSharedRomAlive)
+{
+  // given
+  std::shared_ptr<const Rom> rom = std::make_shared<const Rom>(NES_TEST_ROM);
+  Bus bus;
+  bus.insertDisk(rom);
+
+  // when
+  rom.reset();
+
+  // then
+  EXPECT_EQ(bus.read(0xc000), 0x4c);
+}
+
+// Heap in use, small allocations and the ones that got their own mapping
+static size_t heapInUse()
+{
+  struct mallinfo2 info = mallinfo2();
+  return info.uordblks + info.hblkhd;
+}
+
+TEST_F(RomTest, InstancesOnlyAllocateTheirOwnState)
+{
+  // given
+  const int instances = 1000;
+  std::shared_ptr<const Rom> rom = std::make_shared<const Rom>(NES_TEST_ROM);
+  std::vector<std::unique_ptr<Bus>> buses;
+  buses.reserve(instances);
+  size_t before = heapInUse();
+
+  // when
+  for (int i = 0; i < instances; i++)
+  {
+    buses.emplace_back(new Bus());
+    buses.back()->insertDisk(rom);
+  }
+
+  // then
+  size_t perInstance = (heapInUse() - before) / instances;
+  std::cout << "[          ] " << std::dec << instances << " instances of 01.nes, " << perInstance << " bytes each" << std::endl;
+  RecordProperty("BytesPerInstance", (int) perInstance);
+  EXPECT_EQ(rom.use_count(), 1 + instances);
+  // RAM, PRG RAM and the page table of the Bus, the 24KB of PRG and CHR ROM is shared
+  EXPECT_LT(perInstance, 20 * 1024);
+  for (int i = 1; i < instances; i++)
+    ASSERT_EQ(buses[i]->read(0xc000), buses[0]->read(0xc000));
+}
@@ -0,0 +1,144 @@
+#include <algorithm>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "bus.h"
+#include "ppu/sprite_compositor.h"
+
+class SpriteCompositorTest : public ::testing::Test
+{
+public:
+  SpriteCompositorTest()
+    : prg(0x8000, 0xea), chr(0x2000), oam(256), background(SpriteCompositor::WIDTH), palette(32) {
+    // Random sprites, half of them in the top lines so some lines have more than 8, random tiles and background
+    for (int i = 0; i < 256; i++)
+      oam[i] = i % 4 == 0 && i < 128 ? next() % 40 : next();
+    for (unsigned char &value : chr)
+      value = next();
+    bus.insertDisk(RomImage{0, VERTICAL, prg.data(), (int) prg.size(), chr.data(), (int) chr.size()});
+    tiles.update(bus.getCartridge());
+    for (unsigned char &pixel : background)
+      pixel = next() & 0x0f;
+    for (unsigned char &color : palette)
+      color = next() & 0x3f;
+  }
+
+protected:
+  SpriteCompositor compositor;
+  Bus bus;
+  TileCache tiles;
+  std::vector<unsigned char> prg;
+  std::vector<unsigned char> chr;
+  std::vector<unsigned char> oam;
+  std::vector<unsigned char> background;
+  std::vector<unsigned char> palette;
+  unsigned int random = 4321;
+
+  unsigned char next()
+  {
+    random = random * 1103515245 + 12345;
+    return random >> 16;
+  }
+
+  std::vector<unsigned char> drawLine(int y, int height, int *found)
+  {
+    std::vector<unsigned char> line(SpriteCompositor::WIDTH + 8);
+    *found = compositor.draw(oam.data(), tiles, y, height, 256, line.data());
+    line.resize(SpriteCompositor::WIDTH);
+    return line;
+  }
+};
+
+TEST_F(SpriteCompositorTest, EvaluateFindsSpritesBelowTheirY)
+{
+  // given
+  ASSERT_TRUE(compositor.setSimd(SpriteCompositor::SCALAR));
+  std::fill(oam.begin(), oam.end(), 0xff);
+  oam[0] = 10;
+  oam[4 * 63] = 3;
+
+  // when
+  uint64_t line11 = compositor.evaluate(oam.data(), 11, 8);
+  uint64_t line18 = compositor.evaluate(oam.data(), 18, 8);
+  uint64_t line19 = compositor.evaluate(oam.data(), 19, 16);
+
+  // then
+  EXPECT_EQ(line11, 1ULL | 1ULL << 63);
+  EXPECT_EQ(line18, 1ULL);
+  EXPECT_EQ(line19, 1ULL | 1ULL << 63);
+}
+
+TEST_F(SpriteCompositorTest, Sprite0DoesNotHitInLastColumn)
+{
+  // given
+  std::vector<unsigned char> opaque(SpriteCompositor::WIDTH, 0x01);
+  std::vector<unsigned char> sprites(SpriteCompositor::WIDTH, 0);
+  std::vector<unsigned char> out(SpriteCompositor::WIDTH);
+
+  for (SpriteCompositor::Simd simd : {SpriteCompositor::SCALAR, SpriteCompositor::SSSE3, SpriteCompositor::AVX2})
+  {
+    if (!compositor.setSimd(simd))
+      continue;
+
+    // when
+    sprites[255] = SpriteCompositor::SPRITE_0 | 0x11;
+    bool last = compositor.compose(opaque.data(), sprites.data(), palette.data(), 0x3f, out.data());
+    sprites[254] = SpriteCompositor::SPRITE_0 | 0x11;
+    bool beforeLast = compositor.compose(opaque.data(), sprites.data(), palette.data(), 0x3f, out.data());
+    sprites[254] = sprites[255] = 0;
+
+    // then
+    EXPECT_FALSE(last) << simd;
+    EXPECT_TRUE(beforeLast) << simd;
+    EXPECT_EQ(out[255], palette[0x11]) << simd;
+  }
+}
+
+TEST_F(SpriteCompositorTest, SimdMatchesScalar)
+{
+  // given
+  ASSERT_TRUE(compositor.setSimd(SpriteCompositor::SCALAR));
+  std::vector<uint64_t> masks;
+  std::vector<std::vector<unsigned char>> lines;
+  std::vector<int> counts;
+  std::vector<std::vector<unsigned char>> frames;
+  std::vector<bool> hits;
+  for (int height : {8, 16})
+    for (int y = 0; y < 240; y++)
+    {
+      masks.push_back(compositor.evaluate(oam.data(), y, height));
+      int found;
+      lines.push_back(drawLine(y, height, &found));
+      counts.push_back(found);
+      std::vector<unsigned char> out(SpriteCompositor::WIDTH);
+      hits.push_back(compositor.compose(background.data(), lines.back().data(), palette.data(), 0x3f, out.data()));
+      frames.push_back(out);
+    }
+  EXPECT_GT(*std::max_element(counts.begin(), counts.end()), 8);
+  EXPECT_GT(std::count(hits.begin(), hits.end(), true), 0);
+
+  for (SpriteCompositor::Simd simd : {SpriteCompositor::SSSE3, SpriteCompositor::AVX2})
+  {
+    if (!compositor.setSimd(simd))
+      continue;
+    int i = 0;
+    for (int height : {8, 16})
+      for (int y = 0; y < 240; y++, i++)
+      {
+        // when
+        uint64_t mask = compositor.evaluate(oam.data(), y, height);
+        int found;
+        std::vector<unsigned char> line = drawLine(y, height, &found);
+        std::vector<unsigned char> out(SpriteCompositor::WIDTH);
+        bool hit = compositor.compose(background.data(), line.data(), palette.data(), 0x3f, out.data());
+
+        // then
+        ASSERT_EQ(mask, masks[i]) << simd << " line " << y;
+        ASSERT_EQ(found, counts[i]) << simd << " line " << y;
+        ASSERT_EQ(line, lines[i]) << simd << " line " << y;
+        ASSERT_EQ(hit, hits[i]) << simd << " line " << y;
+        ASSERT_EQ(out, frames[i]) << simd << " line " << y;
+      }
+  }
+}